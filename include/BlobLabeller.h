@@ -0,0 +1,107 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _BLOB_LABELLER_H_
+#define _BLOB_LABELLER_H_
+
+#include "Kalman.h"
+#include "SpokeHistory.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// The blobs of unclaimed returns in a sector of the ARPA history.
+//
+// Label() finds the connected sets of returns (neighbours in r on a spoke,
+// or at the same r on the next spoke) in one pass over the sector. Each
+// spoke is read as runs of returns, a word at a time, and the runs that
+// touch a run on the previous spoke are joined with union-find. When the
+// sector is the whole circle the last spoke is joined to the first.
+//
+// The table is then queried instead of the history: the target search only
+// has to look at each blob once, instead of at every return of every other
+// spoke.
+//
+struct Blob {
+    int min_angle; // in [angle1, angle2>, but less than angle1 when the
+    int max_angle; // blob wraps around the whole circle
+    int min_r;
+    int max_r;
+    int area; // number of returns
+    int contour_length; // returns with a neighbour outside the blob
+    bool doppler; // at least one return is a doppler return
+    double angle; // centroid
+    double r;
+    Polar start; // the first return of the blob, on its contour
+};
+
+class BlobLabeller {
+public:
+    BlobLabeller();
+    ~BlobLabeller();
+
+    // Label the returns [r1..r2> of spokes [angle1..angle2> that are set in
+    // the unclaimed plane, and in the doppler plane when 'doppler' is set.
+    // angle2 - angle1 must not be more than 'spokes'.
+    void Label(SpokeHistory* history, size_t spokes, int angle1, int angle2,
+        size_t r1, size_t r2, bool doppler);
+
+    // The blobs in the order of their start, by angle and then by r
+    size_t GetCount() { return m_blob_count; }
+    const Blob& GetBlob(size_t i) { return m_blobs[i]; }
+
+private:
+    struct Run {
+        int angle;
+        int start;
+        int end;
+        int doppler;
+        int contour_length;
+        bool wrapped; // joined to the other end of the circle
+        size_t blob; // index in m_blobs, when this run is the root
+    };
+
+    size_t Find(size_t run);
+    void Join(size_t a, size_t b);
+    void Grow(size_t runs);
+
+    Run* m_runs;
+    size_t* m_parent;
+    size_t m_run_count;
+    size_t m_run_max;
+
+    Blob* m_blobs;
+    size_t m_blob_count;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _BLOB_LABELLER_H_ */
@@ -95,10 +95,15 @@ public:
     };
 
     /*
-     * Check if data is in this GuardZone, if so update bogeyCount
+     * Check if a spoke is in this GuardZone, and if so which returns to count.
      */
-    void ProcessSpoke(
-        SpokeBearing angle, uint8_t* data, uint8_t* hist, size_t len);
+    bool GetSpokeRange(
+        SpokeBearing angle, size_t len, size_t* start, size_t* end);
+
+    /*
+     * Add the returns counted in a spoke to the bogeyCount
+     */
+    void ProcessSpoke(SpokeBearing angle, bool in_guard_zone, int count);
 
     // Find targets inside the zone
     void SearchTargets();
@@ -88,6 +88,76 @@ private:
     size_t m_spokes;
 };
 
+// The steps that KalmanBatch::Run does for a track, in this order
+#define KALMAN_PREDICT (1)
+#define KALMAN_UPDATE_P (2)
+#define KALMAN_MEASURE (4) // SetMeasurement
+#define KALMAN_BLOCK (64) // number of tracks that are stored together
+
+//
+// The Kalman filters of all ARPA targets of a radar.
+//
+// Each track gives the same results as a KalmanFilter, but the state vectors
+// and covariances of the tracks are kept as structure of arrays, in blocks of
+// KALMAN_BLOCK tracks, and only the elements of the matrices that are not
+// always zero or one are computed. Run() does each step as one loop over the
+// tracks of a block that the compiler can vectorize: the tracks that do not
+// have the step scheduled compute it too, but keep their values.
+//
+// Tracks are only added while no steps are scheduled. Different threads may
+// schedule and run steps of different tracks. The number of spokes is passed
+// with each measurement, as it changes when the radar type does.
+//
+class KalmanBatch {
+public:
+    KalmanBatch();
+    ~KalmanBatch();
+
+    // Makes room for 'tracks' tracks, the filters of new tracks are reset
+    void Resize(size_t tracks);
+    size_t GetCount() { return m_count; }
+
+    void ResetFilter(size_t i); // also cancels the scheduled steps
+    Matrix<double, 4> GetP(size_t i);
+    void SetP(size_t i, const Matrix<double, 4>& P);
+
+    // The arguments of KalmanFilter::Predict, and the state that the
+    // prediction and measurement change
+    void SetState(size_t i, const LocalPosition* x, double delta_time);
+    void GetState(size_t i, LocalPosition* x);
+    // The other arguments of KalmanFilter::SetMeasurement, and the spokes
+    // that the KalmanFilter would have been made with
+    void SetMeasured(size_t i, const Polar* p, const Polar* expected,
+        double scale, size_t spokes);
+
+    void Schedule(size_t i, int steps);
+    void Cancel(size_t i);
+    void Run(); // all tracks
+    void Run(size_t i); // only track i
+
+private:
+    struct Block {
+        double P[16][KALMAN_BLOCK]; // P(r, c) is in P[r * 4 + c]
+        double x[4][KALMAN_BLOCK]; // lat, lon, dlat_dt, dlon_dt
+        double var_speed[KALMAN_BLOCK]; // square of sd_speed_m_s
+        double delta_time[KALMAN_BLOCK]; // for the next prediction
+        double a[KALMAN_BLOCK]; // delta_time of the last one, A(0, 2)
+        double z[2][KALMAN_BLOCK]; // measured - expected
+        double scale[KALMAN_BLOCK];
+        double c[KALMAN_BLOCK]; // spokes / (2 * PI)
+        uint8_t steps[KALMAN_BLOCK];
+    };
+
+    void Predict(Block* b, size_t from, size_t to);
+    void Update_P(Block* b, size_t from, size_t to);
+    void SetMeasurement(Block* b, size_t from, size_t to);
+    void Run(Block* b, size_t from, size_t to);
+
+    Block* m_blocks;
+    size_t m_block_count;
+    size_t m_count;
+};
+
 class GPSKalmanFilter {
 public:
     GPSKalmanFilter();
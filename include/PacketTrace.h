@@ -0,0 +1,115 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _PACKET_TRACE_H_
+#define _PACKET_TRACE_H_
+
+#include <atomic>
+
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define PACKET_TRACE_SLOTS (32)         // power of two
+#define PACKET_TRACE_SLOT_SIZE (2048)   // longer packets are truncated
+
+//
+// In memory record of the last PACKET_TRACE_SLOTS raw packets received from
+// a radar, so they can be logged after the fact (e.g. when data is lost)
+// without formatting every packet as it arrives.
+//
+// Record() is only called by the receive thread and never blocks. Get() may
+// be called from any thread; each slot carries a sequence number that is odd
+// while the slot is being written, so a reader can tell when it raced the
+// receive thread and skip that slot.
+//
+class PacketTrace {
+public:
+    PacketTrace()
+    {
+        m_slots = (Slot*)calloc(sizeof(Slot), PACKET_TRACE_SLOTS);
+        for (size_t i = 0; i < PACKET_TRACE_SLOTS; i++) {
+            m_slots[i].seq.store(0);
+        }
+        m_head.store(0);
+    }
+
+    ~PacketTrace() { free(m_slots); }
+
+    void Record(const uint8_t* data, size_t len)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        Slot* slot = &m_slots[head & (PACKET_TRACE_SLOTS - 1)];
+        uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+
+        slot->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot->len = len;
+        memcpy(slot->data, data, len < PACKET_TRACE_SLOT_SIZE ? len : PACKET_TRACE_SLOT_SIZE);
+        slot->seq.store(seq + 2, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // Number of packets recorded so far
+    uint32_t Count() { return m_head.load(std::memory_order_acquire); }
+
+    // Copy packet n (0 <= n < Count()) into data, which must hold
+    // PACKET_TRACE_SLOT_SIZE bytes. Returns false when the packet has
+    // already been overwritten.
+    bool Get(uint32_t n, uint8_t* data, size_t* len)
+    {
+        Slot* slot = &m_slots[n & (PACKET_TRACE_SLOTS - 1)];
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+
+        // Each packet that passed through this slot added 2 to seq
+        if (seq != 2 * (n / PACKET_TRACE_SLOTS + 1)) {
+            return false;
+        }
+        *len = slot->len;
+        memcpy(data, slot->data, *len < PACKET_TRACE_SLOT_SIZE ? *len : PACKET_TRACE_SLOT_SIZE);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot->seq.load(std::memory_order_relaxed) == seq;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        size_t len;
+        uint8_t data[PACKET_TRACE_SLOT_SIZE];
+    };
+
+    Slot* m_slots;
+    std::atomic<uint32_t> m_head;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _PACKET_TRACE_H_ */
@@ -45,9 +45,14 @@ public:
         = 0;
     virtual void DrawRadarPanelImage(double panel_scale, double panel_rotate)
         = 0;
+    // trail_age, when not 0, holds the trail age of each return, and the
+    // weak returns in data have not been replaced by trail colours. Only
+    // draws that return true from ColoursTrails() are given trail ages.
     virtual void ProcessRadarSpoke(int transparency, SpokeBearing angle,
-        uint8_t* data, size_t len, GeoPosition spoke_pos)
+        uint8_t* data, size_t len, GeoPosition spoke_pos,
+        const uint8_t* trail_age)
         = 0;
+    virtual bool ColoursTrails() { return false; }
 
     virtual ~RadarDraw() = 0;
 
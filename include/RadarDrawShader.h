@@ -46,12 +46,15 @@ public:
         m_start_line = -1; // No spokes received since last draw
         m_lines = 0;
         m_texture = 0;
+        m_trail_texture = 0;
         m_fragment = 0;
         m_vertex = 0;
         m_program = 0;
         m_format = GL_RGBA;
         m_channels = SHADER_COLOR_CHANNELS;
         m_data = 0;
+        m_trail_data = 0;
+        m_alpha = 255;
         m_spokes = 0;
         m_spoke_len_max = 0;
     }
@@ -62,7 +65,8 @@ public:
     void DrawRadarOverlayImage(double radar_scale, double panel_rotate);
     void DrawRadarPanelImage(double panel_scale, double panel_rotate);
     void ProcessRadarSpoke(int transparency, SpokeBearing angle, uint8_t* data,
-        size_t len, GeoPosition spoke_pos);
+        size_t len, GeoPosition spoke_pos, const uint8_t* trail_age);
+    bool ColoursTrails() { return true; }
 
 private:
     RadarInfo* m_ri;
@@ -70,6 +74,8 @@ private:
     wxCriticalSection m_exclusive; // protects the following data structures
     unsigned char*
         m_data; // [SHADER_COLOR_CHANNELS * m_spokes * m_spoke_len_max];
+    unsigned char* m_trail_data; // [m_spokes * m_spoke_len_max] trail ages
+    GLubyte m_alpha; // of the last spoke, used for the trails as well
     size_t m_spokes;
     size_t m_spoke_len_max;
 
@@ -80,11 +86,14 @@ private:
     int m_channels;
 
     GLuint m_texture;
+    GLuint m_trail_texture;
     GLuint m_fragment;
     GLuint m_vertex;
     GLuint m_program;
 
     void Reset();
+    void UploadLines(GLenum format, int channels, unsigned char* data);
+    void SetTrailUniforms();
 };
 
 PLUGIN_END_NAMESPACE
@@ -36,6 +36,8 @@
 
 PLUGIN_BEGIN_NAMESPACE
 
+class SpokeKernels;
+
 class RadarFactory {
 public:
     static ControlsDialog* MakeControlsDialog(size_t radarType, int radar);
@@ -48,6 +50,7 @@ public:
     static size_t GetRadarRanges(
         RadarInfo* ri, RangeUnits units, const int** ranges);
     static void GetRadarTypes(wxArrayString& radarTypes);
+    static SpokeKernels* MakeSpokeKernels(size_t radarType);
 };
 
 PLUGIN_END_NAMESPACE
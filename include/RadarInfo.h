@@ -35,8 +35,11 @@
 #include "ControlsDialog.h"
 #include "RadarControlItem.h"
 #include "RadarReceive.h"
+#include "SpokeHistory.h"
 #include "radar_pi.h"
 
+#include <atomic>
+
 PLUGIN_BEGIN_NAMESPACE
 
 class RadarDraw;
@@ -45,6 +48,12 @@ class RadarPanel;
 class GuardZoneBogey;
 class RadarInfo;
 class TrailBuffer;
+class RadarSnapshot;
+struct TrailRun;
+class SpokeRing;
+class SpokeProcessor;
+class SpokeKernels;
+class PacketTrace;
 
 struct DrawInfo {
     RadarDraw* draw;
@@ -53,7 +62,7 @@ struct DrawInfo {
 };
 
 #define SECONDS_TO_REVOLUTIONS(x) ((x)*2 / 5)
-#define TRAIL_MAX_REVOLUTIONS SECONDS_TO_REVOLUTIONS(600) + 1
+#define TRAIL_MAX_REVOLUTIONS (SECONDS_TO_REVOLUTIONS(600) + 1)
 enum {
     TRAIL_15SEC,
     TRAIL_30SEC,
@@ -67,6 +76,9 @@ enum {
 
 #define COURSE_SAMPLES (16)
 
+// Number of spokes that can be queued between receive and processing thread
+#define SPOKE_QUEUE_SIZE (1024)
+
 class RadarInfo {
     friend class TrailBuffer;
 
@@ -186,6 +198,9 @@ public:
                                // addresses + serial nr)
     RadarControl* m_control;
     RadarReceive* m_receive;
+    SpokeRing* m_spoke_ring; // Spokes from m_receive waiting for processing
+    SpokeProcessor* m_spoke_processor;
+    PacketTrace* m_packet_trace; // Last packets received, see TRACE_PACKET
     ControlsDialog* m_control_dialog;
     RadarPanel* m_radar_panel;
     RadarCanvas* m_radar_canvas;
@@ -207,19 +222,16 @@ public:
     double m_ebl[ORIENTATION_NUMBER][BEARING_LINES];
     double m_vrm[BEARING_LINES];
     receive_statistics m_statistics;
+    wxCriticalSection m_statistics_lock; // protects m_statistics, taken after m_exclusive
 
-    struct line_history {
-        uint8_t* line;
-        wxLongLong time;
-        GeoPosition pos;
-    };
-
-    line_history* m_history;
+    SpokeHistory* m_history; // Written by ProcessRadarSpoke
+    wxCriticalSection m_history_lock; // protects m_history against UpdateArpaHistory
+    SpokeHistory* m_arpa_history; // Used by ARPA and the guard zones, see UpdateArpaHistory
+    std::atomic<bool> m_arpa_sector_queued; // see radar_pi::NotifyArpaSector
 
     int m_old_range;
-    int m_dir_lat;
-    int m_dir_lon;
     TrailBuffer* m_trails;
+    RadarSnapshot* m_snapshot; // Keeps the trails, history and ARPA targets over a restart
 
     // Timed Transmit
     time_t m_idle_standby; // When we will change to standby
@@ -238,13 +250,17 @@ public:
     void SetAutoRangeMeters(int meters);
     bool SetControlValue(ControlType controlType, RadarControlItem& item,
         RadarControlButton* button);
+    bool QueueRadarSpoke(SpokeBearing angle, SpokeBearing bearing,
+        uint8_t* data, size_t len, int range_meters, wxLongLong time);
+    void SpokesQueued();
+    bool ProcessQueuedSpokes();
+    void DumpPacketTrace();
+    size_t UpdateArpaHistory();
     void ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing,
         uint8_t* data, size_t len, int range_meters, wxLongLong time);
     void RefreshDisplay();
     void RenderGuardZone();
     void ResetRadarImage();
-    void ShiftImageLonToCenter();
-    void ShiftImageLatToCenter();
     void RenderRadarImage1(
         wxPoint center, double scale, double rotation, bool overlay);
     void ShowRadarWindow(bool show);
@@ -337,10 +353,15 @@ public:
     // m_settings.display_option.
     PixelColour m_colour_map_rgb[BLOB_COLOURS];
     BlobColour m_colour_map[UINT8_MAX + 1];
+    int m_trail_revolutions; // Trails older than this are not shown, see ComputeTargetTrails
+    double m_trail_colours_per_revolution; // BLOB_HISTORY colours that a trail goes through per revolution
 
     // Speedup PolarToCartesian lookup (angle,radius) -> (x, y)
     PolarToCartesianLookup* m_polar_lookup;
 
+    // The per return loops, compiled for the spokes and spoke length of m_radar_type
+    SpokeKernels* m_spoke_kernels;
+
     void AdjustRange(int adjustment, int current_range_meters);
     int GetNearestRange(int range_meters, int units);
 
@@ -356,6 +377,9 @@ public:
 
 private:
     void ResetSpokes();
+    void StopSpokeThreads();
+    void ColourTrails(const uint8_t* data, const uint8_t* trail_age, size_t len, const TrailRun* runs, size_t run_count,
+        uint8_t* coloured);
     void RenderRadarImage2(
         DrawInfo* di, double radar_scale, double panel_rotate);
     wxString FormatDistance(double distance);
@@ -378,6 +402,8 @@ private:
     int m_previous_orientation;
 
     GeoPosition m_radar_position;
+
+    size_t m_sector_spokes; // Spokes processed since the last radar_pi::NotifyArpaSector
 };
 
 PLUGIN_END_NAMESPACE
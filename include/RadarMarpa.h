@@ -36,16 +36,22 @@
 //#include "pi_common.h"
 
 //#include "radar_pi.h"
+#include "BlobLabeller.h"
 #include "Kalman.h"
 #include "Matrix.h"
 #include "RadarInfo.h"
 
+#include <atomic>
+
 PLUGIN_BEGIN_NAMESPACE
 
 //    Forward definitions
-class KalmanFilter;
+class ArpaRefreshThread;
+class KalmanBatch;
+struct SnapshotTarget;
 
-#define MAX_NUMBER_OF_TARGETS (100) //
+#define MAX_NUMBER_OF_TARGETS (500) // the pool of targets grows up to this
+#define MIN_NUMBER_OF_TARGETS (32) // targets the pool has room for at first
 #define TARGET_SEARCH_RADIUS1                                                  \
     (2) // radius of target search area for pass 1 (on top of the size of the
         // blob)
@@ -80,6 +86,10 @@ class KalmanFilter;
 #define START_UP_SPEED                                                         \
     (0.5) // maximum allowed speed (m/sec) for new target, real format with .
 #define DISTANCE_BETWEEN_TARGETS (4) // minimum separation between targets
+#define ARPA_REFRESH_THREADS (4) // At most this many threads refresh the targets
+#define ARPA_REFRESH_SECTORS                                                   \
+    (16) // the targets in every other sector are refreshed at the same time,
+         // must be even
 
 typedef int target_status;
 enum OCPN_target_status {
@@ -93,6 +103,7 @@ enum PassN { PASS1, PASS2 };
 
 class ArpaTarget {
     friend class RadarArpa; // Allow RadarArpa access to private members
+    friend class RadarArpaTest;
 
 public:
     ArpaTarget(radar_pi* pi, RadarInfo* ri);
@@ -110,11 +121,14 @@ public:
     void ResetPixels();
     bool Pix(int ang, int rad);
     bool MultiPix(int ang, int rad);
+    bool OutsideFence(int ang);
+    bool IsDue(Polar pol);
 
 private:
     RadarInfo* m_ri;
     radar_pi* m_pi;
-    KalmanFilter* m_kalman;
+    KalmanBatch* m_kalman; // of RadarArpa, shared by all targets
+    size_t m_track; // of this target in m_kalman
     int m_target_id;
     target_status m_status;
     // radar position at time of last target fix, the polars in the contour
@@ -130,8 +144,10 @@ private:
     bool m_check_for_duplicate;
     TargetProcessStatus m_pass1_result;
     PassN m_pass_nr;
-    Polar m_contour[MAX_CONTOUR_LENGTH
-        + 1]; // contour of target, only valid immediately after finding it
+    // contour of target, only valid immediately after finding it. Allocated
+    // when the first contour is found, so that the targets that are refreshed
+    // stay small.
+    ContourPoint* m_contour;
     int m_contour_length;
     Polar m_max_angle, m_min_angle, m_max_r,
         m_min_r; // charasterictics of contour
@@ -140,11 +156,39 @@ private:
     uint8_t
         m_doppler_target; // 0: no doppler, 1 approaching, 2 receiding; 3 any
 
+    // Set while the target is refreshed by one of the threads of
+    // RadarArpa::RefreshTargets. It may then only look at the spokes
+    // [m_fence_start..m_fence_start + m_fence_width>, and when it has to look
+    // further it stops and sets m_fence_hit. No fence when m_fence_width is 0.
+    int m_fence_start;
+    int m_fence_width;
+    bool m_fence_hit;
+    bool m_in_thread; // keep the messages to OpenCPN in m_nmea
+    wxArrayString m_nmea;
+    int m_reserved_id; // target id to use when it gets one in a thread
+    int m_refresh_sector; // in RadarArpa::RefreshTargets, -1 when not refreshed
+
+    // Passed from PrepareRefresh to SearchTarget and FinishRefresh, the
+    // Kalman steps in between are run for all targets together
+    ExtendedPosition m_own_pos;
+    wxLongLong m_due_time; // of the spoke at the target
+    double m_delta_t;
+    LocalPosition m_x_local; // predicted, then measured, local position
+    bool m_finish; // SearchTarget returned true
+
+    // The steps of RefreshTarget
+    bool PrepareRefresh();
+    bool SearchTarget(int dist);
+    void FinishRefresh();
+
     ExtendedPosition Polar2Pos(Polar pol, ExtendedPosition own_ship);
     Polar Pos2Polar(ExtendedPosition p, ExtendedPosition own_ship);
 };
 
 class RadarArpa {
+    friend class ArpaRefreshThread;
+    friend class RadarArpaTest;
+
 public:
     RadarArpa(radar_pi* pi, RadarInfo* ri);
     ~RadarArpa();
@@ -155,6 +199,7 @@ public:
     void AcquireNewMARPATarget(ExtendedPosition p);
     void DeleteTarget(ExtendedPosition p);
     bool MultiPix(int ang, int rad, bool doppler);
+    bool AcquireBlobs(int angle1, int angle2, size_t r1, size_t r2, bool doppler);
     void DeleteAllTargets();
     void CleanUpLostTargets();
     void RadarLost()
@@ -163,21 +208,52 @@ public:
     }
     void ClearContours();
     int GetTargetCount() { return m_number_of_targets; }
+    int SaveTargets(SnapshotTarget* targets, int max);
+    void RestoreTargets(const SnapshotTarget* targets, int count);
 
 private:
+    // The targets in use come first, then the lost ones that may be used
+    // again. m_targets grows when all m_targets_allocated are in use.
     int m_number_of_targets;
-    ArpaTarget* m_targets[MAX_NUMBER_OF_TARGETS];
+    int m_targets_allocated;
+    ArpaTarget** m_targets;
+    KalmanBatch* m_kalman;
     wxLongLong m_doppler_arpa_update_time[SPOKES_MAX];
+    std::atomic<bool> m_clear_contours; // set by ClearContours
+    size_t m_rotation_spokes; // received since the last search for new targets
+    BlobLabeller m_blobs;
 
     radar_pi* m_pi;
     RadarInfo* m_ri;
 
+    ArpaTarget* NewTarget(int status);
     void AcquireOrDeleteMarpaTarget(ExtendedPosition p, int status);
     void CalculateCentroid(ArpaTarget* t);
     void DrawContour(ArpaTarget* t);
     bool Pix(int ang, int rad, bool doppler);
     void SearchDopplerTargets();
     bool IsAtLeastOneRadarTransmitting();
+    void RefreshTargets(PassN pass, int dist);
+    void StartRefreshThreads(int threads);
+    void RefreshSectors(int dist);
+
+    // The sectors that RefreshTargets refreshes at the same time, and their
+    // targets: those of m_sectors[k] are m_sector_targets[m_sector_start[k]..
+    // m_sector_start[k + 1]>, so that a thread does not look at the others.
+    int m_sectors[ARPA_REFRESH_SECTORS / 2];
+    int m_sector_count;
+    int m_sector_start[ARPA_REFRESH_SECTORS / 2 + 1];
+    int m_sector_targets[MAX_NUMBER_OF_TARGETS];
+    std::atomic<int> m_next_sector;
+
+    // The threads that help RefreshTargets with m_sectors
+    ArpaRefreshThread* m_refresh_thread[ARPA_REFRESH_THREADS];
+    int m_refresh_thread_count;
+    bool m_refresh_threads_started;
+    wxSemaphore m_refresh_start; // Posted once for each thread that should join in
+    wxSemaphore m_refresh_done; // Posted by each of those when no sectors are left
+    int m_refresh_dist;
+    volatile bool m_refresh_shutdown;
 };
 
 PLUGIN_END_NAMESPACE
@@ -0,0 +1,181 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _RADAR_SNAPSHOT_H_
+#define _RADAR_SNAPSHOT_H_
+
+#include <atomic>
+
+#include "RadarMarpa.h"
+#include "SpokeHistory.h"
+#include "TrailBuffer.h"
+
+#ifdef __WXMSW__
+#include <windows.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// A snapshot of the trails, the spoke history and the ARPA targets of a radar,
+// kept in a memory mapped file so that a restart of OpenCPN or the plugin
+// comes back with them.
+//
+// Once every SNAPSHOT_SAVE_ROTATIONS rotations the spoke processor copies the
+// part of the trails and history that each spoke changes into the map, and the
+// GUI thread copies the ARPA targets after each refresh. Pages that already
+// hold what would be copied are left alone, so only the pages that changed
+// since the last save are written. The operating system writes them back to
+// the file in the background, so nothing waits for the disk.
+//
+// The snapshot is only restored when it was made by the same type of radar,
+// with the same spoke geometry, not too long ago and not too far away.
+//
+
+#define SNAPSHOT_MAGIC (0x50414e53) // "SNAP"
+#define SNAPSHOT_VERSION (2)
+#define SNAPSHOT_MAX_AGE (600) // seconds, older snapshots are not restored
+#define SNAPSHOT_MAX_DISTANCE (0.5) // nautical miles the radar may have moved
+#define SNAPSHOT_SAVE_ROTATIONS (24) // one rotation in this many is saved, about once a minute
+#define SNAPSHOT_PAGE (4096) // bytes of the map compared at a time before copying
+
+// An ARPA target as kept in the snapshot
+struct SnapshotTarget {
+    int target_id;
+    target_status status;
+    int stationary;
+    int lost_count;
+    bool automatic;
+    uint8_t doppler_target;
+    GeoPosition radar_pos;
+    ExtendedPosition position;
+    double speed_kn;
+    double course;
+    Matrix<double, 4> P; // Covariance of the Kalman filter
+};
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    int radar_type;
+    uint32_t spokes;
+    uint32_t spoke_len_max;
+    uint32_t trail_size;
+    uint64_t size; // of the whole file
+
+    wxLongLong time; // UTC millis when the last spoke was copied
+    GeoPosition pos; // where the radar was then
+
+    // TrailBuffer state
+    GeoPosition trail_pos;
+    GeoPosition trail_dif;
+    int trail_offset_lat;
+    int trail_offset_lon;
+    double trail_pixels_per_meter;
+    TrailRevolution trail_revolution;
+
+    int arpa_targets;
+    SnapshotTarget arpa[MAX_NUMBER_OF_TARGETS];
+};
+
+//
+// Whether radar_pi::RefreshArpaTargets should refresh the ARPA targets of a
+// radar. The targets of a snapshot are taken up again by that refresh, so a
+// pending restore counts too: after a restart there are no targets yet, and
+// MARPA targets do not need a guard zone with ARPA on to come back.
+//
+inline bool ArpaRefreshWanted(bool guard_zone_arpa, int targets, bool autotrack_doppler, bool restore_pending)
+{
+    return guard_zone_arpa || targets > 0 || autotrack_doppler || restore_pending;
+}
+
+class RadarSnapshot {
+    friend class RadarSnapshotTest;
+
+public:
+    RadarSnapshot(radar_pi* pi, RadarInfo* ri);
+    ~RadarSnapshot();
+
+    // Spoke processor thread
+    bool Restore();
+    void Save(SpokeBearing angle, SpokeBearing bearing);
+
+    // GUI thread
+    void RestoreTargets();
+    void SaveTargets();
+    bool TargetsPending() { return m_state == SNAPSHOT_SAVING && m_restore_targets; }
+
+private:
+    bool Map(const wxString& name);
+    void Unmap();
+    bool IsValid(GeoPosition* pos);
+    void Start();
+    void CopyChanged(void* to, const void* from, size_t size);
+
+    size_t HistoryPlanesSize() { return m_ri->m_spokes * HISTORY_PLANES * m_ri->m_history->Words() * sizeof(uint64_t); }
+
+    radar_pi* m_pi;
+    RadarInfo* m_ri;
+
+    enum SnapshotState { SNAPSHOT_OFF, SNAPSHOT_LOADING, SNAPSHOT_SAVING };
+    std::atomic<int> m_state;
+    std::atomic<bool> m_restore_targets; // Set when the GUI thread should restore the ARPA targets
+    size_t m_loading_spokes; // Spokes seen while waiting for the radar position
+
+    // The parts of the map
+    uint8_t* m_map;
+    size_t m_size;
+    SnapshotHeader* m_header;
+    TrailRevolution* m_true_trails;
+    TrailRevolution* m_relative_trails;
+    uint64_t* m_history_planes;
+    wxLongLong* m_history_time;
+    GeoPosition* m_history_pos;
+
+    size_t m_true_trails_size; // points in m_true_trails
+    size_t m_true_trails_copied; // the next point of m_true_trails to copy
+    SpokeBearing m_last_angle;
+    size_t m_rotations; // since Start()
+    std::atomic<bool> m_saving; // Set while the current rotation is saved
+    std::atomic<size_t> m_saved_rotations; // since Start()
+    size_t m_targets_saved; // m_saved_rotations when SaveTargets last saved
+
+#ifdef __WXMSW__
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _RADAR_SNAPSHOT_H_ */
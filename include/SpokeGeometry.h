@@ -0,0 +1,300 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKE_GEOMETRY_H_
+#define _SPOKE_GEOMETRY_H_
+
+#include "Kalman.h"
+#include "SpokeHistory.h"
+#include "SpokeKernel.h"
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// The number of spokes and the spoke length of every radar type are fixed
+// in the DEFINE_RADAR tables. The loops that run per return in the spoke
+// processing and in ARPA are compiled for each of these geometries, so that
+// wrapping a power of two number of spokes is a mask instead of a division,
+// and the spoke length is a constant.
+//
+// RadarInfo::Init gets the SpokeKernels of its radar type from
+// RadarFactory::MakeSpokeKernels, so the geometry is chosen once per call of
+// a kernel instead of once per return.
+//
+template <size_t SPOKES, size_t SPOKE_LEN>
+struct SpokeGeometry {
+    enum {
+        spokes = SPOKES,
+        spoke_len = SPOKE_LEN,
+        history_words = HistoryPlaneWords(SPOKE_LEN)
+    };
+
+    // As MOD_SPOKES
+    static SpokeBearing Mod(int raw)
+    {
+        if ((SPOKES & (SPOKES - 1)) == 0) {
+            return raw & (int)(SPOKES - 1);
+        }
+        return (raw + 2 * (int)SPOKES) % (int)SPOKES;
+    }
+};
+
+// The results of SpokeKernels::TraceContour, which are also the return
+// codes of ArpaTarget::GetContour.
+enum ContourResult {
+    CONTOUR_CLOSED = 0, // back at the start
+    CONTOUR_R_LARGE = 1, // start.r too large
+    CONTOUR_R_SMALL = 2, // start.r too small
+    CONTOUR_OUTSIDE = 3, // start is outside the blob
+    CONTOUR_INSIDE = 4, // start is not on the contour
+    CONTOUR_BROKEN = 7, // no next point found
+    CONTOUR_LONG = 8, // longer than max_length
+    CONTOUR_FENCE = 9 // would have to look outside the fence
+};
+
+// A point of a contour, as kept with an ARPA target for drawing it
+struct ContourPoint {
+    int16_t angle;
+    int16_t r;
+};
+
+struct ContourWalk {
+    int min_radius; // start.r must be at least this
+    // When points is not 0 the contour is stored there, cut short to
+    // max_points. Otherwise the walk stops after max_length points.
+    ContourPoint* points;
+    int max_points;
+    int max_length;
+    // The walk may only look at spokes [fence_start..fence_start +
+    // fence_width>, modulo the spokes. No fence when fence_width is 0.
+    int fence_start;
+    int fence_width;
+
+    // output
+    int length;
+    Polar min_angle; // angle can be negative, or larger than the spokes
+    Polar max_angle;
+    Polar min_r;
+    Polar max_r;
+};
+
+// No second plane for Pix and TraceContour
+#define HISTORY_NO_PLANE (HISTORY_PLANES)
+
+class SpokeKernels {
+public:
+    virtual ~SpokeKernels() {}
+
+    // SpokeKernel for this spoke length
+    virtual void ProcessSpoke(
+        uint8_t* data, size_t len, uint64_t* hist, SpokeKernelParams& p)
+        = 0;
+    // Is return (ang, rad) set in plane, and in and_plane unless that is
+    // HISTORY_NO_PLANE? ang may be off by up to two rotations.
+    virtual bool Pix(
+        SpokeHistory* h, int plane, int and_plane, int ang, int rad)
+        = 0;
+    // Follow the contour of the blob of Pix() from start, clockwise.
+    virtual int TraceContour(SpokeHistory* h, int plane, int and_plane,
+        Polar start, ContourWalk* walk)
+        = 0;
+    // Clear returns [from..to> of spokes angle1..angle2: the targets, or
+    // only the unclaimed returns.
+    virtual void ClearPixels(SpokeHistory* h, int angle1, int angle2,
+        size_t from, size_t to, bool unclaimed_only)
+        = 0;
+};
+
+template <class G>
+class SpokeKernelsFor : public SpokeKernels {
+public:
+    void ProcessSpoke(
+        uint8_t* data, size_t len, uint64_t* hist, SpokeKernelParams& p)
+    {
+        if (len == G::spoke_len) {
+            SpokeKernel(data, G::spoke_len, hist, G::history_words, p);
+        } else {
+            SpokeKernel(data, len, hist, G::history_words, p);
+        }
+    }
+
+    bool Pix(SpokeHistory* h, int plane, int and_plane, int ang, int rad)
+    {
+        return InlinePix(h, plane, and_plane, ang, rad);
+    }
+
+    int TraceContour(SpokeHistory* h, int plane, int and_plane, Polar start,
+        ContourWalk* walk)
+    {
+        // The 4 possible translations to move from a point on the contour to the next
+        static const int transl_angle[4] = { 0, 1, 0, -1 };
+        static const int transl_r[4] = { 1, 0, -1, 0 };
+        Polar current = start;
+        bool fenced = walk->fence_width > 0;
+        int count = 0;
+        int index = 0;
+        int aa = 0;
+        int rr = 0;
+        bool succes = false;
+
+        walk->length = 0;
+        walk->min_angle = current;
+        walk->max_angle = current;
+        walk->min_r = current;
+        walk->max_r = current;
+        if (start.r >= (int)G::spoke_len) {
+            return CONTOUR_R_LARGE;
+        }
+        if (start.r < walk->min_radius) {
+            return CONTOUR_R_SMALL;
+        }
+        // The neighbours of start are looked at too
+        if (fenced && (int)G::Mod(start.angle - 1 - walk->fence_start) >= walk->fence_width - 2) {
+            return CONTOUR_FENCE;
+        }
+        if (!InlinePix(h, plane, and_plane, start.angle, start.r)) {
+            return CONTOUR_OUTSIDE;
+        }
+        // First find the orientation of border point p
+        for (int i = 0; i < 4; i++) {
+            index = i;
+            aa = current.angle + transl_angle[index];
+            rr = current.r + transl_r[index];
+            succes = !InlinePix(h, plane, and_plane, aa, rr);
+            if (succes) {
+                break;
+            }
+        }
+        if (!succes) {
+            return CONTOUR_INSIDE;
+        }
+        index += 1; // determines starting direction
+        if (index > 3) {
+            index -= 4;
+        }
+
+        while (current.r != start.r || current.angle != start.angle || count == 0) {
+            // Try all translations to find the next point, starting with the
+            // "left most" translation relative to the previous one
+            index += 3;
+            for (int i = 0; i < 4; i++) {
+                if (index > 3) {
+                    index -= 4;
+                }
+                aa = current.angle + transl_angle[index];
+                rr = current.r + transl_r[index];
+                if (fenced && (int)G::Mod(aa - walk->fence_start) >= walk->fence_width) {
+                    walk->length = count;
+                    return CONTOUR_FENCE;
+                }
+                succes = InlinePix(h, plane, and_plane, aa, rr);
+                if (succes) {
+                    break;
+                }
+                index += 1;
+            }
+            if (!succes) {
+                walk->length = count;
+                return CONTOUR_BROKEN;
+            }
+            current.angle = aa;
+            current.r = rr;
+            if (walk->points) {
+                if (count < walk->max_points - 2) {
+                    walk->points[count].angle = (int16_t)current.angle;
+                    walk->points[count].r = (int16_t)current.r;
+                }
+                if (count == walk->max_points - 2) {
+                    // shortcut to the beginning for drawing the contour
+                    walk->points[count].angle = (int16_t)start.angle;
+                    walk->points[count].r = (int16_t)start.r;
+                    current = start; // this will cause the while to terminate
+                }
+                if (count < walk->max_points - 1) {
+                    count++;
+                }
+            } else {
+                if (count >= walk->max_length) {
+                    walk->length = count;
+                    return CONTOUR_LONG;
+                }
+                count++;
+            }
+            if (current.angle > walk->max_angle.angle) {
+                walk->max_angle = current;
+            }
+            if (current.angle < walk->min_angle.angle) {
+                walk->min_angle = current;
+            }
+            if (current.r > walk->max_r.r) {
+                walk->max_r = current;
+            }
+            if (current.r < walk->min_r.r) {
+                walk->min_r = current;
+            }
+        }
+        walk->length = count;
+        return CONTOUR_CLOSED;
+    }
+
+    void ClearPixels(SpokeHistory* h, int angle1, int angle2, size_t from,
+        size_t to, bool unclaimed_only)
+    {
+        for (int a = angle1; a <= angle2; a++) {
+            SpokeBearing angle = G::Mod(a);
+            if (unclaimed_only) {
+                HistoryClear(h->Plane(angle, HISTORY_UNCLAIMED), from, to);
+            } else {
+                h->Clear(angle, from, to);
+            }
+        }
+    }
+
+private:
+    inline bool InlinePix(
+        SpokeHistory* h, int plane, int and_plane, int ang, int rad)
+    {
+        if (rad <= 0 || rad >= (int)G::spoke_len) {
+            return false;
+        }
+        SpokeBearing angle = G::Mod(ang);
+        if (!HistoryTest(h->Plane(angle, plane), rad)) {
+            return false;
+        }
+        return and_plane == HISTORY_NO_PLANE
+            || HistoryTest(h->Plane(angle, and_plane), rad);
+    }
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKE_GEOMETRY_H_ */
@@ -0,0 +1,301 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKE_HISTORY_H_
+#define _SPOKE_HISTORY_H_
+
+#include "radar_pi.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// The history of a spoke, as used by ARPA and the guard zones, is kept as
+// three bit planes of one bit per return:
+//
+// HISTORY_TARGET     the return is strong enough to be (part of) a target.
+// HISTORY_UNCLAIMED  as HISTORY_TARGET, but not yet claimed by an ARPA
+//                    target, so it can still be found by the target search.
+// HISTORY_DOPPLER    the return is an approaching doppler return.
+//
+// Return r is bit (r % 64) of word (r / 64) of a plane. Each plane of a
+// spoke is at least HISTORY_WORDS(spoke_len) words long, and the planes of
+// a spoke follow each other in the order above.
+//
+// So a return takes three bits instead of the byte it used to, 2.7 times
+// less: 0.75 MB instead of 2 MB for a Navico radar. A return can be empty,
+// a claimed or unclaimed target, or a claimed or unclaimed doppler target;
+// those five states need three bits, so 8 times less (one bit) would lose
+// information that ARPA uses.
+//
+
+enum HistoryPlane { HISTORY_TARGET, HISTORY_UNCLAIMED, HISTORY_DOPPLER, HISTORY_PLANES };
+
+#define HISTORY_WORDS(len) (((len) + 63) / 64)
+#define HISTORY_ALIGN (64) // bytes, a cache line
+
+// The length of a plane of a spoke of len returns, rounded up so that every
+// plane starts on a cache line. SpokeHistory::Words() of a history for
+// spokes of len returns.
+constexpr size_t HistoryPlaneWords(size_t len)
+{
+    return (HISTORY_WORDS(len) + HISTORY_ALIGN / 8 - 1) & ~(size_t)(HISTORY_ALIGN / 8 - 1);
+}
+
+inline int HistoryPopCount(uint64_t w)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// Index of the lowest set bit, w must not be 0
+inline size_t HistoryLowestBit(uint64_t w)
+{
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(w);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, w);
+    return index;
+#else
+    return (size_t)HistoryPopCount((w & (0 - w)) - 1);
+#endif
+}
+
+inline bool HistoryTest(const uint64_t* plane, size_t r)
+{
+    return ((plane[r >> 6] >> (r & 63)) & 1) != 0;
+}
+
+// Bits from..to-1 of a word, from < to <= 64
+inline uint64_t HistoryMask(size_t from, size_t to)
+{
+    uint64_t high = (to == 64) ? ~(uint64_t)0 : (((uint64_t)1 << to) - 1);
+    return high & (~(uint64_t)0 << from);
+}
+
+// Clear returns [from..to>
+inline void HistoryClear(uint64_t* plane, size_t from, size_t to)
+{
+    while (from < to) {
+        size_t w = from >> 6;
+        size_t end = (to - (w << 6) >= 64) ? 64 : to - (w << 6);
+        plane[w] &= ~HistoryMask(from & 63, end);
+        from = (w << 6) + end;
+    }
+}
+
+// The first return in [from..to> that is set in plane, and also in and_plane
+// when that is not 0. Returns to when there is none.
+inline size_t HistoryFindNext(
+    const uint64_t* plane, const uint64_t* and_plane, size_t from, size_t to)
+{
+    if (from >= to) {
+        return to;
+    }
+    size_t w = from >> 6;
+    uint64_t bits = plane[w] & (~(uint64_t)0 << (from & 63));
+    size_t last = (to - 1) >> 6;
+
+    for (;;) {
+        if (and_plane) {
+            bits &= and_plane[w];
+        }
+        if (bits) {
+            size_t r = (w << 6) + HistoryLowestBit(bits);
+            return r < to ? r : to;
+        }
+        if (++w > last) {
+            return to;
+        }
+        bits = plane[w];
+    }
+}
+
+// The first return in [from..to> that is not set in plane, or not in
+// and_plane when that is not 0. Returns to when there is none.
+inline size_t HistoryFindNextClear(
+    const uint64_t* plane, const uint64_t* and_plane, size_t from, size_t to)
+{
+    if (from >= to) {
+        return to;
+    }
+    size_t w = from >> 6;
+    size_t last = (to - 1) >> 6;
+
+    for (;;) {
+        uint64_t bits = and_plane ? plane[w] & and_plane[w] : plane[w];
+        bits = ~bits;
+        if (w == from >> 6) {
+            bits &= ~(uint64_t)0 << (from & 63);
+        }
+        if (bits) {
+            size_t r = (w << 6) + HistoryLowestBit(bits);
+            return r < to ? r : to;
+        }
+        if (++w > last) {
+            return to;
+        }
+    }
+}
+
+//
+// The history of all spokes of a radar.
+//
+// The bit planes of all spokes live in a single block of memory, each plane
+// starting on a cache line. The time and position at which each spoke was
+// received are kept in separate arrays, so the searches that only look at
+// the times do not have to skip over the planes.
+//
+// RadarInfo keeps two of these: the one the spoke processor writes, and the
+// working copy of ARPA and the guard zones, which claim targets in it.
+// Update() only copies the spokes that were received again, so the claims
+// on the other spokes survive.
+//
+// Each time another 1/HISTORY_SECTORS of a rotation has been received the
+// ARPA targets are refreshed, see radar_pi::NotifyArpaSector, so this also
+// sets how soon after the beam a target is refreshed.
+//
+#define HISTORY_SECTORS (32)
+
+class SpokeHistory {
+public:
+    SpokeHistory(size_t spokes, size_t spoke_len)
+    {
+        m_spokes = spokes;
+        m_words = HistoryPlaneWords(spoke_len);
+        size_t size = spokes * HISTORY_PLANES * m_words * sizeof(uint64_t);
+#ifdef _WIN32
+        m_planes = (uint64_t*)_aligned_malloc(size, HISTORY_ALIGN);
+#else
+        void* planes;
+        m_planes = posix_memalign(&planes, HISTORY_ALIGN, size) == 0 ? (uint64_t*)planes : 0;
+#endif
+        if (!m_planes) {
+            wxLogError(wxT("Out Of Memory, fatal!"));
+            wxAbort();
+        }
+        m_time = new wxLongLong[spokes]();
+        m_pos = new GeoPosition[spokes]();
+        m_pixels_per_meter = 0.;
+        m_heading_ok = false;
+        m_hdt = 0.;
+        Reset();
+    }
+
+    ~SpokeHistory()
+    {
+#ifdef _WIN32
+        _aligned_free(m_planes);
+#else
+        free(m_planes);
+#endif
+        delete[] m_time;
+        delete[] m_pos;
+    }
+
+    void Reset()
+    {
+        memset(m_planes, 0, m_spokes * HISTORY_PLANES * m_words * sizeof(uint64_t));
+        for (size_t i = 0; i < m_spokes; i++) {
+            m_time[i] = 0;
+            m_pos[i].lat = 0.;
+            m_pos[i].lon = 0.;
+        }
+    }
+
+    // The HISTORY_PLANES planes of a spoke, one after the other
+    uint64_t* Planes(SpokeBearing angle) { return m_planes + angle * HISTORY_PLANES * m_words; }
+
+    uint64_t* Plane(SpokeBearing angle, int plane) { return Planes(angle) + plane * m_words; }
+
+    // Length of each plane
+    size_t Words() { return m_words; }
+
+    // Copy the spokes that 'from' received after we did, returns how many.
+    // Both must have been constructed with the same size.
+    size_t Update(const SpokeHistory& from)
+    {
+        size_t stride = HISTORY_PLANES * m_words;
+        size_t n = 0;
+
+        for (size_t i = 0; i < m_spokes; i++) {
+            if (m_time[i] != from.m_time[i]) {
+                memcpy(m_planes + i * stride, from.m_planes + i * stride, stride * sizeof(uint64_t));
+                m_time[i] = from.m_time[i];
+                m_pos[i] = from.m_pos[i];
+                n++;
+            }
+        }
+        m_pixels_per_meter = from.m_pixels_per_meter;
+        m_heading_ok = from.m_heading_ok;
+        m_hdt = from.m_hdt;
+        return n;
+    }
+
+    // Forget the targets in returns [from..to> of a spoke, the doppler
+    // plane is left as is.
+    void Clear(SpokeBearing angle, size_t from, size_t to)
+    {
+        HistoryClear(Plane(angle, HISTORY_TARGET), from, to);
+        HistoryClear(Plane(angle, HISTORY_UNCLAIMED), from, to);
+    }
+
+    wxLongLong* m_time; // when each spoke was received
+    GeoPosition* m_pos; // where the radar was at that time
+
+    // The radar state that goes with the last spoke, copied along by Update()
+    // so that whoever reads a copy does not look at the live values.
+    double m_pixels_per_meter;
+    bool m_heading_ok; // There is a true heading, or a magnetic one and variation
+    double m_hdt; // True heading
+
+private:
+    size_t m_spokes;
+    size_t m_words;
+    uint64_t* m_planes;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKE_HISTORY_H_ */
@@ -0,0 +1,186 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKE_KERNEL_H_
+#define _SPOKE_KERNEL_H_
+
+#include "SpokeHistory.h"
+#include "radar_pi.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPOKE_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// The per-return work that RadarInfo::ProcessRadarSpoke does on every spoke,
+// fused into one pass over the data:
+//
+// - zero the main bang,
+// - apply the threshold,
+// - set the history bit planes used by ARPA and count doppler returns,
+// - count the returns that fall in each guard zone.
+//
+// The thresholded data is left in place for the trails and draw code.
+//
+
+struct SpokeKernelZone {
+    size_t start; // first return to count
+    size_t end; // last return to count, if end < start nothing is counted
+    int count; // output: number of returns >= guard_threshold
+};
+
+struct SpokeKernelParams {
+    size_t main_bang; // Number of returns to zero, starting at the radar
+    int threshold; // Returns below this are set to zero, 0..255, 0 = off
+    uint8_t history_threshold; // Returns at or above this are ARPA targets
+    uint8_t guard_threshold; // Returns at or above this count in guard zones
+    size_t zones;
+    SpokeKernelZone zone[GUARD_ZONES];
+
+    // output
+    int doppler_count;
+};
+
+struct SpokeKernelBits {
+    uint64_t target; // >= history_threshold
+    uint64_t doppler; // == 255
+    uint64_t guard; // >= guard_threshold
+};
+
+/*
+ * Threshold the n <= 64 returns at data in place and return one bit per
+ * return for each of the tests.
+ */
+inline SpokeKernelBits SpokeKernelChunk(
+    uint8_t* data, size_t n, const SpokeKernelParams& p)
+{
+    SpokeKernelBits bits = { 0, 0, 0 };
+    uint8_t threshold = (uint8_t)p.threshold;
+    size_t i = 0;
+
+#ifdef SPOKE_KERNEL_SSE2
+    if (n == 64) {
+        // Unsigned a >= b is max(a, b) == a
+        const __m128i thr = _mm_set1_epi8((char)threshold);
+        const __m128i hist = _mm_set1_epi8((char)p.history_threshold);
+        const __m128i guard = _mm_set1_epi8((char)p.guard_threshold);
+        const __m128i ones = _mm_set1_epi8((char)0xff);
+
+        for (; i < 64; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+            v = _mm_and_si128(v, _mm_cmpeq_epi8(_mm_max_epu8(v, thr), v));
+            _mm_storeu_si128((__m128i*)(data + i), v);
+            bits.target |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                               _mm_cmpeq_epi8(_mm_max_epu8(v, hist), v))
+                << i;
+            bits.doppler |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                                _mm_cmpeq_epi8(v, ones))
+                << i;
+            bits.guard |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+                              _mm_cmpeq_epi8(_mm_max_epu8(v, guard), v))
+                << i;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        uint8_t v = data[i];
+        v = v < threshold ? 0 : v;
+        data[i] = v;
+        bits.target |= (uint64_t)(v >= p.history_threshold) << i;
+        bits.doppler |= (uint64_t)(v == 255) << i;
+        bits.guard |= (uint64_t)(v >= p.guard_threshold) << i;
+    }
+    return bits;
+}
+
+/*
+ * Process data[0..len> in place and write the history bit planes of the
+ * spoke, each hist_words long, to hist.
+ *
+ * Guard zone hits are counted per 64 returns with a mask and a popcount, so
+ * the inner loop does not need to test the zone boundaries.
+ */
+inline void SpokeKernel(
+    uint8_t* data, size_t len, uint64_t* hist, size_t hist_words, SpokeKernelParams& p)
+{
+    size_t bang = p.main_bang < len ? p.main_bang : len;
+    uint64_t* target = hist + HISTORY_TARGET * hist_words;
+    uint64_t* unclaimed = hist + HISTORY_UNCLAIMED * hist_words;
+    uint64_t* doppler = hist + HISTORY_DOPPLER * hist_words;
+    size_t words = HISTORY_WORDS(len);
+
+    memset(data, 0, bang);
+
+    for (size_t z = 0; z < p.zones; z++) {
+        p.zone[z].count = 0;
+        if (len == 0) {
+            p.zone[z].start = 1; // end < start, nothing to count
+            p.zone[z].end = 0;
+        } else if (p.zone[z].end >= len) {
+            p.zone[z].end = len - 1;
+        }
+    }
+
+    p.doppler_count = 0;
+    for (size_t w = 0; w < words && w < hist_words; w++) {
+        size_t from = w * 64;
+        size_t n = (len - from < 64) ? len - from : 64;
+        SpokeKernelBits bits = SpokeKernelChunk(data + from, n, p);
+
+        // Approaching doppler returns are always targets
+        target[w] = bits.target | bits.doppler;
+        unclaimed[w] = bits.target | bits.doppler;
+        doppler[w] = bits.doppler;
+        p.doppler_count += HistoryPopCount(bits.doppler);
+
+        for (size_t z = 0; z < p.zones; z++) {
+            size_t start = p.zone[z].start > from ? p.zone[z].start : from;
+            size_t end = p.zone[z].end + 1 < from + n ? p.zone[z].end + 1 : from + n;
+            if (start < end) {
+                p.zone[z].count += HistoryPopCount(
+                    bits.guard & HistoryMask(start - from, end - from));
+            }
+        }
+    }
+
+    for (size_t w = words; w < hist_words; w++) {
+        target[w] = 0;
+        unclaimed[w] = 0;
+        doppler[w] = 0;
+    }
+}
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKE_KERNEL_H_ */
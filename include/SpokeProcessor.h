@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKE_PROCESSOR_H_
+#define _SPOKE_PROCESSOR_H_
+
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// The thread that takes the spokes queued by the receive thread out of
+// RadarInfo::m_spoke_ring and runs them through RadarInfo::ProcessRadarSpoke.
+// This way the receive thread never has to wait for RadarInfo::m_exclusive,
+// which is also held while rendering.
+//
+
+class SpokeProcessor : public wxThread {
+public:
+    SpokeProcessor(radar_pi* pi, RadarInfo* ri)
+        : wxThread(wxTHREAD_JOINABLE)
+        , m_ready(0, 1) // posts while the ring is drained add up to one wakeup
+    {
+        Create(1024 * 1024); // Stack size, be liberal
+        m_pi = pi;
+        m_ri = ri;
+        m_shutdown = false;
+    }
+
+    ~SpokeProcessor() { }
+
+    void* Entry(void);
+
+    // Called by the receive thread after it queued one or more spokes.
+    void Wakeup() { m_ready.Post(); }
+
+    void Shutdown(void)
+    {
+        m_shutdown = true;
+        m_ready.Post();
+    }
+
+private:
+    radar_pi* m_pi;
+    RadarInfo* m_ri;
+    wxSemaphore m_ready;
+    volatile bool m_shutdown;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKE_PROCESSOR_H_ */
@@ -0,0 +1,141 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKE_RING_H_
+#define _SPOKE_RING_H_
+
+#include <atomic>
+
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// A spoke as decoded by a receive thread, waiting to be processed.
+//
+struct QueuedSpoke {
+    SpokeBearing angle;
+    SpokeBearing bearing;
+    size_t len;
+    int range_meters;
+    wxLongLong time_rec;
+    uint8_t* data; // points into the ring's data arena
+};
+
+//
+// Single producer, single consumer ring of spokes.
+//
+// The receive thread is the only one that calls Push(), the SpokeProcessor
+// thread is the only one that calls Front() and Pop(). Each side only writes
+// its own index, so neither side ever has to wait for the other.
+//
+class SpokeRing {
+public:
+    SpokeRing(size_t capacity, size_t spoke_len_max)
+    {
+        // capacity must be a power of two
+        m_mask = capacity - 1;
+        m_capacity = capacity;
+        m_spoke_len_max = spoke_len_max;
+        m_spokes = (QueuedSpoke*)calloc(sizeof(QueuedSpoke), capacity);
+        m_data = (uint8_t*)calloc(sizeof(uint8_t), capacity * spoke_len_max);
+        for (size_t i = 0; i < capacity; i++) {
+            m_spokes[i].data = m_data + i * spoke_len_max;
+        }
+        m_head.store(0);
+        m_tail.store(0);
+    }
+
+    ~SpokeRing()
+    {
+        free(m_spokes);
+        free(m_data);
+    }
+
+    size_t SpokeLenMax() { return m_spoke_len_max; }
+
+    // Producer: copy a spoke into the ring. Returns false when the ring is
+    // full, e.g. the consumer fell behind, in which case the spoke is dropped.
+    bool Push(SpokeBearing angle, SpokeBearing bearing, const uint8_t* data,
+        size_t len, int range_meters, wxLongLong time_rec)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= m_capacity) {
+            return false;
+        }
+        QueuedSpoke* spoke = &m_spokes[head & m_mask];
+        if (len > m_spoke_len_max) {
+            len = m_spoke_len_max;
+        }
+        spoke->angle = angle;
+        spoke->bearing = bearing;
+        spoke->len = len;
+        spoke->range_meters = range_meters;
+        spoke->time_rec = time_rec;
+        memcpy(spoke->data, data, len);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: the oldest spoke in the ring, or 0 when it is empty.
+    QueuedSpoke* Front()
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return 0;
+        }
+        return &m_spokes[tail & m_mask];
+    }
+
+    // Consumer: release the spoke returned by Front() back to the producer.
+    void Pop()
+    {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+    }
+
+private:
+    size_t m_capacity;
+    size_t m_mask;
+    size_t m_spoke_len_max;
+    QueuedSpoke* m_spokes;
+    uint8_t* m_data;
+
+    // Keep the two indices on separate cache lines, they are written by
+    // different threads.
+    std::atomic<size_t> m_head; // written by the producer
+    char m_pad[64];
+    std::atomic<size_t> m_tail; // written by the consumer
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKE_RING_H_ */
@@ -37,18 +37,53 @@
 PLUGIN_BEGIN_NAMESPACE
 
 typedef uint8_t TrailRevolutionsAge;
+typedef uint16_t TrailRevolution; // TrailBuffer::m_revolution when a target was last seen, 0 = never
+
+// How often the trails that are too old to be shown are cleared, see
+// TrailBuffer::ExpireTrails(). Must be a power of two.
+#define TRAIL_EXPIRE_REVOLUTIONS (64)
 
 #define MARGIN (100)
 
+// The true trails grid is stored in tiles of TRAIL_TILE * TRAIL_TILE points,
+// so the points along a spoke are close together whatever its bearing.
+#define TRAIL_TILE_SHIFT (4)
+#define TRAIL_TILE (1 << TRAIL_TILE_SHIFT)
+
+#define TRAIL_ZOOM_SHIFT (16) // Fixed point used when zooming the trails
+#define TRAIL_ZOOM_THREADS (4) // At most this many threads zoom the trails
+
+// While fewer than 1 / TRAIL_SPARSE_DENSITY of the relative trails and of the
+// tiles of the true trails hold a trail, a spoke only looks at the points near
+// earlier trails and at its strong returns. See ChooseUpdate().
+//
+// For the true trails the points near earlier trails are kept per spoke as a
+// bit per block of TRAIL_TILE returns, see MarkTrueTile().
+#define TRAIL_BLOCK_WORD (64 * TRAIL_TILE) // returns covered by one word of blocks
+#define TRAIL_SPARSE_DENSITY (16)
+#define TRAIL_RUNS_MAX (16) // Runs kept per spoke, when there are more the last one grows
+#define TRAIL_RUN_GAP (8) // Runs closer together than this are joined
+
+// The points [start..end> of a spoke
+struct TrailRun {
+    uint16_t start;
+    uint16_t end;
+};
+
 class TrailBuffer {
+    friend class TrailZoomThread;
+    friend class RadarSnapshot;
+    friend class RadarSnapshotTest;
+
 public:
     TrailBuffer(RadarInfo* ri, size_t spokes, size_t max_spoke_len);
     ~TrailBuffer();
 
     void ClearTrails();
     void UpdateTrailPosition();
-    void UpdateTrueTrails(SpokeBearing bearing, uint8_t* data, size_t len);
-    void UpdateRelativeTrails(SpokeBearing angle, uint8_t* data, size_t len);
+    void UpdateRevolution(SpokeBearing angle);
+    bool UpdateTrueTrails(SpokeBearing bearing, uint8_t* data, size_t len, TrailRevolutionsAge* trail_age);
+    bool UpdateRelativeTrails(SpokeBearing angle, uint8_t* data, size_t len, TrailRevolutionsAge* trail_age);
 
     struct GeoPositionPixels {
         int lat;
@@ -58,23 +93,101 @@ public:
     GeoPosition m_pos;
     GeoPosition m_dif; // Fraction of a pixel expressed in lat/lon for True
                        // Motion Target Trails
-    GeoPositionPixels m_offset;
+    GeoPositionPixels m_offset; // How far the radar has moved in the true trails
+                                // grid, modulo m_trail_size
+
+    // Where the trail_age of the last spoke given to Update...Trails() may be non zero
+    TrailRun m_age_runs[TRAIL_RUNS_MAX];
+    size_t m_age_run_count;
 
 private:
-    void ShiftImageLonToCenter();
-    void ShiftImageLatToCenter();
+    void ClearTrueTrailsLat(int x, int count);
+    void ClearTrueTrailsLon(int y, int count);
     void ZoomTrails(float zoom_factor);
+    void ZoomBand(int inverse, int band, int bands);
+    TrailRevolution Newest(TrailRevolution a, TrailRevolution b);
+    void ExpireTrails();
+    void ChooseUpdate();
+    void CountTrails();
+    void BuildRuns();
+    void UpdateRelativeRuns(SpokeBearing angle, uint8_t* data, size_t len, TrailRevolutionsAge* trail_age);
+    void BuildTrueBlocks();
+    void MarkTrueTile(size_t tile);
+    void UpdateTrueRuns(SpokeBearing bearing, uint8_t* data, size_t len, TrailRevolutionsAge* trail_age);
+
+    // Number of revolutions since the trail was last hit plus one, 0 if it never was.
+    //
+    // The stamps could give ages of up to TRAIL_EXPIRE_REVOLUTIONS, but the age
+    // is clamped to TRAIL_MAX_REVOLUTIONS: it goes to the draws and to the trail
+    // texture of the shader as a byte, and m_trail_colour only has colours up to
+    // there. That covers the longest timed trail (10 minutes), and continuous
+    // trails show every age from TRAIL_MAX_REVOLUTIONS on with the same colour.
+    TrailRevolutionsAge Age(TrailRevolution trail)
+    {
+        if (trail == 0) {
+            return 0;
+        }
+        int age = (TrailRevolution)(m_revolution - trail) + 1;
+        return (age < TRAIL_MAX_REVOLUTIONS) ? (TrailRevolutionsAge)age : TRAIL_MAX_REVOLUTIONS;
+    }
+
+    // The true trails grid wraps around at its edges. Wrap() is the cheap
+    // version of Mod() for i in [-m_trail_size..2 * m_trail_size>.
+    int Wrap(int i)
+    {
+        return (i < 0) ? i + m_trail_size : (i >= m_trail_size) ? i - m_trail_size : i;
+    }
+    int Mod(int i)
+    {
+        i %= m_trail_size;
+        return (i < 0) ? i + m_trail_size : i;
+    }
+
+    // Index of point (x, y) of the true trails grid, both in [0..m_trail_size>
+    size_t TrueTrailsTile(int x, int y)
+    {
+        return (size_t)(x >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT) + (y >> TRAIL_TILE_SHIFT);
+    }
+    size_t TrueTrailsIndex(size_t tile, int x, int y)
+    {
+        return (tile << (2 * TRAIL_TILE_SHIFT)) + ((x & (TRAIL_TILE - 1)) << TRAIL_TILE_SHIFT) + (y & (TRAIL_TILE - 1));
+    }
+    size_t TrueTrailsIndex(int x, int y) { return TrueTrailsIndex(TrueTrailsTile(x, y), x, y); }
+
+    // A point of the true trails grid in tile 'tile' got its first trail
+    void AddTrueTrail(size_t tile)
+    {
+        if (m_tile_count[tile]++ == 0) {
+            m_true_tiles++;
+            if (m_sparse) {
+                MarkTrueTile(tile);
+            }
+        }
+    }
 
     RadarInfo* m_ri;
     size_t m_spokes;
     int m_max_spoke_len;
     int m_trail_size;
     double m_previous_pixels_per_meter;
+    TrailRevolution m_revolution; // Revolutions seen, skipping 0
+    SpokeBearing m_last_angle;
+
+    TrailRevolution* m_true_trails; // m_trails_size * m_trails_size, a torus in tiles
+    TrailRevolution* m_relative_trails; // m_spokes * m_max_spoke_len
+    TrailRevolution* m_copy_true_trails; // m_trails_size * m_trails_size
+    TrailRevolution* m_copy_relative_trails; // m_spokes * m_max_spoke_len
 
-    TrailRevolutionsAge* m_true_trails; // m_trails_size * m_trails_size
-    TrailRevolutionsAge* m_relative_trails; // m_spokes * m_max_spoke_len
-    TrailRevolutionsAge* m_copy_true_trails; // m_trails_size * m_trails_size
-    TrailRevolutionsAge* m_copy_relative_trails; // m_spokes * m_max_spoke_len
+    bool m_sparse; // Update the trails sparsely, see ChooseUpdate()
+    uint16_t* m_tile_count; // Number of points with a trail in each tile of m_true_trails
+    size_t m_true_tiles; // Number of tiles of m_true_trails with a trail
+    size_t m_relative_count; // Number of points of m_relative_trails with a trail
+    TrailRun* m_runs; // m_spokes * TRAIL_RUNS_MAX, where m_relative_trails may hold trails when m_sparse
+    uint8_t* m_run_count; // m_spokes
+    size_t m_run_cells; // Number of points in all m_runs
+    uint64_t* m_true_blocks; // m_spokes * m_block_words, the blocks of each spoke that may cross a tile with a trail
+    size_t m_block_words;
+    GeoPositionPixels m_blocks_offset; // m_offset when m_true_blocks was built
 };
 
 PLUGIN_END_NAMESPACE
@@ -53,63 +53,79 @@ typedef struct {
     int16_t y;
 } PointInt;
 
-// Allocated arrays are not two dimensional, so we make
-// up a macro that makes it look that way. Note the 'stride'
-// which is the length of the 2nd dimension, not the 1st.
-#define M_XY_STRIDE m_spoke_len
-#define M_XY(x, y) m_xy[x * M_XY_STRIDE + y]
-#define M_XYI(x, y) m_xyi[x * M_XY_STRIDE + y]
-
+//
+// Cartesian position of (angle, radius) in spokes and returns.
+//
+// Only the unit vector of each spoke is kept, so a point costs two
+// multiplications, and the result is exactly what a full table of points
+// would hold. The unit vectors are stored for [-spokes, 2 * spokes>, which
+// covers the angles the callers use without a modulo.
+//
+// A lookup depends on nothing but the number of spokes, so radars with the
+// same number of spokes share one: use Acquire() and Release() instead of
+// new and delete.
+//
 class PolarToCartesianLookup {
-private:
-    size_t m_spokes;
-    size_t m_spoke_len;
-    Point* m_xy;
-    PointInt* m_xyi;
-
 public:
-    PolarToCartesianLookup(size_t spokes, size_t spoke_len)
+    PolarToCartesianLookup(size_t spokes)
     {
         m_spokes = spokes;
-        m_spoke_len = spoke_len + 1;
+        m_references = 0;
+        m_next = 0;
+        m_unit = (Point*)malloc(sizeof(Point) * 3 * m_spokes);
 
-        m_xy = (Point*)malloc(sizeof(Point) * m_spokes * m_spoke_len);
-        m_xyi = (PointInt*)malloc(sizeof(PointInt) * m_spokes * m_spoke_len);
-
-        if (!m_xy || !m_xyi) {
+        if (!m_unit) {
             wxLogError(wxT("Out Of Memory, fatal!"));
             wxAbort();
         }
 
         for (size_t arc = 0; arc < m_spokes; arc++) {
-            float sine = sinf((float)arc * PI * 2 / m_spokes);
-            float cosine = cosf((float)arc * PI * 2 / m_spokes);
-            for (size_t radius = 0; radius < m_spoke_len; radius++) {
-                float x = (float)radius * cosine;
-                float y = (float)radius * sine;
-                M_XY(arc, radius).x = x;
-                M_XY(arc, radius).y = y;
-                M_XYI(arc, radius).x = (int16_t)x;
-                M_XYI(arc, radius).y = (int16_t)y;
-            }
+            Point unit;
+            unit.x = cosf((float)arc * PI * 2 / m_spokes);
+            unit.y = sinf((float)arc * PI * 2 / m_spokes);
+            m_unit[arc] = unit;
+            m_unit[arc + m_spokes] = unit;
+            m_unit[arc + 2 * m_spokes] = unit;
         }
     }
 
-    ~PolarToCartesianLookup()
-    {
-        free(m_xy);
-        free(m_xyi);
-    }
+    ~PolarToCartesianLookup() { free(m_unit); }
+
+    static PolarToCartesianLookup* Acquire(size_t spokes);
+    static void Release(PolarToCartesianLookup* lookup);
 
     // We trust that the optimizer will inline this
-    Point GetPoint(size_t angle, size_t radius)
+    Point GetPoint(int angle, size_t radius)
     {
-        return M_XY((angle + m_spokes) % m_spokes, radius);
+        const Point& unit = Unit(angle);
+        Point p;
+        p.x = (float)radius * unit.x;
+        p.y = (float)radius * unit.y;
+        return p;
     }
-    PointInt GetPointInt(size_t angle, size_t radius)
+    PointInt GetPointInt(int angle, size_t radius)
     {
-        return M_XYI((angle + m_spokes) % m_spokes, radius);
+        Point p = GetPoint(angle, radius);
+        PointInt pi;
+        pi.x = (int16_t)p.x;
+        pi.y = (int16_t)p.y;
+        return pi;
     };
+
+private:
+    size_t m_spokes;
+    Point* m_unit; // [3 * m_spokes], for angles [-m_spokes, 2 * m_spokes>
+    int m_references;
+    PolarToCartesianLookup* m_next; // Next shared lookup
+
+    const Point& Unit(int angle)
+    {
+        int spokes = (int)m_spokes;
+        if (angle < -spokes || angle >= 2 * spokes) {
+            angle %= spokes;
+        }
+        return m_unit[angle + spokes];
+    }
 };
 
 extern void DrawRoundRect(
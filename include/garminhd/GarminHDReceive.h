@@ -32,6 +32,7 @@
 #ifndef _GARMIN_HD_RECEIVE_H_
 #define _GARMIN_HD_RECEIVE_H_
 
+#include "GarminHDUnpack.h"
 #include "RadarReceive.h"
 #include "socketutil.h"
 
@@ -63,6 +64,9 @@ public:
         m_ri->m_showManualValueInAuto = true;
 
         LOG_RECEIVE(wxT("%s receive thread created"), m_ri->m_name.c_str());
+        m_unpacker = GetGarminHDUnpacker();
+        LOG_INFO(wxT("%s using %s spoke unpacker"), m_ri->m_name.c_str(),
+            m_unpacker.name);
     };
 
     ~GarminHDReceive() { }
@@ -111,6 +115,7 @@ private:
     RadarControlState m_rain_mode; // RCS_OFF, RCS_MANUAL, RCS_AUTO_1
     int m_rain_clutter; // 0..100
     int m_no_spoke_timeout;
+    GarminHDUnpacker m_unpacker; // Expands 1 bit returns to 8 bits
 
     bool UpdateScannerStatus(int status);
 
@@ -0,0 +1,67 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _GARMINHDUNPACK_H_
+#define _GARMINHDUNPACK_H_
+
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// Garmin HD radars send 1 bit per return, eight returns per byte with the
+// least significant bit first. These functions expand packed_len bytes into
+// 8 * packed_len returns of 0 or 255.
+//
+// Several implementations exist; the fastest one this CPU supports is
+// selected at runtime.
+//
+
+typedef void (*GarminHDUnpackFunction)(const uint8_t* packed, uint8_t* unpacked, size_t packed_len);
+
+struct GarminHDUnpacker {
+    const char* name;
+    GarminHDUnpackFunction unpack;
+};
+
+#define GARMIN_HD_UNPACKERS 4
+
+// Fill unpackers with all implementations that can run on this CPU, the
+// portable lookup table version first and the fastest last.
+// Returns the number of entries filled.
+size_t GetGarminHDUnpackers(GarminHDUnpacker unpackers[GARMIN_HD_UNPACKERS]);
+
+// The fastest implementation that can run on this CPU.
+GarminHDUnpacker GetGarminHDUnpacker();
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _GARMINHDUNPACK_H_ */
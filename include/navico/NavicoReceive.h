@@ -35,6 +35,7 @@
 #include "NavicoCommon.h"
 #include "RadarReceive.h"
 #include "navico/NavicoLocate.h"
+#include "navico/NavicoUnpack.h"
 #include "socketutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
@@ -53,6 +54,9 @@ PLUGIN_BEGIN_NAMESPACE
 #define SCALE_DECIDEGREES_TO_DEGREES(n) (((int)n) / 10)
 #define SCALE_DEGREES_TO_DECIDEGREES(n) (((int)n) * 10)
 
+// Maximum number of frames drained from the data socket per select() wakeup
+#define NAVICO_FRAME_BATCH 8
+
 extern SOCKET g_HaloInfoSocket;
 
 //
@@ -79,6 +83,8 @@ public:
         m_halo_sent_heading = m_halo_received_info;
         m_halo_sent_mystery = m_halo_received_info;
         m_hours = 0;
+        m_frame_arena = 0;
+        CLEAR_STRUCT(m_frame_len);
 
         m_receive_socket = GetLocalhostServerTCPSocket();
         m_send_socket = GetLocalhostSendTCPSocket(m_receive_socket);
@@ -88,7 +94,9 @@ public:
                          // of Navicolocate
         LOG_INFO(wxT("%s receive thread created, prio= %i"),
             m_ri->m_name.c_str(), GetPriority());
-        InitializeLookupData();
+        m_unpacker = GetNavicoUnpacker();
+        LOG_INFO(wxT("%s using %s spoke unpacker"), m_ri->m_name.c_str(),
+            m_unpacker.name);
 
         RadarLocationInfo info = m_ri->GetRadarLocationInfo();
         if (info.report_addr.IsNull() && !m_info.report_addr.IsNull()) {
@@ -117,8 +125,6 @@ public:
 
     ~NavicoReceive() {};
 
-    void InitializeLookupData();
-
     void* Entry(void);
     void Shutdown(void);
     wxString GetInfoStatus();
@@ -137,6 +143,8 @@ private:
     SOCKET PickNextEthernetCard();
     bool ProcessReport(const uint8_t* data, size_t len);
     void DetectedRadar(NetworkAddress& radar_address);
+    int ReceiveFrames(SOCKET socket);
+    void ProcessFrames(int frames);
     void ProcessFrame(const uint8_t* data, size_t len);
     void ReleaseInfoSocket();
     void SendHeadingPacket();
@@ -153,6 +161,10 @@ private:
     uint8_t m_next_scan;
     char m_radar_status;
     bool m_first_receive;
+    NavicoUnpacker m_unpacker; // Expands 4 bit returns to 8 bits
+
+    uint8_t* m_frame_arena; // NAVICO_FRAME_BATCH frames, allocated in Entry()
+    size_t m_frame_len[NAVICO_FRAME_BATCH]; // Received length of each frame
 
     wxLongLong m_halo_received_info; // When some mfd sent info
     wxLongLong m_halo_sent_heading; // When we send it, every 100 ms
@@ -0,0 +1,72 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _NAVICOUNPACK_H_
+#define _NAVICOUNPACK_H_
+
+#include "NavicoCommon.h"
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// Navico radars send 4 bits per return, two returns per byte with the low
+// nibble first. These functions expand packed_len bytes into 2 * packed_len
+// returns, mapping each nibble through a 16 entry table that depends on the
+// doppler mode (0 = normal, 1 = both, 2 = approaching only).
+//
+// Several implementations exist; the fastest one this CPU supports is
+// selected at runtime.
+//
+
+#define NAVICO_DOPPLER_MODES 3
+
+typedef void (*NavicoUnpackFunction)(
+    const uint8_t* packed, uint8_t* unpacked, size_t packed_len, int doppler);
+
+struct NavicoUnpacker {
+    const char* name;
+    NavicoUnpackFunction unpack;
+};
+
+#define NAVICO_UNPACKERS 4
+
+// Fill unpackers with all implementations that can run on this CPU, the
+// portable lookup table version first and the fastest last.
+// Returns the number of entries filled.
+size_t GetNavicoUnpackers(NavicoUnpacker unpackers[NAVICO_UNPACKERS]);
+
+// The fastest implementation that can run on this CPU.
+NavicoUnpacker GetNavicoUnpacker();
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _NAVICOUNPACK_H_ */
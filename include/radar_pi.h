@@ -147,6 +147,7 @@ typedef int AngleDegrees; // An angle relative to North or HeadUp. Generally
 #define LOGLEVEL_GUARD 16
 #define LOGLEVEL_ARPA 32
 #define LOGLEVEL_REPORTS 64
+#define LOGLEVEL_SPOKES 128
 #define IF_LOG_AT_LEVEL(x) if ((M_SETTINGS.verbose & (x)) != 0)
 #define IF_LOG_AT(x, y)                                                        \
     do {                                                                       \
@@ -194,6 +195,29 @@ typedef int AngleDegrees; // An angle relative to North or HeadUp. Generally
         M_PLUGIN logBinaryData(what, data, size);                              \
     }
 
+// Spoke data arrives thousands of times per second, so tracing it is only
+// compiled into debug builds, or when RADAR_PACKET_TRACE is defined.
+// LOG_BINARY_SPOKES logs every packet as it arrives, TRACE_PACKET keeps the
+// most recent ones in the radar's PacketTrace for RadarInfo::DumpPacketTrace.
+#if !defined(NDEBUG) && !defined(RADAR_PACKET_TRACE)
+#define RADAR_PACKET_TRACE
+#endif
+#ifdef RADAR_PACKET_TRACE
+#define LOG_BINARY_SPOKES(what, data, size)                                    \
+    IF_LOG_AT_LEVEL(LOGLEVEL_SPOKES)                                           \
+    {                                                                          \
+        M_PLUGIN logBinaryData(what, data, size);                              \
+    }
+#define TRACE_PACKET(ri, data, size)                                           \
+    IF_LOG_AT_LEVEL(LOGLEVEL_RECEIVE)                                          \
+    {                                                                          \
+        (ri)->m_packet_trace->Record(data, size);                              \
+    }
+#else
+#define LOG_BINARY_SPOKES(what, data, size)
+#define TRACE_PACKET(ri, data, size)
+#endif
+
 enum {
     BM_ID_RED,
     BM_ID_RED_SLAVE,
@@ -264,6 +288,9 @@ struct receive_statistics {
     int spokes;
     int broken_spokes;
     int missing_spokes;
+    int dropped_spokes; // Spokes not processed because the spoke queue was full
+    int receive_calls; // Number of receive system calls on the spoke data socket
+    int max_batch; // Largest number of packets returned by one receive call
 };
 
 typedef enum GuardZoneType { GZ_ARC, GZ_CIRCLE } GuardZoneType;
@@ -588,6 +615,7 @@ public:
 
     void NotifyRadarWindowViz();
     void NotifyControlDialog();
+    void NotifyArpaSector(RadarInfo* ri);
 
     void OnControlDialogClose(RadarInfo* ri);
     void SetDisplayMode(DisplayModeType mode);
@@ -708,6 +736,8 @@ private:
     void OnTimerNotify(wxTimerEvent& event);
     void TimedControlUpdate();
     void TimedUpdate(wxTimerEvent& event);
+    void OnArpaSector(wxThreadEvent& event);
+    void RefreshArpaTargets(size_t r);
     void ScheduleWindowRefresh();
     void SetOpenGLMode(OpenGLMode mode);
     int GetArpaTargetCount(void);
@@ -0,0 +1,61 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _RAYMARINERLE_H_
+#define _RAYMARINERLE_H_
+
+#include "radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+//
+// Raymarine scanners run-length encode their spokes: a 0x5C byte is followed
+// by a count and a value, any other byte is a literal. HD and Quantum
+// scanners send 8 bit returns, the older analogue ones pack two 4 bit
+// returns per byte which are expanded to (nibble << 4) + 0x0f.
+//
+
+#define RAYMARINE_RLE_ESCAPE (0x5c)
+
+/*
+ * Decode src[0..src_len> into dst[0..dst_len>, never reading or writing
+ * outside either buffer. Decoding stops when the input is used up or the
+ * output is full, whatever comes first.
+ *
+ * Returns the number of returns written; *consumed is set to the number of
+ * input bytes used.
+ */
+size_t RaymarineDecodeRLE(const uint8_t* src, size_t src_len, uint8_t* dst,
+    size_t dst_len, bool nibbles, size_t* consumed);
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _RAYMARINERLE_H_ */
@@ -0,0 +1,274 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Test for BlobLabeller.
+ *
+ * Labels random histories and sectors, some of which wrap past spoke 0 or
+ * cover the whole circle, and compares every blob with the one a plain
+ * flood fill of the same sector finds: the order, start, box, area,
+ * contour length, doppler flag and centroid must all be the same.
+ *
+ * As in BlobLabeller, a return is on the contour when the return before or
+ * after it on its spoke is not part of the blob, or when the same return on
+ * the spoke before or after it is not set in the history.
+ */
+
+#include "BlobLabeller.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_HISTORIES (3000)
+
+static uint32_t seed = 1;
+
+static uint32_t Random(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 8) & 0xffffff) % n;
+}
+
+static void Set(uint64_t *plane, size_t r) { plane[r >> 6] |= (uint64_t)1 << (r & 63); }
+
+// The sector to label, and the blobs a flood fill finds in it
+struct Sector {
+  SpokeHistory *history;
+  size_t spokes;
+  int angle1;
+  int n;
+  size_t r1;
+  size_t r2;
+  bool doppler;
+
+  vector<int> label;  // per return of the sector, -1 when not labelled yet
+  vector<Blob> blobs;
+
+  SpokeBearing Spoke(int a) { return ((a % (int)spokes) + spokes) % spokes; }
+
+  // Is the return set in the history, whether it is in the sector or not
+  bool IsSet(int a, int r) {
+    SpokeBearing angle = Spoke(a);
+    if (!HistoryTest(history->Plane(angle, HISTORY_UNCLAIMED), r)) {
+      return false;
+    }
+    return !doppler || HistoryTest(history->Plane(angle, HISTORY_DOPPLER), r);
+  }
+
+  // Is the return in the sector and set, k counts from angle1
+  bool In(int k, int r) { return k >= 0 && k < n && r >= (int)r1 && r < (int)r2 && IsSet(angle1 + k, r); }
+
+  int &Label(int k, int r) { return label[k * (r2 - r1) + r - r1]; }
+
+  void FloodFill() {
+    label.assign(n * (r2 - r1), -1);
+    blobs.clear();
+
+    // Each blob starts at its first return by angle and then by r
+    for (int k = 0; k < n; k++) {
+      for (int r = (int)r1; r < (int)r2; r++) {
+        if (!In(k, r) || Label(k, r) >= 0) {
+          continue;
+        }
+        vector<pair<int, int> > returns;
+        vector<pair<int, int> > todo;
+        bool wrapped = false;
+        int b = (int)blobs.size();
+
+        Label(k, r) = b;
+        todo.push_back(make_pair(k, r));
+        while (!todo.empty()) {
+          pair<int, int> p = todo.back();
+          todo.pop_back();
+          returns.push_back(p);
+
+          pair<int, int> next[4] = {make_pair(p.first, p.second - 1), make_pair(p.first, p.second + 1),
+                                    make_pair(p.first - 1, p.second), make_pair(p.first + 1, p.second)};
+          bool circle = (size_t)n == spokes && n > 1;
+          for (int i = 0; i < 4; i++) {
+            // A whole circle joins its last spoke to its first
+            if (circle && (next[i].first < 0 || next[i].first >= n) && In((next[i].first + n) % n, next[i].second)) {
+              next[i].first = (next[i].first + n) % n;
+              wrapped = true;
+            }
+            if (In(next[i].first, next[i].second) && Label(next[i].first, next[i].second) < 0) {
+              Label(next[i].first, next[i].second) = b;
+              todo.push_back(next[i]);
+            }
+          }
+        }
+
+        Blob blob;
+        blob.min_angle = angle1 + k;
+        blob.max_angle = angle1 + k;
+        blob.min_r = r;
+        blob.max_r = r;
+        blob.area = 0;
+        blob.contour_length = 0;
+        blob.doppler = false;
+        blob.angle = 0.;
+        blob.r = 0.;
+        blob.start.angle = Spoke(angle1 + k);
+        blob.start.r = r;
+        for (size_t i = 0; i < returns.size(); i++) {
+          int rk = returns[i].first;
+          int rr = returns[i].second;
+          int angle = angle1 + rk;
+          if (wrapped && rk >= n / 2) {
+            angle -= n;  // in one piece around angle1
+          }
+          blob.min_angle = wxMin(blob.min_angle, angle);
+          blob.max_angle = wxMax(blob.max_angle, angle);
+          blob.min_r = wxMin(blob.min_r, rr);
+          blob.max_r = wxMax(blob.max_r, rr);
+          blob.area++;
+          if (!In(rk, rr - 1) || !In(rk, rr + 1) || !IsSet(angle1 + rk - 1, rr) || !IsSet(angle1 + rk + 1, rr)) {
+            blob.contour_length++;
+          }
+          if (HistoryTest(history->Plane(Spoke(angle1 + rk), HISTORY_DOPPLER), rr)) {
+            blob.doppler = true;
+          }
+          blob.angle += angle;
+          blob.r += rr;
+        }
+        blob.angle /= blob.area;
+        blob.r /= blob.area;
+        blobs.push_back(blob);
+      }
+    }
+  }
+};
+
+// Random blobs of all sizes, a few rings around the radar, noise and some
+// doppler returns
+static void MakeHistory(SpokeHistory *h, size_t spokes, size_t spoke_len) {
+  h->Reset();
+  size_t blobs = Random(30);
+  for (size_t b = 0; b < blobs; b++) {
+    int angle = (int)Random(spokes);
+    int r = (int)Random(spoke_len);
+    int da = (int)Random(b % 5 == 0 ? spokes : 8);
+    int dr = (int)Random(b % 5 == 1 ? 80 : 8);
+    bool doppler = Random(3) == 0;
+    for (int a = angle - da; a <= angle + da; a++) {
+      SpokeBearing s = (SpokeBearing)((a + 2 * (int)spokes) % (int)spokes);
+      for (int rr = r - dr; rr <= r + dr; rr++) {
+        if (rr < 0 || rr >= (int)spoke_len || Random(12) == 0) {
+          continue;
+        }
+        Set(h->Plane(s, HISTORY_TARGET), rr);
+        Set(h->Plane(s, HISTORY_UNCLAIMED), rr);
+        if (doppler && Random(4) != 0) {
+          Set(h->Plane(s, HISTORY_DOPPLER), rr);
+        }
+      }
+    }
+  }
+  size_t noise = Random(4) * spokes;
+  for (size_t i = 0; i < noise; i++) {
+    SpokeBearing s = (SpokeBearing)Random(spokes);
+    size_t r = Random(spoke_len);
+    Set(h->Plane(s, HISTORY_UNCLAIMED), r);
+    if (Random(2) == 0) {
+      Set(h->Plane(s, HISTORY_DOPPLER), r);
+    }
+  }
+}
+
+static bool SameBlob(const Blob &a, const Blob &b) {
+  return a.min_angle == b.min_angle && a.max_angle == b.max_angle && a.min_r == b.min_r && a.max_r == b.max_r &&
+         a.area == b.area && a.contour_length == b.contour_length && a.doppler == b.doppler && fabs(a.angle - b.angle) < 1e-6 &&
+         fabs(a.r - b.r) < 1e-6 && a.start.angle == b.start.angle && a.start.r == b.start.r;
+}
+
+static void PrintBlob(const char *what, const Blob &b) {
+  cout << "INFO: " << what << " angle " << b.min_angle << ".." << b.max_angle << " r " << b.min_r << ".." << b.max_r << " area "
+       << b.area << " contour " << b.contour_length << " doppler " << b.doppler << " centroid " << b.angle << "," << b.r
+       << " start " << b.start.angle << "," << b.start.r << "\n";
+}
+
+int main() {
+  static const size_t geometries[][2] = {{16, 64}, {64, 100}, {250, 250}, {360, 130}};
+  BlobLabeller labeller;
+  int errors = 0;
+  int wrapping = 0;
+  int circles = 0;
+  size_t blobs = 0;
+
+  for (int n = 0; n < TEST_HISTORIES && errors < 10; n++) {
+    const size_t *g = geometries[n % ARRAY_SIZE(geometries)];
+    SpokeHistory history(g[0], g[1]);
+    Sector sector;
+
+    MakeHistory(&history, g[0], g[1]);
+    sector.history = &history;
+    sector.spokes = g[0];
+    sector.angle1 = (int)Random(3 * g[0]) - (int)g[0];
+    sector.n = Random(4) == 0 ? (int)g[0] : 1 + (int)Random(g[0]);
+    sector.r1 = Random(g[1]);
+    sector.r2 = sector.r1 + 1 + Random(history.Words() * 64 - sector.r1);
+    sector.doppler = Random(3) == 0;
+    sector.FloodFill();
+
+    labeller.Label(&history, sector.spokes, sector.angle1, sector.angle1 + sector.n, sector.r1, sector.r2, sector.doppler);
+
+    wrapping += sector.Spoke(sector.angle1) + sector.n > (int)sector.spokes;
+    circles += sector.n == (int)sector.spokes;
+    blobs += sector.blobs.size();
+    if (labeller.GetCount() != sector.blobs.size()) {
+      cout << "ERROR: history " << n << " sector " << sector.angle1 << "+" << sector.n << " r " << sector.r1 << ".." << sector.r2
+           << " has " << labeller.GetCount() << " blobs, expected " << sector.blobs.size() << "\n";
+      errors++;
+      continue;
+    }
+    for (size_t b = 0; b < sector.blobs.size(); b++) {
+      if (!SameBlob(labeller.GetBlob(b), sector.blobs[b])) {
+        cout << "ERROR: history " << n << " sector " << sector.angle1 << "+" << sector.n << " r " << sector.r1 << ".."
+             << sector.r2 << " blob " << b << " differs\n";
+        PrintBlob("got", labeller.GetBlob(b));
+        PrintBlob("expected", sector.blobs[b]);
+        errors++;
+        break;
+      }
+    }
+  }
+
+  cout << "INFO: " << blobs << " blobs in " << TEST_HISTORIES << " histories, " << wrapping
+       << " sectors across spoke 0 and " << circles << " whole circles\n";
+  if (errors == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(errors != 0 ? 1 : 0);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
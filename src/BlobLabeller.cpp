@@ -0,0 +1,228 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "BlobLabeller.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+// Number of returns in [from..to> that are set in all of the planes, p3 and
+// p4 are ignored when 0.
+static int CountSet(const uint64_t *p1, const uint64_t *p2, const uint64_t *p3, const uint64_t *p4, size_t from, size_t to) {
+  int n = 0;
+
+  while (from < to) {
+    size_t w = from >> 6;
+    size_t end = (to - (w << 6) >= 64) ? 64 : to - (w << 6);
+    uint64_t bits = p1[w] & p2[w] & HistoryMask(from & 63, end);
+    if (p3) bits &= p3[w];
+    if (p4) bits &= p4[w];
+    n += HistoryPopCount(bits);
+    from = (w << 6) + end;
+  }
+  return n;
+}
+
+BlobLabeller::BlobLabeller() {
+  m_runs = 0;
+  m_parent = 0;
+  m_blobs = 0;
+  m_run_count = 0;
+  m_run_max = 0;
+  m_blob_count = 0;
+}
+
+BlobLabeller::~BlobLabeller() {
+  free(m_runs);
+  free(m_parent);
+  free(m_blobs);
+}
+
+void BlobLabeller::Grow(size_t runs) {
+  if (runs <= m_run_max) {
+    return;
+  }
+  m_run_max = wxMax(runs, 2 * m_run_max + 256);
+  m_runs = (Run *)realloc(m_runs, m_run_max * sizeof(Run));
+  m_parent = (size_t *)realloc(m_parent, m_run_max * sizeof(size_t));
+  m_blobs = (Blob *)realloc(m_blobs, m_run_max * sizeof(Blob));
+  if (!m_runs || !m_parent || !m_blobs) {
+    wxLogError(wxT("Out Of Memory, fatal!"));
+    wxAbort();
+  }
+}
+
+size_t BlobLabeller::Find(size_t run) {
+  while (m_parent[run] != run) {
+    m_parent[run] = m_parent[m_parent[run]];
+    run = m_parent[run];
+  }
+  return run;
+}
+
+// The root of a set is always its first run, which makes it the start of the blob
+void BlobLabeller::Join(size_t a, size_t b) {
+  a = Find(a);
+  b = Find(b);
+  if (a < b) {
+    m_parent[b] = a;
+  } else if (b < a) {
+    m_parent[a] = b;
+  }
+}
+
+void BlobLabeller::Label(SpokeHistory *history, size_t spokes, int angle1, int angle2, size_t r1, size_t r2, bool doppler) {
+  int n = angle2 - angle1;
+  size_t prev_first = 0;   // runs of the previous spoke are [prev_first..prev_end>
+  size_t prev_end = 0;
+  size_t first_end = 0;    // runs of the first spoke are [0..first_end>
+  size_t words = history->Words();
+
+  m_run_count = 0;
+  m_blob_count = 0;
+  if (n <= 0 || (size_t)n > spokes || r1 >= r2 || r2 > words * 64) {
+    return;
+  }
+
+  for (int a = angle1; a < angle2; a++) {
+    SpokeBearing angle = ((a % (int)spokes) + spokes) % spokes;
+    SpokeBearing before = (angle + spokes - 1) % spokes;
+    SpokeBearing after = (angle + 1) % spokes;
+    const uint64_t *unclaimed = history->Plane(angle, HISTORY_UNCLAIMED);
+    const uint64_t *doppler_plane = history->Plane(angle, HISTORY_DOPPLER);
+    const uint64_t *and_plane = doppler ? doppler_plane : 0;
+    const uint64_t *before_plane = history->Plane(before, HISTORY_UNCLAIMED);
+    const uint64_t *after_plane = history->Plane(after, HISTORY_UNCLAIMED);
+    const uint64_t *before_and = doppler ? history->Plane(before, HISTORY_DOPPLER) : 0;
+    const uint64_t *after_and = doppler ? history->Plane(after, HISTORY_DOPPLER) : 0;
+    size_t first = m_run_count;
+    size_t p = prev_first;
+    size_t end;
+
+    for (size_t r = HistoryFindNext(unclaimed, and_plane, r1, r2); r < r2; r = HistoryFindNext(unclaimed, and_plane, end, r2)) {
+      end = HistoryFindNextClear(unclaimed, and_plane, r + 1, r2);
+      Grow(m_run_count + 1);
+
+      Run &run = m_runs[m_run_count];
+      run.angle = a;
+      run.start = (int)r;
+      run.end = (int)end;
+      run.doppler = CountSet(unclaimed, doppler_plane, 0, 0, r, end);
+      // The ends of a run are on the contour, the returns in between when
+      // the spoke before or after does not have them.
+      run.contour_length = (int)(end - r);
+      if (end - r > 2) {
+        run.contour_length -= CountSet(before_plane, after_plane, before_and, after_and, r + 1, end - 1);
+      }
+      run.wrapped = false;
+      m_parent[m_run_count] = m_run_count;
+
+      // Join the runs of the previous spoke that share an r with this one
+      while (p < prev_end && m_runs[p].end <= run.start) {
+        p++;
+      }
+      for (size_t q = p; q < prev_end && m_runs[q].start < run.end; q++) {
+        Join(q, m_run_count);
+      }
+      m_run_count++;
+    }
+    if (a == angle1) {
+      first_end = m_run_count;
+    }
+    prev_first = first;
+    prev_end = m_run_count;
+  }
+
+  if ((size_t)n == spokes && n > 1) {
+    // The last spoke is next to the first
+    size_t p = 0;
+    for (size_t q = prev_first; q < prev_end; q++) {
+      while (p < first_end && m_runs[p].end <= m_runs[q].start) {
+        p++;
+      }
+      for (size_t i = p; i < first_end && m_runs[i].start < m_runs[q].end; i++) {
+        Join(i, q);
+        m_runs[q].wrapped = true;
+      }
+    }
+    for (size_t q = prev_first; q < prev_end; q++) {
+      if (m_runs[q].wrapped) {
+        m_runs[Find(q)].wrapped = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < m_run_count; i++) {
+    Run &run = m_runs[i];
+    size_t root = Find(i);
+    int angle = run.angle;
+    int length = run.end - run.start;
+    Blob *blob;
+
+    if (root == i) {
+      run.blob = m_blob_count++;
+      blob = &m_blobs[run.blob];
+      blob->min_angle = angle;
+      blob->max_angle = angle;
+      blob->min_r = run.start;
+      blob->max_r = run.end - 1;
+      blob->area = 0;
+      blob->contour_length = 0;
+      blob->doppler = false;
+      blob->angle = 0.;
+      blob->r = 0.;
+      blob->start.angle = ((angle % (int)spokes) + spokes) % spokes;
+      blob->start.r = run.start;
+      blob->start.time = 0;
+    } else {
+      blob = &m_blobs[m_runs[root].blob];
+    }
+    if (m_runs[root].wrapped && angle >= angle1 + n / 2) {
+      // Keep the blob in one piece, around angle1
+      angle -= n;
+    }
+    blob->min_angle = wxMin(blob->min_angle, angle);
+    blob->max_angle = wxMax(blob->max_angle, angle);
+    blob->min_r = wxMin(blob->min_r, run.start);
+    blob->max_r = wxMax(blob->max_r, run.end - 1);
+    blob->area += length;
+    blob->contour_length += run.contour_length;
+    blob->doppler = blob->doppler || run.doppler > 0;
+    blob->angle += (double)angle * length;
+    blob->r += (run.start + run.end - 1) * 0.5 * length;
+  }
+
+  for (size_t b = 0; b < m_blob_count; b++) {
+    m_blobs[b].angle /= m_blobs[b].area;
+    m_blobs[b].r /= m_blobs[b].area;
+  }
+}
+
+PLUGIN_END_NAMESPACE
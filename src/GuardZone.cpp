@@ -34,8 +34,6 @@
 
 PLUGIN_BEGIN_NAMESPACE
 
-#undef TEST_GUARD_ZONE_LOCATION
-
 GuardZone::GuardZone(radar_pi* pi, RadarInfo* ri, int zone) {
   m_pi = pi;
   m_ri = ri;
@@ -52,31 +50,26 @@ GuardZone::GuardZone(radar_pi* pi, RadarInfo* ri, int zone) {
   ResetBogeys();
 }
 
-void GuardZone::ProcessSpoke(SpokeBearing angle, uint8_t* data, uint8_t* hist, size_t len) {
+/*
+ * Which returns of the spoke at angle should be counted for this zone, and is
+ * the spoke inside the zone at all? If nothing is to be counted *end < *start.
+ */
+bool GuardZone::GetSpokeRange(SpokeBearing angle, size_t len, size_t* start, size_t* end) {
   size_t range_start = m_inner_range * m_ri->m_pixels_per_meter;  // Convert from meters to [0..spoke_len_max>
   size_t range_end = m_outer_range * m_ri->m_pixels_per_meter;    // Convert from meters to [0..spoke_len_max>
   bool in_guard_zone = false;
   AngleDegrees degAngle = SCALE_SPOKES_TO_DEGREES(angle);
 
+  *start = 1;
+  *end = 0;
+
   switch (m_type) {
     case GZ_ARC:
       if ((degAngle >= m_start_bearing && degAngle < m_end_bearing) ||
           (m_start_bearing >= m_end_bearing && (degAngle >= m_start_bearing || degAngle < m_end_bearing))) {
         if (range_start < len) {
-          if (range_end > len) {
-            range_end = len;
-          }
-          for (size_t r = range_start; r <= range_end; r++) {
-            if (data[r] >= m_pi->m_settings.threshold_blue) {
-              m_running_count++;
-            }
-#ifdef TEST_GUARD_ZONE_LOCATION
-            // Zap guard zone computation location to green so this is visible on screen
-            else {
-              data[r] = m_pi->m_settings.threshold_green;
-            }
-#endif
-          }
+          *start = range_start;
+          *end = range_end;
         }
         in_guard_zone = true;
       }
@@ -84,21 +77,8 @@ void GuardZone::ProcessSpoke(SpokeBearing angle, uint8_t* data, uint8_t* hist, s
 
     case GZ_CIRCLE:
       if (range_start < len) {
-        if (range_end > len) {
-          range_end = len;
-        }
-
-        for (size_t r = range_start; r <= range_end; r++) {
-          if (data[r] >= m_pi->m_settings.threshold_blue) {
-            m_running_count++;
-          }
-#ifdef TEST_GUARD_ZONE_LOCATION
-          // Zap guard zone computation location to green so this is visible on screen
-          else {
-            data[r] = m_pi->m_settings.threshold_green;
-          }
-#endif
-        }
+        *start = range_start;
+        *end = range_end;
         if (angle > m_last_angle) {
           in_guard_zone = true;
         }
@@ -110,12 +90,22 @@ void GuardZone::ProcessSpoke(SpokeBearing angle, uint8_t* data, uint8_t* hist, s
       break;
   }
 
+  return in_guard_zone;
+}
+
+/*
+ * Add the number of returns counted in the spoke at angle, found by SpokeKernel
+ * in the range returned by GetSpokeRange, to the bogey count.
+ */
+void GuardZone::ProcessSpoke(SpokeBearing angle, bool in_guard_zone, int count) {
+  m_running_count += count;
+
   if (m_last_in_guard_zone && !in_guard_zone) {
     // last bearing that could add to m_running_count, so store as bogey_count;
     m_bogey_count = m_running_count;
     m_running_count = 0;
-    LOG_GUARD(wxT("%s angle=%d last_angle=%d guardzone=%d..%d (%d - %d) bogey_count=%d"), m_log_name.c_str(), angle, m_last_angle,
-              range_start, range_end, m_inner_range, m_outer_range, m_bogey_count);
+    LOG_GUARD(wxT("%s angle=%d last_angle=%d guardzone=%d - %d bogey_count=%d"), m_log_name.c_str(), angle, m_last_angle,
+              m_inner_range, m_outer_range, m_bogey_count);
 
     // When debugging with a static ship it is hard to find moving targets, so move
     // the guard zone instead. This slowly rotates the guard zone.
@@ -143,8 +133,7 @@ void GuardZone::SearchTargets() {
   }
   if (!m_pi->m_settings.show                       // No radar shown
       || !m_ri->GetRadarPosition(&own_pos.pos)     // No position
-      || m_pi->GetHeadingSource() == HEADING_NONE  // No heading
-      || (m_pi->GetHeadingSource() == HEADING_FIX_HDM && m_pi->m_var_source == VARIATION_SOURCE_NONE)) {
+      || !m_ri->m_arpa_history->m_heading_ok) {    // No heading
     return;
   }
   if (m_pi->m_radar[0] == 0 && m_pi->m_radar[1] == 0) {
@@ -158,14 +147,14 @@ void GuardZone::SearchTargets() {
     return;
   }
 
-  if (m_ri->m_pixels_per_meter == 0.) {
+  if (m_ri->m_arpa_history->m_pixels_per_meter == 0.) {
     return;
   }
-  size_t range_start = m_inner_range * m_ri->m_pixels_per_meter;  // Convert from meters to 0..511
-  size_t range_end = m_outer_range * m_ri->m_pixels_per_meter;    // Convert from meters to 0..511
+  size_t range_start = m_inner_range * m_ri->m_arpa_history->m_pixels_per_meter;  // Convert from meters to 0..511
+  size_t range_end = m_outer_range * m_ri->m_arpa_history->m_pixels_per_meter;    // Convert from meters to 0..511
   if (range_start < 1) range_start = 1;
   if (range_start >= range_end) return;
-  int hdt = SCALE_DEGREES_TO_SPOKES(m_pi->GetHeadingTrue());
+  int hdt = SCALE_DEGREES_TO_SPOKES(m_ri->m_arpa_history->m_hdt);
   SpokeBearing hdt_spokes = MOD_SPOKES(hdt);
   SpokeBearing start_bearing = SCALE_DEGREES_TO_SPOKES(m_start_bearing) + hdt_spokes;
   SpokeBearing end_bearing = SCALE_DEGREES_TO_SPOKES(m_end_bearing) + hdt_spokes;
@@ -184,12 +173,15 @@ void GuardZone::SearchTargets() {
     }
     if (range_end < range_start) return;
 
-    // loop with +2 increments as target must be larger than 2 pixels in width
+    // Collect the spokes that the beam has passed since the last search into
+    // sectors, and search the blobs of each sector once.
+    // Step by 2 as target must be larger than 2 pixels in width
+    int sector_start = -1;
     for (int angleIter = start_bearing; angleIter < end_bearing; angleIter += 2) {
       SpokeBearing angle = MOD_SPOKES(angleIter);
-      wxLongLong time1 = m_ri->m_history[angle].time;
+      wxLongLong time1 = m_ri->m_arpa_history->m_time[angle];
       // time2 must be timed later than the pass 2 in refresh, otherwise target may be found multiple times
-      wxLongLong time2 = m_ri->m_history[MOD_SPOKES(angle + 3 * SCAN_MARGIN)].time;
+      wxLongLong time2 = m_ri->m_arpa_history->m_time[MOD_SPOKES(angle + 3 * SCAN_MARGIN)];
 
       // check if target has been refreshed since last time
       // and if the beam has passed the target location with SCAN_MARGIN spokes
@@ -197,22 +189,19 @@ void GuardZone::SearchTargets() {
            time2 >= time1)) {  // the beam sould have passed our "angle" AND a
                                // point SCANMARGIN further set new refresh time
         m_arpa_update_time[angle] = time1;
-        for (int rrr = (int)range_start; rrr < (int)range_end; rrr++) {
-          if (m_ri->m_arpa->GetTargetCount() >= MAX_NUMBER_OF_TARGETS - 1) {
-            LOG_INFO(wxT("No more scanning for ARPA targets in loop, maximum number of targets reached"));
-            return;
-          }
-          if (m_ri->m_arpa->MultiPix(angle, rrr, 0)) {
-            // pixel found that does not belong to a known target
-            Polar pol;
-            pol.angle = angle;
-            pol.r = rrr;
-            int target_i = m_ri->m_arpa->AcquireNewARPATarget(pol, 0, 0);
-            if (target_i == -1) break;
-          }
+        if (sector_start < 0) {
+          sector_start = angleIter;
+        }
+      } else if (sector_start >= 0) {
+        if (!m_ri->m_arpa->AcquireBlobs(sector_start, angleIter, range_start, range_end, false)) {
+          return;
         }
+        sector_start = -1;
       }
     }
+    if (sector_start >= 0) {
+      m_ri->m_arpa->AcquireBlobs(sector_start, end_bearing, range_start, range_end, false);
+    }
   }
   return;
 }
@@ -0,0 +1,161 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Microbenchmark for KalmanBatch.
+ *
+ * Refreshes 100 and 500 tracks, each with a prediction, an update of the
+ * covariance and a measurement as ArpaTarget::RefreshTarget does for a
+ * target that is found, once with a KalmanFilter per track and once with
+ * one KalmanBatch for all of them. Shows the time per refresh of all tracks
+ * and checks that both give the same positions.
+ */
+
+#include <chrono>
+
+#include "Kalman.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKES (2048)
+#define BENCH_REPEAT (2000)
+#define BENCH_MAX_TRACKS (500)
+
+struct Track {
+  LocalPosition x;
+  Polar pol;
+  Polar expected;
+  double delta_time;
+};
+
+static void MakeTracks(Track *tracks, int n) {
+  uint32_t seed = 1;
+
+  for (int i = 0; i < n; i++) {
+    Track &t = tracks[i];
+    seed = seed * 1103515245 + 12345;
+    t.x.pos.lat = (double)((seed >> 8) % 10000) - 5000.;
+    seed = seed * 1103515245 + 12345;
+    t.x.pos.lon = (double)((seed >> 8) % 10000) - 5000.;
+    t.x.dlat_dt = (double)(i % 21) - 10.;
+    t.x.dlon_dt = (double)(i % 17) - 8.;
+    t.x.sd_speed_m_s = 0.;
+    t.pol.angle = (int)((seed >> 8) % BENCH_SPOKES);
+    t.pol.r = 100 + i;
+    t.expected.angle = (t.pol.angle + i % 7) % BENCH_SPOKES;
+    t.expected.r = t.pol.r - i % 5;
+    t.delta_time = 2.5;
+  }
+}
+
+// Microseconds per refresh of all n tracks, with a KalmanFilter per track
+static double RunFilters(Track *tracks, int n, LocalPosition *result) {
+  KalmanFilter *filter[BENCH_MAX_TRACKS];
+  LocalPosition x[BENCH_MAX_TRACKS];
+
+  for (int i = 0; i < n; i++) {
+    filter[i] = new KalmanFilter(BENCH_SPOKES);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    for (int i = 0; i < n; i++) {
+      x[i] = tracks[i].x;
+      filter[i]->Predict(&x[i], tracks[i].delta_time);
+      filter[i]->Update_P();
+      filter[i]->SetMeasurement(&tracks[i].pol, &x[i], &tracks[i].expected, 0.25);
+    }
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  for (int i = 0; i < n; i++) {
+    result[i] = x[i];
+    delete filter[i];
+  }
+  return elapsed.count() / BENCH_REPEAT;
+}
+
+// Microseconds per refresh of all n tracks, with one KalmanBatch
+static double RunBatch(Track *tracks, int n, LocalPosition *result) {
+  KalmanBatch batch;
+
+  batch.Resize(n);
+  auto start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    for (int i = 0; i < n; i++) {
+      batch.SetState(i, &tracks[i].x, tracks[i].delta_time);
+      batch.SetMeasured(i, &tracks[i].pol, &tracks[i].expected, 0.25, BENCH_SPOKES);
+      batch.Schedule(i, KALMAN_PREDICT | KALMAN_UPDATE_P | KALMAN_MEASURE);
+    }
+    batch.Run();
+    for (int i = 0; i < n; i++) {
+      batch.GetState(i, &result[i]);
+    }
+  }
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / BENCH_REPEAT;
+}
+
+int main() {
+  int ret = 0;
+  static const int track_counts[] = {100, 500};
+  Track tracks[BENCH_MAX_TRACKS];
+  LocalPosition filter_result[BENCH_MAX_TRACKS];
+  LocalPosition batch_result[BENCH_MAX_TRACKS];
+
+  for (size_t t = 0; t < sizeof(track_counts) / sizeof(track_counts[0]); t++) {
+    int n = track_counts[t];
+
+    MakeTracks(tracks, n);
+    double filter_us = RunFilters(tracks, n, filter_result);
+    double batch_us = RunBatch(tracks, n, batch_result);
+    cout << "INFO: " << n << " tracks: KalmanFilter " << filter_us << " us, KalmanBatch " << batch_us << " us, "
+         << filter_us / batch_us << " times faster\n";
+
+    for (int i = 0; i < n; i++) {
+      if (fabs(filter_result[i].pos.lat - batch_result[i].pos.lat) > 1.e-9 * fabs(filter_result[i].pos.lat) ||
+          fabs(filter_result[i].pos.lon - batch_result[i].pos.lon) > 1.e-9 * fabs(filter_result[i].pos.lon)) {
+        cout << "ERROR: track " << i << " of " << n << " differs\n";
+        ret = 1;
+        break;
+      }
+    }
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
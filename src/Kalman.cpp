@@ -191,6 +191,261 @@ void KalmanFilter::SetMeasurement(Polar* pol, LocalPosition* x, Polar* expected,
   return;
 }
 
+KalmanBatch::KalmanBatch() {
+  m_blocks = 0;
+  m_block_count = 0;
+  m_count = 0;
+}
+
+KalmanBatch::~KalmanBatch() { free(m_blocks); }
+
+void KalmanBatch::Resize(size_t tracks) {
+  size_t blocks = (tracks + KALMAN_BLOCK - 1) / KALMAN_BLOCK;
+
+  if (blocks > m_block_count) {
+    m_blocks = (Block *)realloc(m_blocks, blocks * sizeof(Block));
+    if (!m_blocks) {
+      wxLogError(wxT("Out Of Memory, fatal!"));
+      wxAbort();
+    }
+    memset(m_blocks + m_block_count, 0, (blocks - m_block_count) * sizeof(Block));
+    m_block_count = blocks;
+  }
+  for (size_t i = m_count; i < tracks; i++) {
+    ResetFilter(i);
+  }
+  m_count = wxMax(m_count, tracks);
+}
+
+void KalmanBatch::ResetFilter(size_t i) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+  size_t j = i % KALMAN_BLOCK;
+
+  // As in KalmanFilter::ResetFilter
+  for (int e = 0; e < 16; e++) {
+    b->P[e][j] = 0.;
+  }
+  b->P[0][j] = 20.;
+  b->P[5][j] = 20.;
+  b->P[10][j] = 4.;
+  b->P[15][j] = 4.;
+  b->a[j] = 0.;
+  b->steps[j] = 0;
+}
+
+Matrix<double, 4> KalmanBatch::GetP(size_t i) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+  Matrix<double, 4> P;
+
+  for (int e = 0; e < 16; e++) {
+    P.flatten[e] = b->P[e][i % KALMAN_BLOCK];
+  }
+  return P;
+}
+
+void KalmanBatch::SetP(size_t i, const Matrix<double, 4> &P) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+
+  for (int e = 0; e < 16; e++) {
+    b->P[e][i % KALMAN_BLOCK] = P.flatten[e];
+  }
+}
+
+void KalmanBatch::SetState(size_t i, const LocalPosition *x, double delta_time) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+  size_t j = i % KALMAN_BLOCK;
+
+  b->x[0][j] = x->pos.lat;
+  b->x[1][j] = x->pos.lon;
+  b->x[2][j] = x->dlat_dt;
+  b->x[3][j] = x->dlon_dt;
+  b->var_speed[j] = x->sd_speed_m_s * x->sd_speed_m_s;
+  b->delta_time[j] = delta_time;
+}
+
+void KalmanBatch::GetState(size_t i, LocalPosition *x) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+  size_t j = i % KALMAN_BLOCK;
+
+  x->pos.lat = b->x[0][j];
+  x->pos.lon = b->x[1][j];
+  x->dlat_dt = b->x[2][j];
+  x->dlon_dt = b->x[3][j];
+  x->sd_speed_m_s = sqrt(b->var_speed[j]);
+}
+
+void KalmanBatch::SetMeasured(size_t i, const Polar *p, const Polar *expected, double scale, size_t spokes) {
+  Block *b = &m_blocks[i / KALMAN_BLOCK];
+  size_t j = i % KALMAN_BLOCK;
+
+  // As Z in KalmanFilter::SetMeasurement
+  double z = (double)(p->angle - expected->angle);
+  if (z > spokes / 2) {
+    z -= spokes;
+  }
+  if (z < -(int)spokes / 2) {
+    z += spokes;
+  }
+  b->z[0][j] = z;
+  b->z[1][j] = (double)(p->r - expected->r);
+  b->scale[j] = scale;
+  b->c[j] = spokes / (2. * PI);
+}
+
+void KalmanBatch::Schedule(size_t i, int steps) { m_blocks[i / KALMAN_BLOCK].steps[i % KALMAN_BLOCK] |= (uint8_t)steps; }
+
+void KalmanBatch::Cancel(size_t i) { m_blocks[i / KALMAN_BLOCK].steps[i % KALMAN_BLOCK] = 0; }
+
+/*
+ * The steps below are the ones of KalmanFilter, written out. The products are summed in the
+ * same order as the matrix products of Matrix.h, leaving out the terms that are zero, so that
+ * the results are the same.
+ *
+ * Each step first computes the new values of all tracks in [from..to>, and then keeps them
+ * for the tracks that have the step scheduled. Both loops have no branches, which lets the
+ * compiler vectorize them.
+ */
+
+// Takes the values in 'next' for the tracks that have 'step' scheduled
+static void Merge(double *values, const double *next, const uint8_t *steps, int step, size_t from, size_t to) {
+  for (size_t j = from; j < to; j++) {
+    double value = values[j];
+    double next_value = next[j];
+    values[j] = (steps[j] & step) ? next_value : value;
+  }
+}
+
+// X = A * X, with A(0, 2) = A(1, 3) = delta_time
+void KalmanBatch::Predict(Block *b, size_t from, size_t to) {
+  double x0[KALMAN_BLOCK];
+  double x1[KALMAN_BLOCK];
+  double var_speed[KALMAN_BLOCK];
+
+  for (size_t j = from; j < to; j++) {
+    x0[j] = b->x[0][j] + b->delta_time[j] * b->x[2][j];
+    x1[j] = b->x[1][j] + b->delta_time[j] * b->x[3][j];
+    var_speed[j] = (b->P[10][j] + b->P[15][j]) / 2.;
+  }
+  Merge(b->x[0], x0, b->steps, KALMAN_PREDICT, from, to);
+  Merge(b->x[1], x1, b->steps, KALMAN_PREDICT, from, to);
+  Merge(b->var_speed, var_speed, b->steps, KALMAN_PREDICT, from, to);
+  Merge(b->a, b->delta_time, b->steps, KALMAN_PREDICT, from, to);
+}
+
+// P = A * P * AT + W * Q * WT
+void KalmanBatch::Update_P(Block *b, size_t from, size_t to) {
+  double p[16][KALMAN_BLOCK];
+
+  for (size_t j = from; j < to; j++) {
+    double a = b->a[j];
+    double ap[16];  // A * P
+
+    for (int c = 0; c < 4; c++) {
+      ap[0 + c] = b->P[0 + c][j] + a * b->P[8 + c][j];
+      ap[4 + c] = b->P[4 + c][j] + a * b->P[12 + c][j];
+      ap[8 + c] = b->P[8 + c][j];
+      ap[12 + c] = b->P[12 + c][j];
+    }
+    for (int r = 0; r < 16; r += 4) {
+      p[r + 0][j] = ap[r + 0] + ap[r + 2] * a;
+      p[r + 1][j] = ap[r + 1] + ap[r + 3] * a;
+      p[r + 2][j] = ap[r + 2];
+      p[r + 3][j] = ap[r + 3];
+    }
+    p[10][j] += NOISE;  // W * Q * WT only has Q(0, 0) and Q(1, 1)
+    p[15][j] += NOISE;
+  }
+  for (int e = 0; e < 16; e++) {
+    Merge(b->P[e], p[e], b->steps, KALMAN_UPDATE_P, from, to);
+  }
+}
+
+// K = P * HT * (H * P * HT + R)^-1, X = X + K * Z, P = (I - K * H) * P
+void KalmanBatch::SetMeasurement(Block *b, size_t from, size_t to) {
+  double q[KALMAN_BLOCK];
+  double p[16][KALMAN_BLOCK];
+  double x[4][KALMAN_BLOCK];
+  double var_speed[KALMAN_BLOCK];
+
+  for (size_t j = from; j < to; j++) {
+    q[j] = sqrt(b->x[1][j] * b->x[1][j] + b->x[0][j] * b->x[0][j]);
+  }
+  for (size_t j = from; j < to; j++) {
+    double lat = b->x[0][j];
+    double lon = b->x[1][j];
+    double c = b->c[j];
+    double P[16];
+
+    for (int e = 0; e < 16; e++) {
+      P[e] = b->P[e][j];
+    }
+
+    // H, only the first two columns are not zero
+    double q_sum = lon * lon + lat * lat;
+    double h00 = -c * lon / q_sum;
+    double h01 = c * lat / q_sum;
+    double h10 = lat / q[j] * b->scale[j];
+    double h11 = lon / q[j] * b->scale[j];
+
+    // H * P * HT + R and its inverse
+    double hp[2][2];
+    for (int k = 0; k < 2; k++) {
+      hp[0][k] = h00 * P[k] + h01 * P[4 + k];
+      hp[1][k] = h10 * P[k] + h11 * P[4 + k];
+    }
+    double s00 = hp[0][0] * h00 + hp[0][1] * h01 + 100.;
+    double s01 = hp[0][0] * h10 + hp[0][1] * h11;
+    double s10 = hp[1][0] * h00 + hp[1][1] * h01;
+    double s11 = hp[1][0] * h10 + hp[1][1] * h11 + 25.;
+    double det = s00 * s11 - s01 * s10;
+    double i00 = s11 / det;
+    double i11 = s00 / det;
+    double i01 = -s01 / det;
+    double i10 = -s10 / det;
+
+    for (int r = 0; r < 4; r++) {
+      double pht0 = P[r * 4] * h00 + P[r * 4 + 1] * h01;
+      double pht1 = P[r * 4] * h10 + P[r * 4 + 1] * h11;
+      double k0 = pht0 * i00 + pht1 * i10;
+      double k1 = pht0 * i01 + pht1 * i11;
+
+      x[r][j] = b->x[r][j] + (k0 * b->z[0][j] + k1 * b->z[1][j]);
+
+      double m0 = (r == 0 ? 1. : 0.) - (k0 * h00 + k1 * h10);
+      double m1 = (r == 1 ? 1. : 0.) - (k0 * h01 + k1 * h11);
+      for (int k = 0; k < 4; k++) {
+        p[r * 4 + k][j] = m0 * P[k] + m1 * P[4 + k];
+        if (r >= 2) {
+          p[r * 4 + k][j] += P[r * 4 + k];
+        }
+      }
+    }
+    var_speed[j] = (p[10][j] + p[15][j]) / 2.;
+  }
+  for (int e = 0; e < 16; e++) {
+    Merge(b->P[e], p[e], b->steps, KALMAN_MEASURE, from, to);
+  }
+  for (int r = 0; r < 4; r++) {
+    Merge(b->x[r], x[r], b->steps, KALMAN_MEASURE, from, to);
+  }
+  Merge(b->var_speed, var_speed, b->steps, KALMAN_MEASURE, from, to);
+}
+
+void KalmanBatch::Run(Block *b, size_t from, size_t to) {
+  Predict(b, from, to);
+  Update_P(b, from, to);
+  SetMeasurement(b, from, to);
+  memset(b->steps + from, 0, to - from);
+}
+
+void KalmanBatch::Run() {
+  for (size_t n = 0; n * KALMAN_BLOCK < m_count; n++) {
+    Run(&m_blocks[n], 0, wxMin(m_count - n * KALMAN_BLOCK, (size_t)KALMAN_BLOCK));
+  }
+}
+
+void KalmanBatch::Run(size_t i) { Run(&m_blocks[i / KALMAN_BLOCK], i % KALMAN_BLOCK, i % KALMAN_BLOCK + 1); }
+
 // Kalman filter to stabilize the GPS position and to calculate intermediate positions (Predict())
 GPSKalmanFilter::GPSKalmanFilter() {
   // as the measurement to state transformation is non-linear, the extended Kalman filter is used
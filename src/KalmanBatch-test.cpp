@@ -0,0 +1,165 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Test for KalmanBatch.
+ *
+ * Runs a KalmanBatch and a KalmanFilter per track through the same random
+ * predictions, covariance updates and measurements, once with Run() for all
+ * tracks and once with Run(i) per track, and checks that the state and the
+ * covariance of each track stay the same as those of its KalmanFilter.
+ *
+ * The tracks are for radars with different numbers of spokes, and a track
+ * that is reset may get another one, as when the radar type changes.
+ */
+
+#include "Kalman.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BATCH_TRACKS (150)
+#define BATCH_ROUNDS (200)
+
+static const size_t spoke_counts[] = {2048, 4096, 1440};
+
+static double Random(uint32_t *seed, double min, double max) {
+  *seed = *seed * 1103515245 + 12345;
+  return min + (max - min) * ((*seed >> 8) & 0xffff) / 65535.;
+}
+
+// The compiler may fuse a multiply and add in one of them and not in the other
+static bool Near(double a, double b) { return fabs(a - b) <= 1.e-9 * wxMax(fabs(a), fabs(b)) || fabs(a - b) < 1.e-12; }
+
+// Returns the number of tracks that differ after a round
+static int CompareBatch(bool one_by_one) {
+  KalmanBatch batch;
+  KalmanFilter *filter[BATCH_TRACKS];
+  size_t spokes[BATCH_TRACKS];
+  LocalPosition x[BATCH_TRACKS];
+  uint32_t seed = 1;
+  int differences = 0;
+
+  batch.Resize(BATCH_TRACKS);
+  for (int i = 0; i < BATCH_TRACKS; i++) {
+    spokes[i] = spoke_counts[i % ARRAY_SIZE(spoke_counts)];
+    filter[i] = new KalmanFilter(spokes[i]);
+  }
+  for (int round = 0; round < BATCH_ROUNDS; round++) {
+    for (int i = 0; i < BATCH_TRACKS; i++) {
+      static const int choices[] = {0, KALMAN_PREDICT, KALMAN_UPDATE_P, KALMAN_PREDICT | KALMAN_UPDATE_P,
+                                    KALMAN_PREDICT | KALMAN_UPDATE_P | KALMAN_MEASURE, KALMAN_UPDATE_P | KALMAN_MEASURE};
+      int steps = choices[(int)Random(&seed, 0., 5.999)];
+      double delta_time = Random(&seed, 0., 4.);
+      Polar pol, expected;
+
+      if (round == 0 || Random(&seed, 0., 1.) < 0.1) {
+        x[i].pos.lat = Random(&seed, -5000., 5000.);
+        x[i].pos.lon = Random(&seed, -5000., 5000.);
+        x[i].dlat_dt = Random(&seed, -10., 10.);
+        x[i].dlon_dt = Random(&seed, -10., 10.);
+        x[i].sd_speed_m_s = 0.;
+      }
+      if (Random(&seed, 0., 1.) < 0.02) {
+        spokes[i] = spoke_counts[(int)Random(&seed, 0., ARRAY_SIZE(spoke_counts) - 0.001)];
+        delete filter[i];
+        filter[i] = new KalmanFilter(spokes[i]);
+        batch.ResetFilter(i);
+      }
+      int n = (int)spokes[i];
+      pol.angle = (int)Random(&seed, 0., n - 1.);
+      pol.r = (int)Random(&seed, 10., 1000.);
+      expected.angle = (pol.angle + (int)Random(&seed, -20., 20.) + n) % n;
+      expected.r = pol.r + (int)Random(&seed, -20., 20.);
+      double scale = Random(&seed, 0.05, 0.5);
+
+      batch.SetState(i, &x[i], delta_time);
+      batch.SetMeasured(i, &pol, &expected, scale, spokes[i]);
+      batch.Schedule(i, steps);
+      if (steps & KALMAN_PREDICT) filter[i]->Predict(&x[i], delta_time);
+      if (steps & KALMAN_UPDATE_P) filter[i]->Update_P();
+      if (steps & KALMAN_MEASURE) filter[i]->SetMeasurement(&pol, &x[i], &expected, scale);
+      if (one_by_one) {
+        batch.Run(i);
+      }
+    }
+    if (!one_by_one) {
+      batch.Run();
+    }
+    for (int i = 0; i < BATCH_TRACKS; i++) {
+      LocalPosition y;
+      Matrix<double, 4> P = batch.GetP(i);
+
+      batch.GetState(i, &y);
+      bool same = Near(x[i].pos.lat, y.pos.lat) && Near(x[i].pos.lon, y.pos.lon) && Near(x[i].dlat_dt, y.dlat_dt) &&
+                  Near(x[i].dlon_dt, y.dlon_dt) && Near(x[i].sd_speed_m_s, y.sd_speed_m_s);
+      for (int e = 0; e < 16; e++) {
+        same = same && Near(filter[i]->P.flatten[e], P.flatten[e]);
+      }
+      if (!same) {
+        if (differences < 5) {
+          cout << "INFO: round " << round << " track " << i << " spokes " << spokes[i] << " lat=" << x[i].pos.lat << " batch "
+               << y.pos.lat << " P(0,0)=" << filter[i]->P(0, 0) << " batch " << P(0, 0) << "\n";
+        }
+        differences++;
+      }
+    }
+  }
+  for (int i = 0; i < BATCH_TRACKS; i++) {
+    delete filter[i];
+  }
+  return differences;
+}
+
+int main() {
+  int ret = 0;
+
+  int differences = CompareBatch(false);
+  if (differences > 0) {
+    cout << "ERROR: KalmanBatch::Run() differs from KalmanFilter in " << differences << " cases\n";
+    ret = 1;
+  }
+  differences = CompareBatch(true);
+  if (differences > 0) {
+    cout << "ERROR: KalmanBatch::Run(i) differs from KalmanFilter in " << differences << " cases\n";
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Microbenchmark for the cost of tracing Raymarine scan data.
+ *
+ * RaymarineReceive used to hex dump every scan data packet, formatting each
+ * byte separately. Now the dump is skipped unless LOGLEVEL_SPOKES is set, and
+ * with LOGLEVEL_RECEIVE the packet is only copied into a PacketTrace.
+ * This measures the time per packet spent on each of these.
+ *
+ * wxWidgets is not needed: the old dump is reproduced with one snprintf
+ * per byte into a std::string, which is cheaper than the wxString::Format
+ * calls it replaces, so the "before" figure is an underestimate.
+ */
+
+#include <chrono>
+#include <string>
+
+#include "PacketTrace.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_PACKET_LEN (1100)  // a typical E-120 scan data packet
+#define BENCH_PACKETS (20000)
+
+static std::string OldDump(const uint8_t *data, int size) {
+  std::string explain;
+  char buf[32];
+
+  snprintf(buf, sizeof(buf), "Scandata %d bytes: ", size);
+  explain += buf;
+  for (int i = 0; i < size; i++) {
+    if (i % 16 == 0) {
+      snprintf(buf, sizeof(buf), " \n %3d    ", i);
+      explain += buf;
+    } else if (i % 8 == 0) {
+      snprintf(buf, sizeof(buf), "  ");
+      explain += buf;
+    }
+    snprintf(buf, sizeof(buf), " %02X", data[i]);
+    explain += buf;
+  }
+  return explain;
+}
+
+int main() {
+  int ret = 0;
+  static uint8_t packet[BENCH_PACKET_LEN];
+  static uint8_t copy[PACKET_TRACE_SLOT_SIZE];
+  volatile size_t sink = 0;
+  volatile int verbose = 0;
+  PacketTrace trace;
+
+  for (size_t i = 0; i < sizeof(packet); i++) {
+    packet[i] = (uint8_t)(i * 7);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int n = 0; n < BENCH_PACKETS; n++) {
+    packet[0] = (uint8_t)n;
+    sink += OldDump(packet, sizeof(packet)).size();
+  }
+  std::chrono::duration<double, std::micro> old_time = std::chrono::steady_clock::now() - start;
+
+  // What LOG_BINARY_SPOKES costs when LOGLEVEL_SPOKES is not set
+  start = std::chrono::steady_clock::now();
+  for (int n = 0; n < BENCH_PACKETS; n++) {
+    if ((verbose & LOGLEVEL_SPOKES) != 0) {
+      sink += OldDump(packet, sizeof(packet)).size();
+    }
+  }
+  std::chrono::duration<double, std::micro> gated_time = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int n = 0; n < BENCH_PACKETS; n++) {
+    packet[0] = (uint8_t)n;
+    trace.Record(packet, sizeof(packet));
+  }
+  std::chrono::duration<double, std::micro> trace_time = std::chrono::steady_clock::now() - start;
+
+  cout << "INFO: hex dump every packet " << old_time.count() / BENCH_PACKETS << " us/packet\n";
+  cout << "INFO: dump skipped          " << gated_time.count() / BENCH_PACKETS << " us/packet\n";
+  cout << "INFO: PacketTrace::Record   " << trace_time.count() / BENCH_PACKETS << " us/packet\n";
+
+  // The trace should hold the last PACKET_TRACE_SLOTS packets
+  if (trace.Count() != BENCH_PACKETS) {
+    cout << "ERROR: trace counted " << trace.Count() << " packets\n";
+    ret = 1;
+  }
+  for (uint32_t n = 0; n < BENCH_PACKETS; n++) {
+    size_t len = 0;
+    bool kept = trace.Get(n, copy, &len);
+    if (kept != (n >= BENCH_PACKETS - PACKET_TRACE_SLOTS)) {
+      cout << "ERROR: packet " << n << (kept ? " should have been overwritten\n" : " missing\n");
+      ret = 1;
+    } else if (kept && (len != sizeof(packet) || copy[0] != (uint8_t)n || memcmp(copy + 1, packet + 1, len - 1) != 0)) {
+      cout << "ERROR: packet " << n << " differs\n";
+      ret = 1;
+    }
+  }
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
@@ -0,0 +1,482 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Test for RadarArpa::RefreshTargets.
+ *
+ * Records the spoke history of a few rotations once, and plays it twice: with
+ * all targets refreshed on this thread, and with the refresh threads helping.
+ * After every refresh the targets, their Kalman filters, the history they
+ * claimed and the messages to OpenCPN must be the same in both.
+ *
+ * The recording has boats that move, clutter that is only there for one
+ * rotation, and a few big boats across the boundary of two sectors, wider
+ * than the fence of a target reaches past it. Most rotations are played in
+ * fifths, so that the targets of a few sectors are due at a time. Every third
+ * rotation is played at once, as when the refresh is late.
+ *
+ * Only RadarArpa, the Kalman filters and the blob labeller are linked in. The
+ * parts of RadarInfo, radar_pi and OpenCPN that they use are made below.
+ */
+
+#include <wx/init.h>
+
+#include <algorithm>
+
+#include "GuardZone.h"
+#include "RadarMarpa.h"
+#include "RadarSnapshot.h"
+#include "SpokeGeometry.h"
+
+#define TEST_SPOKES (2048)
+#define TEST_SPOKE_LEN (512)
+#define TEST_PIXELS_PER_METER (TEST_SPOKE_LEN / 1852.)  // a range of 1 NM
+#define TEST_ROTATION_MILLIS (2500)
+#define TEST_ROTATIONS (12)
+#define TEST_BOATS (60)
+#define TEST_BIG_BOATS (6)
+#define TEST_CLUTTER (20)  // per rotation
+#define TEST_MIN_TRACKED (20)
+
+PLUGIN_BEGIN_NAMESPACE
+
+static GeoPosition test_radar_pos;
+static vector<wxString> test_nmea;  // What was sent to OpenCPN
+
+// radar_pi cannot be made without OpenCPN. RadarArpa only reads its settings, which are all 0 here.
+alignas(radar_pi) static char test_pi[sizeof(radar_pi)];
+
+PLUGIN_END_NAMESPACE
+
+void PushNMEABuffer(wxString str) { RadarPlugin::test_nmea.push_back(str); }
+
+void GetCanvasPixLL(PlugIn_ViewPort *vp, wxPoint *pp, double lat, double lon) {}
+
+PLUGIN_BEGIN_NAMESPACE
+
+RadarInfo::RadarInfo(radar_pi *pi, int radar) {
+  m_pi = pi;
+  m_radar = radar;
+  m_name = wxT("Radar");
+  m_spokes = TEST_SPOKES;
+  m_spoke_len_max = TEST_SPOKE_LEN;
+  m_pixels_per_meter = TEST_PIXELS_PER_METER;
+  m_min_contour_length = 6;
+  m_history = new SpokeHistory(m_spokes, m_spoke_len_max);
+  m_arpa_history = new SpokeHistory(m_spokes, m_spoke_len_max);
+  m_spoke_kernels = new SpokeKernelsFor<SpokeGeometry<TEST_SPOKES, TEST_SPOKE_LEN> >;
+  m_arpa = new RadarArpa(pi, this);
+}
+
+RadarInfo::~RadarInfo() {
+  delete m_arpa;
+  delete m_spoke_kernels;
+  delete m_arpa_history;
+  delete m_history;
+}
+
+bool RadarInfo::GetRadarPosition(GeoPosition *pos) {
+  *pos = test_radar_pos;
+  return true;
+}
+
+size_t RadarInfo::UpdateArpaHistory() {
+  wxCriticalSectionLocker lock(m_history_lock);
+
+  return m_arpa_history->Update(*m_history);
+}
+
+bool radar_pi::FindAIS_at_arpaPos(const GeoPosition &pos, const double &arpa_dist) { return false; }
+
+// Only used by RadarArpa::RefreshArpaTargets, which is not tested here
+void GuardZone::SearchTargets() {}
+void RadarSnapshot::RestoreTargets() {}
+void RadarSnapshot::SaveTargets() {}
+
+struct Boat {
+  double north;  // meters from the radar
+  double east;
+  double v_north;  // meters per second
+  double v_east;
+  double radius;  // meters
+};
+
+struct TargetTrace {
+  target_status status;
+  int id;
+  double lat;
+  double lon;
+  double speed_kn;
+  double course;
+  int lost_count;
+  int stationary;
+  int contour_length;
+  wxLongLong refresh;
+  Matrix<double, 4> P;
+};
+
+// What the targets looked like after one refresh
+struct StepTrace {
+  uint64_t history;  // hash of the claims in the history
+  vector<TargetTrace> targets;
+  vector<wxString> nmea;
+};
+
+static uint32_t seed = 1;
+
+static uint32_t Random(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 8) & 0xffffff) % n;
+}
+
+static double Random(double from, double to) { return from + (to - from) * Random(1 << 20) / (double)(1 << 20); }
+
+// A boat between returns min_r and max_r
+static Boat RandomBoat(double min_r, double max_r, double max_speed, double min_radius, double max_radius) {
+  Boat boat;
+  double bearing = Random(0., 2. * PI);
+  double distance = Random(min_r, max_r) / TEST_PIXELS_PER_METER;
+  double speed = Random(0., max_speed);
+  double course = Random(0., 2. * PI);
+
+  boat.north = distance * cos(bearing);
+  boat.east = distance * sin(bearing);
+  boat.v_north = speed * cos(course);
+  boat.v_east = speed * sin(course);
+  boat.radius = Random(min_radius, max_radius);
+  return boat;
+}
+
+// The spokes of TEST_ROTATIONS rotations, as the spoke kernel turned them into history
+static SpokeHistory *recording[TEST_ROTATIONS];
+
+// Records the rotations, the first spoke at start
+static void Record(wxLongLong start) {
+  SpokeKernelsFor<SpokeGeometry<TEST_SPOKES, TEST_SPOKE_LEN> > kernels;
+  SpokeKernelParams params;
+  vector<Boat> boats;
+  uint8_t data[TEST_SPOKE_LEN];
+
+  CLEAR_STRUCT(params);
+  params.history_threshold = 100;
+  params.guard_threshold = 255;
+
+  for (int b = 0; b < TEST_BOATS; b++) {
+    boats.push_back(RandomBoat(60., 450., 8., 6., 20.));
+  }
+  for (int b = 0; b < TEST_BIG_BOATS; b++) {
+    // About 80 spokes to either side of a sector boundary, the fence reaches 64 spokes past it
+    Boat boat;
+    double bearing = (Random(ARPA_REFRESH_SECTORS) + Random(-0.1, 0.1)) * 2. * PI / ARPA_REFRESH_SECTORS;
+    double distance = Random(550., 700.);
+    boat.north = distance * cos(bearing);
+    boat.east = distance * sin(bearing);
+    boat.v_north = 0.;
+    boat.v_east = 0.;
+    boat.radius = Random(130., 170.);
+    boats.push_back(boat);
+  }
+
+  for (int k = 0; k < TEST_ROTATIONS; k++) {
+    SpokeHistory *h = new SpokeHistory(TEST_SPOKES, TEST_SPOKE_LEN);
+
+    boats.resize(TEST_BOATS + TEST_BIG_BOATS);
+    for (int c = 0; c < TEST_CLUTTER; c++) {
+      boats.push_back(RandomBoat(30., 500., 0., 4., 10.));
+    }
+    for (size_t a = 0; a < TEST_SPOKES; a++) {
+      double t = (k + (double)a / TEST_SPOKES) * TEST_ROTATION_MILLIS / 1000.;  // seconds
+      double angle = a * 2. * PI / TEST_SPOKES;
+
+      memset(data, 0, sizeof(data));
+      for (size_t b = 0; b < boats.size(); b++) {
+        const Boat &boat = boats[b];
+        double north = boat.north + boat.v_north * t;
+        double east = boat.east + boat.v_east * t;
+        double along = north * cos(angle) + east * sin(angle);
+        double across = east * cos(angle) - north * sin(angle);
+        if (along <= 0. || fabs(across) >= boat.radius) {
+          continue;
+        }
+        double half = sqrt(boat.radius * boat.radius - across * across);
+        int r1 = wxMax((int)((along - half) * TEST_PIXELS_PER_METER), 0);
+        int r2 = wxMin((int)((along + half) * TEST_PIXELS_PER_METER), TEST_SPOKE_LEN - 1);
+        for (int r = r1; r <= r2; r++) {
+          data[r] = 200;
+        }
+      }
+      if (Random(4) == 0) {
+        data[Random(TEST_SPOKE_LEN)] = 200;  // noise
+      }
+
+      kernels.ProcessSpoke(data, TEST_SPOKE_LEN, h->Planes(a), params);
+      h->m_time[a] = start + (long)(k * TEST_ROTATION_MILLIS + a * TEST_ROTATION_MILLIS / TEST_SPOKES);
+      h->m_pos[a] = test_radar_pos;
+    }
+    recording[k] = h;
+  }
+}
+
+#define NMEA_ID (1)
+#define NMEA_NAME (11)
+
+// The fields of a message to OpenCPN without the checksum, see ArpaTarget::PassARPAtoOCPN
+static vector<string> NmeaFields(const wxString &nmea) {
+  string sentence = (const char *)nmea.mb_str();
+  vector<string> fields;
+  size_t start = 0;
+
+  sentence = sentence.substr(0, sentence.find('*'));
+  for (;;) {
+    size_t end = sentence.find(',', start);
+    fields.push_back(sentence.substr(start, end == string::npos ? string::npos : end - start));
+    if (end == string::npos) {
+      return fields;
+    }
+    start = end + 1;
+  }
+}
+
+static int NmeaId(const vector<string> &fields) { return fields.size() > NMEA_NAME ? atoi(fields[NMEA_ID].c_str()) : 0; }
+
+class RadarArpaTest {
+ public:
+  static uint64_t Hash(SpokeHistory *h) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t angle = 0; angle < TEST_SPOKES; angle++) {
+      uint64_t *planes = h->Planes(angle);
+      for (size_t w = 0; w < HISTORY_PLANES * h->Words(); w++) {
+        hash = (hash ^ planes[w]) * 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
+
+  static void Trace(RadarInfo *ri, vector<StepTrace> *trace) {
+    RadarArpa *arpa = ri->m_arpa;
+    StepTrace step;
+
+    step.history = Hash(ri->m_arpa_history);
+    for (int i = 0; i < arpa->m_number_of_targets; i++) {
+      ArpaTarget *target = arpa->m_targets[i];
+      TargetTrace t;
+      t.status = target->m_status;
+      t.id = target->m_target_id;
+      t.lat = target->m_position.pos.lat;
+      t.lon = target->m_position.pos.lon;
+      t.speed_kn = target->m_speed_kn;
+      t.course = target->m_course;
+      t.lost_count = target->m_lost_count;
+      t.stationary = target->m_stationary;
+      t.contour_length = target->m_contour_length;
+      t.refresh = target->m_refresh;
+      t.P = arpa->m_kalman->GetP(target->m_track);
+      step.targets.push_back(t);
+    }
+    step.nmea.swap(test_nmea);
+    trace->push_back(step);
+  }
+
+  // Plays the recording with the given number of refresh threads, returns how the targets went
+  static vector<StepTrace> Play(int threads, int *started) {
+    RadarInfo ri((radar_pi *)test_pi, 0);
+    RadarArpa *arpa = ri.m_arpa;
+    SpokeHistory *h = ri.m_history;
+    vector<StepTrace> trace;
+    int acquire1 = 0;
+    int acquire2 = 0;
+
+    arpa->StartRefreshThreads(threads);
+    *started = arpa->m_refresh_thread_count;
+    h->m_pixels_per_meter = TEST_PIXELS_PER_METER;
+    h->m_heading_ok = true;
+    test_nmea.clear();
+
+    for (int k = 0; k < TEST_ROTATIONS; k++) {
+      int steps = (k % 3 == 2) ? 1 : 5;
+      for (int s = 0; s < steps; s++) {
+        int angle1 = s * TEST_SPOKES / steps;
+        int angle2 = (s + 1) * TEST_SPOKES / steps;
+        for (int a = angle1; a < angle2; a++) {
+          memcpy(h->Planes(a), recording[k]->Planes(a), HISTORY_PLANES * h->Words() * sizeof(uint64_t));
+          h->m_time[a] = recording[k]->m_time[a];
+          h->m_pos[a] = recording[k]->m_pos[a];
+        }
+
+        ri.UpdateArpaHistory();
+        arpa->CleanUpLostTargets();
+        arpa->RefreshTargets(PASS1, TARGET_SEARCH_RADIUS1);
+        arpa->RefreshTargets(PASS2, TARGET_SEARCH_RADIUS2);
+        // What is left of the spokes played the step before becomes new targets, as a guard zone would
+        if (acquire2 > acquire1) {
+          arpa->AcquireBlobs(acquire1, acquire2, 20, TEST_SPOKE_LEN - 5, false);
+        }
+        acquire1 = angle1;
+        acquire2 = angle2;
+
+        Trace(&ri, &trace);
+      }
+    }
+    return trace;
+  }
+};
+
+// The smallest target id in a trace, the ids of the second play follow those of the first
+static int FirstId(const vector<StepTrace> &trace) {
+  int first = 0;
+  for (size_t s = 0; s < trace.size(); s++) {
+    for (size_t i = 0; i < trace[s].targets.size(); i++) {
+      int id = trace[s].targets[i].id;
+      if (id > 0 && (first == 0 || id < first)) {
+        first = id;
+      }
+    }
+    for (size_t m = 0; m < trace[s].nmea.size(); m++) {
+      int id = NmeaId(NmeaFields(trace[s].nmea[m]));
+      if (id > 0 && (first == 0 || id < first)) {
+        first = id;
+      }
+    }
+  }
+  return first;
+}
+
+// One line per target and message of a step, with the target ids counted from first_id
+static vector<string> Describe(const StepTrace &step, int first_id) {
+  vector<string> lines;
+  char line[1024];
+
+  snprintf(line, sizeof(line), "history %016llx", (unsigned long long)step.history);
+  lines.push_back(line);
+  for (size_t i = 0; i < step.targets.size(); i++) {
+    const TargetTrace &t = step.targets[i];
+    int n = snprintf(line, sizeof(line), "target %d status %d id %d pos %.17g,%.17g speed %.17g course %.17g", (int)i, t.status,
+                     t.id > 0 ? t.id - first_id : -1, t.lat, t.lon, t.speed_kn, t.course);
+    n += snprintf(line + n, sizeof(line) - n, " lost %d stationary %d contour %d refresh %lld P", t.lost_count, t.stationary,
+                  t.contour_length, (long long)t.refresh.GetValue());
+    for (int e = 0; e < 16; e++) {
+      n += snprintf(line + n, sizeof(line) - n, " %.17g", t.P.flatten[e]);
+    }
+    lines.push_back(line);
+  }
+  for (size_t m = 0; m < step.nmea.size(); m++) {
+    // The id and the name hold the target id, the checksum depends on them
+    vector<string> fields = NmeaFields(step.nmea[m]);
+    string nmea = "nmea";
+    int id = NmeaId(fields);
+    if (id > 0) {
+      snprintf(line, sizeof(line), "%d", id - first_id);
+      fields[NMEA_ID] = line;
+      fields[NMEA_NAME] = fields[NMEA_NAME].substr(0, fields[NMEA_NAME].find_first_of(" 0123456789")) + line;
+    }
+    for (size_t f = 0; f < fields.size(); f++) {
+      nmea += (f == 0 ? " " : ",") + fields[f];
+    }
+    lines.push_back(nmea);
+  }
+  return lines;
+}
+
+int main() {
+  wxInitializer initializer;
+  int ret = 0;
+
+  if (!initializer) {
+    cout << "ERROR: cannot initialize wxWidgets\n";
+    exit(1);
+  }
+  test_radar_pos.lat = 52.;
+  test_radar_pos.lon = 4.;
+  // An hour from now, so that PrepareRefresh never finds a target that has not been refreshed for
+  // too long, however slow this runs
+  Record(wxGetUTCTimeMillis() + 3600 * 1000);
+
+  int serial_threads;
+  int threads;
+  vector<StepTrace> serial = RadarArpaTest::Play(0, &serial_threads);
+  vector<StepTrace> threaded = RadarArpaTest::Play(ARPA_REFRESH_THREADS - 1, &threads);
+  if (threads != ARPA_REFRESH_THREADS - 1) {
+    cout << "ERROR: " << threads << " refresh threads started instead of " << ARPA_REFRESH_THREADS - 1 << "\n";
+    ret = 1;
+  }
+
+  int serial_first = FirstId(serial);
+  int threaded_first = FirstId(threaded);
+  vector<int> ids;
+  for (size_t s = 0; s < serial.size(); s++) {
+    for (size_t i = 0; i < serial[s].targets.size(); i++) {
+      if (serial[s].targets[i].id > 0) {
+        ids.push_back(serial[s].targets[i].id);
+      }
+    }
+  }
+  sort(ids.begin(), ids.end());
+  int tracked = (int)(unique(ids.begin(), ids.end()) - ids.begin());
+  cout << "INFO: " << tracked << " targets tracked in " << serial.size() << " refreshes, " << threads << " refresh threads\n";
+  if (tracked < TEST_MIN_TRACKED) {
+    cout << "ERROR: fewer than " << TEST_MIN_TRACKED << " targets tracked\n";
+    ret = 1;
+  }
+
+  for (size_t s = 0; s < serial.size() && s < threaded.size(); s++) {
+    vector<string> a = Describe(serial[s], serial_first);
+    vector<string> b = Describe(threaded[s], threaded_first);
+    size_t l = 0;
+    while (l < a.size() && l < b.size() && a[l] == b[l]) {
+      l++;
+    }
+    if (l < a.size() || l < b.size()) {
+      cout << "ERROR: refresh " << s << " differs with refresh threads\n";
+      cout << "INFO: serial:   " << (l < a.size() ? a[l] : string("(nothing)")) << "\n";
+      cout << "INFO: threaded: " << (l < b.size() ? b[l] : string("(nothing)")) << "\n";
+      ret = 1;
+      break;
+    }
+  }
+  if (serial.size() != threaded.size()) {
+    cout << "ERROR: " << threaded.size() << " refreshes with refresh threads instead of " << serial.size() << "\n";
+    ret = 1;
+  }
+
+  for (int k = 0; k < TEST_ROTATIONS; k++) {
+    delete recording[k];
+  }
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
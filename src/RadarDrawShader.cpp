@@ -60,15 +60,30 @@ static const char *FragmentShaderText =
     "} \n";
 #endif
 
+// Where there is no echo the trail is drawn, using the age of the trail
+// in trail2d. The colour goes from trail_start in steps of trail_delta,
+// as RadarInfo::ComputeColourMap and ComputeTargetTrails do it for the
+// other drawing methods.
 static const char *FragmentShaderColorText =
     "uniform sampler2D tex2d; \n"
+    "uniform sampler2D trail2d; \n"
+    "uniform float trail_revolutions; \n"
+    "uniform float trail_step; \n"
+    "uniform vec3 trail_start; \n"
+    "uniform vec3 trail_delta; \n"
+    "uniform float trail_alpha; \n"
     "void main() \n"
     "{ \n"
     "   float d = length(gl_TexCoord[0].xy);\n"
     "   if (d >= 1.0) \n"
     "      discard; \n"
     "   float a = atan(gl_TexCoord[0].y, gl_TexCoord[0].x) / 6.28318; \n"
-    "   gl_FragColor = texture2D(tex2d, vec2(d, a)); \n"
+    "   vec4 colour = texture2D(tex2d, vec2(d, a)); \n"
+    "   float age = floor(texture2D(trail2d, vec2(d, a)).r * 255.0 + 0.5); \n"
+    "   if (colour.a == 0.0 && age >= 1.0 && age < trail_revolutions) { \n"
+    "      colour = vec4(trail_start + floor((age - 1.0) * trail_step) * trail_delta, trail_alpha); \n"
+    "   } \n"
+    "   gl_FragColor = colour; \n"
     "} \n";
 
 bool RadarDrawShader::Init(size_t spokes, size_t spoke_len_max) {
@@ -118,6 +133,18 @@ bool RadarDrawShader::Init(size_t spokes, size_t spoke_len_max) {
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+  // The trail ages, one byte per return. Ages are not interpolated.
+  glGenTextures(1, &m_trail_texture);
+  glBindTexture(GL_TEXTURE_2D, m_trail_texture);
+
+  m_trail_data = (unsigned char *)calloc(1, m_spoke_len_max * m_spokes);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, m_spoke_len_max, m_spokes, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_trail_data);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
   m_start_line = -1;
   m_lines = 0;
 
@@ -141,11 +168,89 @@ void RadarDrawShader::Reset() {
     glDeleteTextures(1, &m_texture);
     m_texture = 0;
   }
+  if (m_trail_texture) {
+    glDeleteTextures(1, &m_trail_texture);
+    m_trail_texture = 0;
+  }
 
   if (m_data) {
     free(m_data);
     m_data = 0;
   }
+  if (m_trail_data) {
+    free(m_trail_data);
+    m_trail_data = 0;
+  }
+}
+
+/*
+ * Send the lines received since the last draw, [m_start_line, m_start_line + m_lines>,
+ * to the texture that is bound.
+ */
+void RadarDrawShader::UploadLines(GLenum format, int channels, unsigned char *data) {
+  if (m_start_line + m_lines > (int)m_spokes) {
+    int end_line = (m_start_line + m_lines) % m_spokes;
+    // if the new data partly wraps past the end of the texture
+    // tell it the two parts separately
+    // First remap [0, m_end_line>
+    glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
+                    /* level =    */ 0,
+                    /* x-offset = */ 0,
+                    /* y-offset = */ 0,
+                    /* width =    */ m_spoke_len_max,
+                    /* height =   */ end_line,
+                    /* format =   */ format,
+                    /* type =     */ GL_UNSIGNED_BYTE,
+                    /* pixels =   */ data);
+    // And then remap [m_start_line, m_spokes>
+    glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
+                    /* level =    */ 0,
+                    /* x-offset = */ 0,
+                    /* y-offset = */ m_start_line,
+                    /* width =    */ m_spoke_len_max,
+                    /* height =   */ m_spokes - m_start_line,
+                    /* format =   */ format,
+                    /* type =     */ GL_UNSIGNED_BYTE,
+                    /* pixels =   */ data + m_start_line * m_spoke_len_max * channels);
+  } else {
+    // Map [m_start_line, m_end_line>
+    glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
+                    /* level =    */ 0,
+                    /* x-offset = */ 0,
+                    /* y-offset = */ m_start_line,
+                    /* width =    */ m_spoke_len_max,
+                    /* height =   */ m_lines,
+                    /* format =   */ format,
+                    /* type =     */ GL_UNSIGNED_BYTE,
+                    /* pixels =   */ data + m_start_line * m_spoke_len_max * channels);
+  }
+}
+
+/*
+ * The trail length and colours are uniforms, so changing them does not
+ * require the spokes to be processed again.
+ */
+void RadarDrawShader::SetTrailUniforms() {
+  wxColour start = m_ri->m_pi->m_settings.trail_start_colour;
+  wxColour end = m_ri->m_pi->m_settings.trail_end_colour;
+  GLfloat v[3];
+
+  Uniform1i(GetUniformLocation(m_program, "tex2d"), 0);
+  Uniform1i(GetUniformLocation(m_program, "trail2d"), 1);
+  v[0] = (GLfloat)m_ri->m_trail_revolutions;
+  Uniform1fv(GetUniformLocation(m_program, "trail_revolutions"), 1, v);
+  v[0] = (GLfloat)m_ri->m_trail_colours_per_revolution;
+  Uniform1fv(GetUniformLocation(m_program, "trail_step"), 1, v);
+  v[0] = m_alpha / 255.f;
+  Uniform1fv(GetUniformLocation(m_program, "trail_alpha"), 1, v);
+  v[0] = start.Red() / 255.f;
+  v[1] = start.Green() / 255.f;
+  v[2] = start.Blue() / 255.f;
+  Uniform3fv(GetUniformLocation(m_program, "trail_start"), 1, v);
+  v[0] = (end.Red() - start.Red()) / 255.f / BLOB_HISTORY_COLOURS;
+  v[1] = (end.Green() - start.Green()) / 255.f / BLOB_HISTORY_COLOURS;
+  v[2] = (end.Blue() - start.Blue()) / 255.f / BLOB_HISTORY_COLOURS;
+  Uniform3fv(GetUniformLocation(m_program, "trail_delta"), 1, v);
 }
 
 RadarDrawShader::~RadarDrawShader() {
@@ -157,55 +262,29 @@ RadarDrawShader::~RadarDrawShader() {
 void RadarDrawShader::DrawRadarOverlayImage(double radar_scale, double panel_rotate) {
   wxCriticalSectionLocker lock(m_exclusive);
 
-  if (!m_program || !m_texture || !m_data) {
+  if (!m_program || !m_texture || !m_data || !m_trail_texture) {
     return;
   }
 
   glPushAttrib(GL_TEXTURE_BIT);
 
   UseProgram(m_program);
+  SetTrailUniforms();
 
+  ActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, m_trail_texture);
+  if (m_start_line > -1) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    UploadLines(GL_LUMINANCE, 1, m_trail_data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+  ActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, m_texture);
 
   if (m_start_line > -1) {
     // Since the last time we have received data from [m_start_line, m_end_line>
     // so we only need to update the texture for those data lines.
-    if (m_start_line + m_lines > (int)m_spokes) {
-      int end_line = (m_start_line + m_lines) % m_spokes;
-      // if the new data partly wraps past the end of the texture
-      // tell it the two parts separately
-      // First remap [0, m_end_line>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ 0,
-                      /* width =    */ m_spoke_len_max,
-                      /* height =   */ end_line,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data);
-      // And then remap [m_start_line, m_spokes>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ m_start_line,
-                      /* width =    */ m_spoke_len_max,
-                      /* height =   */ m_spokes - m_start_line,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data + m_start_line * m_spoke_len_max * m_channels);
-    } else {
-      // Map [m_start_line, m_end_line>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ m_start_line,
-                      /* width =    */ m_spoke_len_max,
-                      /* height =   */ m_lines,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data + m_start_line * m_spoke_len_max * m_channels);
-    }
+    UploadLines(m_format, m_channels, m_data);
     m_start_line = -1;
     m_lines = 0;
   }
@@ -230,7 +309,8 @@ void RadarDrawShader::DrawRadarOverlayImage(double radar_scale, double panel_rot
 
 void RadarDrawShader::DrawRadarPanelImage(double panel_scale, double panel_rotate) { DrawRadarOverlayImage(1., 0.); }
 
-void RadarDrawShader::ProcessRadarSpoke(int transparency, SpokeBearing angle, uint8_t *data, size_t len, GeoPosition spoke_pos) {
+void RadarDrawShader::ProcessRadarSpoke(int transparency, SpokeBearing angle, uint8_t *data, size_t len, GeoPosition spoke_pos,
+                                        const uint8_t *trail_age) {
   GLubyte alpha = 255 * (MAX_OVERLAY_TRANSPARENCY - transparency) / MAX_OVERLAY_TRANSPARENCY;
   wxCriticalSectionLocker lock(m_exclusive);
 
@@ -240,12 +320,23 @@ void RadarDrawShader::ProcessRadarSpoke(int transparency, SpokeBearing angle, ui
   if (m_lines < (int)m_spokes) {
     m_lines++;
   }
+  m_alpha = alpha;
+
+  // With trails the weak returns are left to the fragment shader, which draws the trail there
+  uint8_t weak_target = trail_age ? m_ri->m_pi->m_settings.threshold_blue : 0;
+  unsigned char *t = m_trail_data + angle * m_spoke_len_max;
+  if (trail_age) {
+    memcpy(t, trail_age, len);
+    memset(t + len, 0, m_spoke_len_max - len);
+  } else {
+    memset(t, 0, m_spoke_len_max);
+  }
 
   if (m_channels == SHADER_COLOR_CHANNELS) {
     unsigned char *d = m_data + (angle * m_spoke_len_max) * m_channels;
     for (size_t r = 0; r < len; r++) {
       GLubyte strength = data[r];
-      BlobColour colour = m_ri->m_colour_map[strength];
+      BlobColour colour = strength < weak_target ? BLOB_NONE : m_ri->m_colour_map[strength];
       d[0] = m_ri->m_colour_map_rgb[colour].Red();
       d[1] = m_ri->m_colour_map_rgb[colour].Green();
       d[2] = m_ri->m_colour_map_rgb[colour].Blue();
@@ -32,6 +32,7 @@
 #include "RadarFactory.h"
 
 #include "RadarType.h"
+#include "SpokeGeometry.h"
 #include "pi_common.h"
 
 PLUGIN_BEGIN_NAMESPACE
@@ -71,6 +72,16 @@ RadarControl* RadarFactory::MakeRadarControl(size_t radarType, radar_pi* pi, Rad
   return 0;
 }
 
+SpokeKernels* RadarFactory::MakeSpokeKernels(size_t radarType) {
+  switch (radarType) {
+#define DEFINE_RADAR(t, x, s, l, a, b, c, d) \
+  case t:                                    \
+    return new SpokeKernelsFor<SpokeGeometry<s, l> >;
+#include "RadarType.h"
+  };
+  return 0;
+}
+
 size_t RadarFactory::GetRadarRanges(size_t radarType, RangeUnits units, const int** ranges) {
   size_t n = 0;
   *ranges = 0;
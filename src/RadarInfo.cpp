@@ -40,6 +40,12 @@
 #include "RadarMarpa.h"
 #include "RadarPanel.h"
 #include "RadarReceive.h"
+#include "RadarSnapshot.h"
+#include "SpokeGeometry.h"
+#include "SpokeKernel.h"
+#include "SpokeProcessor.h"
+#include "PacketTrace.h"
+#include "SpokeRing.h"
 #include "TrailBuffer.h"
 #include "drawutil.h"
 
@@ -62,8 +68,6 @@ RadarInfo::RadarInfo(radar_pi *pi, int radar) {
   m_timed_idle.Update(1, RCS_OFF);
   m_course_index = 0;
   m_old_range = 0;
-  m_dir_lat = 0;
-  m_dir_lon = 0;
   m_pixels_per_meter = 0.;
   m_previous_auto_range_meters = 0;
   m_previous_orientation = ORIENTATION_HEAD_UP;
@@ -71,10 +75,17 @@ RadarInfo::RadarInfo(radar_pi *pi, int radar) {
   m_radar_timeout = 0;
   m_data_timeout = 0;
   m_history = 0;
+  m_arpa_history = 0;
+  m_sector_spokes = 0;
+  m_arpa_sector_queued = false;
+  m_trail_revolutions = 0;
+  m_trail_colours_per_revolution = 0.;
   m_polar_lookup = 0;
+  m_spoke_kernels = 0;
   m_spokes = 0;
   m_spoke_len_max = 0;
   m_trails = 0;
+  m_snapshot = 0;
   m_idle_standby = 0;
   m_idle_transmit = 0;
   m_doppler_count = 0;
@@ -103,6 +114,13 @@ RadarInfo::RadarInfo(radar_pi *pi, int radar) {
   }
   m_control = 0;
   m_receive = 0;
+  m_spoke_ring = 0;
+  m_spoke_processor = 0;
+#ifdef RADAR_PACKET_TRACE
+  m_packet_trace = new PacketTrace();
+#else
+  m_packet_trace = 0;
+#endif
   m_draw_panel.draw = 0;
   m_draw_overlay.draw = 0;
   m_draw_time_ms = 1000;  // Assume really bad draw time until we actually measure it to prevent fast redraw at start
@@ -146,6 +164,22 @@ RadarInfo::RadarInfo(radar_pi *pi, int radar) {
 }
 
 void RadarInfo::Shutdown() {
+  StopSpokeThreads();
+  if (m_control_dialog) {
+    delete m_control_dialog;
+    m_control_dialog = 0;
+  }
+  if (m_radar_panel) {
+    delete m_radar_panel;
+    m_radar_panel = 0;
+  }
+}
+
+/*
+ * Stop the receive and spoke processing threads, the only ones that write
+ * the spoke buffers.
+ */
+void RadarInfo::StopSpokeThreads() {
   if (m_receive) {
     wxLongLong threadStartWait = wxGetUTCTimeMillis();
     m_receive->Shutdown();
@@ -159,13 +193,11 @@ void RadarInfo::Shutdown() {
       m_receive = 0;
     }
   }
-  if (m_control_dialog) {
-    delete m_control_dialog;
-    m_control_dialog = 0;
-  }
-  if (m_radar_panel) {
-    delete m_radar_panel;
-    m_radar_panel = 0;
+  if (m_spoke_processor) {
+    m_spoke_processor->Shutdown();
+    m_spoke_processor->Wait();
+    delete m_spoke_processor;
+    m_spoke_processor = 0;
   }
 }
 
@@ -195,6 +227,10 @@ RadarInfo::~RadarInfo() {
     delete m_arpa;
     m_arpa = 0;
   }
+  if (m_snapshot) {
+    delete m_snapshot;
+    m_snapshot = 0;
+  }
   if (m_trails) {
     delete m_trails;
     m_trails = 0;
@@ -207,17 +243,29 @@ RadarInfo::~RadarInfo() {
   }
 
   if (m_history) {
-    for (size_t i = 0; i < m_spokes; i++) {
-      if (m_history[i].line) {
-        free(m_history[i].line);
-      }
-    }
-    free(m_history);
+    delete m_history;
+    m_history = 0;
+  }
+  if (m_arpa_history) {
+    delete m_arpa_history;
+    m_arpa_history = 0;
   }
   if (m_polar_lookup) {
-    delete m_polar_lookup;
+    PolarToCartesianLookup::Release(m_polar_lookup);
     m_polar_lookup = 0;
   }
+  if (m_spoke_kernels) {
+    delete m_spoke_kernels;
+    m_spoke_kernels = 0;
+  }
+  if (m_spoke_ring) {
+    delete m_spoke_ring;
+    m_spoke_ring = 0;
+  }
+  if (m_packet_trace) {
+    delete m_packet_trace;
+    m_packet_trace = 0;
+  }
 }
 
 /**
@@ -228,15 +276,35 @@ RadarInfo::~RadarInfo() {
  * multiple times.
  */
 bool RadarInfo::Init() {
+  if (m_receive || m_spoke_processor) {
+    // Init() again, maybe for another radar type. The buffers below are made
+    // again for the spoke geometry, so first stop the threads that write
+    // them. They are started again at the end.
+    StopSpokeThreads();
+  }
   m_verbose = M_SETTINGS.verbose;
   m_name = RadarTypeName[m_radar_type];
   m_spokes = RadarSpokes[m_radar_type];
   m_spoke_len_max = RadarSpokeLenMax[m_radar_type];
-  m_history = (line_history *)calloc(sizeof(line_history), m_spokes);
-  for (size_t i = 0; i < m_spokes; i++) {
-    m_history[i].line = (uint8_t *)calloc(sizeof(uint8_t), m_spoke_len_max);
+  if (m_history) {
+    delete m_history;
+  }
+  m_history = new SpokeHistory(m_spokes, m_spoke_len_max);
+  if (m_arpa_history) {
+    delete m_arpa_history;
+  }
+  m_arpa_history = new SpokeHistory(m_spokes, m_spoke_len_max);
+  // Acquire the new lookup before releasing the old one, so that a lookup
+  // with the same number of spokes is kept instead of being made again.
+  PolarToCartesianLookup *old_lookup = m_polar_lookup;
+  m_polar_lookup = PolarToCartesianLookup::Acquire(m_spokes);
+  if (old_lookup) {
+    PolarToCartesianLookup::Release(old_lookup);
+  }
+  if (m_spoke_kernels) {
+    delete m_spoke_kernels;
   }
-  m_polar_lookup = new PolarToCartesianLookup(m_spokes, m_spoke_len_max);
+  m_spoke_kernels = RadarFactory::MakeSpokeKernels(m_radar_type);
   ComputeColourMap();
   if (!m_control) {
     m_control = RadarFactory::MakeRadarControl(m_radar_type, m_pi, this);
@@ -267,9 +335,32 @@ bool RadarInfo::Init() {
   if (!m_arpa) {
     m_arpa = new RadarArpa(m_pi, this);
   }
+  if (m_trails) {
+    delete m_trails;
+  }
   m_trails = new TrailBuffer(this, m_spokes, m_spoke_len_max);
+  // The snapshot is laid out for the trails and the spoke geometry
+  if (m_snapshot) {
+    delete m_snapshot;
+  }
+  m_snapshot = new RadarSnapshot(m_pi, this);
   ComputeTargetTrails();
   UpdateControlState(true);
+  if (m_spoke_ring && m_spoke_ring->SpokeLenMax() != m_spoke_len_max) {
+    delete m_spoke_ring;
+    m_spoke_ring = 0;
+  }
+  if (!m_spoke_ring) {
+    m_spoke_ring = new SpokeRing(SPOKE_QUEUE_SIZE, m_spoke_len_max);
+  }
+  if (!m_spoke_processor) {
+    m_spoke_processor = new SpokeProcessor(m_pi, this);
+    if (m_spoke_processor->Run() != wxTHREAD_NO_ERROR) {
+      LOG_INFO(wxT("%s unable to start spoke processing thread."), m_name.c_str());
+      delete m_spoke_processor;
+      m_spoke_processor = 0;
+    }
+  }
   if (!m_receive) {
     LOG_RECEIVE(wxT("%s starting receive thread"), m_name.c_str());
     m_receive = RadarFactory::MakeRadarReceive(m_radar_type, m_pi, this);
@@ -406,21 +497,19 @@ void RadarInfo::ResetSpokes() {
   LOG_VERBOSE(wxT("reset spokes"));
 
   CLEAR_STRUCT(zap);
-  for (size_t i = 0; i < m_spokes; i++) {
-    memset(m_history[i].line, 0, m_spoke_len_max);
-    m_history[i].time = 0;
-    m_history[i].pos.lat = 0.;
-    m_history[i].pos.lon = 0.;
+  {
+    wxCriticalSectionLocker lock(m_history_lock);
+    m_history->Reset();
   }
 
   if (m_draw_panel.draw) {
     for (size_t r = 0; r < m_spokes; r++) {
-      m_draw_panel.draw->ProcessRadarSpoke(0, r, zap, m_spoke_len_max, pos);
+      m_draw_panel.draw->ProcessRadarSpoke(0, r, zap, m_spoke_len_max, pos, 0);
     }
   }
   if (m_draw_overlay.draw) {
     for (size_t r = 0; r < m_spokes; r++) {
-      m_draw_overlay.draw->ProcessRadarSpoke(0, r, zap, m_spoke_len_max, pos);
+      m_draw_overlay.draw->ProcessRadarSpoke(0, r, zap, m_spoke_len_max, pos, 0);
     }
   }
 
@@ -449,7 +538,92 @@ void RadarInfo::CalculateRotationSpeed(SpokeBearing angle) {
 
 /*
  * A spoke of data has been received by the receive thread and it calls this (in
- * the context of the receive thread, so no UI actions can be performed here.)
+ * the context of the receive thread). The spoke is copied into m_spoke_ring, so
+ * data may be reused as soon as this returns. The caller must hold m_statistics_lock.
+ *
+ * Returns false if the spoke was dropped because the processing thread fell behind.
+ */
+bool RadarInfo::QueueRadarSpoke(SpokeBearing angle, SpokeBearing bearing, uint8_t *data, size_t len, int range_meters,
+                                wxLongLong time_rec) {
+  if (!m_spoke_ring->Push(angle, bearing, data, len, range_meters, time_rec)) {
+    m_statistics.dropped_spokes++;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Called by the receive thread when it is done queueing the spokes of a packet.
+ */
+void RadarInfo::SpokesQueued() {
+  if (m_spoke_processor) {
+    m_spoke_processor->Wakeup();
+  }
+}
+
+/*
+ * Process the spokes queued by the receive thread, in the context of the
+ * spoke processing thread.
+ *
+ * The lock is released after at most a quarter of the queue so the GUI thread
+ * is not locked out for long when the radar sends faster than we can process.
+ * Returns true if there are more spokes waiting.
+ */
+bool RadarInfo::ProcessQueuedSpokes() {
+  wxCriticalSectionLocker lock(m_exclusive);
+  QueuedSpoke *spoke;
+
+  for (int n = 0; n < SPOKE_QUEUE_SIZE / 4; n++) {
+    spoke = m_spoke_ring->Front();
+    if (!spoke) {
+      return false;
+    }
+    ProcessRadarSpoke(spoke->angle, spoke->bearing, spoke->data, spoke->len, spoke->range_meters, spoke->time_rec);
+    m_spoke_ring->Pop();
+  }
+  return m_spoke_ring->Front() != 0;
+}
+
+/*
+ * Bring m_arpa_history up to date with m_history, on the GUI thread.
+ *
+ * ARPA and the guard zones only look at m_arpa_history, so they do not need
+ * m_exclusive while they search: the spoke processor cannot change it, and
+ * there are no half written spokes in it. Only the spokes that were received
+ * again are copied, so targets claimed on the other spokes stay claimed.
+ * The scale and heading that go with the spokes are copied along, so ARPA
+ * uses those instead of the live ones. Returns the number of spokes copied.
+ */
+size_t RadarInfo::UpdateArpaHistory() {
+  wxCriticalSectionLocker lock(m_history_lock);
+
+  return m_arpa_history->Update(*m_history);
+}
+
+/*
+ * Log the packets kept by TRACE_PACKET, oldest first.
+ */
+void RadarInfo::DumpPacketTrace() {
+  uint8_t data[PACKET_TRACE_SLOT_SIZE];
+
+  if (!m_packet_trace) {
+    return;
+  }
+  uint32_t count = m_packet_trace->Count();
+  uint32_t first = (count > PACKET_TRACE_SLOTS) ? count - PACKET_TRACE_SLOTS : 0;
+  LOG_INFO(wxT("%s last %u of %u packets received"), m_name.c_str(), count - first, count);
+  for (uint32_t n = first; n < count; n++) {
+    size_t len;
+    if (m_packet_trace->Get(n, data, &len)) {
+      m_pi->logBinaryData(wxString::Format(wxT("%s packet %u"), m_name.c_str(), n), data,
+                          (int)wxMin(len, (size_t)PACKET_TRACE_SLOT_SIZE));
+    }
+  }
+}
+
+/*
+ * A queued spoke is processed by the spoke processing thread, which calls this with
+ * m_exclusive held (no UI actions can be performed here.)
  *
  * @param angle                 Bearing (relative to Boat)  at which the spoke is seen.
  * @param bearing               Bearing (relative to North) at which the spoke is seen.
@@ -461,7 +635,6 @@ void RadarInfo::CalculateRotationSpeed(SpokeBearing angle) {
 void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, uint8_t *data, size_t len, int range_meters,
                                   wxLongLong time_rec) {
   int orientation;
-  int i;
 
   SampleCourse(angle);            // Calculate course as the moving average of m_hdt over one revolution
   CalculateRotationSpeed(angle);  // Find out how fast the radar is rotating
@@ -472,19 +645,6 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, uint
     return;
   }
 
-  for (i = 0; i < m_main_bang_size.GetValue(); i++) {
-    data[i] = 0;
-  }
-  int threshold = m_threshold.GetValue();
-  if (threshold > 0) {
-    threshold = threshold * (255 - BLOB_HISTORY_MAX) / 100 + BLOB_HISTORY_MAX;
-    for (; i < (int)len; i++) {
-      if (data[i] < threshold) {
-        data[i] = 0;
-      }
-    }
-  }
-
   double pixels_per_meter = (len / (double)range_meters) * (1. - (double)m_range_adjustment.GetValue() * 0.001);
 
   if (m_pixels_per_meter != pixels_per_meter) {
@@ -513,30 +673,61 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, uint
   // with relative data.
   //
   int stabilized_mode = orientation != ORIENTATION_HEAD_UP;
-  uint8_t weakest_normal_blob = m_pi->m_settings.threshold_red;
 
-  uint8_t *hist_data = m_history[bearing].line;
-  m_history[bearing].time = time_rec;
-  memset(hist_data, 0, m_spoke_len_max);
-  GetRadarPosition(&m_history[bearing].pos);
-  for (size_t radius = 0; radius < len; radius++) {
-    if (data[radius] >= weakest_normal_blob) {
-      // and add 1 if above threshold and set the left 2 bits, used for ARPA
-      hist_data[radius] = 192;  // this is C0, 1100 0000
-    }
-    if (data[radius] == 255) {  // approaching doppler target
-      // and add 1 if above threshold and set the left 2 bits, used for ARPA
-      hist_data[radius] = 0xE0;  // this is  1110 0000, bit 3 indicates this is an approaching target
-      m_doppler_count++;
-    }
-  }
+  // Main bang, threshold, history bits and guard zone counts are all done
+  // in a single pass over the spoke by SpokeKernel.
+  SpokeKernelParams kernel;
+  GuardZone *zones[GUARD_ZONES];
+  bool in_guard_zone[GUARD_ZONES];
 
+  if (len > m_spoke_len_max) {
+    len = m_spoke_len_max;
+  }
+  kernel.main_bang = (size_t)wxMax(m_main_bang_size.GetValue(), 0);
+  kernel.threshold = m_threshold.GetValue();
+  if (kernel.threshold > 0) {
+    kernel.threshold = kernel.threshold * (255 - BLOB_HISTORY_MAX) / 100 + BLOB_HISTORY_MAX;
+  }
+  kernel.history_threshold = m_pi->m_settings.threshold_red;
+  kernel.guard_threshold = m_pi->m_settings.threshold_blue;
+  kernel.zones = 0;
   for (size_t z = 0; z < GUARD_ZONES; z++) {
     if (m_guard_zone[z]->m_alarm_on) {
-      m_guard_zone[z]->ProcessSpoke(angle, data, m_history[bearing].line, len);
+      SpokeKernelZone *kz = &kernel.zone[kernel.zones];
+      zones[kernel.zones] = m_guard_zone[z];
+      in_guard_zone[kernel.zones] = m_guard_zone[z]->GetSpokeRange(angle, len, &kz->start, &kz->end);
+      kernel.zones++;
     }
   }
 
+  m_snapshot->Restore();
+
+  GeoPosition spoke_pos;
+  GetRadarPosition(&spoke_pos);
+  HeadingSource heading_source = m_pi->GetHeadingSource();
+  bool heading_ok = heading_source != HEADING_NONE &&
+                    !(heading_source == HEADING_FIX_HDM && m_pi->GetVariationSource() == VARIATION_SOURCE_NONE);
+  double hdt = m_pi->GetHeadingTrue();
+  {
+    // A spoke is only ever seen whole by UpdateArpaHistory
+    wxCriticalSectionLocker lock(m_history_lock);
+    m_history->m_time[bearing] = time_rec;
+    m_history->m_pos[bearing] = spoke_pos;
+    m_history->m_pixels_per_meter = m_pixels_per_meter;
+    m_history->m_heading_ok = heading_ok;
+    m_history->m_hdt = hdt;
+    m_spoke_kernels->ProcessSpoke(data, len, m_history->Planes(bearing), kernel);
+  }
+  m_doppler_count += kernel.doppler_count;
+  if (++m_sector_spokes >= m_spokes / HISTORY_SECTORS) {
+    m_sector_spokes = 0;
+    m_pi->NotifyArpaSector(this);
+  }
+
+  for (size_t z = 0; z < kernel.zones; z++) {
+    zones[z]->ProcessSpoke(angle, in_guard_zone[z], kernel.zone[z].count);
+  }
+
   size_t trail_len = len;
   if (m_pi->m_settings.show_extreme_range) {
     data[len - 1] = 255;
@@ -545,22 +736,74 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, uint
 
   bool draw_trails_on_overlay = M_SETTINGS.trails_on_overlay;
   if (m_draw_overlay.draw && !draw_trails_on_overlay) {
-    m_draw_overlay.draw->ProcessRadarSpoke(M_SETTINGS.overlay_transparency.GetValue(), bearing, data, len, m_history[bearing].pos);
+    m_draw_overlay.draw->ProcessRadarSpoke(M_SETTINGS.overlay_transparency.GetValue(), bearing, data, len, m_history->m_pos[bearing],
+                                           0);
   }
   m_trails->UpdateTrailPosition();
+  m_trails->UpdateRevolution(angle);
 
   // True trails
-  m_trails->UpdateTrueTrails(bearing, data, trail_len);
+  TrailRevolutionsAge trail_age[SPOKE_LEN_MAX];
+  bool have_trails = m_trails->UpdateTrueTrails(bearing, data, trail_len, trail_age);
 
   // Relative trails
-  m_trails->UpdateRelativeTrails(angle, data, trail_len);
+  have_trails |= m_trails->UpdateRelativeTrails(angle, data, trail_len, trail_age);
+
+  // The draws that cannot colour the trails themselves get them coloured into the data
+  uint8_t trail_data[SPOKE_LEN_MAX];
+  uint8_t *coloured = data;
+  if (have_trails) {
+    for (size_t r = trail_len; r < len; r++) {
+      trail_age[r] = 0;
+    }
+    if ((m_draw_overlay.draw && draw_trails_on_overlay && !m_draw_overlay.draw->ColoursTrails()) ||
+        (m_draw_panel.draw && !m_draw_panel.draw->ColoursTrails())) {
+      ColourTrails(data, trail_age, trail_len, m_trails->m_age_runs, m_trails->m_age_run_count, trail_data);
+      memcpy(trail_data + trail_len, data + trail_len, len - trail_len);
+      coloured = trail_data;
+    }
+  }
 
   if (m_draw_overlay.draw && draw_trails_on_overlay) {
-    m_draw_overlay.draw->ProcessRadarSpoke(M_SETTINGS.overlay_transparency.GetValue(), bearing, data, len, m_history[bearing].pos);
+    if (have_trails && m_draw_overlay.draw->ColoursTrails()) {
+      m_draw_overlay.draw->ProcessRadarSpoke(M_SETTINGS.overlay_transparency.GetValue(), bearing, data, len,
+                                             m_history->m_pos[bearing], trail_age);
+    } else {
+      m_draw_overlay.draw->ProcessRadarSpoke(M_SETTINGS.overlay_transparency.GetValue(), bearing, coloured, len,
+                                             m_history->m_pos[bearing], 0);
+    }
   }
 
   if (m_draw_panel.draw) {
-    m_draw_panel.draw->ProcessRadarSpoke(4, stabilized_mode ? bearing : angle, data, len, m_history[bearing].pos);
+    if (have_trails && m_draw_panel.draw->ColoursTrails()) {
+      m_draw_panel.draw->ProcessRadarSpoke(4, stabilized_mode ? bearing : angle, data, len, m_history->m_pos[bearing], trail_age);
+    } else {
+      m_draw_panel.draw->ProcessRadarSpoke(4, stabilized_mode ? bearing : angle, coloured, len, m_history->m_pos[bearing], 0);
+    }
+  }
+
+  m_snapshot->Save(angle, bearing);
+}
+
+/*
+ * Replace the weak returns of a spoke by the colour of the trail at that point,
+ * for the draws that do not colour the trails themselves. Outside the runs the
+ * trail age is 0, which has no colour.
+ */
+void RadarInfo::ColourTrails(const uint8_t *data, const uint8_t *trail_age, size_t len, const TrailRun *runs, size_t run_count,
+                             uint8_t *coloured) {
+  uint8_t weak_target = m_pi->m_settings.threshold_blue;
+
+  for (size_t r = 0; r < len; r++) {
+    coloured[r] = (r + 1 < len && data[r] < weak_target) ? (uint8_t)BLOB_NONE : data[r];
+  }
+  for (size_t i = 0; i < run_count; i++) {
+    size_t end = wxMin((size_t)runs[i].end, len - 1);
+    for (size_t r = runs[i].start; r < end; r++) {
+      if (data[r] < weak_target) {
+        coloured[r] = (uint8_t)m_trail_colour[trail_age[r]];
+      }
+    }
   }
 }
 
@@ -605,6 +848,7 @@ void RadarInfo::UpdateTransmitState() {
   if (state == RADAR_TRANSMIT && TIMED_OUT(now, m_data_timeout)) {
     m_state.Update(RADAR_STANDBY);
     LOG_VERBOSE(wxT("%s data lost"), m_name.c_str());
+    IF_LOG_AT(LOGLEVEL_RECEIVE, DumpPacketTrace());
   }
   if (state == RADAR_STANDBY && TIMED_OUT(now, m_radar_timeout)) {
     static wxString empty;
@@ -1446,6 +1690,8 @@ void RadarInfo::ComputeTargetTrails() {
   }
 
   LOG_VERBOSE(wxT("Target trail value %d = %d revolutions"), target_trails, maxRev);
+  m_trail_revolutions = maxRev;
+  m_trail_colours_per_revolution = coloursPerRevolution;
 
   // Disperse the BLOB_HISTORY values over 0..maxrev
   for (revolution = 0; revolution <= TRAIL_MAX_REVOLUTIONS; revolution++) {
@@ -34,6 +34,8 @@
 #include "GuardZone.h"
 #include "RadarCanvas.h"
 #include "RadarInfo.h"
+#include "RadarSnapshot.h"
+#include "SpokeGeometry.h"
 #include "drawutil.h"
 #include "radar_pi.h"
 
@@ -41,30 +43,113 @@ PLUGIN_BEGIN_NAMESPACE
 
 static int target_id_count = 0;
 
+static int NewTargetId() {
+  target_id_count++;
+  if (target_id_count >= 10000) target_id_count = 1;
+  return target_id_count;
+}
+
+// Helps RadarArpa::RefreshTargets refresh the targets in the sectors of RadarArpa::m_sectors.
+// Started by the first refresh that can use it and kept until the RadarArpa is deleted.
+class ArpaRefreshThread : public wxThread {
+ public:
+  ArpaRefreshThread(RadarArpa* arpa) : wxThread(wxTHREAD_JOINABLE) { m_arpa = arpa; }
+
+  void* Entry(void) {
+    for (;;) {
+      m_arpa->m_refresh_start.Wait();
+      if (m_arpa->m_refresh_shutdown) {
+        break;
+      }
+      m_arpa->RefreshSectors(m_arpa->m_refresh_dist);
+      m_arpa->m_refresh_done.Post();
+    }
+    return 0;
+  }
+
+ private:
+  RadarArpa* m_arpa;
+};
+
 RadarArpa::RadarArpa(radar_pi* pi, RadarInfo* ri) {
   m_ri = ri;
   m_pi = pi;
   m_number_of_targets = 0;
-  CLEAR_STRUCT(m_targets);
+  m_targets_allocated = 0;
+  m_targets = 0;
+  m_kalman = new KalmanBatch;
   CLEAR_STRUCT(m_doppler_arpa_update_time);
+  m_clear_contours = false;
+  m_rotation_spokes = 0;
+  m_sector_count = 0;
+  m_sector_start[0] = 0;
+  m_next_sector = 0;
+  m_refresh_threads_started = false;
+  m_refresh_thread_count = 0;
+  m_refresh_dist = 0;
+  m_refresh_shutdown = false;
 }
 
 ArpaTarget::~ArpaTarget() {
-  if (m_kalman) {
-    delete m_kalman;
-    m_kalman = 0;
-  }
+  free(m_contour);
+  m_contour = 0;
 }
 
 RadarArpa::~RadarArpa() {
-  int n = m_number_of_targets;
+  m_refresh_shutdown = true;
+  for (int t = 0; t < m_refresh_thread_count; t++) {
+    m_refresh_start.Post();
+  }
+  for (int t = 0; t < m_refresh_thread_count; t++) {
+    m_refresh_thread[t]->Wait();
+    delete m_refresh_thread[t];
+  }
+  m_refresh_thread_count = 0;
+
+  int n = m_targets_allocated;
   m_number_of_targets = 0;
+  m_targets_allocated = 0;
   for (int i = 0; i < n; i++) {
     if (m_targets[i]) {
       delete m_targets[i];
       m_targets[i] = 0;
     }
   }
+  free(m_targets);
+  m_targets = 0;
+  delete m_kalman;
+  m_kalman = 0;
+}
+
+// Takes a target from the pool: a lost one after the targets in use, or a new one when
+// there is none. Returns 0 when there are too many targets, the last one is kept for
+// the target that deletes another one.
+ArpaTarget* RadarArpa::NewTarget(int status) {
+  if (m_number_of_targets >= MAX_NUMBER_OF_TARGETS - 1 &&
+      !(m_number_of_targets == MAX_NUMBER_OF_TARGETS - 1 && status == FOR_DELETION)) {
+    wxLogError(wxT("Error, max targets exceeded %i"), m_number_of_targets);
+    return 0;
+  }
+  if (m_number_of_targets == m_targets_allocated) {
+    int n = wxMin(wxMax(2 * m_targets_allocated, MIN_NUMBER_OF_TARGETS), MAX_NUMBER_OF_TARGETS);
+    m_targets = (ArpaTarget**)realloc(m_targets, n * sizeof(ArpaTarget*));
+    if (!m_targets) {
+      wxLogError(wxT("Out Of Memory, fatal!"));
+      wxAbort();
+    }
+    for (int i = m_targets_allocated; i < n; i++) {
+      m_targets[i] = 0;
+    }
+    m_targets_allocated = n;
+  }
+  if (!m_targets[m_number_of_targets]) {
+    ArpaTarget* target = new ArpaTarget(m_pi, m_ri);
+    target->m_kalman = m_kalman;
+    target->m_track = m_kalman->GetCount();
+    m_kalman->Resize(target->m_track + 1);
+    m_targets[m_number_of_targets] = target;
+  }
+  return m_targets[m_number_of_targets++];
 }
 
 ExtendedPosition ArpaTarget::Polar2Pos(Polar pol, ExtendedPosition own_ship) {
@@ -72,10 +157,11 @@ ExtendedPosition ArpaTarget::Polar2Pos(Polar pol, ExtendedPosition own_ship) {
   // converts in a radar image angular data r ( 0 - max_spoke_len ) and angle (0 - max_spokes) to position (lat, lon)
   // based on the own ship position own_ship
   ExtendedPosition pos;
+  double pixels_per_meter = m_ri->m_arpa_history->m_pixels_per_meter;
 
-  pos.pos.lat = own_ship.pos.lat + ((double)pol.r / m_ri->m_pixels_per_meter)  // Scale to fraction of distance from radar
+  pos.pos.lat = own_ship.pos.lat + ((double)pol.r / pixels_per_meter)  // Scale to fraction of distance from radar
                                        * cos(deg2rad(SCALE_SPOKES_TO_DEGREES(pol.angle))) / 60. / 1852.;
-  pos.pos.lon = own_ship.pos.lon + ((double)pol.r / m_ri->m_pixels_per_meter)  // Scale to fraction of distance to radar
+  pos.pos.lon = own_ship.pos.lon + ((double)pol.r / pixels_per_meter)  // Scale to fraction of distance to radar
                                        * sin(deg2rad(SCALE_SPOKES_TO_DEGREES(pol.angle))) / cos(deg2rad(own_ship.pos.lat)) / 60. /
                                        1852.;
   return pos;
@@ -87,252 +173,83 @@ Polar ArpaTarget::Pos2Polar(ExtendedPosition p, ExtendedPosition own_ship) {
   double dif_lat = p.pos.lat;
   dif_lat -= own_ship.pos.lat;
   double dif_lon = (p.pos.lon - own_ship.pos.lon) * cos(deg2rad(own_ship.pos.lat));
-  pol.r = (int)(sqrt(dif_lat * dif_lat + dif_lon * dif_lon) * 60. * 1852. * m_ri->m_pixels_per_meter + 1);
+  pol.r = (int)(sqrt(dif_lat * dif_lat + dif_lon * dif_lon) * 60. * 1852. * m_ri->m_arpa_history->m_pixels_per_meter + 1);
   pol.angle = (int)((atan2(dif_lon, dif_lat)) * (double)m_ri->m_spokes / (2. * PI) + 1);  // + 1 to minimize rounding errors
   if (pol.angle < 0) pol.angle += m_ri->m_spokes;
   return pol;
 }
 
 bool RadarArpa::Pix(int ang, int rad, bool doppler) {
-  if (rad <= 0 || rad >= (int)m_ri->m_spoke_len_max) {
-    return false;
-  }
-  int angle = MOD_SPOKES(ang);
-  bool bit0 = (m_ri->m_history[angle].line[rad] & 128) != 0;
-  bool bit2 = (m_ri->m_history[angle].line[rad] & 32) != 0;
-  if (!doppler) {
-    return (bit0);
-  } else {
-    return (bit0 && bit2);
-  }
+  return m_ri->m_spoke_kernels->Pix(m_ri->m_arpa_history, HISTORY_UNCLAIMED, doppler ? HISTORY_DOPPLER : HISTORY_NO_PLANE, ang,
+                                    rad);
 }
 
+bool ArpaTarget::OutsideFence(int ang) { return m_fence_width > 0 && (int)MOD_SPOKES(ang - m_fence_start) >= m_fence_width; }
+
 bool ArpaTarget::Pix(int ang, int rad) {
-  if (rad <= 0 || rad >= (int)m_ri->m_spoke_len_max) {
-    return false;
-  }
-  SpokeBearing angle = MOD_SPOKES(ang);
-  bool bit0 = (m_ri->m_history[angle].line[rad] & 128) > 0;
-  bool bit1 = (m_ri->m_history[angle].line[rad] & 64) > 0;
-  bool bit2 = (m_ri->m_history[angle].line[rad] & 32) > 0;
+  // When checking for duplicates targets that are already claimed count too, and
+  // when looking for doppler targets the return must be doppler as well.
+  int plane = m_check_for_duplicate ? HISTORY_TARGET : HISTORY_UNCLAIMED;
+  int and_plane = m_doppler_target > 0 ? HISTORY_DOPPLER : HISTORY_NO_PLANE;
 
-  if (m_doppler_target > 0 && !bit2) {  // we are looking for doppler targets and this is not doppler
+  if (m_fence_hit || OutsideFence(ang)) {
+    m_fence_hit = true;
     return false;
   }
-  if (m_check_for_duplicate) {
-    return (bit1);
-  } else {
-    return (bit0);
-  }
+  return m_ri->m_spoke_kernels->Pix(m_ri->m_arpa_history, plane, and_plane, ang, rad);
 }
 
-bool ArpaTarget::MultiPix(int ang, int rad) {  // checks if the blob has a contour of at least length pixels
-  // pol must start on the contour of the blob
-  // false if not
-  // if false clears out pixels of the blob in hist
-  wxCriticalSectionLocker lock(ArpaTarget::m_ri->m_exclusive);
-  int length = m_ri->m_min_contour_length;
+/*
+ * Checks if the blob has a contour of at least m_min_contour_length pixels.
+ * (ang, rad) must be on the contour of the blob, false if not. When the contour
+ * is shorter the pixels of the blob are cleared, so that it is not checked again.
+ * With a fence, see ArpaTarget::m_fence_start, the walk may stop at it and set *fence_hit.
+ */
+static bool BlobHasContour(RadarInfo* ri, int plane, int and_plane, int ang, int rad, int fence_start, int fence_width,
+                           bool* fence_hit) {
+  ContourWalk walk;
   Polar start;
+
   start.angle = ang;
   start.r = rad;
-  if (!Pix(start.angle, start.r)) {
-    return false;
+  walk.min_radius = 3;
+  walk.points = 0;
+  walk.max_points = 0;
+  walk.max_length = ri->m_min_contour_length;
+  walk.fence_start = fence_start;
+  walk.fence_width = fence_width;
+
+  int result = ri->m_spoke_kernels->TraceContour(ri->m_arpa_history, plane, and_plane, start, &walk);
+  if (result == CONTOUR_LONG) {
+    return true;
   }
-  Polar current = start;  // the 4 possible translations to move from a point on the contour to the next
-  Polar max_angle;
-  Polar min_angle;
-  Polar max_r;
-  Polar min_r;
-  Polar transl[4];  //   = { 0, 1,   1, 0,   0, -1,   -1, 0 };
-  transl[0].angle = 0;
-  transl[0].r = 1;
-  transl[1].angle = 1;
-  transl[1].r = 0;
-  transl[2].angle = 0;
-  transl[2].r = -1;
-  transl[3].angle = -1;
-  transl[3].r = 0;
-  int count = 0;
-  int aa;
-  int rr;
-  bool succes = false;
-  int index = 0;
-  max_r = current;
-  max_angle = current;
-  min_r = current;
-  min_angle = current;  // check if p inside blob
-  if (start.r >= (int)m_ri->m_spoke_len_max) {
-    return false;  //  r too large
-  }
-  if (start.r < 3) {
-    return false;  //  r too small
-  }
-  // first find the orientation of border point p
-  for (int i = 0; i < 4; i++) {
-    index = i;
-    aa = current.angle + transl[index].angle;
-    rr = current.r + transl[index].r;
-    succes = !Pix(aa, rr);
-    if (succes) break;
-  }
-  if (!succes) {
-    // single pixel blob
+  if (result == CONTOUR_FENCE) {
+    *fence_hit = true;
     return false;
   }
-  index += 1;  // determines starting direction
-  if (index > 3) index -= 4;
-  while (current.r != start.r || current.angle != start.angle || count == 0) {  // try all translations to find the next point
-    // start with the "left most" translation relative to the
-    // previous one
-    index += 3;  // we will turn left all the time if possible
-    for (int i = 0; i < 4; i++) {
-      if (index > 3) index -= 4;
-      aa = current.angle + transl[index].angle;
-      rr = current.r + transl[index].r;
-      succes = Pix(aa, rr);
-      if (succes) {  // next point found
-        break;
-      }
-      index += 1;
-    }
-    if (!succes) {
-      return false;  // no next point found (this happens when the blob consists of one single pixel)
-    }                // next point found
-    current.angle = aa;
-    current.r = rr;
-    if (count >= length) {
-      return true;
-    }
-    count++;
-    if (current.angle > max_angle.angle) {
-      max_angle = current;
-    }
-    if (current.angle < min_angle.angle) {
-      min_angle = current;
-    }
-    if (current.r > max_r.r) {
-      max_r = current;
-    }
-    if (current.r < min_r.r) {
-      min_r = current;
-    }
-  }  // contour length is less than m_min_contour_length
-     // before returning false erase this blob so we do not have to check this one again
-  if (min_angle.angle < 0) {
-    min_angle.angle += m_ri->m_spokes;
-    max_angle.angle += m_ri->m_spokes;
-  }
-  for (int a = min_angle.angle; a <= max_angle.angle; a++) {
-    for (int r = min_r.r; r <= max_r.r; r++) {
-      m_ri->m_history[MOD_SPOKES(a)].line[r] &= 63;
+  if (result == CONTOUR_CLOSED) {
+    if (walk.min_angle.angle < 0) {
+      walk.min_angle.angle += ri->m_spokes;
+      walk.max_angle.angle += ri->m_spokes;
     }
+    ri->m_spoke_kernels->ClearPixels(ri->m_arpa_history, walk.min_angle.angle, walk.max_angle.angle, walk.min_r.r,
+                                     walk.max_r.r + 1, false);
   }
   return false;
 }
 
-bool RadarArpa::MultiPix(int ang, int rad, bool doppler) {
-  // checks the blob has a contour of at least length pixels
-  // pol must start on the contour of the blob
-  // false if not
-  // if false clears out pixels of th blob in hist
-  //    wxCriticalSectionLocker lock(ArpaTarget::m_ri->m_exclusive);
-  int length = m_ri->m_min_contour_length;
-  Polar start;
-  start.angle = ang;
-  start.r = rad;
+bool ArpaTarget::MultiPix(int ang, int rad) {
+  int plane = m_check_for_duplicate ? HISTORY_TARGET : HISTORY_UNCLAIMED;
+  int and_plane = m_doppler_target > 0 ? HISTORY_DOPPLER : HISTORY_NO_PLANE;
 
-  if (!Pix(start.angle, start.r, doppler)) {
+  if (m_fence_hit) {
     return false;
   }
-  Polar current = start;  // the 4 possible translations to move from a point on the contour to the next
-  Polar max_angle;
-  Polar min_angle;
-  Polar max_r;
-  Polar min_r;
-  Polar transl[4];  //   = { 0, 1,   1, 0,   0, -1,   -1, 0 };
-  transl[0].angle = 0;
-  transl[0].r = 1;
-  transl[1].angle = 1;
-  transl[1].r = 0;
-  transl[2].angle = 0;
-  transl[2].r = -1;
-  transl[3].angle = -1;
-  transl[3].r = 0;
-  int count = 0;
-  int aa;
-  int rr;
-  bool succes = false;
-  int index = 0;
-  max_r = current;
-  max_angle = current;
-  min_r = current;
-  min_angle = current;  // check if p inside blob
-  if (start.r >= (int)m_ri->m_spoke_len_max) {
-    return false;  //  r too large
-  }
-  if (start.r < 3) {
-    return false;  //  r too small
-  }
-  // first find the orientation of border point p
-  for (int i = 0; i < 4; i++) {
-    index = i;
-    aa = current.angle + transl[index].angle;
-    rr = current.r + transl[index].r;
-    succes = !Pix(aa, rr, doppler);
-    if (succes) break;
-  }
-  if (!succes) {
-    return false;
-  }
-  index += 1;  // determines starting direction
-  if (index > 3) index -= 4;
-  while (current.r != start.r || current.angle != start.angle ||
-         count == 0) {  // try all translations to find the next point  // start with the "left most" translation relative to the
-    // previous one
-    index += 3;  // we will turn left all the time if possible
-    for (int i = 0; i < 4; i++) {
-      if (index > 3) index -= 4;
-      aa = current.angle + transl[index].angle;
-      rr = current.r + transl[index].r;
-      succes = Pix(aa, rr, doppler);
-      if (succes) {  // next point found
-        break;
-      }
-      index += 1;
-    }
-    if (!succes) {
-      return false;  // no next point found
-    }                // next point found
-    current.angle = aa;
-    current.r = rr;
-    if (count >= length) {
-      return true;
-    }
-    count++;
-    if (current.angle > max_angle.angle) {
-      max_angle = current;
-    }
-    if (current.angle < min_angle.angle) {
-      min_angle = current;
-    }
-    if (current.r > max_r.r) {
-      max_r = current;
-    }
-    if (current.r < min_r.r) {
-      min_r = current;
-    }
-  }  // contour length is less than m_min_contour_length
-  // before returning false erase this blob so we do not have to check this one again
-  if (min_angle.angle < 0) {
-    min_angle.angle += m_ri->m_spokes;
-    max_angle.angle += m_ri->m_spokes;
-  }
-  for (int a = min_angle.angle; a <= max_angle.angle; a++) {
-    for (int r = min_r.r; r <= max_r.r; r++) {
-      m_ri->m_history[MOD_SPOKES(a)].line[r] &= 63;  // 0x3F
-    }
-  }
-  return false;
+  return BlobHasContour(m_ri, plane, and_plane, ang, rad, m_fence_start, m_fence_width, &m_fence_hit);
+}
+
+bool RadarArpa::MultiPix(int ang, int rad, bool doppler) {
+  return BlobHasContour(m_ri, HISTORY_UNCLAIMED, doppler ? HISTORY_DOPPLER : HISTORY_NO_PLANE, ang, rad, 0, 0, 0);
 }
 
 void RadarArpa::AcquireNewMARPATarget(ExtendedPosition target_pos) { AcquireOrDeleteMarpaTarget(target_pos, ACQUIRE0); }
@@ -346,22 +263,13 @@ void RadarArpa::AcquireOrDeleteMarpaTarget(ExtendedPosition target_pos, int stat
   // returns in X metric coordinates of click
   // constructs Kalman filter
   // make new target
-  int i_target;
-  if (m_number_of_targets < MAX_NUMBER_OF_TARGETS - 1 ||
-      (m_number_of_targets == MAX_NUMBER_OF_TARGETS - 1 && status == FOR_DELETION)) {
-    if (m_targets[m_number_of_targets] == 0) {
-      m_targets[m_number_of_targets] = new ArpaTarget(m_pi, m_ri);
-    }
-    i_target = m_number_of_targets;
-    m_number_of_targets++;
-  } else {
-    wxLogError(wxT("Error, max targets exceeded "));
+  ArpaTarget* target = NewTarget(status);
+  if (!target) {
     return;
   }
 
   LOG_ARPA(wxT("Adding (M)ARPA target at position %f / %f"), target_pos.pos.lat, target_pos.pos.lon);
 
-  ArpaTarget* target = m_targets[i_target];
   target->m_position = target_pos;  // Expected position
   target->m_position.time = 0;
   target->m_position.dlat_dt = 0.;
@@ -372,10 +280,6 @@ void RadarArpa::AcquireOrDeleteMarpaTarget(ExtendedPosition target_pos, int stat
   target->m_min_angle.angle = 0;
   target->m_max_r.r = 0;
   target->m_min_r.r = 0;
-
-  if (!target->m_kalman) {
-    target->m_kalman = new KalmanFilter(m_ri->m_spokes);
-  }
   target->m_automatic = false;
   return;
 }
@@ -415,104 +319,41 @@ bool ArpaTarget::FindContourFromInside(Polar* pol) {  // moves pol to contour of
  * Returns 0 if ok, or a small integer on error (but nothing is done with this)
  */
 int ArpaTarget::GetContour(Polar* pol) {
-  wxCriticalSectionLocker lock(ArpaTarget::m_ri->m_exclusive);
-  // the 4 possible translations to move from a point on the contour to the next
-  Polar transl[4];  //   = { 0, 1,   1, 0,   0, -1,   -1, 0 };
-  transl[0].angle = 0;
-  transl[0].r = 1;
-
-  transl[1].angle = 1;
-  transl[1].r = 0;
-
-  transl[2].angle = 0;
-  transl[2].r = -1;
-
-  transl[3].angle = -1;
-  transl[3].r = 0;
-
-  int count = 0;
-  Polar start = *pol;
-  Polar current = *pol;
-  int aa;
-  int rr;
-
-  bool succes = false;
-  int index = 0;
-  m_max_r = current;
-  m_max_angle = current;
-  m_min_r = current;
-  m_min_angle = current;
-  // check if p inside blob
-  if (start.r >= (int)m_ri->m_spoke_len_max) {
-    return 1;  // return code 1, r too large
-  }
-  if (start.r < 4) {
-    return 2;  // return code 2, r too small
-  }
-  if (!Pix(start.angle, start.r)) {
-    return 3;  // return code 3, starting point outside blob
-  }
-  // first find the orientation of border point p
-  for (int i = 0; i < 4; i++) {
-    index = i;
-    aa = current.angle + transl[index].angle;
-    rr = current.r + transl[index].r;
-    succes = !Pix(aa, rr);
-    if (succes) break;
-  }
-  if (!succes) {
-    return 4;  // return code 4, starting point not on contour
-  }
-  index += 1;  // determines starting direction
-  if (index > 3) index -= 4;
-
-  while (current.r != start.r || current.angle != start.angle || count == 0) {
-    // try all translations to find the next point
-    // start with the "left most" translation relative to the previous one
-    index += 3;  // we will turn left all the time if possible
-    for (int i = 0; i < 4; i++) {
-      if (index > 3) index -= 4;
-      aa = current.angle + transl[index].angle;
-      rr = current.r + transl[index].r;
-      succes = Pix(aa, rr);
-      if (succes) {
-        // next point found
-
-        break;
-      }
-      index += 1;
-    }
-    if (!succes) {
-      LOG_INFO(wxT("radar_pi::RadarArpa::GetContour no next point found count= %i"), count);
-      return 7;  // return code 7, no next point found
-    }
-    // next point found
-    current.angle = aa;
-    current.r = rr;
-    if (count < MAX_CONTOUR_LENGTH - 2) {
-      m_contour[count] = current;
-    }
-    if (count == MAX_CONTOUR_LENGTH - 2) {
-      m_contour[count] = start;  // shortcut to the beginning for drawing the contour
-      current = start;           // this will cause the while to terminate
-    }
-    if (count < MAX_CONTOUR_LENGTH - 1) {
-      count++;
-    }
-    if (current.angle > m_max_angle.angle) {
-      m_max_angle = current;
-    }
-    if (current.angle < m_min_angle.angle) {
-      m_min_angle = current;
-    }
-    if (current.r > m_max_r.r) {
-      m_max_r = current;
-    }
-    if (current.r < m_min_r.r) {
-      m_min_r = current;
+  ContourWalk walk;
+  int plane = m_check_for_duplicate ? HISTORY_TARGET : HISTORY_UNCLAIMED;
+  int and_plane = m_doppler_target > 0 ? HISTORY_DOPPLER : HISTORY_NO_PLANE;
+
+  if (!m_contour) {
+    m_contour = (ContourPoint*)malloc((MAX_CONTOUR_LENGTH + 1) * sizeof(ContourPoint));
+    if (!m_contour) {
+      wxLogError(wxT("Out Of Memory, fatal!"));
+      wxAbort();
     }
   }
-  m_contour_length = count;
+  walk.min_radius = 4;
+  walk.points = m_contour;
+  walk.max_points = MAX_CONTOUR_LENGTH;
+  walk.max_length = 0;
+  walk.fence_start = m_fence_start;
+  walk.fence_width = m_fence_width;
+  if (m_fence_hit) {
+    return CONTOUR_FENCE;
+  }
+  int result = m_ri->m_spoke_kernels->TraceContour(m_ri->m_arpa_history, plane, and_plane, *pol, &walk);
+  m_max_r = walk.max_r;
+  m_max_angle = walk.max_angle;
+  m_min_r = walk.min_r;
+  m_min_angle = walk.min_angle;
+  if (result == CONTOUR_BROKEN) {
+    LOG_INFO(wxT("radar_pi::RadarArpa::GetContour no next point found count= %i"), walk.length);
+  }
+  if (result == CONTOUR_FENCE) {
+    m_fence_hit = true;
+  }
+  if (result != CONTOUR_CLOSED) {
+    return result;
+  }
+  m_contour_length = walk.length;
   //  CalculateCentroid(*target);    we better use the real centroid instead of the average, todo
   if (m_min_angle.angle < 0) {
     m_min_angle.angle += m_ri->m_spokes;
@@ -529,8 +370,8 @@ int ArpaTarget::GetContour(Polar* pol) {
     pol->angle -= m_ri->m_spokes;
   }
   pol->r = (m_max_r.r + m_min_r.r) / 2;
-  pol->time = m_ri->m_history[MOD_SPOKES(pol->angle)].time;
-  m_radar_pos = m_ri->m_history[MOD_SPOKES(pol->angle)].pos;
+  pol->time = m_ri->m_arpa_history->m_time[MOD_SPOKES(pol->angle)];
+  m_radar_pos = m_ri->m_arpa_history->m_pos[MOD_SPOKES(pol->angle)];
 
   double poslat = m_radar_pos.lat;
   double poslon = m_radar_pos.lon;
@@ -560,8 +401,8 @@ void RadarArpa::DrawContour(ArpaTarget* target) {
       return;
     }
     vertex_array[i] = m_ri->m_polar_lookup->GetPoint(angle, radius);
-    vertex_array[i].x = vertex_array[i].x / m_ri->m_pixels_per_meter;
-    vertex_array[i].y = vertex_array[i].y / m_ri->m_pixels_per_meter;
+    vertex_array[i].x = vertex_array[i].x / m_ri->m_arpa_history->m_pixels_per_meter;
+    vertex_array[i].y = vertex_array[i].y / m_ri->m_arpa_history->m_pixels_per_meter;
   }
 
   glVertexPointer(2, GL_FLOAT, 0, vertex_array);
@@ -663,28 +504,38 @@ void RadarArpa::DrawArpaTargetsPanel(double scale, double arpa_rotate) {
 }
 
 void RadarArpa::CleanUpLostTargets() {
-  // remove targets with status LOST and put them at the end
+  // remove targets with status LOST and put them at the end, keeping the others in sequence
   // adjust m_number_of_targets
-  int ii = 0;
-  while (ii < m_number_of_targets) {
-    if (m_targets[ii]) {
-      if (m_targets[ii]->m_status == LOST) {
-        // we keep the lost target for later use, destruction and construction is expensive
-        ArpaTarget* lost = m_targets[ii];
-        int len = sizeof(ArpaTarget*);
-        // move rest of larget list up to keep them in sequence
-        memmove(&m_targets[ii], &m_targets[ii] + 1, (m_number_of_targets - ii) * len);
-        m_number_of_targets--;
-        // set the lost target at the last position
-        m_targets[m_number_of_targets] = lost;
-      } else {
-        ii++;
-      }
+  // we keep the lost targets for later use, destruction and construction is expensive
+  int n = 0;
+  for (int i = 0; i < m_number_of_targets; i++) {
+    ArpaTarget* target = m_targets[i];
+    if (target && target->m_status != LOST) {
+      m_targets[i] = m_targets[n];
+      m_targets[n++] = target;
     }
   }
+  m_number_of_targets = n;
 }
 
+/*
+ * Called on the GUI thread, without m_ri->m_exclusive. Everything looked at
+ * in the spoke history comes from m_ri->m_arpa_history.
+ *
+ * Called each time a sector of spokes has been received, see
+ * radar_pi::NotifyArpaSector, so only the targets the beam just passed are
+ * refreshed. The guard zones and the doppler search look for new targets in
+ * the spokes the beam passed since their last search, and the snapshot saves
+ * all targets, which is only done once per rotation.
+ */
 void RadarArpa::RefreshArpaTargets() {
+  m_rotation_spokes += m_ri->UpdateArpaHistory();
+  m_ri->m_snapshot->RestoreTargets();
+  if (m_clear_contours.exchange(false)) {
+    for (int i = 0; i < m_number_of_targets; i++) {
+      m_targets[i]->m_contour_length = 0;
+    }
+  }
   CleanUpLostTargets();
   int target_to_delete = -1;
   // find a target with status FOR_DELETION if it is there
@@ -719,66 +570,279 @@ void RadarArpa::RefreshArpaTargets() {
     CleanUpLostTargets();
   }
 
-  ArpaTarget t;
-  KalmanFilter k(m_ri->m_spokes);
   // main target refresh loop
+  RefreshTargets(PASS1, TARGET_SEARCH_RADIUS1);
+  RefreshTargets(PASS2, TARGET_SEARCH_RADIUS2);
+
+  if (m_rotation_spokes < m_ri->m_spokes) {
+    return;
+  }
+  m_rotation_spokes = 0;
+  for (int i = 0; i < GUARD_ZONES; i++) {
+    m_ri->m_guard_zone[i]->SearchTargets();
+  }
+  if (m_ri->m_doppler.GetValue() > 0 && m_ri->m_autotrack_doppler.GetValue() > 0) {
+    SearchDopplerTargets();
+  }
+  m_ri->m_snapshot->SaveTargets();
+}
+
+/*
+ * One pass of the target refresh.
+ *
+ * The circle is divided in ARPA_REFRESH_SECTORS sectors, and each target is
+ * refreshed with the sector its position is in. First the targets in the even
+ * sectors are refreshed, then those in the odd sectors. Within a sector the
+ * targets are refreshed in order, on one thread, but the sectors are spread
+ * over up to ARPA_REFRESH_THREADS threads: the calling thread and those of
+ * StartRefreshThreads(), which wait for the next phase in between.
+ *
+ * A target may look at its own sector and half of each neighbour, so two
+ * sectors that are refreshed at the same time never look at the same spokes of
+ * the history, and the result does not depend on the timing of the threads. A
+ * target that needs to look further is put back as it was, and refreshed again
+ * when the threads are done. So are the messages to OpenCPN and the new target
+ * ids: they are sent and handed out in the order of the targets. The fences are
+ * set whenever a phase has more than one sector, also when no thread helps, so
+ * the result does not depend on the number of threads either.
+ *
+ * The Kalman filters of the targets are run together: the predictions of all
+ * targets before the search, the updates of all targets of the even or odd
+ * sectors after it.
+ */
+void RadarArpa::RefreshTargets(PassN pass, int dist) {
+  int width = (int)m_ri->m_spokes / ARPA_REFRESH_SECTORS;
 
-  // pass 1 of target refresh
-  int dist = TARGET_SEARCH_RADIUS1;
   for (int i = 0; i < m_number_of_targets; i++) {
-    if (!m_targets[i]) {
+    ArpaTarget* target = m_targets[i];
+    if (!target) {
       LOG_INFO(wxT(" error target non existent i=%i"), i);
       continue;
     }
-    m_targets[i]->m_pass_nr = PASS1;
-    if (m_targets[i]->m_pass1_result == NOT_FOUND_IN_PASS1) continue;
-    m_targets[i]->RefreshTarget(dist);
-    if (m_targets[i]->m_pass1_result == NOT_FOUND_IN_PASS1) {
+    target->m_refresh_sector = -1;
+    if (pass == PASS1) {
+      target->m_pass_nr = PASS1;
+      if (target->m_pass1_result == NOT_FOUND_IN_PASS1) continue;
+    } else {
+      if (target->m_pass1_result == UNKNOWN) continue;
+      target->m_pass_nr = PASS2;
+    }
+    if (!target->PrepareRefresh()) continue;  // not passed by the beam yet, or lost
+    m_kalman->SetState(target->m_track, &target->m_x_local, target->m_delta_t);
+    m_kalman->Schedule(target->m_track, KALMAN_PREDICT);
+    if (width > 2 * DISTANCE_BETWEEN_TARGETS) {
+      Polar pol = target->Pos2Polar(target->m_position, target->m_own_pos);
+      target->m_refresh_sector = (int)MOD_SPOKES(pol.angle) * ARPA_REFRESH_SECTORS / (int)m_ri->m_spokes;
+    } else {
+      // All targets in one sector, which leaves no room for threads
+      target->m_refresh_sector = 0;
     }
   }
 
-  // pass 2 of target refresh
-  dist = TARGET_SEARCH_RADIUS2;
+  // Refreshed per sector of spokes, see radar_pi::NotifyArpaSector, the targets that are
+  // due lie in the one or two sectors the beam just passed. Each phase then has a single
+  // sector, which no thread can help with, so they are all refreshed in one phase instead.
+  // The threads only help when the refresh is late and many sectors are due at once.
+  bool due[ARPA_REFRESH_SECTORS];
+  int phase_sectors[2] = {0, 0};
+  CLEAR_STRUCT(due);
+  for (int i = 0; i < m_number_of_targets; i++) {
+    ArpaTarget* target = m_targets[i];
+    if (target && target->m_refresh_sector >= 0 && !due[target->m_refresh_sector]) {
+      due[target->m_refresh_sector] = true;
+      phase_sectors[target->m_refresh_sector % 2]++;
+    }
+  }
+  if (phase_sectors[0] <= 1 && phase_sectors[1] <= 1) {
+    for (int i = 0; i < m_number_of_targets; i++) {
+      ArpaTarget* target = m_targets[i];
+      if (target && target->m_refresh_sector > 0) {
+        target->m_refresh_sector = 0;
+      }
+    }
+  }
+  m_kalman->Run();
   for (int i = 0; i < m_number_of_targets; i++) {
-    if (!m_targets[i]) {
-      LOG_INFO(wxT("error target non existent i=%i"), i);
+    ArpaTarget* target = m_targets[i];
+    if (target && target->m_refresh_sector >= 0) {
+      m_kalman->GetState(target->m_track, &target->m_x_local);
+    }
+  }
+
+  for (int odd = 0; odd < 2; odd++) {
+    bool in_phase[ARPA_REFRESH_SECTORS];
+
+    CLEAR_STRUCT(in_phase);
+    for (int i = 0; i < m_number_of_targets; i++) {
+      if (m_targets[i] && m_targets[i]->m_refresh_sector >= 0 && m_targets[i]->m_refresh_sector % 2 == odd) {
+        in_phase[m_targets[i]->m_refresh_sector] = true;
+      }
+    }
+    m_sector_count = 0;
+    for (int s = odd; s < ARPA_REFRESH_SECTORS; s += 2) {
+      if (in_phase[s]) {
+        m_sectors[m_sector_count++] = s;
+      }
+    }
+    if (m_sector_count == 0) {
       continue;
     }
-    if (m_targets[i]->m_pass1_result == UNKNOWN) continue;
-    m_targets[i]->m_pass_nr = PASS2;
-    m_targets[i]->RefreshTarget(dist);
+
+    int helpers = 0;
+    if (m_sector_count > 1) {
+      StartRefreshThreads(wxMin(wxThread::GetCPUCount(), ARPA_REFRESH_THREADS) - 1);
+      helpers = wxMin(m_refresh_thread_count, m_sector_count - 1);
+    }
+
+    // Fence in the targets, and give the ones that may get a target id one now
+    bool fenced = m_sector_count > 1;
+    for (int i = 0; i < m_number_of_targets; i++) {
+      ArpaTarget* target = m_targets[i];
+      if (target && target->m_refresh_sector >= 0 && target->m_refresh_sector % 2 == odd) {
+        int first = target->m_refresh_sector * (int)m_ri->m_spokes / ARPA_REFRESH_SECTORS;
+        int last = (target->m_refresh_sector + 1) * (int)m_ri->m_spokes / ARPA_REFRESH_SECTORS;
+        target->m_fence_start = fenced ? MOD_SPOKES(first - width / 2) : 0;
+        target->m_fence_width = fenced ? last - first + 2 * (width / 2) : 0;
+        target->m_fence_hit = false;
+        target->m_in_thread = true;
+        target->m_reserved_id = (target->m_status == STATUS_TO_OCPN - 1) ? NewTargetId() : 0;
+      }
+    }
+    int n = 0;
+    for (int k = 0; k < m_sector_count; k++) {
+      m_sector_start[k] = n;
+      for (int i = 0; i < m_number_of_targets; i++) {
+        if (m_targets[i] && m_targets[i]->m_refresh_sector == m_sectors[k]) {
+          m_sector_targets[n++] = i;
+        }
+      }
+    }
+    m_sector_start[m_sector_count] = n;
+
+    m_next_sector = 0;
+    m_refresh_dist = dist;
+    for (int t = 0; t < helpers; t++) {
+      m_refresh_start.Post();
+    }
+    RefreshSectors(dist);
+    for (int t = 0; t < helpers; t++) {
+      m_refresh_done.Wait();
+    }
+    m_kalman->Run();
+
+    for (int i = 0; i < m_number_of_targets; i++) {
+      ArpaTarget* target = m_targets[i];
+      if (target && target->m_refresh_sector >= 0 && target->m_refresh_sector % 2 == odd) {
+        target->m_in_thread = false;
+        target->m_fence_width = 0;
+        target->m_reserved_id = 0;
+        for (size_t m = 0; m < target->m_nmea.GetCount(); m++) {
+          PushNMEABuffer(target->m_nmea[m]);
+        }
+        target->m_nmea.Clear();
+        if (target->m_fence_hit) {
+          target->m_fence_hit = false;
+          target->RefreshTarget(dist);
+        } else if (target->m_finish) {
+          m_kalman->GetState(target->m_track, &target->m_x_local);
+          target->FinishRefresh();
+        }
+        target->m_finish = false;
+      }
+    }
   }
+}
 
-  for (int i = 0; i < GUARD_ZONES; i++) {
-    m_ri->m_guard_zone[i]->SearchTargets();
+// Starts the threads that help RefreshTargets, once. RefreshTargets asks for as many as
+// make up ARPA_REFRESH_THREADS together with the GUI thread, but not more than there are
+// CPUs. A thread that cannot be started is left out, the others take over its sectors.
+void RadarArpa::StartRefreshThreads(int threads) {
+  if (m_refresh_threads_started) {
+    return;
   }
-  if (m_ri->m_doppler.GetValue() > 0 && m_ri->m_autotrack_doppler.GetValue() > 0) {
-    SearchDopplerTargets();
+  m_refresh_threads_started = true;
+  for (int t = 0; t < threads && t < ARPA_REFRESH_THREADS; t++) {
+    ArpaRefreshThread* thread = new ArpaRefreshThread(this);
+    if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+      delete thread;
+      continue;
+    }
+    m_refresh_thread[m_refresh_thread_count++] = thread;
   }
+  LOG_ARPA(wxT("%s started %d ARPA refresh threads"), m_ri->m_name.c_str(), m_refresh_thread_count);
 }
 
-void ArpaTarget::RefreshTarget(int dist) {
-  ExtendedPosition prev_X;
-  ExtendedPosition prev2_X;
-  ExtendedPosition own_pos;
-  Polar pol;
-  double delta_t;
-  LocalPosition x_local;
-  wxLongLong prev_refresh = m_refresh;
-  // refresh may be called from guard directly, better check
-  if (m_status == LOST || !m_ri->GetRadarPosition(&own_pos.pos)) {
-    return;
+// Refreshes the targets of the sectors in m_sectors that no other thread has taken yet.
+void RadarArpa::RefreshSectors(int dist) {
+  ArpaTarget saved;
+  Matrix<double, 4> saved_P;
+
+  for (int k = m_next_sector++; k < m_sector_count; k = m_next_sector++) {
+    for (int j = m_sector_start[k]; j < m_sector_start[k + 1]; j++) {
+      ArpaTarget* target = m_targets[m_sector_targets[j]];
+
+      saved = *target;
+      saved_P = m_kalman->GetP(target->m_track);
+      target->m_finish = target->SearchTarget(dist);
+      if (target->m_fence_hit) {
+        // Undo, it is refreshed again without a fence
+        ContourPoint* contour = target->m_contour;
+        *target = saved;
+        m_kalman->SetP(target->m_track, saved_P);
+        m_kalman->Cancel(target->m_track);
+        // The contour may be partly overwritten, it is found again
+        target->m_contour = contour;
+        target->m_contour_length = 0;
+        target->m_fence_hit = true;
+      }
+    }
   }
-  pol = Pos2Polar(m_position, own_pos);
-  wxLongLong time1 = m_ri->m_history[MOD_SPOKES(pol.angle)].time;
+  saved.m_contour = 0;
+}
+
+// Has the beam passed the target at pol since its last refresh?
+bool ArpaTarget::IsDue(Polar pol) {
+  wxLongLong time1 = m_ri->m_arpa_history->m_time[MOD_SPOKES(pol.angle)];
   int margin = SCAN_MARGIN;
   if (m_pass_nr == PASS2) margin += 100;
-  wxLongLong time2 = m_ri->m_history[MOD_SPOKES(pol.angle + margin)].time;
+  wxLongLong time2 = m_ri->m_arpa_history->m_time[MOD_SPOKES(pol.angle + margin)];
   // check if target has been refreshed since last time (at least SCAN_MARGIN2 later)
   // and if the beam has passed the target location with SCAN_MARGIN spokes
   // the beam sould have passed our "angle" AND a point SCANMARGIN further
   // always refresh when status == 0
-  if ((time1 < (m_refresh + SCAN_MARGIN2) || time2 < time1) && m_status != 0) {
+  return (time1 >= (m_refresh + SCAN_MARGIN2) && time2 >= time1) || m_status == 0;
+}
+
+// Refreshes the target on its own, RadarArpa::RefreshTargets does the same steps for all
+// targets together.
+void ArpaTarget::RefreshTarget(int dist) {
+  if (!PrepareRefresh()) {
+    return;
+  }
+  m_kalman->SetState(m_track, &m_x_local, m_delta_t);
+  m_kalman->Schedule(m_track, KALMAN_PREDICT);
+  m_kalman->Run(m_track);
+  m_kalman->GetState(m_track, &m_x_local);  // x_local is new estimated local position of the target
+  bool found = SearchTarget(dist);
+  m_kalman->Run(m_track);
+  if (found) {
+    m_kalman->GetState(m_track, &m_x_local);
+    FinishRefresh();
+  }
+}
+
+// Checks whether the beam has passed the target, and sets what the prediction of its
+// position needs. Returns false when the target is not refreshed now, it may then be lost.
+bool ArpaTarget::PrepareRefresh() {
+  Polar pol;
+
+  // refresh may be called from guard directly, better check
+  if (m_status == LOST || !m_ri->GetRadarPosition(&m_own_pos.pos)) {
+    return false;
+  }
+  pol = Pos2Polar(m_position, m_own_pos);
+  wxLongLong time1 = m_ri->m_arpa_history->m_time[MOD_SPOKES(pol.angle)];
+  if (!IsDue(pol)) {
     wxLongLong now = wxGetUTCTimeMillis();  // millis
     int diff = now.GetLo() - m_refresh.GetLo();
     if (diff > 8000) {
@@ -786,44 +850,51 @@ void ArpaTarget::RefreshTarget(int dist) {
                diff);
       SetStatusLost();
     }
-    return;
+    return false;
+  }
+  if (m_position.pos.lat > 90.) {
+    SetStatusLost();
+    return false;
   }
-  // set new refresh time
-  m_refresh = time1;
-  prev2_X = prev_X;
-  prev_X = m_position;  // save the previous target position
-
-  // for test only
-  /* if (status == 0) {
-       target_id_count++;
-       if (target_id_count >= 10000) target_id_count = 1;
-       target_id = target_id_count;
-   }*/
 
   // PREDICTION CYCLE
 
-  m_position.time = time1;                                                // estimated new target time
-  delta_t = ((double)((m_position.time - prev_X.time).GetLo())) / 1000.;  // in seconds
+  m_due_time = time1;                                                  // estimated new target time
+  m_delta_t = ((double)((m_due_time - m_position.time).GetLo())) / 1000.;  // in seconds
   if (m_status == 0) {
-    delta_t = 0.;
-  }
-  if (m_position.pos.lat > 90.) {
-    SetStatusLost();
-    return;
-  }
-  x_local.pos.lat = (m_position.pos.lat - own_pos.pos.lat) * 60. * 1852.;                                  // in meters
-  x_local.pos.lon = (m_position.pos.lon - own_pos.pos.lon) * 60. * 1852. * cos(deg2rad(own_pos.pos.lat));  // in meters
-  x_local.dlat_dt = m_position.dlat_dt;                                                                    // meters / sec
-  x_local.dlon_dt = m_position.dlon_dt;                                                                    // meters / sec
-  m_kalman->Predict(&x_local, delta_t);  // x_local is new estimated local position of the target
-                                         // now set the polar to expected angular position from the expected local position
-  pol.angle = (int)(atan2(x_local.pos.lon, x_local.pos.lat) * m_ri->m_spokes / (2. * PI));
+    m_delta_t = 0.;
+  }
+  m_x_local.pos.lat = (m_position.pos.lat - m_own_pos.pos.lat) * 60. * 1852.;  // in meters
+  m_x_local.pos.lon =
+      (m_position.pos.lon - m_own_pos.pos.lon) * 60. * 1852. * cos(deg2rad(m_own_pos.pos.lat));  // in meters
+  m_x_local.dlat_dt = m_position.dlat_dt;                                                          // meters / sec
+  m_x_local.dlon_dt = m_position.dlon_dt;                                                          // meters / sec
+  m_x_local.sd_speed_m_s = 0.;
+  return true;
+}
+
+// Searches the target at the position that the Kalman filter predicted in m_x_local, and
+// schedules the Kalman steps for what it found. Returns true when FinishRefresh is to be
+// called once these have run.
+bool ArpaTarget::SearchTarget(int dist) {
+  ExtendedPosition prev_X;
+  Polar pol;
+  wxLongLong prev_refresh = m_refresh;
+
+  // set new refresh time
+  m_refresh = m_due_time;
+  prev_X = m_position;  // save the previous target position
+  m_position.time = m_due_time;
+
+  // now set the polar to expected angular position from the expected local position
+  pol.angle = (int)(atan2(m_x_local.pos.lon, m_x_local.pos.lat) * m_ri->m_spokes / (2. * PI));
   if (pol.angle < 0) pol.angle += m_ri->m_spokes;
-  pol.r = (int)(sqrt(x_local.pos.lat * x_local.pos.lat + x_local.pos.lon * x_local.pos.lon) * m_ri->m_pixels_per_meter);
+  pol.r = (int)(sqrt(m_x_local.pos.lat * m_x_local.pos.lat + m_x_local.pos.lon * m_x_local.pos.lon) *
+                m_ri->m_arpa_history->m_pixels_per_meter);
   // zooming and target movement may  cause r to be out of bounds
   if (pol.r >= (int)m_ri->m_spoke_len_max || pol.r <= 0) {
     SetStatusLost();
-    return;
+    return false;
   }
   m_expected = pol;  // save expected polar position
 
@@ -838,7 +909,7 @@ void ArpaTarget::RefreshTarget(int dist) {
     if (abs(back.r - pol.r) > MAX_TARGET_DIAMETER || abs(m_max_r.r - m_min_r.r) > MAX_TARGET_DIAMETER ||
         abs(m_min_angle.angle - m_max_angle.angle) > MAX_TARGET_DIAMETER) {
       SetStatusLost();
-      return;
+      return false;
     }
     // target refreshed, measured position in pol
     // check if target has a new later time than previous target
@@ -846,14 +917,13 @@ void ArpaTarget::RefreshTarget(int dist) {
       // found old target again, reset what we have done
       LOG_INFO(wxT("Error Gettarget same time found"));
       m_position = prev_X;
-      prev_X = prev2_X;
-      return;
+      return false;
     }
     m_lost_count = 0;
     if (m_status == ACQUIRE0) {
       // as this is the first measurement, move target to measured position
       ExtendedPosition p_own;
-      p_own.pos = m_ri->m_history[MOD_SPOKES(pol.angle)].pos;  // get the position at receive time
+      p_own.pos = m_ri->m_arpa_history->m_pos[MOD_SPOKES(pol.angle)];  // get the position at receive time
       m_position = Polar2Pos(pol, p_own);                      // using own ship location from the time of reception
       m_position.dlat_dt = 0.;
       m_position.dlon_dt = 0.;
@@ -863,26 +933,22 @@ void ArpaTarget::RefreshTarget(int dist) {
     m_status++;
     // target gets an id when status  == STATUS_TO_OCPN
     if (m_status == STATUS_TO_OCPN) {
-      target_id_count++;
-      if (target_id_count >= 10000) target_id_count = 1;
-      m_target_id = target_id_count;
+      m_target_id = m_in_thread ? m_reserved_id : NewTargetId();
     }
     // Kalman filter to  calculate the apostriori local position and speed based on found position (pol)
     if (m_status > 1) {
-      m_kalman->Update_P();
-      m_kalman->SetMeasurement(&pol, &x_local, &m_expected,
-                               m_ri->m_pixels_per_meter);  // pol is measured position in polar coordinates
+      m_kalman->SetMeasured(m_track, &pol, &m_expected, m_ri->m_arpa_history->m_pixels_per_meter,
+                            m_ri->m_spokes);  // pol is measured position in polar coordinates
+      m_kalman->Schedule(m_track, KALMAN_UPDATE_P | KALMAN_MEASURE);
     }
 
-    // x_local expected position in local coordinates
-
     m_position.time = pol.time;  // set the target time to the newly found time
   }                              // end of target found
 
   // target not found
   else {
     // target not found
-    if (m_pass_nr == PASS1) m_kalman->Update_P();
+    if (m_pass_nr == PASS1) m_kalman->Schedule(m_track, KALMAN_UPDATE_P);
     // check if the position of the target has been taken by another target, a duplicate
     // if duplicate, handle target as not found but don't do pass 2 (= search in the surroundings)
     bool duplicate = false;
@@ -898,17 +964,15 @@ void ArpaTarget::RefreshTarget(int dist) {
     if (m_pass_nr == PASS1 && !duplicate) {
       m_pass1_result = NOT_FOUND_IN_PASS1;
       // reset what we have done
-      pol.time = prev_X.time;
       m_refresh = prev_refresh;
       m_position = prev_X;
-      prev_X = prev2_X;
-      return;
+      return false;
     }
 
     // delete low status targets immediately when not found
     if (m_status == ACQUIRE0 || m_status == ACQUIRE1 || m_status == 2) {
       SetStatusLost();
-      return;
+      return false;
     }
 
     m_lost_count++;
@@ -916,18 +980,26 @@ void ArpaTarget::RefreshTarget(int dist) {
     // delete if not found too often
     if (m_lost_count > MAX_LOST_COUNT) {
       SetStatusLost();
-      return;
+      return false;
     }
   }  // end of target not found
+  return true;
+}
+
+// Takes the position and speed from the Kalman filter in m_x_local, and passes the target
+// to OpenCPN.
+void ArpaTarget::FinishRefresh() {
+  Polar pol;
+
   // set pass1_result ready for next sweep
   m_pass1_result = UNKNOWN;
   if (m_status != ACQUIRE1) {
     // if status == 1, then this was first measurement, keep position at measured position
-    m_position.pos.lat = own_pos.pos.lat + x_local.pos.lat / 60. / 1852.;
-    m_position.pos.lon = own_pos.pos.lon + x_local.pos.lon / 60. / 1852. / cos(deg2rad(own_pos.pos.lat));
-    m_position.dlat_dt = x_local.dlat_dt;  // meters / sec
-    m_position.dlon_dt = x_local.dlon_dt;  // meters /sec
-    m_position.sd_speed_kn = x_local.sd_speed_m_s * 3600. / 1852.;
+    m_position.pos.lat = m_own_pos.pos.lat + m_x_local.pos.lat / 60. / 1852.;
+    m_position.pos.lon = m_own_pos.pos.lon + m_x_local.pos.lon / 60. / 1852. / cos(deg2rad(m_own_pos.pos.lat));
+    m_position.dlat_dt = m_x_local.dlat_dt;  // meters / sec
+    m_position.dlon_dt = m_x_local.dlon_dt;  // meters /sec
+    m_position.sd_speed_kn = m_x_local.sd_speed_m_s * 3600. / 1852.;
   }
 
   // set refresh time to the time of the spoke where the target was found
@@ -953,7 +1025,7 @@ void ArpaTarget::RefreshTarget(int dist) {
     m_course = rad2deg(atan2(s2, s1));
     m_course = MOD_DEGREES_FLOAT(m_course);
     if (m_speed_kn > 20.) {
-      pol = Pos2Polar(m_position, own_pos);
+      pol = Pos2Polar(m_position, m_own_pos);
     }
 
     if (m_speed_kn < (double)TARGET_SPEED_DIV_SDEV * m_position.sd_speed_kn) {
@@ -967,7 +1039,7 @@ void ArpaTarget::RefreshTarget(int dist) {
     }
 
     // send target data to OCPN
-    pol = Pos2Polar(m_position, own_pos);
+    pol = Pos2Polar(m_position, m_own_pos);
     if (m_status >= STATUS_TO_OCPN) {
       OCPN_target_status s;
       if (m_status >= Q_NUM) s = Q;
@@ -977,7 +1049,7 @@ void ArpaTarget::RefreshTarget(int dist) {
         s = Q;
       }
       // Check for AIS target at (M)ARPA position
-      double dist2target = pol.r / m_ri->m_pixels_per_meter;
+      double dist2target = pol.r / m_ri->m_arpa_history->m_pixels_per_meter;
       if (m_pi->FindAIS_at_arpaPos(m_position.pos, dist2target)) s = L;
       PassARPAtoOCPN(&pol, s);
     }
@@ -1033,7 +1105,9 @@ ArpaTarget::ArpaTarget(radar_pi* pi, RadarInfo* ri) {
   ArpaTarget::m_ri = ri;
   m_pi = pi;
   m_kalman = 0;
+  m_track = 0;
   m_status = LOST;
+  m_contour = 0;
   m_contour_length = 0;
   m_lost_count = 0;
   m_target_id = 0;
@@ -1047,11 +1121,22 @@ ArpaTarget::ArpaTarget(radar_pi* pi, RadarInfo* ri) {
   m_pass1_result = UNKNOWN;
   m_pass_nr = PASS1;
   m_doppler_target = 0;
+  m_fence_start = 0;
+  m_fence_width = 0;
+  m_fence_hit = false;
+  m_in_thread = false;
+  m_reserved_id = 0;
+  m_refresh_sector = -1;
+  m_due_time = 0;
+  m_delta_t = 0.;
+  m_finish = false;
 }
 
 ArpaTarget::ArpaTarget() {
   m_kalman = 0;
+  m_track = 0;
   m_status = LOST;
+  m_contour = 0;
   m_contour_length = 0;
   m_lost_count = 0;
   m_target_id = 0;
@@ -1065,6 +1150,15 @@ ArpaTarget::ArpaTarget() {
   m_pass1_result = UNKNOWN;
   m_pass_nr = PASS1;
   m_doppler_target = 0;
+  m_fence_start = 0;
+  m_fence_width = 0;
+  m_fence_hit = false;
+  m_in_thread = false;
+  m_reserved_id = 0;
+  m_refresh_sector = -1;
+  m_due_time = 0;
+  m_delta_t = 0.;
+  m_finish = false;
 }
 
 bool ArpaTarget::GetTarget(Polar* pol, int dist1) {
@@ -1092,7 +1186,9 @@ bool ArpaTarget::GetTarget(Polar* pol, int dist1) {
   }
   int cont = GetContour(pol);
   if (cont != 0) {
-    LOG_ARPA(wxT("ARPA contour error %d at %d, %d"), cont, a, r);
+    if (cont != CONTOUR_FENCE) {
+      LOG_ARPA(wxT("ARPA contour error %d at %d, %d"), cont, a, r);
+    }
     // reset pol in case of error
     pol->angle = a;
     pol->r = r;
@@ -1127,7 +1223,7 @@ void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
       break;
   }
 
-  double dist = pol->r / m_ri->m_pixels_per_meter / 1852.;
+  double dist = pol->r / m_ri->m_arpa_history->m_pixels_per_meter / 1852.;
   double bearing = SCALE_SPOKES_TO_DEGREES(pol->angle);
   bearing = MOD_DEGREES_FLOAT(bearing);
   s_TargID = wxString::Format(wxT("%2i"), m_target_id);
@@ -1158,15 +1254,18 @@ void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
     checksum ^= *p;
   }
   nmea.Printf(wxT("$%s*%02X\r\n"), sentence, (unsigned)checksum);
-  PushNMEABuffer(nmea);
+  if (m_in_thread) {
+    m_nmea.Add(nmea);
+  } else {
+    PushNMEABuffer(nmea);
+  }
 }
 
 void ArpaTarget::SetStatusLost() {
   m_contour_length = 0;
   m_lost_count = 0;
   if (m_kalman) {
-    // reset kalman filter, don't delete it, too  expensive
-    m_kalman->ResetFilter();
+    m_kalman->ResetFilter(m_track);
   }
   if (m_status >= STATUS_TO_OCPN) {
     Polar p;
@@ -1186,6 +1285,65 @@ void ArpaTarget::SetStatusLost() {
   m_pass_nr = PASS1;
 }
 
+// Copies the targets that are tracked into targets, for the snapshot. Returns how many there are.
+int RadarArpa::SaveTargets(SnapshotTarget* targets, int max) {
+  int n = 0;
+
+  for (int i = 0; i < m_number_of_targets && n < max; i++) {
+    ArpaTarget* target = m_targets[i];
+    if (!target || target->m_status < ACQUIRE0) continue;
+    SnapshotTarget* s = &targets[n++];
+    s->target_id = target->m_target_id;
+    s->status = target->m_status;
+    s->stationary = target->m_stationary;
+    s->lost_count = target->m_lost_count;
+    s->automatic = target->m_automatic;
+    s->doppler_target = target->m_doppler_target;
+    s->radar_pos = target->m_radar_pos;
+    s->position = target->m_position;
+    s->speed_kn = target->m_speed_kn;
+    s->course = target->m_course;
+    s->P = m_kalman->GetP(target->m_track);
+  }
+  return n;
+}
+
+// Takes up the targets of a snapshot again
+void RadarArpa::RestoreTargets(const SnapshotTarget* targets, int count) {
+  wxLongLong now = wxGetUTCTimeMillis();
+
+  for (int i = 0; i < count && m_number_of_targets < MAX_NUMBER_OF_TARGETS - 1; i++) {
+    const SnapshotTarget* s = &targets[i];
+    ArpaTarget* target = NewTarget(s->status);
+    m_kalman->SetP(target->m_track, s->P);
+    target->m_target_id = s->target_id;
+    target->m_status = s->status;
+    target->m_stationary = s->stationary;
+    target->m_lost_count = s->lost_count;
+    target->m_automatic = s->automatic;
+    target->m_doppler_target = s->doppler_target;
+    target->m_radar_pos = s->radar_pos;
+    target->m_position = s->position;
+    target->m_speed_kn = s->speed_kn;
+    target->m_course = s->course;
+    target->m_contour_length = 0;
+    target->m_max_angle.angle = 0;
+    target->m_min_angle.angle = 0;
+    target->m_max_r.r = 0;
+    target->m_min_r.r = 0;
+    target->m_check_for_duplicate = false;
+    target->m_pass1_result = UNKNOWN;
+    target->m_pass_nr = PASS1;
+    // Wait for the radar to pass the target again. m_position.time is not changed,
+    // so the Kalman filter predicts where the target went meanwhile.
+    target->m_refresh = now;
+    if (target->m_target_id > target_id_count) {
+      target_id_count = target->m_target_id;
+    }
+  }
+  LOG_ARPA(wxT("%s restored %d ARPA targets"), m_ri->m_name.c_str(), count);
+}
+
 void RadarArpa::DeleteAllTargets() {
   for (int i = 0; i < m_number_of_targets; i++) {
     if (!m_targets[i]) continue;
@@ -1204,18 +1362,11 @@ int RadarArpa::AcquireNewARPATarget(Polar pol, int status, uint8_t doppler) {
     return -1;
   }
   // make new target or re-use an existing one with status == lost
-  int i;
-  if (m_number_of_targets < MAX_NUMBER_OF_TARGETS - 1 || (m_number_of_targets == MAX_NUMBER_OF_TARGETS - 1 && status == -2)) {
-    if (!m_targets[m_number_of_targets]) {
-      m_targets[m_number_of_targets] = new ArpaTarget(m_pi, m_ri);
-    }
-    i = m_number_of_targets;
-    m_number_of_targets++;
-  } else {
-    wxLogError(wxT("Error, max targets exceeded %i"), m_number_of_targets);
+  int i = m_number_of_targets;
+  ArpaTarget* target = NewTarget(status);
+  if (!target) {
     return -1;
   }
-  ArpaTarget* target = m_targets[i];
   target_pos = target->Polar2Pos(pol, own_pos);
 
   target->m_position = target_pos;  // Expected position
@@ -1229,9 +1380,6 @@ int RadarArpa::AcquireNewARPATarget(Polar pol, int status, uint8_t doppler) {
   target->m_max_r.r = 0;
   target->m_min_r.r = 0;
   target->m_doppler_target = doppler;
-  if (!target->m_kalman) {
-    target->m_kalman = new KalmanFilter(m_ri->m_spokes);
-  }
   target->m_check_for_duplicate = false;
   target->m_automatic = true;
   target->m_target_id = 0;
@@ -1242,20 +1390,26 @@ int RadarArpa::AcquireNewARPATarget(Polar pol, int status, uint8_t doppler) {
 void ArpaTarget::ResetPixels() {
   // resets the pixels of the current blob (plus DISTANCE_BETWEEN_TARGETS) so that blob will not be found again in the same sweep
   // We not only reset the blob but all pixels in a radial "square" covering the blob
-  for (int r = wxMax(m_min_r.r - DISTANCE_BETWEEN_TARGETS, 0);
-       r <= wxMin(m_max_r.r + DISTANCE_BETWEEN_TARGETS, (int)m_ri->m_spoke_len_max - 1); r++) {
-    for (int a = m_min_angle.angle - DISTANCE_BETWEEN_TARGETS; a <= m_max_angle.angle + DISTANCE_BETWEEN_TARGETS; a++) {
-      m_ri->m_history[MOD_SPOKES(a)].line[r] = m_ri->m_history[MOD_SPOKES(a)].line[r] & 127;
-    }
+  int r1 = wxMax(m_min_r.r - DISTANCE_BETWEEN_TARGETS, 0);
+  int r2 = wxMin(m_max_r.r + DISTANCE_BETWEEN_TARGETS, (int)m_ri->m_spoke_len_max - 1);
+  if (r1 > r2) {
+    return;
   }
-}
-
-void RadarArpa::ClearContours() {
-  for (int i = 0; i < m_number_of_targets; i++) {
-    m_targets[i]->m_contour_length = 0;
+  if (m_fence_width > 0 &&
+      (m_fence_hit || OutsideFence(m_min_angle.angle - DISTANCE_BETWEEN_TARGETS) ||
+       OutsideFence(m_max_angle.angle + DISTANCE_BETWEEN_TARGETS) ||
+       m_max_angle.angle - m_min_angle.angle + 2 * DISTANCE_BETWEEN_TARGETS >= m_fence_width)) {
+    m_fence_hit = true;
+    return;
   }
+  m_ri->m_spoke_kernels->ClearPixels(m_ri->m_arpa_history, m_min_angle.angle - DISTANCE_BETWEEN_TARGETS,
+                                     m_max_angle.angle + DISTANCE_BETWEEN_TARGETS, r1, r2 + 1, true);
 }
 
+// May be called from the spoke processing thread, so the contours are cleared
+// at the start of the next RefreshArpaTargets.
+void RadarArpa::ClearContours() { m_clear_contours = true; }
+
 bool RadarArpa::IsAtLeastOneRadarTransmitting() {
   for (size_t r = 0; r < RADARS; r++) {
     if (m_pi->m_radar[r] != NULL && m_pi->m_radar[r]->m_state.GetValue() == RADAR_TRANSMIT) {
@@ -1273,12 +1427,11 @@ void RadarArpa::SearchDopplerTargets() {
   }
   if (!m_pi->m_settings.show                       // No radar shown
       || !m_ri->GetRadarPosition(&own_pos.pos)     // No position
-      || m_pi->GetHeadingSource() == HEADING_NONE  // No heading
-      || (m_pi->GetHeadingSource() == HEADING_FIX_HDM && m_pi->m_var_source == VARIATION_SOURCE_NONE)) {
+      || !m_ri->m_arpa_history->m_heading_ok) {    // No heading
     return;
   }
 
-  if (m_ri->m_pixels_per_meter == 0. || !IsAtLeastOneRadarTransmitting()) {
+  if (m_ri->m_arpa_history->m_pixels_per_meter == 0. || !IsAtLeastOneRadarTransmitting()) {
     return;
   }
 
@@ -1288,12 +1441,13 @@ void RadarArpa::SearchDopplerTargets() {
   SpokeBearing start_bearing = 0;
   SpokeBearing end_bearing = m_ri->m_spokes;
 
-  // loop with +2 increments as target must be larger than 2 pixels in width
+  // Search the sectors that the beam has passed since the last search, as in GuardZone::SearchTargets
+  int sector_start = -1;
   for (int angleIter = start_bearing; angleIter < end_bearing; angleIter += 2) {
     SpokeBearing angle = MOD_SPOKES(angleIter);
-    wxLongLong time1 = m_ri->m_history[angle].time;
+    wxLongLong time1 = m_ri->m_arpa_history->m_time[angle];
     // time2 must be timed later than the pass 2 in refresh, otherwise target may be found multiple times
-    wxLongLong time2 = m_ri->m_history[MOD_SPOKES(angle + 3 * SCAN_MARGIN)].time;
+    wxLongLong time2 = m_ri->m_arpa_history->m_time[MOD_SPOKES(angle + 3 * SCAN_MARGIN)];
 
     // check if target has been refreshed since last time
     // and if the beam has passed the target location with SCAN_MARGIN spokes
@@ -1301,25 +1455,46 @@ void RadarArpa::SearchDopplerTargets() {
          time2 >= time1)) {  // the beam sould have passed our "angle" AND a
                              // point SCANMARGIN further set new refresh time
       m_doppler_arpa_update_time[angle] = time1;
-      for (int rrr = (int)range_start; rrr < (int)range_end; rrr++) {
-        if (m_ri->m_arpa->GetTargetCount() >= MAX_NUMBER_OF_TARGETS - 1) {
-          LOG_INFO(wxT("No more scanning for ARPA targets in loop, maximum number of targets reached"));
-          return;
-        }
-
-        if (m_ri->m_arpa->MultiPix(angle, rrr, 1)) {
-          // pixel found that does not belong to a known target
-          Polar pol;
-          pol.angle = angle;
-          pol.r = rrr;
-          int target_i = m_ri->m_arpa->AcquireNewARPATarget(pol, 0, 1);
-          if (target_i == -1) break;
-        }
+      if (sector_start < 0) {
+        sector_start = angleIter;
+      }
+    } else if (sector_start >= 0) {
+      if (!AcquireBlobs(sector_start, angleIter, range_start, range_end, true)) {
+        return;
       }
+      sector_start = -1;
     }
   }
+  if (sector_start >= 0) {
+    AcquireBlobs(sector_start, end_bearing, range_start, range_end, true);
+  }
 
   return;
 }
 
+// Acquire a target on each blob of unclaimed returns in spokes [angle1..angle2>
+// and returns [r1..r2> that has a long enough contour, see MultiPix.
+// With doppler set only the approaching doppler returns are searched.
+// Returns false when the maximum number of targets is reached.
+bool RadarArpa::AcquireBlobs(int angle1, int angle2, size_t r1, size_t r2, bool doppler) {
+  m_blobs.Label(m_ri->m_arpa_history, m_ri->m_spokes, angle1, angle2, r1, r2, doppler);
+
+  for (size_t i = 0; i < m_blobs.GetCount(); i++) {
+    const Blob &blob = m_blobs.GetBlob(i);
+    if (blob.max_angle == blob.min_angle) {
+      continue;  // target must be larger than 2 pixels in width
+    }
+    if (GetTargetCount() >= MAX_NUMBER_OF_TARGETS - 1) {
+      LOG_INFO(wxT("No more scanning for ARPA targets in loop, maximum number of targets reached"));
+      return false;
+    }
+    // A target acquired earlier in this loop may have claimed the blob meanwhile,
+    // then MultiPix no longer finds its start
+    if (MultiPix(blob.start.angle, blob.start.r, doppler)) {
+      AcquireNewARPATarget(blob.start, 0, doppler ? 1 : 0);
+    }
+  }
+  return true;
+}
+
 PLUGIN_END_NAMESPACE
@@ -0,0 +1,400 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Check the snapshot of a radar:
+ *
+ * - the trails, the spoke history and the ARPA targets saved by a
+ *   RadarSnapshot are restored by the next one made on the same file,
+ * - a snapshot with another magic, version or spoke count, one that is too
+ *   old and one made too far away are not restored,
+ * - when radar_pi::RefreshArpaTargets refreshes the ARPA targets, in
+ *   particular that the MARPA targets of a snapshot are restored after a
+ *   restart when no guard zone has ARPA on.
+ *
+ * Only the snapshot and the trails are linked in. The parts of RadarInfo and
+ * RadarArpa that they use are made below. RadarArpa hands the targets to the
+ * snapshot as SnapshotTargets, turning those into ArpaTargets is not checked.
+ */
+
+#include <wx/filename.h>
+
+#include "RadarSnapshot.h"
+
+#define TEST_SPOKES (256)
+#define TEST_SPOKE_LEN (128)
+#define TEST_TARGETS (5)
+
+PLUGIN_BEGIN_NAMESPACE
+
+static wxString test_dir;  // Holds the radar_pi directory with the snapshot
+static GeoPosition test_radar_pos;
+static SnapshotTarget test_targets[MAX_NUMBER_OF_TARGETS];  // What RadarArpa tracks
+static SnapshotTarget test_restored[MAX_NUMBER_OF_TARGETS];  // What RadarArpa was given back
+static int test_restored_count;
+
+PLUGIN_END_NAMESPACE
+
+wxString *GetpPrivateApplicationDataLocation() { return &RadarPlugin::test_dir; }
+
+PLUGIN_BEGIN_NAMESPACE
+
+double local_distance(GeoPosition pos1, GeoPosition pos2) {
+  double s1 = deg2rad(pos1.lat);
+  double s2 = deg2rad(pos2.lat);
+  double theta = deg2rad(pos2.lon - pos1.lon);
+  double c = sin(s1) * sin(s2) + cos(s1) * cos(s2) * cos(theta);
+
+  return fabs(rad2deg(acos(wxMin(c, 1.)))) * 60;  // nautical miles/degree
+}
+
+RadarInfo::RadarInfo(radar_pi *pi, int radar) {
+  m_pi = pi;
+  m_radar = radar;
+  m_radar_type = (RadarType)0;
+  m_name = wxT("Radar");
+  m_spokes = TEST_SPOKES;
+  m_spoke_len_max = TEST_SPOKE_LEN;
+  m_pixels_per_meter = 0.;
+  m_history = new SpokeHistory(m_spokes, m_spoke_len_max);
+  m_trails = new TrailBuffer(this, m_spokes, m_spoke_len_max);
+  m_arpa = new RadarArpa(pi, this);
+}
+
+RadarInfo::~RadarInfo() {
+  delete m_arpa;
+  delete m_trails;
+  delete m_history;
+}
+
+bool RadarInfo::GetRadarPosition(GeoPosition *pos) {
+  *pos = test_radar_pos;
+  return true;
+}
+
+RadarArpa::RadarArpa(radar_pi *pi, RadarInfo *ri) {
+  m_pi = pi;
+  m_ri = ri;
+  m_number_of_targets = 0;
+}
+
+RadarArpa::~RadarArpa() {}
+
+int RadarArpa::SaveTargets(SnapshotTarget *targets, int max) {
+  int n = wxMin(TEST_TARGETS, max);
+  memcpy(targets, test_targets, n * sizeof(SnapshotTarget));
+  return n;
+}
+
+void RadarArpa::RestoreTargets(const SnapshotTarget *targets, int count) {
+  memcpy(test_restored, targets, count * sizeof(SnapshotTarget));
+  test_restored_count = count;
+}
+
+class RadarSnapshotTest {
+ public:
+  // Fills the trails and the history of ri with something to save
+  static void Fill(RadarInfo *ri) {
+    TrailBuffer *trails = ri->m_trails;
+    SpokeHistory *history = ri->m_history;
+    size_t true_size = (size_t)trails->m_trail_size * trails->m_trail_size;
+    size_t relative_size = ri->m_spokes * ri->m_spoke_len_max;
+    wxLongLong now = wxGetUTCTimeMillis();
+
+    for (size_t i = 0; i < true_size; i++) {
+      trails->m_true_trails[i] = (i % 7 == 0) ? (TrailRevolution)(1 + i % 50) : 0;
+    }
+    for (size_t i = 0; i < relative_size; i++) {
+      trails->m_relative_trails[i] = (i % 5 == 0) ? (TrailRevolution)(1 + i % 40) : 0;
+    }
+    trails->m_pos = test_radar_pos;
+    trails->m_dif.lat = 1.e-6;
+    trails->m_dif.lon = -2.e-6;
+    trails->m_offset.lat = 3;
+    trails->m_offset.lon = -4;
+    trails->m_previous_pixels_per_meter = 0.25;
+    trails->m_revolution = 60;
+
+    for (size_t angle = 0; angle < ri->m_spokes; angle++) {
+      uint64_t *planes = history->Planes(angle);
+      for (size_t w = 0; w < HISTORY_PLANES * history->Words(); w++) {
+        planes[w] = (uint64_t)(angle * 31 + w) * 0x9e3779b97f4a7c15ULL;
+      }
+      history->m_time[angle] = now - (wxLongLong)(ri->m_spokes - angle);
+      history->m_pos[angle] = test_radar_pos;
+    }
+
+    for (int i = 0; i < TEST_TARGETS; i++) {
+      SnapshotTarget *t = &test_targets[i];
+      *t = SnapshotTarget();
+      t->target_id = i + 1;
+      t->status = (target_status)(ACQUIRE3 + 1);
+      t->automatic = (i % 2) == 0;
+      t->radar_pos = test_radar_pos;
+      t->position.pos.lat = test_radar_pos.lat + 0.01 * i;
+      t->position.pos.lon = test_radar_pos.lon - 0.01 * i;
+      t->speed_kn = 2. * i;
+      t->course = 30. * i;
+    }
+  }
+
+  // Returns the number of differences between what was filled into from and restored into to
+  static int Compare(RadarInfo *from, RadarInfo *to) {
+    TrailBuffer *a = from->m_trails;
+    TrailBuffer *b = to->m_trails;
+    int errors = 0;
+
+    if (memcmp(a->m_true_trails, b->m_true_trails, (size_t)a->m_trail_size * a->m_trail_size * sizeof(TrailRevolution)) != 0) {
+      cout << "ERROR: true trails differ\n";
+      errors++;
+    }
+    size_t relative_size = from->m_spokes * from->m_spoke_len_max;
+    if (memcmp(a->m_relative_trails, b->m_relative_trails, relative_size * sizeof(TrailRevolution)) != 0) {
+      cout << "ERROR: relative trails differ\n";
+      errors++;
+    }
+    if (a->m_pos.lat != b->m_pos.lat || a->m_pos.lon != b->m_pos.lon || a->m_dif.lat != b->m_dif.lat ||
+        a->m_dif.lon != b->m_dif.lon || a->m_offset.lat != b->m_offset.lat || a->m_offset.lon != b->m_offset.lon ||
+        a->m_previous_pixels_per_meter != b->m_previous_pixels_per_meter) {
+      cout << "ERROR: trail position differs\n";
+      errors++;
+    }
+    // The trails age by the time between saving and restoring, that is at most a few seconds here
+    if ((TrailRevolution)(b->m_revolution - a->m_revolution) > SECONDS_TO_REVOLUTIONS(10)) {
+      cout << "ERROR: trail revolution " << b->m_revolution << " instead of " << a->m_revolution << "\n";
+      errors++;
+    }
+    if (b->m_relative_count == 0 || b->m_true_tiles == 0) {
+      cout << "ERROR: restored trails are not counted\n";
+      errors++;
+    }
+
+    SpokeHistory *h = from->m_history;
+    SpokeHistory *g = to->m_history;
+    if (memcmp(h->Planes(0), g->Planes(0), from->m_spokes * HISTORY_PLANES * h->Words() * sizeof(uint64_t)) != 0) {
+      cout << "ERROR: history differs\n";
+      errors++;
+    }
+    for (size_t angle = 0; angle < from->m_spokes; angle++) {
+      if (h->m_time[angle] != g->m_time[angle] || h->m_pos[angle].lat != g->m_pos[angle].lat ||
+          h->m_pos[angle].lon != g->m_pos[angle].lon) {
+        cout << "ERROR: time or position of spoke " << angle << " differs\n";
+        errors++;
+        break;
+      }
+    }
+
+    if (test_restored_count != TEST_TARGETS || memcmp(test_restored, test_targets, TEST_TARGETS * sizeof(SnapshotTarget)) != 0) {
+      cout << "ERROR: " << test_restored_count << " ARPA targets restored instead of " << TEST_TARGETS << "\n";
+      errors++;
+    }
+    return errors;
+  }
+
+  // Saves the trails, history and targets of ri in its snapshot, returns the map
+  static std::vector<uint8_t> Save(RadarInfo *ri) {
+    RadarSnapshot snapshot(0, ri);
+    std::vector<uint8_t> map;
+
+    if (!snapshot.m_map) {
+      cout << "ERROR: cannot map the snapshot\n";
+      return map;
+    }
+    if (snapshot.Restore()) {
+      cout << "ERROR: an empty snapshot was restored\n";
+    }
+    // Only one rotation in SNAPSHOT_SAVE_ROTATIONS is saved
+    for (int rotation = 0; rotation <= SNAPSHOT_SAVE_ROTATIONS; rotation++) {
+      for (SpokeBearing angle = 0; angle < (SpokeBearing)ri->m_spokes; angle++) {
+        snapshot.Save(angle, angle);
+        if (angle == 0) {
+          snapshot.SaveTargets();
+        }
+      }
+    }
+    snapshot.Save(0, 0);
+    map.assign(snapshot.m_map, snapshot.m_map + snapshot.m_size);
+    return map;
+  }
+
+  // Lets a new snapshot restore map into ri after corrupt has changed its header,
+  // returns whether it restored anything
+  static bool Restore(RadarInfo *ri, const std::vector<uint8_t> &map, void (*corrupt)(SnapshotHeader *h)) {
+    RadarSnapshot snapshot(0, ri);
+
+    if (!snapshot.m_map || snapshot.m_size != map.size()) {
+      cout << "ERROR: cannot map the snapshot\n";
+      return false;
+    }
+    memcpy(snapshot.m_map, &map[0], map.size());
+    if (corrupt) {
+      corrupt(snapshot.m_header);
+    }
+    test_restored_count = -1;
+    bool restored = snapshot.Restore();
+    snapshot.RestoreTargets();
+    return restored || test_restored_count >= 0;
+  }
+};
+
+static void WrongMagic(SnapshotHeader *h) { h->magic ^= 1; }
+static void WrongVersion(SnapshotHeader *h) { h->version++; }
+static void WrongSpokes(SnapshotHeader *h) { h->spokes *= 2; }
+static void TooOld(SnapshotHeader *h) { h->time = wxGetUTCTimeMillis() - (SNAPSHOT_MAX_AGE + 1) * 1000; }
+static void FromTheFuture(SnapshotHeader *h) { h->time = wxGetUTCTimeMillis() + 60 * 1000; }
+
+static int CheckSaveRestore() {
+  int ret = 0;
+
+  test_dir = wxFileName::GetTempDir() + wxFileName::GetPathSeparator() +
+             wxString::Format(wxT("radar_pi-test-%lu"), (unsigned long)wxGetProcessId());
+  wxString dir = test_dir + wxFileName::GetPathSeparator() + wxT("radar_pi");
+  wxString file = dir + wxFileName::GetPathSeparator() + wxT("radar0.snapshot");
+  test_radar_pos.lat = 52.;
+  test_radar_pos.lon = 4.;
+  wxRemoveFile(file);  // Left behind by an earlier run that failed
+
+  RadarInfo saved(0, 0);
+  RadarSnapshotTest::Fill(&saved);
+  std::vector<uint8_t> map = RadarSnapshotTest::Save(&saved);
+  if (map.empty()) {
+    return 1;
+  }
+
+  RadarInfo restored(0, 0);
+  if (!RadarSnapshotTest::Restore(&restored, map, 0)) {
+    cout << "ERROR: snapshot not restored\n";
+    ret = 1;
+  } else if (RadarSnapshotTest::Compare(&saved, &restored) != 0) {
+    ret = 1;
+  }
+
+  static const struct {
+    const char *name;
+    void (*corrupt)(SnapshotHeader *h);
+  } rejects[] = {{"another magic", WrongMagic},
+                 {"another version", WrongVersion},
+                 {"other spokes", WrongSpokes},
+                 {"too old", TooOld},
+                 {"made in the future", FromTheFuture}};
+  for (size_t i = 0; i < sizeof(rejects) / sizeof(rejects[0]); i++) {
+    RadarInfo ri(0, 0);
+    if (RadarSnapshotTest::Restore(&ri, map, rejects[i].corrupt)) {
+      cout << "ERROR: snapshot with " << rejects[i].name << " restored\n";
+      ret = 1;
+    }
+  }
+
+  // The radar moved a little more than allowed since the snapshot
+  GeoPosition pos = test_radar_pos;
+  test_radar_pos.lat += (SNAPSHOT_MAX_DISTANCE + 0.1) / 60.;
+  RadarInfo moved(0, 0);
+  if (RadarSnapshotTest::Restore(&moved, map, 0)) {
+    cout << "ERROR: snapshot restored after the radar moved\n";
+    ret = 1;
+  }
+  test_radar_pos = pos;
+
+  wxRemoveFile(file);
+  wxFileName::Rmdir(dir);
+  wxFileName::Rmdir(test_dir);
+  return ret;
+}
+
+static int CheckArpaRefreshWanted() {
+  int ret = 0;
+  SnapshotHeader *h = (SnapshotHeader *)calloc(1, sizeof(SnapshotHeader));
+
+  // A snapshot with MARPA targets only, as saved before the restart
+  h->arpa_targets = 3;
+  for (int i = 0; i < h->arpa_targets; i++) {
+    h->arpa[i].target_id = i + 1;
+    h->arpa[i].status = ACQUIRE3 + 1;  // active
+    h->arpa[i].automatic = false;
+  }
+
+  // Restore() has run, nothing is tracked yet and no guard zone has ARPA on
+  int targets = 0;
+  bool restore_pending = true;
+  if (!ArpaRefreshWanted(false, targets, false, restore_pending)) {
+    cout << "ERROR: MARPA only snapshot is not restored\n";
+    ret = 1;
+  }
+
+  // The refresh took up the targets and saves them again from now on
+  targets = h->arpa_targets;
+  restore_pending = false;
+  if (!ArpaRefreshWanted(false, targets, false, restore_pending)) {
+    cout << "ERROR: restored MARPA targets are not refreshed\n";
+    ret = 1;
+  }
+
+  // An empty snapshot is restored once, after that there is nothing to do
+  if (!ArpaRefreshWanted(false, 0, false, true)) {
+    cout << "ERROR: empty snapshot is not restored\n";
+    ret = 1;
+  }
+  if (ArpaRefreshWanted(false, 0, false, false)) {
+    cout << "ERROR: refresh without targets, guard zones or doppler\n";
+    ret = 1;
+  }
+
+  // The other reasons still hold on their own
+  if (!ArpaRefreshWanted(true, 0, false, false) || !ArpaRefreshWanted(false, 0, true, false)) {
+    cout << "ERROR: guard zone or doppler does not refresh\n";
+    ret = 1;
+  }
+
+  free(h);
+  return ret;
+}
+
+int main() {
+  int ret = 0;
+
+  if (CheckSaveRestore() != 0) {
+    ret = 1;
+  }
+  if (CheckArpaRefreshWanted() != 0) {
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
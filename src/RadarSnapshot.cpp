@@ -0,0 +1,412 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "RadarSnapshot.h"
+
+#include <wx/filename.h>
+
+#ifndef __WXMSW__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+// Each part of the map starts on a cache line
+#define SNAPSHOT_ALIGN(x) (((x) + HISTORY_ALIGN - 1) & ~(size_t)(HISTORY_ALIGN - 1))
+
+#ifndef __WXMSW__
+/*
+ * Make the file size bytes long with all of its blocks on disk. A page of the
+ * map without a block behind it only gets one when it is first written, and
+ * if the disk is full by then the spoke processor gets a SIGBUS instead of an
+ * error. A file of another size holds no snapshot we can use, so it is emptied.
+ */
+static bool ReserveFile(int fd, size_t size) {
+  struct stat st;
+
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  if (st.st_size != (off_t)size && ftruncate(fd, 0) != 0) {
+    return false;
+  }
+#ifdef __linux__
+  // Only allocates the blocks that are missing, the data is left as it is
+  return posix_fallocate(fd, 0, (off_t)size) == 0;
+#else
+  if (st.st_size == (off_t)size && (size_t)st.st_blocks * 512 >= size) {
+    return true;
+  }
+  static const uint8_t zeros[SNAPSHOT_PAGE] = {0};
+  for (size_t at = 0; at < size; at += SNAPSHOT_PAGE) {
+    size_t n = wxMin(size - at, (size_t)SNAPSHOT_PAGE);
+    if (pwrite(fd, zeros, n, (off_t)at) != (ssize_t)n) {
+      return false;
+    }
+  }
+  return true;
+#endif
+}
+#endif
+
+RadarSnapshot::RadarSnapshot(radar_pi *pi, RadarInfo *ri) {
+  m_pi = pi;
+  m_ri = ri;
+  m_state = SNAPSHOT_OFF;
+  m_restore_targets = false;
+  m_loading_spokes = 0;
+  m_map = 0;
+  m_header = 0;
+  m_true_trails_copied = 0;
+  m_last_angle = 0;
+  m_rotations = 0;
+  m_saving = false;
+  m_saved_rotations = 0;
+  m_targets_saved = 0;
+#ifdef __WXMSW__
+  m_file = INVALID_HANDLE_VALUE;
+  m_mapping = 0;
+#else
+  m_fd = -1;
+#endif
+
+  size_t spokes = m_ri->m_spokes;
+  size_t trail_size = (size_t)m_ri->m_trails->m_trail_size;
+  size_t true_trails = SNAPSHOT_ALIGN(sizeof(SnapshotHeader));
+  size_t relative_trails = true_trails + SNAPSHOT_ALIGN(trail_size * trail_size * sizeof(TrailRevolution));
+  size_t history_planes = relative_trails + SNAPSHOT_ALIGN(spokes * m_ri->m_spoke_len_max * sizeof(TrailRevolution));
+  size_t history_time = history_planes + SNAPSHOT_ALIGN(HistoryPlanesSize());
+  size_t history_pos = history_time + SNAPSHOT_ALIGN(spokes * sizeof(wxLongLong));
+
+  m_size = history_pos + SNAPSHOT_ALIGN(spokes * sizeof(GeoPosition));
+  m_true_trails_size = trail_size * trail_size;
+
+  wxString dir = *GetpPrivateApplicationDataLocation() + wxFileName::GetPathSeparator() + wxT("radar_pi");
+  if (!wxFileName::DirExists(dir) && !wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+    LOG_INFO(wxT("%s cannot create directory %s, no snapshot"), m_ri->m_name.c_str(), dir.c_str());
+    return;
+  }
+  if (!Map(dir + wxFileName::GetPathSeparator() + wxString::Format(wxT("radar%d.snapshot"), (int)m_ri->m_radar))) {
+    return;
+  }
+
+  m_header = (SnapshotHeader *)m_map;
+  m_true_trails = (TrailRevolution *)(m_map + true_trails);
+  m_relative_trails = (TrailRevolution *)(m_map + relative_trails);
+  m_history_planes = (uint64_t *)(m_map + history_planes);
+  m_history_time = (wxLongLong *)(m_map + history_time);
+  m_history_pos = (GeoPosition *)(m_map + history_pos);
+  m_state = SNAPSHOT_LOADING;
+}
+
+RadarSnapshot::~RadarSnapshot() { Unmap(); }
+
+bool RadarSnapshot::Map(const wxString &name) {
+#ifdef __WXMSW__
+  m_file = CreateFileW(name.wc_str(), GENERIC_READ | GENERIC_WRITE, 0, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+  if (m_file == INVALID_HANDLE_VALUE) {
+    LOG_INFO(wxT("%s cannot open %s, no snapshot"), m_ri->m_name.c_str(), name.c_str());
+    return false;
+  }
+  // This makes the file at least m_size long and fails when there is no room for that
+  m_mapping = CreateFileMappingW(m_file, 0, PAGE_READWRITE, (DWORD)((uint64_t)m_size >> 32), (DWORD)(m_size & 0xffffffff), 0);
+  if (m_mapping) {
+    m_map = (uint8_t *)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, m_size);
+  }
+#else
+  m_fd = open(name.mb_str(), O_RDWR | O_CREAT, 0644);
+  if (m_fd < 0) {
+    LOG_INFO(wxT("%s cannot open %s, no snapshot"), m_ri->m_name.c_str(), name.c_str());
+    return false;
+  }
+  if (!ReserveFile(m_fd, m_size)) {
+    LOG_INFO(wxT("%s no room for %s, no snapshot"), m_ri->m_name.c_str(), name.c_str());
+    Unmap();
+    return false;
+  }
+  void *map = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (map != MAP_FAILED) {
+    m_map = (uint8_t *)map;
+  }
+#endif
+  if (!m_map) {
+    LOG_INFO(wxT("%s cannot map %s, no snapshot"), m_ri->m_name.c_str(), name.c_str());
+    Unmap();
+    return false;
+  }
+  return true;
+}
+
+void RadarSnapshot::Unmap() {
+  m_state = SNAPSHOT_OFF;
+#ifdef __WXMSW__
+  if (m_map) {
+    UnmapViewOfFile(m_map);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+    m_mapping = 0;
+  }
+  if (m_file != INVALID_HANDLE_VALUE) {
+    CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (m_map) {
+    munmap(m_map, m_size);
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+#endif
+  m_map = 0;
+}
+
+/*
+ * Is the snapshot in the map one that we can use? pos is where the radar is now.
+ */
+bool RadarSnapshot::IsValid(GeoPosition *pos) {
+  SnapshotHeader *h = m_header;
+
+  if (h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION || h->size != m_size) {
+    LOG_INFO(wxT("%s no snapshot to restore"), m_ri->m_name.c_str());
+    return false;
+  }
+  if (h->radar_type != m_ri->m_radar_type || h->spokes != m_ri->m_spokes || h->spoke_len_max != m_ri->m_spoke_len_max ||
+      h->trail_size != (uint32_t)m_ri->m_trails->m_trail_size) {
+    LOG_INFO(wxT("%s snapshot is of another radar, not restored"), m_ri->m_name.c_str());
+    return false;
+  }
+  wxLongLong age = wxGetUTCTimeMillis() - h->time;
+  if (age < 0 || age > SNAPSHOT_MAX_AGE * 1000) {
+    LOG_INFO(wxT("%s snapshot is too old, not restored"), m_ri->m_name.c_str());
+    return false;
+  }
+  if (local_distance(h->pos, *pos) > SNAPSHOT_MAX_DISTANCE) {
+    LOG_INFO(wxT("%s radar has moved since the snapshot, not restored"), m_ri->m_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Start saving into the map, whatever is in it now is kept.
+ */
+void RadarSnapshot::Start() {
+  SnapshotHeader *h = m_header;
+
+  h->magic = SNAPSHOT_MAGIC;
+  h->version = SNAPSHOT_VERSION;
+  h->radar_type = m_ri->m_radar_type;
+  h->spokes = (uint32_t)m_ri->m_spokes;
+  h->spoke_len_max = (uint32_t)m_ri->m_spoke_len_max;
+  h->trail_size = (uint32_t)m_ri->m_trails->m_trail_size;
+  h->size = m_size;
+  m_rotations = 0;
+  m_saving = false;
+  m_saved_rotations = 0;
+  m_state = SNAPSHOT_SAVING;
+}
+
+/*
+ * Called by ProcessRadarSpoke for each spoke, before anything is done with it.
+ *
+ * The first time the radar position is known, the trails and the history are
+ * restored from the map if it holds a snapshot that fits. Returns true when it
+ * did, the ARPA targets are then restored by the next RestoreTargets().
+ */
+bool RadarSnapshot::Restore() {
+  GeoPosition pos;
+
+  if (m_state != SNAPSHOT_LOADING) {
+    return false;
+  }
+  if (!m_ri->GetRadarPosition(&pos)) {
+    // Do not wait for a position forever, the snapshot is not saved meanwhile
+    if (++m_loading_spokes >= m_ri->m_spokes) {
+      LOG_INFO(wxT("%s no radar position, snapshot not restored"), m_ri->m_name.c_str());
+      memset(m_map, 0, m_size);
+      Start();
+    }
+    return false;
+  }
+  if (!IsValid(&pos)) {
+    memset(m_map, 0, m_size);
+    Start();
+    return false;
+  }
+
+  SnapshotHeader *h = m_header;
+  TrailBuffer *trails = m_ri->m_trails;
+  int seconds = (int)(wxGetUTCTimeMillis() - h->time).GetLo() / 1000;
+
+  memcpy(trails->m_true_trails, m_true_trails, m_true_trails_size * sizeof(TrailRevolution));
+  memcpy(trails->m_relative_trails, m_relative_trails, m_ri->m_spokes * m_ri->m_spoke_len_max * sizeof(TrailRevolution));
+  trails->m_pos = h->trail_pos;
+  trails->m_dif = h->trail_dif;
+  trails->m_offset.lat = h->trail_offset_lat;
+  trails->m_offset.lon = h->trail_offset_lon;
+  // The next UpdateTrailPosition moves and zooms the trails to where the radar is now
+  trails->m_previous_pixels_per_meter = h->trail_pixels_per_meter;
+  // The trails kept ageing while we were gone
+  trails->m_revolution = (TrailRevolution)(h->trail_revolution + SECONDS_TO_REVOLUTIONS(seconds));
+  if (trails->m_revolution == 0) {
+    trails->m_revolution = 1;
+  }
+  trails->CountTrails();
+
+  SpokeHistory *history = m_ri->m_history;
+  {
+    wxCriticalSectionLocker lock(m_ri->m_history_lock);
+    memcpy(history->Planes(0), m_history_planes, HistoryPlanesSize());
+    for (size_t i = 0; i < m_ri->m_spokes; i++) {
+      history->m_time[i] = m_history_time[i];
+      history->m_pos[i] = m_history_pos[i];
+    }
+  }
+
+  LOG_INFO(wxT("%s restored snapshot of %d seconds ago with %d ARPA targets"), m_ri->m_name.c_str(), seconds, h->arpa_targets);
+  m_restore_targets = true;
+  Start();
+  return true;
+}
+
+/*
+ * Copies into the map, but only the pages of it that do not hold the same
+ * already. Reading a page of the map does not make it dirty, so the pages
+ * that did not change are not written to the file again.
+ */
+void RadarSnapshot::CopyChanged(void *to, const void *from, size_t size) {
+  uint8_t *dst = (uint8_t *)to;
+  const uint8_t *src = (const uint8_t *)from;
+
+  while (size > 0) {
+    size_t n = wxMin(size, SNAPSHOT_PAGE - (size_t)(dst - m_map) % SNAPSHOT_PAGE);
+    if (memcmp(dst, src, n) != 0) {
+      memcpy(dst, src, n);
+    }
+    dst += n;
+    src += n;
+    size -= n;
+  }
+}
+
+/*
+ * Called by ProcessRadarSpoke after a spoke has been processed. During one
+ * rotation out of SNAPSHOT_SAVE_ROTATIONS, copies what the spoke changed into
+ * the map: its relative trails and history, and a 1 / m_spokes share of the
+ * true trails so those are all copied in that rotation.
+ *
+ * Copying every rotation would make the whole map dirty each time, some 13 MB
+ * per rotation for a 2048 spoke radar, which wears out the SD card of a small
+ * chart plotter. Now at most the whole map is written once a minute, and in
+ * practice only the pages with trails or echoes that changed meanwhile.
+ */
+void RadarSnapshot::Save(SpokeBearing angle, SpokeBearing bearing) {
+  if (m_state != SNAPSHOT_SAVING) {
+    return;
+  }
+  if (angle < m_last_angle) {
+    if (m_saving) {
+      // The rotation is in the map, ask for its pages to be written without waiting for them
+#ifdef __WXMSW__
+      FlushViewOfFile(m_map, 0);
+#else
+      msync(m_map, m_size, MS_ASYNC);
+#endif
+    }
+    m_rotations++;
+    m_saving = (m_rotations % SNAPSHOT_SAVE_ROTATIONS) == 0;
+    if (m_saving) {
+      m_saved_rotations++;
+    }
+  }
+  m_last_angle = angle;
+  if (!m_saving) {
+    return;
+  }
+
+  TrailBuffer *trails = m_ri->m_trails;
+  SpokeHistory *history = m_ri->m_history;
+  SnapshotHeader *h = m_header;
+  size_t len = (size_t)trails->m_max_spoke_len;
+  size_t stride = HISTORY_PLANES * history->Words();
+
+  CopyChanged(m_relative_trails + angle * len, trails->m_relative_trails + angle * len, len * sizeof(TrailRevolution));
+
+  size_t from = m_true_trails_copied;
+  size_t count = wxMin((m_true_trails_size + m_ri->m_spokes - 1) / m_ri->m_spokes, m_true_trails_size - from);
+  CopyChanged(m_true_trails + from, trails->m_true_trails + from, count * sizeof(TrailRevolution));
+  m_true_trails_copied = (from + count) % m_true_trails_size;
+
+  CopyChanged(m_history_planes + bearing * stride, history->Planes(bearing), stride * sizeof(uint64_t));
+  m_history_time[bearing] = history->m_time[bearing];
+  m_history_pos[bearing] = history->m_pos[bearing];
+
+  // Not the time of the spoke, some radars stamp those with the local time
+  h->time = wxGetUTCTimeMillis();
+  h->pos = history->m_pos[bearing];
+  h->trail_pos = trails->m_pos;
+  h->trail_dif = trails->m_dif;
+  h->trail_offset_lat = trails->m_offset.lat;
+  h->trail_offset_lon = trails->m_offset.lon;
+  h->trail_pixels_per_meter = trails->m_previous_pixels_per_meter;
+  h->trail_revolution = trails->m_revolution;
+}
+
+/*
+ * Called by RefreshArpaTargets, restores the targets when Restore() restored the rest.
+ */
+void RadarSnapshot::RestoreTargets() {
+  if (m_state == SNAPSHOT_SAVING && m_restore_targets) {
+    m_ri->m_arpa->RestoreTargets(m_header->arpa, wxMin(wxMax(m_header->arpa_targets, 0), MAX_NUMBER_OF_TARGETS));
+    m_restore_targets = false;
+  }
+}
+
+/*
+ * Called by RefreshArpaTargets once per rotation, copies the targets into the map
+ * once for each rotation that is saved: while it is saved or soon after.
+ */
+void RadarSnapshot::SaveTargets() {
+  size_t saved = m_saved_rotations;
+
+  if (m_state == SNAPSHOT_SAVING && saved != m_targets_saved && !m_restore_targets) {
+    m_header->arpa_targets = m_ri->m_arpa->SaveTargets(m_header->arpa, MAX_NUMBER_OF_TARGETS);
+    m_targets_saved = saved;
+  }
+}
+
+PLUGIN_END_NAMESPACE
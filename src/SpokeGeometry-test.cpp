@@ -0,0 +1,386 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Test for SpokeKernelsFor<SpokeGeometry>.
+ *
+ * Compares the loops compiled for a spoke geometry against the same loops
+ * with the geometry known only at run time, as ArpaTarget used to do them
+ * with MOD_SPOKES and m_spoke_len_max, on random histories with blobs that
+ * wrap past spoke 0. Pix, both kinds of contour walk, ClearPixels and
+ * ProcessSpoke must give the same results, bounds, contours and history.
+ */
+
+#include "SpokeGeometry.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_HISTORIES (20)
+#define TEST_WALKS (2000)
+#define TEST_MAX_POINTS (100) // Short, so that long contours are cut short
+#define TEST_MAX_LENGTH (90)
+
+static uint32_t seed = 1;
+
+static uint32_t Random(uint32_t n) {
+  seed = seed * 1103515245 + 12345;
+  return ((seed >> 8) & 0xffffff) % n;
+}
+
+// The old code, with the geometry of a RadarInfo
+struct Reference {
+  size_t spokes;
+  size_t spoke_len;
+
+  int Mod(int raw) { return (raw + 2 * (int)spokes) % (int)spokes; }
+
+  bool Pix(SpokeHistory *h, int plane, int and_plane, int ang, int rad) {
+    if (rad <= 0 || rad >= (int)spoke_len) {
+      return false;
+    }
+    int angle = Mod(ang);
+    if (and_plane != HISTORY_NO_PLANE && !HistoryTest(h->Plane(angle, and_plane), rad)) {
+      return false;
+    }
+    return HistoryTest(h->Plane(angle, plane), rad);
+  }
+
+  int TraceContour(SpokeHistory *h, int plane, int and_plane, Polar start, ContourWalk *walk) {
+    Polar transl[4];  //   = { 0, 1,   1, 0,   0, -1,   -1, 0 };
+    transl[0].angle = 0;
+    transl[0].r = 1;
+    transl[1].angle = 1;
+    transl[1].r = 0;
+    transl[2].angle = 0;
+    transl[2].r = -1;
+    transl[3].angle = -1;
+    transl[3].r = 0;
+    Polar current = start;
+    int count = 0;
+    int aa = 0;
+    int rr = 0;
+    bool succes = false;
+    int index = 0;
+
+    walk->length = 0;
+    walk->max_r = current;
+    walk->max_angle = current;
+    walk->min_r = current;
+    walk->min_angle = current;
+    if (start.r >= (int)spoke_len) {
+      return CONTOUR_R_LARGE;
+    }
+    if (start.r < walk->min_radius) {
+      return CONTOUR_R_SMALL;
+    }
+    if (!Pix(h, plane, and_plane, start.angle, start.r)) {
+      return CONTOUR_OUTSIDE;
+    }
+    for (int i = 0; i < 4; i++) {
+      index = i;
+      aa = current.angle + transl[index].angle;
+      rr = current.r + transl[index].r;
+      succes = !Pix(h, plane, and_plane, aa, rr);
+      if (succes) break;
+    }
+    if (!succes) {
+      return CONTOUR_INSIDE;
+    }
+    index += 1;
+    if (index > 3) index -= 4;
+    while (current.r != start.r || current.angle != start.angle || count == 0) {
+      index += 3;
+      for (int i = 0; i < 4; i++) {
+        if (index > 3) index -= 4;
+        aa = current.angle + transl[index].angle;
+        rr = current.r + transl[index].r;
+        succes = Pix(h, plane, and_plane, aa, rr);
+        if (succes) {
+          break;
+        }
+        index += 1;
+      }
+      if (!succes) {
+        walk->length = count;
+        return CONTOUR_BROKEN;
+      }
+      current.angle = aa;
+      current.r = rr;
+      if (walk->points) {
+        if (count < walk->max_points - 2) {
+          walk->points[count].angle = (int16_t)current.angle;
+          walk->points[count].r = (int16_t)current.r;
+        }
+        if (count == walk->max_points - 2) {
+          walk->points[count].angle = (int16_t)start.angle;
+          walk->points[count].r = (int16_t)start.r;
+          current = start;
+        }
+        if (count < walk->max_points - 1) {
+          count++;
+        }
+      } else {
+        if (count >= walk->max_length) {
+          walk->length = count;
+          return CONTOUR_LONG;
+        }
+        count++;
+      }
+      if (current.angle > walk->max_angle.angle) {
+        walk->max_angle = current;
+      }
+      if (current.angle < walk->min_angle.angle) {
+        walk->min_angle = current;
+      }
+      if (current.r > walk->max_r.r) {
+        walk->max_r = current;
+      }
+      if (current.r < walk->min_r.r) {
+        walk->min_r = current;
+      }
+    }
+    walk->length = count;
+    return CONTOUR_CLOSED;
+  }
+
+  void ClearPixels(SpokeHistory *h, int angle1, int angle2, size_t from, size_t to, bool unclaimed_only) {
+    for (int a = angle1; a <= angle2; a++) {
+      if (unclaimed_only) {
+        HistoryClear(h->Plane(Mod(a), HISTORY_UNCLAIMED), from, to);
+      } else {
+        h->Clear(Mod(a), from, to);
+      }
+    }
+  }
+};
+
+static void Set(uint64_t *plane, size_t r) { plane[r >> 6] |= (uint64_t)1 << (r & 63); }
+
+// Random blobs, some across spoke 0, claimed and doppler in parts
+static void MakeHistory(SpokeHistory *h, size_t spokes, size_t spoke_len) {
+  h->Reset();
+  size_t blobs = 20 + Random(40);
+  for (size_t b = 0; b < blobs; b++) {
+    int angle = (int)Random(spokes);
+    int r = 1 + (int)Random(spoke_len - 1);
+    int da = 1 + (int)Random(b % 4 == 0 ? 60 : 12);
+    int dr = 1 + (int)Random(b % 4 == 0 ? 60 : 12);
+    bool claimed = Random(4) == 0;
+    bool doppler = Random(4) == 0;
+    for (int a = angle - da; a <= angle + da; a++) {
+      SpokeBearing s = (SpokeBearing)((a + 2 * (int)spokes) % (int)spokes);
+      for (int rr = r - dr; rr <= r + dr; rr++) {
+        if (rr < 0 || rr >= (int)spoke_len || Random(16) == 0) {
+          continue;  // ragged edges and a few holes
+        }
+        Set(h->Plane(s, HISTORY_TARGET), rr);
+        if (!claimed) {
+          Set(h->Plane(s, HISTORY_UNCLAIMED), rr);
+        }
+        if (doppler && rr % 3 != 0) {
+          Set(h->Plane(s, HISTORY_DOPPLER), rr);
+        }
+      }
+    }
+  }
+}
+
+static bool SameWalk(const ContourWalk &a, const ContourWalk &b) {
+  if (a.length != b.length || a.min_angle.angle != b.min_angle.angle || a.min_angle.r != b.min_angle.r ||
+      a.max_angle.angle != b.max_angle.angle || a.max_angle.r != b.max_angle.r || a.min_r.angle != b.min_r.angle ||
+      a.min_r.r != b.min_r.r || a.max_r.angle != b.max_r.angle || a.max_r.r != b.max_r.r) {
+    return false;
+  }
+  if (a.points) {
+    int n = a.length < a.max_points ? a.length : a.max_points;
+    for (int i = 0; i < n; i++) {
+      if (a.points[i].angle != b.points[i].angle || a.points[i].r != b.points[i].r) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool SameHistory(SpokeHistory *a, SpokeHistory *b, size_t spokes) {
+  return memcmp(a->Planes(0), b->Planes(0), spokes * HISTORY_PLANES * a->Words() * sizeof(uint64_t)) == 0;
+}
+
+template <class G>
+static int CheckGeometry() {
+  SpokeKernelsFor<G> kernels;
+  Reference ref = {G::spokes, G::spoke_len};
+  SpokeHistory h(G::spokes, G::spoke_len);
+  SpokeHistory g(G::spokes, G::spoke_len);
+  static const int planes[][2] = {{HISTORY_UNCLAIMED, HISTORY_NO_PLANE},
+                                  {HISTORY_TARGET, HISTORY_NO_PLANE},
+                                  {HISTORY_UNCLAIMED, HISTORY_DOPPLER},
+                                  {HISTORY_TARGET, HISTORY_DOPPLER}};
+  int errors = 0;
+  int closed = 0;
+  int cut = 0;
+
+  cout << "INFO: geometry " << G::spokes << "x" << G::spoke_len << "\n";
+  if (h.Words() != (size_t)G::history_words) {
+    cout << "ERROR: history_words " << G::history_words << " but SpokeHistory::Words() " << h.Words() << "\n";
+    errors++;
+  }
+
+  for (int n = 0; n < TEST_HISTORIES && errors == 0; n++) {
+    MakeHistory(&h, G::spokes, G::spoke_len);
+
+    for (int i = 0; i < TEST_WALKS && errors < 10; i++) {
+      const int *p = planes[Random(4)];
+      int ang = (int)Random(4 * G::spokes) - 2 * (int)G::spokes;
+      int rad = (int)Random(G::spoke_len + 4) - 2;
+
+      if (kernels.Pix(&h, p[0], p[1], ang, rad) != ref.Pix(&h, p[0], p[1], ang, rad)) {
+        cout << "ERROR: Pix(" << ang << ", " << rad << ") differs\n";
+        errors++;
+      }
+
+      // Start on a contour most of the time: go out from a set return
+      Polar start;
+      start.angle = (int)Random(G::spokes);
+      start.r = 1 + (int)Random(G::spoke_len - 1);
+      while (Random(8) != 0 && ref.Pix(&h, p[0], p[1], start.angle, start.r + 1)) {
+        start.r++;
+      }
+
+      ContourPoint points[TEST_MAX_POINTS];
+      ContourPoint ref_points[TEST_MAX_POINTS];
+      ContourWalk walk;
+      ContourWalk ref_walk;
+      bool draw = Random(2) == 0;
+      walk.min_radius = draw ? 4 : 3;
+      walk.points = draw ? points : 0;
+      walk.max_points = TEST_MAX_POINTS;
+      walk.max_length = TEST_MAX_LENGTH;
+      walk.fence_start = 0;
+      walk.fence_width = 0;
+      ref_walk = walk;
+      ref_walk.points = draw ? ref_points : 0;
+
+      int result = kernels.TraceContour(&h, p[0], p[1], start, &walk);
+      int ref_result = ref.TraceContour(&h, p[0], p[1], start, &ref_walk);
+      if (result != ref_result || !SameWalk(walk, ref_walk)) {
+        cout << "ERROR: TraceContour(" << start.angle << ", " << start.r << ") gave " << result << " length " << walk.length
+             << ", expected " << ref_result << " length " << ref_walk.length << "\n";
+        errors++;
+        continue;
+      }
+      closed += result == CONTOUR_CLOSED;
+      cut += result == CONTOUR_LONG || (draw && walk.length == TEST_MAX_POINTS - 1);
+
+      // A fence only ever stops a walk, it never changes one
+      ContourWalk fenced = walk;
+      fenced.fence_start = (int)Random(G::spokes);
+      fenced.fence_width = 3 + (int)Random(G::spokes - 3);
+      int fenced_result = kernels.TraceContour(&h, p[0], p[1], start, &fenced);
+      if (fenced_result != CONTOUR_FENCE && (fenced_result != result || !SameWalk(fenced, ref_walk))) {
+        cout << "ERROR: fenced TraceContour(" << start.angle << ", " << start.r << ") gave " << fenced_result << ", expected "
+             << result << "\n";
+        errors++;
+      }
+
+      // Clear the blob as BlobHasContour does, on a copy
+      if (result == CONTOUR_CLOSED && i % 8 == 0) {
+        memcpy(g.Planes(0), h.Planes(0), G::spokes * HISTORY_PLANES * h.Words() * sizeof(uint64_t));
+        bool unclaimed_only = Random(2) == 0;
+        kernels.ClearPixels(&h, walk.min_angle.angle, walk.max_angle.angle, walk.min_r.r, walk.max_r.r + 1, unclaimed_only);
+        ref.ClearPixels(&g, walk.min_angle.angle, walk.max_angle.angle, walk.min_r.r, walk.max_r.r + 1, unclaimed_only);
+        if (!SameHistory(&h, &g, G::spokes)) {
+          cout << "ERROR: ClearPixels(" << walk.min_angle.angle << ", " << walk.max_angle.angle << ") differs\n";
+          errors++;
+        }
+      }
+    }
+  }
+  cout << "INFO: " << closed << " closed and " << cut << " cut short contours\n";
+  if (closed == 0 || cut == 0) {
+    cout << "ERROR: the random histories do not cover the contour walks\n";
+    errors++;
+  }
+
+  // ProcessSpoke is SpokeKernel with the history words of the geometry
+  vector<uint8_t> data(G::spoke_len);
+  vector<uint8_t> ref_data(G::spoke_len);
+  for (int n = 0; n < 200 && errors == 0; n++) {
+    size_t len = n % 2 ? G::spoke_len : Random(G::spoke_len + 1);
+    SpokeBearing angle = (SpokeBearing)Random(G::spokes);
+    SpokeKernelParams params;
+    CLEAR_STRUCT(params);
+    params.main_bang = Random(20);
+    params.threshold = (int)Random(64);
+    params.history_threshold = 200;
+    params.guard_threshold = 150;
+    params.zones = 1;
+    params.zone[0].start = Random(G::spoke_len);
+    params.zone[0].end = Random(G::spoke_len);
+    SpokeKernelParams ref_params = params;
+
+    for (size_t r = 0; r < len; r++) {
+      data[r] = (uint8_t)(Random(8) == 0 ? 255 : Random(256));
+      ref_data[r] = data[r];
+    }
+    memset(g.Planes(angle), 0xa5, HISTORY_PLANES * g.Words() * sizeof(uint64_t));
+    memset(h.Planes(angle), 0x5a, HISTORY_PLANES * h.Words() * sizeof(uint64_t));
+    kernels.ProcessSpoke(data.data(), len, h.Planes(angle), params);
+    SpokeKernel(ref_data.data(), len, g.Planes(angle), g.Words(), ref_params);
+    if (memcmp(data.data(), ref_data.data(), len) != 0 ||
+        memcmp(h.Planes(angle), g.Planes(angle), HISTORY_PLANES * h.Words() * sizeof(uint64_t)) != 0 ||
+        params.doppler_count != ref_params.doppler_count || params.zone[0].count != ref_params.zone[0].count) {
+      cout << "ERROR: ProcessSpoke of " << len << " returns differs\n";
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+int main() {
+  int errors = 0;
+
+  errors += CheckGeometry<SpokeGeometry<2048, 1024> >();
+  errors += CheckGeometry<SpokeGeometry<1440, 705> >();
+  errors += CheckGeometry<SpokeGeometry<250, 250> >();
+
+  if (errors == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(errors != 0 ? 1 : 0);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
@@ -0,0 +1,184 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Microbenchmark for the ARPA history bit planes.
+ *
+ * Builds a synthetic sweep with many small targets and some sea clutter,
+ * then runs the target search the way GuardZone::SearchTargets does it:
+ * every other spoke is scanned for a return that is not claimed yet, and
+ * each target found is erased so it is not found again.
+ *
+ * This is done on the old layout, one byte per return with bit 7 meaning
+ * "unclaimed target", and on the HISTORY_UNCLAIMED bit plane. Both must
+ * find the same targets.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include "SpokeHistory.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKES (2048)
+#define BENCH_SPOKE_LEN (1024)
+#define BENCH_WORDS (HISTORY_WORDS(BENCH_SPOKE_LEN))
+#define BENCH_TARGETS (200)
+#define BENCH_TARGET_SIZE (6)
+#define BENCH_REPEAT (50)
+
+struct Blob {
+  int angle;
+  int r;
+};
+
+static void MakeSweep(vector<Blob> &blobs, uint8_t *bytes, uint64_t *planes) {
+  uint32_t seed = 1;
+
+  memset(bytes, 0, BENCH_SPOKES * BENCH_SPOKE_LEN);
+  memset(planes, 0, HISTORY_PLANES * BENCH_SPOKES * BENCH_WORDS * sizeof(uint64_t));
+  for (int t = 0; t < BENCH_TARGETS; t++) {
+    seed = seed * 1103515245 + 12345;
+    Blob b = {(int)((seed >> 8) % (BENCH_SPOKES - BENCH_TARGET_SIZE)),
+              (int)(20 + (seed >> 20) % (BENCH_SPOKE_LEN - 40))};
+    blobs.push_back(b);
+  }
+  // Clutter close to the radar
+  for (int a = 0; a < BENCH_SPOKES; a += 37) {
+    Blob b = {a, 8};
+    blobs.push_back(b);
+  }
+  for (size_t i = 0; i < blobs.size(); i++) {
+    for (int a = blobs[i].angle; a < blobs[i].angle + BENCH_TARGET_SIZE; a++) {
+      for (int r = blobs[i].r; r < blobs[i].r + BENCH_TARGET_SIZE; r++) {
+        bytes[(a % BENCH_SPOKES) * BENCH_SPOKE_LEN + r] = 0xc0;
+        uint64_t *plane = planes + (a % BENCH_SPOKES) * HISTORY_PLANES * BENCH_WORDS;
+        plane[HISTORY_TARGET * BENCH_WORDS + r / 64] |= (uint64_t)1 << (r & 63);
+        plane[HISTORY_UNCLAIMED * BENCH_WORDS + r / 64] |= (uint64_t)1 << (r & 63);
+      }
+    }
+  }
+}
+
+// Erase the square at angle, r as a stand in for ResetPixels
+static int SearchBytes(uint8_t *bytes) {
+  int found = 0;
+
+  for (int angle = 0; angle < BENCH_SPOKES; angle += 2) {
+    uint8_t *line = bytes + angle * BENCH_SPOKE_LEN;
+    for (int r = 1; r < BENCH_SPOKE_LEN; r++) {
+      if ((line[r] & 128) != 0) {
+        found++;
+        for (int a = angle; a < angle + BENCH_TARGET_SIZE; a++) {
+          uint8_t *l = bytes + (a % BENCH_SPOKES) * BENCH_SPOKE_LEN;
+          for (int rr = r; rr < r + BENCH_TARGET_SIZE && rr < BENCH_SPOKE_LEN; rr++) {
+            l[rr] &= 127;
+          }
+        }
+      }
+    }
+  }
+  return found;
+}
+
+static int SearchPlanes(uint64_t *planes) {
+  int found = 0;
+
+  for (int angle = 0; angle < BENCH_SPOKES; angle += 2) {
+    const uint64_t *unclaimed = planes + (angle * HISTORY_PLANES + HISTORY_UNCLAIMED) * BENCH_WORDS;
+    for (size_t r = HistoryFindNext(unclaimed, 0, 1, BENCH_SPOKE_LEN); r < BENCH_SPOKE_LEN;
+         r = HistoryFindNext(unclaimed, 0, r + 1, BENCH_SPOKE_LEN)) {
+      found++;
+      for (int a = angle; a < angle + BENCH_TARGET_SIZE; a++) {
+        uint64_t *plane = planes + ((a % BENCH_SPOKES) * HISTORY_PLANES + HISTORY_UNCLAIMED) * BENCH_WORDS;
+        HistoryClear(plane, r, r + BENCH_TARGET_SIZE < BENCH_SPOKE_LEN ? r + BENCH_TARGET_SIZE : BENCH_SPOKE_LEN);
+      }
+    }
+  }
+  return found;
+}
+
+int main() {
+  int ret = 0;
+  vector<Blob> blobs;
+  static uint8_t sweep_bytes[BENCH_SPOKES * BENCH_SPOKE_LEN], bytes[BENCH_SPOKES * BENCH_SPOKE_LEN];
+  static uint64_t sweep_planes[HISTORY_PLANES * BENCH_SPOKES * BENCH_WORDS], planes[HISTORY_PLANES * BENCH_SPOKES * BENCH_WORDS];
+  int found_bytes = 0, found_planes = 0;
+
+  MakeSweep(blobs, sweep_bytes, sweep_planes);
+  cout << "INFO: " << blobs.size() << " targets, history " << sizeof(sweep_bytes) / 1024 << " kB as bytes, "
+       << sizeof(sweep_planes) / 1024 << " kB as bit planes\n";
+
+  std::chrono::duration<double, std::micro> byte_time(0), plane_time(0);
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    memcpy(bytes, sweep_bytes, sizeof(bytes));
+    auto start = std::chrono::steady_clock::now();
+    found_bytes = SearchBytes(bytes);
+    byte_time += std::chrono::steady_clock::now() - start;
+
+    memcpy(planes, sweep_planes, sizeof(planes));
+    start = std::chrono::steady_clock::now();
+    found_planes = SearchPlanes(planes);
+    plane_time += std::chrono::steady_clock::now() - start;
+  }
+
+  cout << "INFO: byte history " << byte_time.count() / BENCH_REPEAT << " us/sweep, " << found_bytes << " found\n";
+  cout << "INFO: bit planes   " << plane_time.count() / BENCH_REPEAT << " us/sweep, " << found_planes << " found\n";
+
+  if (found_bytes != found_planes) {
+    cout << "ERROR: searches found a different number of targets\n";
+    ret = 1;
+  }
+  for (int a = 0; a < BENCH_SPOKES; a++) {
+    for (int r = 0; r < BENCH_SPOKE_LEN; r++) {
+      bool byte = (bytes[a * BENCH_SPOKE_LEN + r] & 128) != 0;
+      bool bit = HistoryTest(planes + (a * HISTORY_PLANES + HISTORY_UNCLAIMED) * BENCH_WORDS, r);
+      if (byte != bit) {
+        cout << "ERROR: history differs at " << a << ", " << r << "\n";
+        ret = 1;
+        a = BENCH_SPOKES;
+        break;
+      }
+    }
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
@@ -0,0 +1,284 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Microbenchmark for the memory layout of the spoke history.
+ *
+ * Compares the old layout, an array of { line, time, pos } with each line
+ * allocated separately, against SpokeHistory: one aligned block for all bit
+ * planes and separate time and position arrays. The same three access
+ * patterns are timed on both:
+ *
+ * - ingest:  ProcessRadarSpoke writing time, position and planes per spoke,
+ * - search:  SearchTargets comparing the times of every other spoke and a
+ *            spoke 3 * SCAN_MARGIN further, then scanning its plane,
+ * - refresh: RefreshTarget reading time and position at random angles.
+ *
+ * The caches are flushed before each pass, as the GUI thread does plenty
+ * of other work between ARPA refreshes. On Linux the cache misses of each
+ * pass are counted with perf_event_open; when that is not allowed (see
+ * /proc/sys/kernel/perf_event_paranoid) only times are shown.
+ */
+
+#include <chrono>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "SpokeHistory.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKES (2048)
+#define BENCH_SPOKE_LEN (1024)
+#define BENCH_SCAN_MARGIN (13)
+#define BENCH_LOOKUPS (20000)
+#define BENCH_REPEAT (20)
+#define BENCH_FLUSH_SIZE (32 * 1024 * 1024)
+
+struct line_history {
+  uint64_t *planes;
+  wxLongLong time;
+  GeoPosition pos;
+};
+
+class OldHistory {
+ public:
+  OldHistory(size_t spokes, size_t spoke_len) {
+    m_words = HISTORY_WORDS(spoke_len);
+    m_lines = (line_history *)calloc(sizeof(line_history), spokes);
+    for (size_t i = 0; i < spokes; i++) {
+      m_lines[i].planes = (uint64_t *)calloc(sizeof(uint64_t), HISTORY_PLANES * m_words);
+      // Other allocations made meanwhile, as happens in RadarInfo::Init
+      m_other.push_back(malloc(16 + (i * 7919) % 700));
+    }
+  }
+  ~OldHistory() {
+    for (size_t i = 0; i < BENCH_SPOKES; i++) {
+      free(m_lines[i].planes);
+    }
+    free(m_lines);
+    for (size_t i = 0; i < m_other.size(); i++) {
+      free(m_other[i]);
+    }
+  }
+  uint64_t *Planes(SpokeBearing angle) { return m_lines[angle].planes; }
+  uint64_t *Plane(SpokeBearing angle, int plane) { return m_lines[angle].planes + plane * m_words; }
+  size_t Words() { return m_words; }
+  wxLongLong &Time(SpokeBearing angle) { return m_lines[angle].time; }
+  GeoPosition &Pos(SpokeBearing angle) { return m_lines[angle].pos; }
+
+ private:
+  size_t m_words;
+  line_history *m_lines;
+  vector<void *> m_other;
+};
+
+// SpokeHistory with the accessors used above
+class NewHistory : public SpokeHistory {
+ public:
+  NewHistory(size_t spokes, size_t spoke_len) : SpokeHistory(spokes, spoke_len) {}
+  wxLongLong &Time(SpokeBearing angle) { return m_time[angle]; }
+  GeoPosition &Pos(SpokeBearing angle) { return m_pos[angle]; }
+};
+
+class CacheMisses {
+ public:
+  CacheMisses() {
+    m_fd = -1;
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  }
+  ~CacheMisses() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      close(m_fd);
+    }
+#endif
+  }
+  bool Available() { return m_fd >= 0; }
+  void Start() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+  long long Stop() {
+    long long count = 0;
+#ifdef __linux__
+    if (m_fd >= 0) {
+      ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+#endif
+    return count;
+  }
+
+ private:
+  int m_fd;
+};
+
+static uint8_t *flush_buffer;
+
+static void FlushCaches() {
+  for (size_t i = 0; i < BENCH_FLUSH_SIZE; i += 64) {
+    flush_buffer[i]++;
+  }
+}
+
+struct Result {
+  double us[3];
+  long long misses[3];
+  long long check;
+};
+
+template <typename H>
+static Result Run(H &h, CacheMisses &perf) {
+  Result res;
+  long long check = 0;
+  size_t words = h.Words();
+
+  memset(&res, 0, sizeof(res));
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    for (int pass = 0; pass < 3; pass++) {
+      FlushCaches();
+      perf.Start();
+      auto start = std::chrono::steady_clock::now();
+      if (pass == 0) {
+        for (SpokeBearing a = 0; a < BENCH_SPOKES; a++) {
+          h.Time(a) = rep * BENCH_SPOKES + a;
+          h.Pos(a).lat = 52. + a * 1e-6;
+          h.Pos(a).lon = 4. + rep * 1e-6;
+          uint64_t *planes = h.Planes(a);
+          for (size_t w = 0; w < HISTORY_PLANES * words; w++) {
+            planes[w] = (a % 5 == 0 && w % 7 == 0) ? (uint64_t)(a + w) : 0;
+          }
+        }
+      } else if (pass == 1) {
+        for (SpokeBearing a = 0; a < BENCH_SPOKES; a += 2) {
+          wxLongLong time1 = h.Time(a);
+          wxLongLong time2 = h.Time((a + 3 * BENCH_SCAN_MARGIN) % BENCH_SPOKES);
+          if (time2 >= time1) {
+            const uint64_t *unclaimed = h.Plane(a, HISTORY_UNCLAIMED);
+            check += (long long)HistoryFindNext(unclaimed, 0, 20, BENCH_SPOKE_LEN - 5);
+          }
+        }
+      } else {
+        uint32_t seed = rep + 1;
+        for (int n = 0; n < BENCH_LOOKUPS; n++) {
+          seed = seed * 1103515245 + 12345;
+          SpokeBearing a = (seed >> 8) % BENCH_SPOKES;
+          wxLongLong time1 = h.Time(a);
+          wxLongLong time2 = h.Time((a + BENCH_SCAN_MARGIN) % BENCH_SPOKES);
+          check += (long long)(time2 - time1) + (long long)h.Pos(a).lat;
+        }
+      }
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      res.misses[pass] += perf.Stop();
+      res.us[pass] += elapsed.count();
+    }
+  }
+  for (int pass = 0; pass < 3; pass++) {
+    res.us[pass] /= BENCH_REPEAT;
+    res.misses[pass] /= BENCH_REPEAT;
+  }
+  res.check = check;
+  return res;
+}
+
+static void Print(const char *name, Result &res, bool misses) {
+  static const char *pass_name[3] = {"ingest ", "search ", "refresh"};
+
+  for (int pass = 0; pass < 3; pass++) {
+    cout << "INFO: " << name << " " << pass_name[pass] << " " << res.us[pass] << " us";
+    if (misses) {
+      cout << ", " << res.misses[pass] << " cache misses";
+    }
+    cout << "\n";
+  }
+}
+
+int main() {
+  int ret = 0;
+  CacheMisses perf;
+
+  flush_buffer = (uint8_t *)calloc(1, BENCH_FLUSH_SIZE);
+  if (!perf.Available()) {
+    cout << "INFO: perf counters not available, only showing times\n";
+  }
+
+  OldHistory old_history(BENCH_SPOKES, BENCH_SPOKE_LEN);
+  NewHistory new_history(BENCH_SPOKES, BENCH_SPOKE_LEN);
+  Result old_result = Run(old_history, perf);
+  Result new_result = Run(new_history, perf);
+
+  Print("separate lines", old_result, perf.Available());
+  Print("arena         ", new_result, perf.Available());
+
+  if ((uintptr_t)new_history.Plane(1, HISTORY_DOPPLER) % HISTORY_ALIGN != 0) {
+    cout << "ERROR: planes are not aligned\n";
+    ret = 1;
+  }
+  if (old_result.check != new_result.check) {
+    cout << "ERROR: layouts give different results\n";
+    ret = 1;
+  }
+  free(flush_buffer);
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
@@ -0,0 +1,263 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Test and microbenchmark for SpokeKernel.
+ *
+ * Compares the fused single pass kernel against the multi pass code that
+ * RadarInfo::ProcessRadarSpoke used before, and checks that both produce
+ * the same data, history and counts, on whole spokes and on spokes of odd
+ * lengths down to none at all. The old code kept the history as one byte
+ * per return, which is converted to bit planes for the comparison.
+ *
+ * Usage: SpokeKernel-test [spokes.raw]
+ *
+ * spokes.raw is a file of recorded 1024 byte Navico spokes, as passed to
+ * ProcessRadarSpoke. Without it a synthetic revolution is used.
+ */
+
+#include <chrono>
+
+#include "SpokeKernel.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKE_LEN (1024)
+#define BENCH_SPOKES (2048)
+#define BENCH_REVOLUTIONS (200)
+#define BENCH_HISTORY_WORDS (HISTORY_WORDS(BENCH_SPOKE_LEN))
+#define BENCH_HISTORY_LEN (HISTORY_PLANES * BENCH_HISTORY_WORDS)
+
+#define OLD_HISTORY_TARGET (0xC0)
+#define OLD_HISTORY_DOPPLER (0xE0)
+
+// The old code, one loop per step
+static void MultiPass(uint8_t *data, size_t len, uint8_t *hist, size_t hist_len, SpokeKernelParams &p) {
+  size_t i;
+
+  for (i = 0; i < p.main_bang && i < len; i++) {
+    data[i] = 0;
+  }
+  if (p.threshold > 0) {
+    for (; i < len; i++) {
+      if (data[i] < p.threshold) {
+        data[i] = 0;
+      }
+    }
+  }
+
+  p.doppler_count = 0;
+  memset(hist, 0, hist_len);
+  for (size_t radius = 0; radius < len; radius++) {
+    if (data[radius] >= p.history_threshold) {
+      hist[radius] = OLD_HISTORY_TARGET;
+    }
+    if (data[radius] == 255) {
+      hist[radius] = OLD_HISTORY_DOPPLER;
+      p.doppler_count++;
+    }
+  }
+
+  for (size_t z = 0; z < p.zones; z++) {
+    p.zone[z].count = 0;
+    for (size_t r = p.zone[z].start; r <= p.zone[z].end && r < len; r++) {
+      if (data[r] >= p.guard_threshold) {
+        p.zone[z].count++;
+      }
+    }
+  }
+}
+
+static size_t LoadSpokes(const char *name, uint8_t *spokes) {
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    cout << "ERROR: cannot open " << name << "\n";
+    exit(1);
+  }
+  size_t n = fread(spokes, BENCH_SPOKE_LEN, BENCH_SPOKES, f);
+  fclose(f);
+  return n;
+}
+
+static size_t MakeSpokes(uint8_t *spokes) {
+  uint32_t seed = 1;
+
+  for (size_t s = 0; s < BENCH_SPOKES; s++) {
+    uint8_t *spoke = spokes + s * BENCH_SPOKE_LEN;
+    for (size_t r = 0; r < BENCH_SPOKE_LEN; r++) {
+      seed = seed * 1103515245 + 12345;
+      uint8_t noise = (seed >> 16) & 0x3f;
+      // A few blobs, land in one sector and some doppler targets
+      if ((s / 64 + r / 128) % 5 == 0 || (s > 1500 && r > 700)) {
+        noise |= 0xc0;
+      }
+      if (s % 300 == 7 && r > 400 && r < 420) {
+        noise = (r & 1) ? 0xff : 0xfe;
+      }
+      spoke[r] = noise;
+    }
+  }
+  return BENCH_SPOKES;
+}
+
+static SpokeKernelParams MakeParams() {
+  SpokeKernelParams p;
+
+  p.main_bang = 20;
+  p.threshold = 50 * (255 - BLOB_HISTORY_MAX) / 100 + BLOB_HISTORY_MAX;
+  p.history_threshold = 200;
+  p.guard_threshold = 200;
+  p.zones = 2;
+  p.zone[0].start = 100;
+  p.zone[0].end = 400;
+  p.zone[1].start = 600;
+  p.zone[1].end = 2000;  // beyond the spoke, as happens at short range
+  return p;
+}
+
+// The bit planes that match an old history line
+static void ToPlanes(const uint8_t *line, uint64_t *planes) {
+  memset(planes, 0, BENCH_HISTORY_LEN * sizeof(uint64_t));
+  for (size_t r = 0; r < BENCH_SPOKE_LEN; r++) {
+    uint64_t bit = (uint64_t)1 << (r & 63);
+    if (line[r] & 0x40) {
+      planes[HISTORY_TARGET * BENCH_HISTORY_WORDS + r / 64] |= bit;
+    }
+    if (line[r] & 0x80) {
+      planes[HISTORY_UNCLAIMED * BENCH_HISTORY_WORDS + r / 64] |= bit;
+    }
+    if (line[r] & 0x20) {
+      planes[HISTORY_DOPPLER * BENCH_HISTORY_WORDS + r / 64] |= bit;
+    }
+  }
+}
+
+// Compare both on the first spoke cut short at each of the lengths
+static int CheckLengths(const uint8_t *spokes) {
+  static const size_t lengths[] = {0, 1, 20, 63, 64, 65, 401, 1000, BENCH_SPOKE_LEN - 1};
+  int ret = 0;
+
+  for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+    size_t len = lengths[l];
+    uint8_t data_multi[BENCH_SPOKE_LEN], data_fused[BENCH_SPOKE_LEN];
+    uint8_t hist_multi[BENCH_SPOKE_LEN];
+    uint64_t planes_multi[BENCH_HISTORY_LEN], planes_fused[BENCH_HISTORY_LEN];
+    SpokeKernelParams multi = MakeParams();
+    SpokeKernelParams fused = MakeParams();
+
+    memcpy(data_multi, spokes, BENCH_SPOKE_LEN);
+    memcpy(data_fused, spokes, BENCH_SPOKE_LEN);
+    memset(planes_fused, 0xff, sizeof(planes_fused));
+    MultiPass(data_multi, len, hist_multi, BENCH_SPOKE_LEN, multi);
+    SpokeKernel(data_fused, len, planes_fused, BENCH_HISTORY_WORDS, fused);
+    ToPlanes(hist_multi, planes_multi);
+
+    if (memcmp(data_multi, data_fused, BENCH_SPOKE_LEN) != 0 ||
+        memcmp(planes_multi, planes_fused, sizeof(planes_fused)) != 0 || multi.doppler_count != fused.doppler_count ||
+        multi.zone[0].count != fused.zone[0].count || multi.zone[1].count != fused.zone[1].count) {
+      cout << "ERROR: spoke of " << len << " returns differs\n";
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+template <typename H>
+static double Run(void (*f)(uint8_t *data, size_t len, H *hist, size_t hist_len, SpokeKernelParams &p), size_t hist_len,
+                  size_t hist_stride, const uint8_t *spokes, size_t n, uint8_t *out_data, H *out_hist, int *counts) {
+  uint8_t data[BENCH_SPOKE_LEN];
+  auto start = std::chrono::steady_clock::now();
+
+  for (int rev = 0; rev < BENCH_REVOLUTIONS; rev++) {
+    for (size_t s = 0; s < n; s++) {
+      SpokeKernelParams p = MakeParams();
+      memcpy(data, spokes + s * BENCH_SPOKE_LEN, BENCH_SPOKE_LEN);
+      f(data, BENCH_SPOKE_LEN, out_hist + s * hist_stride, hist_len, p);
+      if (rev == 0) {
+        memcpy(out_data + s * BENCH_SPOKE_LEN, data, BENCH_SPOKE_LEN);
+        counts[s * 3 + 0] = p.doppler_count;
+        counts[s * 3 + 1] = p.zone[0].count;
+        counts[s * 3 + 2] = p.zone[1].count;
+      }
+    }
+  }
+
+  std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / (BENCH_REVOLUTIONS * n);
+}
+
+int main(int argc, char **argv) {
+  int ret = 0;
+  static uint8_t spokes[BENCH_SPOKES * BENCH_SPOKE_LEN];
+  static uint8_t data_multi[BENCH_SPOKES * BENCH_SPOKE_LEN], data_fused[BENCH_SPOKES * BENCH_SPOKE_LEN];
+  static uint8_t hist_multi[BENCH_SPOKES * BENCH_SPOKE_LEN];
+  static uint64_t planes_multi[BENCH_SPOKES * BENCH_HISTORY_LEN], planes_fused[BENCH_SPOKES * BENCH_HISTORY_LEN];
+  static int counts_multi[BENCH_SPOKES * 3], counts_fused[BENCH_SPOKES * 3];
+
+  size_t n = argc > 1 ? LoadSpokes(argv[1], spokes) : MakeSpokes(spokes);
+  cout << "INFO: " << n << " spokes of " << BENCH_SPOKE_LEN << " returns\n";
+
+  double multi = Run(MultiPass, BENCH_SPOKE_LEN, BENCH_SPOKE_LEN, spokes, n, data_multi, hist_multi, counts_multi);
+  double fused = Run(SpokeKernel, BENCH_HISTORY_WORDS, BENCH_HISTORY_LEN, spokes, n, data_fused, planes_fused, counts_fused);
+  for (size_t s = 0; s < n; s++) {
+    ToPlanes(hist_multi + s * BENCH_SPOKE_LEN, planes_multi + s * BENCH_HISTORY_LEN);
+  }
+
+  cout << "INFO: multi pass " << multi << " us/spoke\n";
+  cout << "INFO: fused      " << fused << " us/spoke\n";
+
+  if (memcmp(data_multi, data_fused, n * BENCH_SPOKE_LEN) != 0) {
+    cout << "ERROR: data differs\n";
+    ret = 1;
+  }
+  if (memcmp(planes_multi, planes_fused, n * BENCH_HISTORY_LEN * sizeof(uint64_t)) != 0) {
+    cout << "ERROR: history differs\n";
+    ret = 1;
+  }
+  if (memcmp(counts_multi, counts_fused, n * 3 * sizeof(int)) != 0) {
+    cout << "ERROR: doppler or guard zone counts differ\n";
+    ret = 1;
+  }
+  if (CheckLengths(spokes) != 0) {
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main(int argc, char **argv) { RadarPlugin::main(argc, argv); }
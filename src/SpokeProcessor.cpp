@@ -0,0 +1,62 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "SpokeProcessor.h"
+
+#include "RadarInfo.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+// The receive thread wakes us up for every packet, but if that doesn't happen
+// (or a wakeup is missed) we still look at the ring this often.
+#define MILLIS_PER_WAIT 100
+
+/*
+ * Entry
+ *
+ * Called by wxThread when the new thread is running.
+ * It should remain running until Shutdown is called.
+ */
+void *SpokeProcessor::Entry(void) {
+  LOG_VERBOSE(wxT("%s spoke processing thread starting"), m_ri->m_name.c_str());
+
+  while (!m_shutdown) {
+    m_ready.WaitTimeout(MILLIS_PER_WAIT);
+    while (!m_shutdown && m_ri->ProcessQueuedSpokes()) {
+      // More spokes are waiting, but give the GUI thread a chance to take the lock first
+    }
+  }
+
+  LOG_VERBOSE(wxT("%s spoke processing thread stopping"), m_ri->m_name.c_str());
+  return 0;
+}
+
+PLUGIN_END_NAMESPACE
@@ -0,0 +1,183 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Benchmark for the layout of the true trails grid.
+ *
+ * Runs the loop of TrailBuffer::UpdateTrueTrails over a number of rotations
+ * of a Navico sized radar (2048 spokes of 1024 returns) on a grid stored
+ * row by row, as it used to be, and on grids stored in tiles of 8x8 and
+ * 16x16 points. TrailBuffer uses the latter, see TRAIL_TILE. The spokes per second are shown per 45 degree sector, as a spoke
+ * that runs along a row of the grid is cheap in both layouts while one that
+ * runs along a column touches a different row for every return.
+ */
+
+#include <chrono>
+
+#include "drawutil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKES (2048)
+#define BENCH_SPOKE_LEN (1024)
+#define BENCH_MARGIN (100)
+#define BENCH_ROTATIONS (20)
+#define BENCH_SECTORS (8)
+#define BENCH_STRONG (200)
+#define BENCH_WEAK (50)
+#define BENCH_MAX_AGE (241)
+
+typedef uint16_t TrailRevolution;
+
+// The grid as TrailBuffer keeps it, with tiles of (1 << SHIFT) * (1 << SHIFT)
+// points or row by row when SHIFT is 0.
+template <int SHIFT>
+class Grid {
+ public:
+  Grid(int spoke_len) {
+    int tile = 1 << SHIFT;
+    m_size = (spoke_len * 2 + BENCH_MARGIN * 2 + tile - 1) & ~(tile - 1);
+    m_trails = (TrailRevolution *)calloc(sizeof(TrailRevolution), m_size * m_size);
+  }
+  ~Grid() { free(m_trails); }
+
+  TrailRevolution &At(int x, int y) {
+    if (SHIFT == 0) {
+      return m_trails[x * m_size + y];
+    }
+    int mask = (1 << SHIFT) - 1;
+    size_t tile = (size_t)(x >> SHIFT) * (m_size >> SHIFT) + (y >> SHIFT);
+    return m_trails[(tile << (2 * SHIFT)) + ((x & mask) << SHIFT) + (y & mask)];
+  }
+  int Wrap(int i) { return (i < 0) ? i + m_size : (i >= m_size) ? i - m_size : i; }
+  int Size() { return m_size; }
+
+ private:
+  int m_size;
+  TrailRevolution *m_trails;
+};
+
+static uint8_t colour[BENCH_MAX_AGE + 1];
+
+template <int SHIFT>
+static void UpdateTrueTrails(Grid<SHIFT> &grid, PolarToCartesianLookup &lookup, TrailRevolution revolution, int offset,
+                             SpokeBearing bearing, uint8_t *data, size_t len) {
+  int center_x = grid.Wrap(grid.Size() / 2 + offset);
+  int center_y = grid.Wrap(grid.Size() / 2 + offset / 2);
+
+  for (size_t radius = 0; radius < len - 1; radius++) {
+    PointInt point = lookup.GetPointInt(bearing, radius);
+    TrailRevolution *trail = &grid.At(grid.Wrap(center_x + point.x), grid.Wrap(center_y + point.y));
+
+    if (data[radius] >= BENCH_STRONG) {
+      *trail = revolution;
+    }
+    if (data[radius] < BENCH_WEAK && *trail != 0) {
+      int age = (TrailRevolution)(revolution - *trail) + 1;
+      data[radius] = colour[age < BENCH_MAX_AGE ? age : BENCH_MAX_AGE];
+    }
+  }
+}
+
+struct Result {
+  double spokes_per_second[BENCH_SECTORS];
+  long long check;
+};
+
+template <int SHIFT>
+static Result Run(PolarToCartesianLookup &lookup) {
+  Grid<SHIFT> grid(BENCH_SPOKE_LEN);
+  uint8_t data[BENCH_SPOKE_LEN];
+  double seconds[BENCH_SECTORS] = {0};
+  Result res;
+  uint32_t seed = 1;
+
+  res.check = 0;
+  for (int rotation = 1; rotation <= BENCH_ROTATIONS; rotation++) {
+    for (int sector = 0; sector < BENCH_SECTORS; sector++) {
+      SpokeBearing first = sector * BENCH_SPOKES / BENCH_SECTORS;
+      std::chrono::duration<double> elapsed(0);
+
+      for (SpokeBearing bearing = first; bearing < first + BENCH_SPOKES / BENCH_SECTORS; bearing++) {
+        // A few strong targets on a background of weak returns
+        for (size_t r = 0; r < BENCH_SPOKE_LEN; r++) {
+          seed = seed * 1103515245 + 12345;
+          data[r] = ((seed >> 16) % 100 < 3) ? BENCH_STRONG : BENCH_WEAK - 1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        UpdateTrueTrails(grid, lookup, (TrailRevolution)rotation, rotation * 3, bearing, data, BENCH_SPOKE_LEN);
+        elapsed += std::chrono::steady_clock::now() - start;
+        for (size_t r = 0; r < BENCH_SPOKE_LEN; r++) {
+          res.check += data[r];
+        }
+      }
+      seconds[sector] += elapsed.count();
+    }
+  }
+  for (int sector = 0; sector < BENCH_SECTORS; sector++) {
+    res.spokes_per_second[sector] = BENCH_ROTATIONS * BENCH_SPOKES / BENCH_SECTORS / seconds[sector];
+  }
+  return res;
+}
+
+int main() {
+  int ret = 0;
+  PolarToCartesianLookup lookup(BENCH_SPOKES);
+
+  for (int age = 0; age <= BENCH_MAX_AGE; age++) {
+    colour[age] = (uint8_t)(age % 32);
+  }
+
+  Result rows = Run<0>(lookup);
+  Result tiles8 = Run<3>(lookup);
+  Result tiles16 = Run<4>(lookup);
+
+  cout << "INFO: bearing   rows   8x8 tiles   16x16 tiles (spokes/s)\n";
+  for (int sector = 0; sector < BENCH_SECTORS; sector++) {
+    cout << "INFO: " << sector * 360 / BENCH_SECTORS << "\t" << (long)rows.spokes_per_second[sector] << "\t"
+         << (long)tiles8.spokes_per_second[sector] << "\t" << (long)tiles16.spokes_per_second[sector] << "\n";
+  }
+  if (rows.check != tiles8.check || rows.check != tiles16.check) {
+    cout << "ERROR: layouts give different trails\n";
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
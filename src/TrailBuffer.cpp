@@ -42,8 +42,10 @@ PLUGIN_BEGIN_NAMESPACE
 // Striding the first dimension makes for better locality because
 // we generally iterate over the range (process one spoke) so those
 // values are now closer together in memory.
-#define M_TRUE_TRAILS_STRIDE m_trail_size
-#define M_TRUE_TRAILS(x, y) m_true_trails[x * M_TRUE_TRAILS_STRIDE + y]
+// The true trails are stored in tiles, see TrueTrailsIndex(), as
+// a spoke crosses the grid in any direction.
+#define M_TRUE_TRAILS(x, y) m_true_trails[TrueTrailsIndex(x, y)]
+#define M_COPY_TRUE_TRAILS(x, y) m_copy_true_trails[TrueTrailsIndex(x, y)]
 #define M_RELATIVE_TRAILS_STRIDE m_max_spoke_len
 #define M_RELATIVE_TRAILS(x, y) m_relative_trails[x * M_RELATIVE_TRAILS_STRIDE + y]
 
@@ -52,13 +54,24 @@ TrailBuffer::TrailBuffer(RadarInfo *ri, size_t spokes, size_t max_spoke_len) {
   m_spokes = spokes;
   m_max_spoke_len = (int)max_spoke_len;
   m_previous_pixels_per_meter = 0.;
-  m_trail_size = max_spoke_len * 2 + MARGIN * 2;
-  m_true_trails = (TrailRevolutionsAge *)calloc(sizeof(TrailRevolutionsAge), m_trail_size * m_trail_size);
-  m_relative_trails = (TrailRevolutionsAge *)calloc(sizeof(TrailRevolutionsAge), m_spokes * m_max_spoke_len);
-  m_copy_true_trails = (TrailRevolutionsAge *)calloc(sizeof(TrailRevolutionsAge), m_trail_size * m_trail_size);
-  m_copy_relative_trails = (TrailRevolutionsAge *)calloc(sizeof(TrailRevolutionsAge), m_spokes * m_max_spoke_len);
-
-  if (!m_true_trails || !m_relative_trails || !m_copy_true_trails || !m_copy_relative_trails) {
+  m_trail_size = (max_spoke_len * 2 + MARGIN * 2 + TRAIL_TILE - 1) & ~(TRAIL_TILE - 1);
+  m_revolution = 1;
+  m_last_angle = 0;
+  m_true_trails = (TrailRevolution *)calloc(sizeof(TrailRevolution), m_trail_size * m_trail_size);
+  m_relative_trails = (TrailRevolution *)calloc(sizeof(TrailRevolution), m_spokes * m_max_spoke_len);
+  m_copy_true_trails = (TrailRevolution *)calloc(sizeof(TrailRevolution), m_trail_size * m_trail_size);
+  m_copy_relative_trails = (TrailRevolution *)calloc(sizeof(TrailRevolution), m_spokes * m_max_spoke_len);
+  m_sparse = false;
+  m_tile_count = (uint16_t *)calloc(sizeof(uint16_t), (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT));
+  m_runs = (TrailRun *)calloc(sizeof(TrailRun), m_spokes * TRAIL_RUNS_MAX);
+  m_run_count = (uint8_t *)calloc(sizeof(uint8_t), m_spokes);
+  m_block_words = (m_max_spoke_len + TRAIL_BLOCK_WORD - 1) / TRAIL_BLOCK_WORD;
+  m_true_blocks = (uint64_t *)calloc(sizeof(uint64_t), m_spokes * m_block_words);
+  m_blocks_offset.lat = 0;
+  m_blocks_offset.lon = 0;
+
+  if (!m_true_trails || !m_relative_trails || !m_copy_true_trails || !m_copy_relative_trails || !m_tile_count || !m_runs ||
+      !m_run_count || !m_true_blocks) {
     wxLogError(wxT("Out Of Memory, fatal!"));
     wxAbort();
   }
@@ -70,168 +83,654 @@ TrailBuffer::~TrailBuffer() {
   free(m_relative_trails);
   free(m_copy_relative_trails);
   free(m_copy_true_trails);
+  free(m_tile_count);
+  free(m_runs);
+  free(m_run_count);
+  free(m_true_blocks);
+}
+
+/*
+ * Count the revolutions of the radar, called for every spoke before the trails are updated.
+ *
+ * The trails do not hold the age of each point but the revolution in which
+ * a strong target was last seen there, so a sweep only writes where there are
+ * targets. Age() does the subtraction when the trail colour is needed.
+ */
+void TrailBuffer::UpdateRevolution(SpokeBearing angle) {
+  if (angle < m_last_angle) {
+    m_revolution++;
+    if (m_revolution == 0) {
+      m_revolution = 1;  // 0 means no trail
+    }
+    if ((m_revolution & (TRAIL_EXPIRE_REVOLUTIONS - 1)) == 0) {
+      ExpireTrails();
+    }
+    ChooseUpdate();
+  }
+  m_last_angle = angle;
+}
+
+/*
+ * Clear the trails that are too old to be shown, so the counts that ChooseUpdate()
+ * looks at only hold the trails that can still be seen, and the sparse update
+ * comes back once a busy scene has cleared.
+ *
+ * Continuous trails never get too old. Those older than TRAIL_MAX_REVOLUTIONS
+ * are moved up to just that age, which looks the same, to keep them from
+ * looking new again when m_revolution wraps around.
+ */
+void TrailBuffer::ExpireTrails() {
+  int shown = m_ri->m_trail_revolutions;  // Age() from here on has no colour
+  bool continuous = shown > TRAIL_MAX_REVOLUTIONS;
+  TrailRevolutionsAge limit = continuous ? TRAIL_MAX_REVOLUTIONS : (TrailRevolutionsAge)wxMax(shown, 0);
+  TrailRevolution oldest = (TrailRevolution)(m_revolution - TRAIL_MAX_REVOLUTIONS);
+  if (oldest == 0) {
+    oldest--;
+  }
+
+  size_t tiles = (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT);
+  for (size_t tile = 0; tile < tiles; tile++) {
+    if (m_tile_count[tile] == 0) {
+      continue;
+    }
+    TrailRevolution *trail = &m_true_trails[tile << (2 * TRAIL_TILE_SHIFT)];
+    for (int i = 0; i < TRAIL_TILE * TRAIL_TILE; i++) {
+      if (trail[i] != 0 && Age(trail[i]) >= limit) {
+        if (continuous) {
+          trail[i] = oldest;
+        } else {
+          trail[i] = 0;
+          if (--m_tile_count[tile] == 0) {
+            m_true_tiles--;
+          }
+        }
+      }
+    }
+  }
+
+  for (size_t i = 0; i < m_spokes * m_max_spoke_len; i++) {
+    TrailRevolution *trail = &m_relative_trails[i];
+    if (*trail != 0 && Age(*trail) >= limit) {
+      if (continuous) {
+        *trail = oldest;
+      } else {
+        *trail = 0;
+        m_relative_count--;
+      }
+    }
+  }
+  if (m_sparse && !continuous) {
+    BuildRuns();  // Drop the points that were cleared from the runs
+  }
+}
+
+/*
+ * Choose between the dense and the sparse update of the trails, once per revolution.
+ *
+ * The dense update looks at every point of the spoke in both trail buffers. In
+ * open water nearly all of those are empty, so the sparse update only looks at
+ * the strong returns, at the runs of the relative trails that hold a trail and
+ * at the blocks of the spoke that cross tiles of the true trails that do. Those
+ * are found again every revolution, so they forget the trails that were cleared.
+ * That costs more per point looked at,
+ * so it is only used while the trails are sparse. The limit to go back is twice
+ * the limit to start, so a scene near the limit does not switch every revolution.
+ */
+void TrailBuffer::ChooseUpdate() {
+  size_t relative_size = m_spokes * m_max_spoke_len;
+  size_t tiles = (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT);
+
+  if (m_sparse) {
+    if (m_run_cells * TRAIL_SPARSE_DENSITY > 2 * relative_size || m_true_tiles * TRAIL_SPARSE_DENSITY > 2 * tiles) {
+      LOG_VERBOSE(wxT("%s trails are dense, %d points in runs, %d tiles"), m_ri->m_name.c_str(), (int)m_run_cells,
+                  (int)m_true_tiles);
+      m_sparse = false;
+    }
+  } else if (m_relative_count * TRAIL_SPARSE_DENSITY < relative_size && m_true_tiles * TRAIL_SPARSE_DENSITY < tiles) {
+    BuildRuns();
+    LOG_VERBOSE(wxT("%s trails are sparse, %d points in runs, %d tiles"), m_ri->m_name.c_str(), (int)m_run_cells,
+                (int)m_true_tiles);
+    m_sparse = true;
+  }
+  if (m_sparse) {
+    BuildTrueBlocks();
+  }
+}
+
+// Adds [start..end> to the runs of a spoke. Runs must be added in order of their start.
+static void AddRun(TrailRun *runs, size_t *count, int start, int end) {
+  if (*count > 0 && (start <= runs[*count - 1].end + TRAIL_RUN_GAP || *count == TRAIL_RUNS_MAX)) {
+    runs[*count - 1].end = (uint16_t)wxMax(runs[*count - 1].end, end);
+  } else {
+    runs[*count].start = (uint16_t)start;
+    runs[*count].end = (uint16_t)end;
+    (*count)++;
+  }
+}
+
+// Finds the runs of points holding a trail in each spoke of the relative trails
+void TrailBuffer::BuildRuns() {
+  m_run_cells = 0;
+  for (size_t angle = 0; angle < m_spokes; angle++) {
+    TrailRevolution *trail = &M_RELATIVE_TRAILS(angle, 0);
+    TrailRun *runs = &m_runs[angle * TRAIL_RUNS_MAX];
+    size_t count = 0;
+
+    for (int r = 0; r < m_max_spoke_len; r++) {
+      if (trail[r]) {
+        AddRun(runs, &count, r, r + 1);
+      }
+    }
+    for (size_t i = 0; i < count; i++) {
+      m_run_cells += runs[i].end - runs[i].start;
+    }
+    m_run_count[angle] = (uint8_t)count;
+  }
+}
+
+// Counts the trails again after they have been changed wholesale
+void TrailBuffer::CountTrails() {
+  size_t tiles = (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT);
+
+  m_true_tiles = 0;
+  for (size_t tile = 0; tile < tiles; tile++) {
+    TrailRevolution *trail = &m_true_trails[tile << (2 * TRAIL_TILE_SHIFT)];
+    uint16_t count = 0;
+
+    for (int i = 0; i < TRAIL_TILE * TRAIL_TILE; i++) {
+      count += (trail[i] != 0);
+    }
+    m_tile_count[tile] = count;
+    m_true_tiles += (count != 0);
+  }
+
+  m_relative_count = 0;
+  for (size_t i = 0; i < m_spokes * m_max_spoke_len; i++) {
+    m_relative_count += (m_relative_trails[i] != 0);
+  }
+  if (m_sparse) {
+    BuildRuns();
+    BuildTrueBlocks();
+  }
+}
+
+// Finds the blocks of each spoke that may cross a tile of the true trails with a trail
+void TrailBuffer::BuildTrueBlocks() {
+  size_t tiles = (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT);
+
+  memset(m_true_blocks, 0, m_spokes * m_block_words * sizeof(uint64_t));
+  m_blocks_offset = m_offset;
+  for (size_t tile = 0; tile < tiles; tile++) {
+    if (m_tile_count[tile]) {
+      MarkTrueTile(tile);
+    }
+  }
+}
+
+/*
+ * Sets the blocks of the spokes that cross a tile of the true trails.
+ *
+ * The tile is taken around the radar as it was when the blocks were built, and
+ * widened by TRAIL_TILE on each side, so the blocks stay valid while the radar
+ * moves less than TRAIL_TILE from there. One more point covers the rounding of
+ * GetPointInt(). The spokes and returns are those of the bounding angles and
+ * distances of the widened tile, which may be a few more than needed.
+ */
+void TrailBuffer::MarkTrueTile(size_t tile) {
+  int tiles = m_trail_size >> TRAIL_TILE_SHIFT;
+  int pad = TRAIL_TILE + 1;
+  int half = m_trail_size / 2;
+  // Tile corner relative to the radar, in [-half..half>
+  int dx = Mod((int)(tile / tiles) * TRAIL_TILE - m_blocks_offset.lat) - half;
+  int dy = Mod((int)(tile % tiles) * TRAIL_TILE - m_blocks_offset.lon) - half;
+  double x0 = dx - pad, x1 = dx + TRAIL_TILE + pad;
+  double y0 = dy - pad, y1 = dy + TRAIL_TILE + pad;
+
+  // Nearest and farthest point of the widened tile
+  double nx = (x0 > 0.) ? x0 : (x1 < 0.) ? x1 : 0.;
+  double ny = (y0 > 0.) ? y0 : (y1 < 0.) ? y1 : 0.;
+  double r_min = sqrt(nx * nx + ny * ny);
+  if (r_min >= m_max_spoke_len) {
+    return;
+  }
+  double fx = wxMax(fabs(x0), fabs(x1));
+  double fy = wxMax(fabs(y0), fabs(y1));
+  size_t block_min = (size_t)r_min >> TRAIL_TILE_SHIFT;
+  size_t block_max = wxMin((size_t)sqrt(fx * fx + fy * fy) >> TRAIL_TILE_SHIFT, m_block_words * 64 - 1);
+
+  int first = 0;
+  int last = (int)m_spokes - 1;
+  if (nx != 0. || ny != 0.) {
+    // The radar is outside the tile, so it is seen under less than half a circle
+    double mid = atan2((y0 + y1) / 2., (x0 + x1) / 2.);
+    double lo = 0.;
+    double hi = 0.;
+    double corner_x[4] = {x0, x1, x0, x1};
+    double corner_y[4] = {y0, y0, y1, y1};
+    for (int c = 0; c < 4; c++) {
+      double d = atan2(corner_y[c], corner_x[c]) - mid;
+      if (d > PI) {
+        d -= 2. * PI;
+      } else if (d < -PI) {
+        d += 2. * PI;
+      }
+      lo = wxMin(lo, d);
+      hi = wxMax(hi, d);
+    }
+    first = (int)floor((mid + lo) * m_spokes / (2. * PI)) - 1;
+    last = (int)ceil((mid + hi) * m_spokes / (2. * PI)) + 1;
+  }
+
+  int spokes = (int)m_spokes;
+  for (int a = first; a <= last; a++) {
+    uint64_t *blocks = &m_true_blocks[(size_t)((a % spokes + spokes) % spokes) * m_block_words];
+    for (size_t b = block_min; b <= block_max; b++) {
+      blocks[b >> 6] |= (uint64_t)1 << (b & 63);
+    }
+  }
 }
 
-void TrailBuffer::UpdateTrueTrails(SpokeBearing bearing, uint8_t *data, size_t len) {
+/*
+ * Update the true trails with a spoke. When the trails are in true motion the
+ * age of the trail at each return is stored in trail_age[0..len> and true is
+ * returned; RadarInfo::ColourTrails turns those into trail colours.
+ */
+bool TrailBuffer::UpdateTrueTrails(SpokeBearing bearing, uint8_t *data, size_t len, TrailRevolutionsAge *trail_age) {
   RadarControlState trails = m_ri->m_target_trails.GetState();
+  bool update_targets_true = false;
 
   if (trails != RCS_OFF) {
     int motion = m_ri->m_trails_motion.GetValue();
-    bool update_targets_true = (motion == TARGET_MOTION_TRUE);
+    update_targets_true = (motion == TARGET_MOTION_TRUE);
+
+    if (m_sparse) {
+      UpdateTrueRuns(bearing, data, len, update_targets_true ? trail_age : 0);
+      return update_targets_true;
+    }
 
-    uint8_t weak_target = M_SETTINGS.threshold_blue;
     uint8_t strong_target = M_SETTINGS.threshold_red;
     size_t radius = 0;
 
+    // Where the radar is in the true trails grid. Points are never more than
+    // m_max_spoke_len away from it, so a single Wrap() puts them back in the grid.
+    int center_x = Wrap(m_trail_size / 2 + m_offset.lat);
+    int center_y = Wrap(m_trail_size / 2 + m_offset.lon);
+
     for (; radius < len - 1; radius++) {  //  len - 1 : no trails on range circle
       PointInt point = m_ri->m_polar_lookup->GetPointInt(bearing, radius);
+      int x = Wrap(center_x + point.x);
+      int y = Wrap(center_y + point.y);
+      size_t tile = TrueTrailsTile(x, y);
+      TrailRevolution *trail = &m_true_trails[TrueTrailsIndex(tile, x, y)];
 
-      point.x += m_trail_size / 2 + m_offset.lat;
-      point.y += m_trail_size / 2 + m_offset.lon;
-
-      if (point.x >= 0 && point.x < (int)m_trail_size && point.y >= 0 && point.y < (int)m_trail_size) {
-        uint8_t *trail = &M_TRUE_TRAILS(point.x, point.y);
-        // when ship moves north, offset.lat > 0. Add to move trails image in opposite direction
-        // when ship moves east, offset.lon > 0. Add to move trails image in opposite direction
-        if (data[radius] >= strong_target) {
-          *trail = 1;
-        } else if (*trail > 0 && *trail < TRAIL_MAX_REVOLUTIONS) {
-          (*trail)++;
+      if (data[radius] >= strong_target) {
+        if (*trail == 0) {
+          AddTrueTrail(tile);
         }
+        *trail = m_revolution;
+      }
 
-        if (update_targets_true && (data[radius] < weak_target)) {
-          data[radius] = m_ri->m_trail_colour[*trail];
-        }
+      if (update_targets_true) {
+        trail_age[radius] = Age(*trail);
       }
     }
+    // The points from len to m_spoke_len_max need no work, their age goes up by itself.
+    if (update_targets_true && len > 0) {
+      trail_age[len - 1] = 0;
+      m_age_runs[0].start = 0;
+      m_age_runs[0].end = (uint16_t)len;
+      m_age_run_count = 1;
+    }
+  }
+  return update_targets_true;
+}
 
-    // Now process the rest of the spoke from len to m_spoke_len_max.
-    // This will only be called when the current spoke length is smaller than the max.
-    // we need to update the trail 'age' for those points.
-    for (; radius < m_ri->m_spoke_len_max; radius++) {
-      PointInt point = m_ri->m_polar_lookup->GetPointInt(bearing, radius);
+/*
+ * The sparse version of UpdateTrueTrails: only the strong returns and the blocks
+ * of the spoke that may cross a tile with a trail are looked at. trail_age may be
+ * 0 when the trails are not in true motion.
+ */
+void TrailBuffer::UpdateTrueRuns(SpokeBearing bearing, uint8_t *data, size_t len, TrailRevolutionsAge *trail_age) {
+  int end = (int)len - 1;  // len - 1 : no trails on range circle
+  uint8_t strong_target = M_SETTINGS.threshold_red;
+  int half = m_trail_size / 2;
+
+  // The blocks only hold while the radar is within TRAIL_TILE of where they were built
+  if (abs(Mod(m_offset.lat - m_blocks_offset.lat + half) - half) > TRAIL_TILE ||
+      abs(Mod(m_offset.lon - m_blocks_offset.lon + half) - half) > TRAIL_TILE) {
+    BuildTrueBlocks();
+  }
 
-      point.x += m_trail_size / 2 + m_offset.lat;
-      point.y += m_trail_size / 2 + m_offset.lon;
+  int center_x = Wrap(half + m_offset.lat);
+  int center_y = Wrap(half + m_offset.lon);
+
+  for (int r = 0; r < end; r++) {
+    if (data[r] >= strong_target) {
+      PointInt point = m_ri->m_polar_lookup->GetPointInt(bearing, r);
+      int x = Wrap(center_x + point.x);
+      int y = Wrap(center_y + point.y);
+      size_t tile = TrueTrailsTile(x, y);
+      TrailRevolution *trail = &m_true_trails[TrueTrailsIndex(tile, x, y)];
+      if (*trail == 0) {
+        AddTrueTrail(tile);  // marks the blocks of the tile when it is new
+      }
+      *trail = m_revolution;
+    }
+  }
 
-      if (point.x >= 0 && point.x < (int)m_trail_size && point.y >= 0 && point.y < (int)m_trail_size) {
-        uint8_t *trail = &M_TRUE_TRAILS(point.x, m_trail_size + point.y);
-        // when ship moves north, offset.lat > 0. Add to move trails image in opposite direction
-        // when ship moves east, offset.lon > 0. Add to move trails image in opposite direction
-        if (*trail > 0 && *trail < TRAIL_MAX_REVOLUTIONS) {
-          (*trail)++;
+  if (!trail_age) {
+    return;
+  }
+  const uint64_t *blocks = &m_true_blocks[bearing * m_block_words];
+  size_t age_runs = 0;
+
+  memset(trail_age, 0, len * sizeof(TrailRevolutionsAge));
+  for (size_t w = 0; w < m_block_words; w++) {
+    for (uint64_t bits = blocks[w]; bits; bits &= bits - 1) {
+      int from = (int)((w * 64 + HistoryLowestBit(bits)) << TRAIL_TILE_SHIFT);
+      int to = wxMin(from + TRAIL_TILE, end);
+      for (int r = from; r < to; r++) {
+        PointInt point = m_ri->m_polar_lookup->GetPointInt(bearing, r);
+        int x = Wrap(center_x + point.x);
+        int y = Wrap(center_y + point.y);
+        size_t tile = TrueTrailsTile(x, y);
+        if (m_tile_count[tile] == 0) {
+          continue;
+        }
+        trail_age[r] = Age(m_true_trails[TrueTrailsIndex(tile, x, y)]);
+        if (trail_age[r] != 0) {
+          AddRun(m_age_runs, &age_runs, r, r + 1);
         }
       }
     }
   }
+  m_age_run_count = age_runs;
 }
 
-void TrailBuffer::UpdateRelativeTrails(SpokeBearing angle, uint8_t *data, size_t len) {
+/*
+ * As UpdateTrueTrails, for the relative trails.
+ */
+bool TrailBuffer::UpdateRelativeTrails(SpokeBearing angle, uint8_t *data, size_t len, TrailRevolutionsAge *trail_age) {
   int motion = m_ri->m_trails_motion.GetValue();
   RadarControlState trails = m_ri->m_target_trails.GetState();
+  bool update_relative_motion = false;
+
   if (trails != RCS_OFF) {
-    uint8_t *trail = &M_RELATIVE_TRAILS(angle, 0);
+    TrailRevolution *trail = &M_RELATIVE_TRAILS(angle, 0);
     size_t radius = 0;
 
-    bool update_relative_motion = motion == TARGET_MOTION_RELATIVE;
+    update_relative_motion = motion == TARGET_MOTION_RELATIVE;
+
+    if (m_sparse) {
+      UpdateRelativeRuns(angle, data, len, update_relative_motion ? trail_age : 0);
+      return update_relative_motion;
+    }
 
-    uint8_t weak_target = M_SETTINGS.threshold_blue;
     uint8_t strong_target = M_SETTINGS.threshold_red;
 
     for (radius = 0; radius < len - 1; radius++, trail++) {  // len - 1 : no trails on range circle
       if (data[radius] >= strong_target) {
-        *trail = 1;
-      } else if (*trail > 0 && *trail < TRAIL_MAX_REVOLUTIONS) {
-        (*trail)++;
+        if (*trail == 0) {
+          m_relative_count++;
+        }
+        *trail = m_revolution;
       }
 
-      if (update_relative_motion && (data[radius] < weak_target)) {
-        data[radius] = m_ri->m_trail_colour[*trail];
+      if (update_relative_motion) {
+        trail_age[radius] = Age(*trail);
       }
     }
+    if (update_relative_motion && len > 0) {
+      trail_age[len - 1] = 0;
+      m_age_runs[0].start = 0;
+      m_age_runs[0].end = (uint16_t)len;
+      m_age_run_count = 1;
+    }
 
     for (; radius < (size_t)m_max_spoke_len; radius++, trail++)  // And clear out empty bit of spoke when spoke_len < max_spoke_len
     {
-      *trail = 0;
+      if (*trail) {
+        m_relative_count--;
+        *trail = 0;
+      }
     }
   }
+  return update_relative_motion;
 }
 
-// Zooms the trailbuffer (containing image of true trails) in and out
-// This version assumes m_offset.lon and m_offset.lat to be zero (earlier versions did zoom offset as well)
-// zoom_factor > 1 -> zoom in, enlarge image
-void TrailBuffer::ZoomTrails(float zoom_factor) {
-  uint8_t *flip;
-  memset(m_copy_relative_trails, 0, m_spokes * m_max_spoke_len);
+/*
+ * The sparse version of UpdateRelativeTrails: only the strong returns and the
+ * runs of the spoke that held a trail are looked at. trail_age may be 0 when the
+ * trails are not in relative motion.
+ */
+void TrailBuffer::UpdateRelativeRuns(SpokeBearing angle, uint8_t *data, size_t len, TrailRevolutionsAge *trail_age) {
+  TrailRevolution *trail = &M_RELATIVE_TRAILS(angle, 0);
+  TrailRun *runs = &m_runs[angle * TRAIL_RUNS_MAX];
+  size_t count = m_run_count[angle];
+  TrailRun merged[TRAIL_RUNS_MAX];
+  size_t merged_count = 0;
+  size_t i = 0;
+  int end = (int)len - 1;  // len - 1 : no trails on range circle
+  uint8_t strong_target = M_SETTINGS.threshold_red;
+
+  // Merge the runs of strong returns into the runs of the spoke
+  for (int r = 0; r < end; r++) {
+    if (data[r] >= strong_target) {
+      int start = r;
+      for (; r < end && data[r] >= strong_target; r++) {
+        if (trail[r] == 0) {
+          m_relative_count++;
+        }
+        trail[r] = m_revolution;
+      }
+      for (; i < count && runs[i].start <= start; i++) {
+        AddRun(merged, &merged_count, runs[i].start, runs[i].end);
+      }
+      AddRun(merged, &merged_count, start, r);
+    }
+  }
+  for (; i < count; i++) {
+    AddRun(merged, &merged_count, runs[i].start, runs[i].end);
+  }
 
-  // zoom relative trails
+  for (i = 0; i < count; i++) {
+    m_run_cells -= runs[i].end - runs[i].start;
+  }
+  count = 0;
+  for (size_t j = 0; j < merged_count; j++) {
+    if (merged[j].end > end) {  // And clear out empty bit of spoke when spoke_len < max_spoke_len
+      for (int r = wxMax(merged[j].start, end); r < merged[j].end; r++) {
+        if (trail[r]) {
+          m_relative_count--;
+          trail[r] = 0;
+        }
+      }
+      merged[j].end = (uint16_t)wxMax(end, 0);
+    }
+    if (merged[j].start < merged[j].end) {
+      runs[count++] = merged[j];
+      m_run_cells += merged[j].end - merged[j].start;
+    }
+  }
+  m_run_count[angle] = (uint8_t)count;
 
-  for (int i = 0; i < (int)m_spokes; i++) {
-    for (int j = 0; j < m_max_spoke_len; j++) {
-      int index_j = j * zoom_factor;
-      if (index_j >= m_max_spoke_len) break;
-      if (M_RELATIVE_TRAILS(i, j) != 0) {
-        m_copy_relative_trails[i * M_RELATIVE_TRAILS_STRIDE + index_j] = M_RELATIVE_TRAILS(i, j);
+  if (trail_age) {
+    memset(trail_age, 0, len * sizeof(TrailRevolutionsAge));
+    for (i = 0; i < count; i++) {
+      for (int r = runs[i].start; r < runs[i].end; r++) {
+        trail_age[r] = Age(trail[r]);
       }
+      m_age_runs[i] = runs[i];
+    }
+    m_age_run_count = count;
+  }
+}
+
+// Zooming is split over a few threads, each doing a band of rows of the true
+// trails and a band of spokes of the relative trails.
+class TrailZoomThread : public wxThread {
+ public:
+  TrailZoomThread(TrailBuffer *trails, int inverse, int band, int bands) : wxThread(wxTHREAD_JOINABLE) {
+    m_trails = trails;
+    m_inverse = inverse;
+    m_band = band;
+    m_bands = bands;
+  }
+
+  void *Entry(void) {
+    m_trails->ZoomBand(m_inverse, m_band, m_bands);
+    return 0;
+  }
+
+ private:
+  TrailBuffer *m_trails;
+  int m_inverse;
+  int m_band;
+  int m_bands;
+};
+
+// The points [*from, *to> that end up at point d when zooming with inverse, the
+// inverse of the zoom factor in TRAIL_ZOOM_SHIFT fixed point. This is a single
+// point when zooming in, and a block of up to 1 / zoom points when zooming out.
+static void ZoomSource(int d, int inverse, int *from, int *to) {
+  int64_t f = (int64_t)d * inverse;
+  int64_t t = (int64_t)(d + 1) * inverse;
+
+  // Round towards minus infinity
+  *from = (int)(f >= 0 ? f >> TRAIL_ZOOM_SHIFT : -((-f + (1 << TRAIL_ZOOM_SHIFT) - 1) >> TRAIL_ZOOM_SHIFT));
+  *to = (int)(t >= 0 ? t >> TRAIL_ZOOM_SHIFT : -((-t + (1 << TRAIL_ZOOM_SHIFT) - 1) >> TRAIL_ZOOM_SHIFT));
+  if (*to <= *from) {
+    *to = *from + 1;
+  }
+}
+
+// Zooms the trailbuffer (containing image of true trails) in and out
+// zoom_factor > 1 -> zoom in, enlarge image
+//
+// Each point of the new image is taken from the point(s) that it came from, so
+// zooming in fills the image and zooming out keeps the most recent trail of the
+// points that are merged.
+void TrailBuffer::ZoomTrails(float zoom_factor) {
+  TrailRevolution *flip;
+  int inverse = (int)((1 << TRAIL_ZOOM_SHIFT) / zoom_factor + 0.5);
+  int bands = wxMax(wxMin(wxThread::GetCPUCount(), TRAIL_ZOOM_THREADS), 1);
+  TrailZoomThread *threads[TRAIL_ZOOM_THREADS];
+
+  for (int band = 1; band < bands; band++) {
+    threads[band] = new TrailZoomThread(this, inverse, band, bands);
+    if (threads[band]->Create() != wxTHREAD_NO_ERROR || threads[band]->Run() != wxTHREAD_NO_ERROR) {
+      delete threads[band];
+      threads[band] = 0;
+      ZoomBand(inverse, band, bands);
     }
   }
+  ZoomBand(inverse, 0, bands);
+  for (int band = 1; band < bands; band++) {
+    if (threads[band]) {
+      threads[band]->Wait();
+      delete threads[band];
+    }
+  }
+
   // Now exchange the two
   flip = m_relative_trails;
   m_relative_trails = m_copy_relative_trails;
   m_copy_relative_trails = flip;
 
-  memset(m_copy_true_trails, 0, m_trail_size * m_trail_size);
+  flip = m_true_trails;
+  m_true_trails = m_copy_true_trails;
+  m_copy_true_trails = flip;
 
-  // zoom true trails
-  for (int i = MARGIN; i < m_trail_size - MARGIN; i++) {
-    int index_i = (int)(((double)i - (double)m_trail_size / 2) * zoom_factor + (double)m_trail_size / 2);
-    if (index_i >= m_trail_size - 1) {
-      break;  // allow adding an additional pixel later
-    }
-    if (index_i < 0) {
-      continue;
-    }
-    for (int j = MARGIN; j < m_trail_size - MARGIN; j++) {
-      int index_j = (int)(((double)j - (double)m_trail_size / 2) * zoom_factor + (double)m_trail_size / 2);
-      if (index_j >= (int)m_trail_size - 1) {
-        break;
-      }
-      if (index_j < 0) {
-        continue;
+  CountTrails();
+}
+
+// The most recent of two trails
+TrailRevolution TrailBuffer::Newest(TrailRevolution a, TrailRevolution b) {
+  if (a == 0) {
+    return b;
+  }
+  if (b == 0) {
+    return a;
+  }
+  return (TrailRevolution)(m_revolution - a) <= (TrailRevolution)(m_revolution - b) ? a : b;
+}
+
+// Fills band 'band' of 'bands' of m_copy_relative_trails and m_copy_true_trails
+// with the zoomed trails. Only reads the current trails, so the bands can be done
+// at the same time.
+void TrailBuffer::ZoomBand(int inverse, int band, int bands) {
+  // zoom relative trails
+  int first = (int)m_spokes * band / bands;
+  int last = (int)m_spokes * (band + 1) / bands;
+
+  for (int i = first; i < last; i++) {
+    TrailRevolution *to = &m_copy_relative_trails[i * M_RELATIVE_TRAILS_STRIDE];
+    for (int j = 0; j < m_max_spoke_len; j++) {
+      int from_j, to_j;
+      TrailRevolution pixel = 0;
+
+      ZoomSource(j, inverse, &from_j, &to_j);
+      for (int k = from_j; k < wxMin(to_j, m_max_spoke_len); k++) {
+        pixel = Newest(pixel, M_RELATIVE_TRAILS(i, k));
       }
-      uint8_t pixel = M_TRUE_TRAILS(i, j);
-      if (pixel != 0) {  // many to one mapping, prevent overwriting trails with 0
-        m_copy_true_trails[index_i * M_TRUE_TRAILS_STRIDE + index_j] = pixel;
-        if (zoom_factor > 1.2) {
-          // add an extra pixel in the y direction
-          m_copy_true_trails[index_i * M_TRUE_TRAILS_STRIDE + index_j + 1] = pixel;
-          if (zoom_factor > 1.6) {
-            // also add pixels in the x direction
-            m_copy_true_trails[(index_i + 1) * M_TRUE_TRAILS_STRIDE + index_j] = pixel;
-            m_copy_true_trails[(index_i + 1) * M_TRUE_TRAILS_STRIDE + index_j + 1] = pixel;
-          }
+      to[j] = pixel;
+    }
+  }
+
+  // zoom true trails, around the position of the radar in the grid
+  int center_x = Wrap(m_trail_size / 2 + m_offset.lat);
+  int center_y = Wrap(m_trail_size / 2 + m_offset.lon);
+  int half = m_trail_size / 2;
+  int *from_y = (int *)malloc(2 * m_trail_size * sizeof(int));
+  int *to_y = from_y + m_trail_size;
+
+  if (!from_y) {
+    wxLogError(wxT("Out Of Memory, fatal!"));
+    wxAbort();
+  }
+
+  // Only the part of the image that the radar covers is zoomed, the rest is cleared
+  for (int y = 0; y < m_trail_size; y++) {
+    int j = y - center_y;
+    j = (j >= half) ? j - m_trail_size : (j < -half) ? j + m_trail_size : j;
+    ZoomSource(j, inverse, &from_y[y], &to_y[y]);
+    from_y[y] = wxMax(from_y[y], -m_max_spoke_len);
+    to_y[y] = wxMin(to_y[y], m_max_spoke_len);
+  }
+
+  first = m_trail_size * band / bands;
+  last = m_trail_size * (band + 1) / bands;
+  for (int x = first; x < last; x++) {
+    int i = x - center_x;
+    int from_x, to_x;
+
+    i = (i >= half) ? i - m_trail_size : (i < -half) ? i + m_trail_size : i;
+    ZoomSource(i, inverse, &from_x, &to_x);
+    from_x = wxMax(from_x, -m_max_spoke_len);
+    to_x = wxMin(to_x, m_max_spoke_len);
+
+    for (int y = 0; y < m_trail_size; y++) {
+      TrailRevolution pixel = 0;
+
+      for (int k = from_x; k < to_x; k++) {
+        int source_x = Wrap(center_x + k);
+        for (int l = from_y[y]; l < to_y[y]; l++) {
+          pixel = Newest(pixel, M_TRUE_TRAILS(source_x, Wrap(center_y + l)));
         }
       }
+      M_COPY_TRUE_TRAILS(x, y) = pixel;
     }
   }
-  flip = m_true_trails;
-  m_true_trails = m_copy_true_trails;
-  m_copy_true_trails = flip;
+  free(from_y);
 }
 
 void TrailBuffer::UpdateTrailPosition() {
   GeoPosition radar;
   GeoPositionPixels shift;
-  // When position changes the trail image is not moved, only the pointer to the center
-  // of the image (offset) is changed.
-  // So we move the image around within the m_trails.true_trails buffer (by moving the pointer).
-  // But when there is no room anymore (margin used) the whole trails image is shifted
-  // and the offset is reset
-  if (m_offset.lon >= MARGIN || m_offset.lon <= -MARGIN || m_offset.lat >= MARGIN || m_offset.lat <= -MARGIN) {
-    LOG_INFO(wxT("offset lat %d or lon too large %d"), m_offset.lat, m_offset.lon);
-    ClearTrails();
-    return;
-  }
+  // When position changes the trail image is not moved, only the position of the radar
+  // in the true trails grid (m_offset) is changed. The grid wraps around at the edges,
+  // so the only thing to do is to clear the strip of the grid that the radar has
+  // moved towards.
 
   // zooming of trails required? First check conditions
   if (m_previous_pixels_per_meter == 0. || m_ri->m_pixels_per_meter == 0.) {
@@ -249,10 +748,6 @@ void TrailBuffer::UpdateTrailPosition() {
       return;
     }
     m_previous_pixels_per_meter = m_ri->m_pixels_per_meter;
-    // center the image before zooming
-    // otherwise the offset might get too large
-    ShiftImageLatToCenter();
-    ShiftImageLonToCenter();
     ZoomTrails(zoom_factor);
   }
 
@@ -277,134 +772,73 @@ void TrailBuffer::UpdateTrailPosition() {
   shift.lat = (int)(fshift_lat + m_dif.lat);
   shift.lon = (int)(fshift_lon + m_dif.lon);
 
-  // Check for changes in the direction of movement, part of the image buffer has to be erased
-
-  if (shift.lat > 0 && m_ri->m_dir_lat <= 0) {
-    // change of direction of movement, moving north now
-    // clear space in trailbuffer above image (this area might not be empty)
-    uint8_t *start_of_area_to_clear = m_true_trails + (m_trail_size - MARGIN + m_offset.lat) * m_trail_size;
-    int number_of_pixels_to_clear = (MARGIN - m_offset.lat) * m_trail_size;
-    memset(start_of_area_to_clear, 0, number_of_pixels_to_clear);
-    m_ri->m_dir_lat = 1;
-  }
-
-  if (shift.lat < 0 && m_ri->m_dir_lat >= 0) {
-    // change of direction of movement, moving south now
-    // clear space in true_trails below image
-    uint8_t *start_of_area_to_clear = m_true_trails;
-    int number_of_pixels_to_clear = (MARGIN + m_offset.lat) * m_trail_size;
-    memset(start_of_area_to_clear, 0, number_of_pixels_to_clear);
-    m_ri->m_dir_lat = -1;
-  }
-
-  if (shift.lon > 0 && m_ri->m_dir_lon <= 0) {
-    // change of direction of movement, moving east now
-    // clear space in true_trails to the right of image
-    int number_of_pixels_to_clear = MARGIN - m_offset.lon;
-    for (int i = 0; i < m_trail_size; i++) {
-      uint8_t *start_of_area_to_clear = m_true_trails + m_trail_size * i + m_trail_size - MARGIN + m_offset.lon;
-      memset(start_of_area_to_clear, 0, number_of_pixels_to_clear);
-    }
-    m_ri->m_dir_lon = 1;
-  }
-
-  if (shift.lon < 0 && m_ri->m_dir_lon >= 0) {
-    // change of direction of movement, moving west now
-    // clear space in true_trails outside image in that direction
-    int number_of_pixels_to_clear = MARGIN + m_offset.lon;
-    for (int i = 0; i < m_trail_size; i++) {
-      uint8_t *start_of_area_to_clear = m_true_trails + m_trail_size * i;
-      memset(start_of_area_to_clear, 0, number_of_pixels_to_clear);
-    }
-    m_ri->m_dir_lon = -1;
-  }
-
   // save the rounding fraction and appy it next time
   m_dif.lat = fshift_lat + m_dif.lat - (double)shift.lat;
   m_dif.lon = fshift_lon + m_dif.lon - (double)shift.lon;
 
-  if (shift.lat >= MARGIN || shift.lat <= -MARGIN || shift.lon >= MARGIN || shift.lon <= -MARGIN) {  // huge shift, reset trails
-
-    LOG_INFO(wxT("%s Large movement trails reset, shift.lat= %f, shift.lon=%f"), m_ri->m_name.c_str(), shift.lat, shift.lon);
+  if (abs(shift.lat) >= m_trail_size / 2 || abs(shift.lon) >= m_trail_size / 2) {  // huge shift, reset trails
+    LOG_INFO(wxT("%s Large movement trails reset, shift.lat= %d, shift.lon=%d"), m_ri->m_name.c_str(), shift.lat, shift.lon);
     ClearTrails();
     return;
   }
 
-  // offset lon too large: shift image
-  if (abs(m_offset.lon + shift.lon) >= MARGIN) {
-    ShiftImageLonToCenter();
+  // apply the shifts to the offset
+  m_offset.lat = Wrap(m_offset.lat + shift.lat);
+  m_offset.lon = Wrap(m_offset.lon + shift.lon);
+
+  // The rows and columns that have just moved over the point opposite the radar
+  // in the grid held trails from behind us, and are now ahead of us.
+  int far_x = m_trail_size / 2 + m_offset.lat + m_trail_size / 2;
+  int far_y = m_trail_size / 2 + m_offset.lon + m_trail_size / 2;
+  if (shift.lat > 0) {
+    ClearTrueTrailsLat(far_x - shift.lat + 1, shift.lat);
+  } else if (shift.lat < 0) {
+    ClearTrueTrailsLat(far_x + 1, -shift.lat);
   }
-
-  // offset lat too large: shift image in lat direction
-  if (abs(m_offset.lat + shift.lat) >= MARGIN) {
-    ShiftImageLatToCenter();
+  if (shift.lon > 0) {
+    ClearTrueTrailsLon(far_y - shift.lon + 1, shift.lon);
+  } else if (shift.lon < 0) {
+    ClearTrueTrailsLon(far_y + 1, -shift.lon);
   }
-  // apply the shifts to the offset
-  m_offset.lat += shift.lat;
-  m_offset.lon += shift.lon;
 }
 
-// shifts the true trails image in lat direction to center
-void TrailBuffer::ShiftImageLatToCenter() {
-  int image_size = m_trail_size * 2 * m_max_spoke_len;  // number of pixels to shift up / down
-
-  if (m_offset.lat >= MARGIN || m_offset.lat <= -MARGIN) {  // abs not ok
-    LOG_INFO(wxT("offset lat too large %i"), m_offset.lat);
-    ClearTrails();
-    return;
-  }
-  // current starting location of shifted image
-  uint8_t *source_address = m_true_trails + (MARGIN + m_offset.lat) * m_trail_size;
-  // location where centered image should be
-  uint8_t *destination_address = m_true_trails + MARGIN * m_trail_size;
-  // size of image to be shifted, extended to the full width of trailbuffer
-  image_size = m_trail_size * 2 * m_max_spoke_len;
-  memmove(destination_address, source_address, image_size);
-  uint8_t *start_of_area_to_clear;
-  int number_of_pixels_to_clear = MARGIN * m_trail_size;
-  if (m_offset.lat > 0) {
-    // clear upper area of trailbuffer which is now outside the image
-    start_of_area_to_clear = m_true_trails + (m_trail_size - MARGIN) * m_trail_size;
-  } else {
-    // clear lower area of trailbuffer which is now outside the image
-    start_of_area_to_clear = m_true_trails;
+// clears count rows of the true trails grid, starting at row x
+void TrailBuffer::ClearTrueTrailsLat(int x, int count) {
+  for (int i = 0; i < count; i++) {
+    int row = Mod(x + i);
+    // each tile holds TRAIL_TILE points of the row
+    for (int y = 0; y < m_trail_size; y += TRAIL_TILE) {
+      size_t tile = TrueTrailsTile(row, y);
+      if (m_tile_count[tile] == 0) {
+        continue;
+      }
+      TrailRevolution *trail = &m_true_trails[TrueTrailsIndex(tile, row, y)];
+      for (int j = 0; j < TRAIL_TILE; j++) {
+        m_tile_count[tile] -= (trail[j] != 0);
+      }
+      if (m_tile_count[tile] == 0) {
+        m_true_tiles--;
+      }
+      memset(trail, 0, TRAIL_TILE * sizeof(TrailRevolution));
+    }
   }
-  memset(start_of_area_to_clear, 0, number_of_pixels_to_clear);
-  m_offset.lat = 0;
 }
 
-// shifts the true trails image in lon direction to center
-void TrailBuffer::ShiftImageLonToCenter() {
-  if (m_offset.lon >= MARGIN || m_offset.lon <= -MARGIN) {  // abs no good
-    LOG_INFO(wxT("offset lon too large %i"), m_offset.lon);
-    ClearTrails();
-    return;
-  }
-  // number of pixels to shift right / left
-  int line_of_image_size = 2 * m_max_spoke_len;
-  // MARGIN is where the centered line should start
-  // shift per line, rigth / left
-  for (int i = 0; i < m_trail_size; i++) {
-    // current starting location of image
-    uint8_t *source_address = m_true_trails + i * m_trail_size + MARGIN + m_offset.lon;
-    // location where centered image should be
-    uint8_t *destination_address = m_true_trails + i * m_trail_size + MARGIN;
-    memmove(destination_address, source_address, line_of_image_size);
-
-    uint8_t *start_of_area_to_clear;
-    // offset > 0, we shifted to the left, so clear area to the right of image
-    if (m_offset.lon > 0) {
-      // start clear at end of the line minus current margin
-      start_of_area_to_clear = m_true_trails + i * m_trail_size + m_trail_size - MARGIN;
-    }
-    // offset <= 0, we shifted to the right, so clear area to the left of image
-    else {
-      // start clear at start of the line
-      start_of_area_to_clear = m_true_trails + i * m_trail_size;
-    }
-    memset(start_of_area_to_clear, 0, MARGIN);
+// clears count columns of the true trails grid, starting at column y
+void TrailBuffer::ClearTrueTrailsLon(int y, int count) {
+  for (int i = 0; i < count; i++) {
+    int column = Mod(y + i);
+    for (int x = 0; x < m_trail_size; x++) {
+      size_t tile = TrueTrailsTile(x, column);
+      TrailRevolution *trail = &m_true_trails[TrueTrailsIndex(tile, x, column)];
+      if (m_tile_count[tile] != 0 && *trail != 0) {
+        *trail = 0;
+        if (--m_tile_count[tile] == 0) {
+          m_true_tiles--;
+        }
+      }
+    }
   }
-  m_offset.lon = 0;
 }
 
 void TrailBuffer::ClearTrails() {
@@ -415,11 +849,25 @@ void TrailBuffer::ClearTrails() {
   // prevent zooming of trails in next trail update
   m_previous_pixels_per_meter = m_ri->m_pixels_per_meter;
   if (m_true_trails) {
-    memset(m_true_trails, 0, m_trail_size * m_trail_size);
+    memset(m_true_trails, 0, m_trail_size * m_trail_size * sizeof(TrailRevolution));
   }
   if (m_relative_trails) {
-    memset(m_relative_trails, 0, m_spokes * m_max_spoke_len);
+    memset(m_relative_trails, 0, m_spokes * m_max_spoke_len * sizeof(TrailRevolution));
+  }
+  if (m_tile_count) {
+    memset(m_tile_count, 0, (m_trail_size >> TRAIL_TILE_SHIFT) * (m_trail_size >> TRAIL_TILE_SHIFT) * sizeof(uint16_t));
+  }
+  if (m_run_count) {
+    memset(m_run_count, 0, m_spokes * sizeof(uint8_t));
+  }
+  if (m_true_blocks) {
+    memset(m_true_blocks, 0, m_spokes * m_block_words * sizeof(uint64_t));
   }
+  m_blocks_offset = m_offset;
+  m_true_tiles = 0;
+  m_relative_count = 0;
+  m_run_cells = 0;
+  m_age_run_count = 0;
   if (!m_ri->GetRadarPosition(&m_pos)) {
     m_pos.lat = 0.;
     m_pos.lon = 0.;
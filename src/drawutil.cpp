@@ -141,6 +141,45 @@ void DrawFilledArc(double r1, double r2, double a1, double a2) {
   }
 }
 
+static wxCriticalSection lookups_lock;
+static PolarToCartesianLookup* lookups = 0;  // All shared lookups
+
+/*
+ * The lookup for this many spokes, made when no radar uses one yet.
+ */
+PolarToCartesianLookup* PolarToCartesianLookup::Acquire(size_t spokes) {
+  wxCriticalSectionLocker lock(lookups_lock);
+  PolarToCartesianLookup* lookup;
+
+  for (lookup = lookups; lookup; lookup = lookup->m_next) {
+    if (lookup->m_spokes == spokes) {
+      break;
+    }
+  }
+  if (!lookup) {
+    lookup = new PolarToCartesianLookup(spokes);
+    lookup->m_next = lookups;
+    lookups = lookup;
+  }
+  lookup->m_references++;
+  return lookup;
+}
+
+void PolarToCartesianLookup::Release(PolarToCartesianLookup* lookup) {
+  wxCriticalSectionLocker lock(lookups_lock);
+
+  if (--lookup->m_references > 0) {
+    return;
+  }
+  for (PolarToCartesianLookup** p = &lookups; *p; p = &(*p)->m_next) {
+    if (*p == lookup) {
+      *p = lookup->m_next;
+      break;
+    }
+  }
+  delete lookup;
+}
+
 void CheckOpenGLError(const wxString& after) {
   GLenum errLast = GL_NO_ERROR;
 
@@ -60,6 +60,7 @@ void EmulatorReceive::EmulateFakeBuffer(void) {
   uint8_t data[EMULATOR_MAX_SPOKE_LEN];
 
   wxCriticalSectionLocker lock(m_ri->m_exclusive);
+  wxCriticalSectionLocker stats_lock(m_ri->m_statistics_lock);
 
   m_ri->m_radar_timeout = now + WATCHDOG_TIMEOUT;
 
@@ -133,8 +134,9 @@ void EmulatorReceive::EmulateFakeBuffer(void) {
     int bearing = MOD_SPOKES(angle + hdt);
 
     wxLongLong time_rec = wxGetUTCTimeMillis();
-    m_ri->ProcessRadarSpoke(angle, bearing, data, sizeof(data), range_meters, time_rec);
+    m_ri->QueueRadarSpoke(angle, bearing, data, sizeof(data), range_meters, time_rec);
   }
+  m_ri->SpokesQueued();
 
   LOG_VERBOSE(wxT("emulating %d spokes at range %d with %d spots"), scanlines_in_packet, range_meters, spots);
 }
@@ -84,15 +84,16 @@ void GarminHDReceive::ProcessFrame(radar_line *packet) {
   // log_line.time_rec = wxGetUTCTimeMillis();
   wxLongLong time_rec = wxGetUTCTimeMillis();
   time_t now = (time_t)(time_rec.GetValue() / MILLISECONDS_PER_SECOND);
-  uint8_t line[GARMIN_HD_MAX_SPOKE_LEN];
-  int i;
-  uint8_t *p, *s;
+  uint8_t line[4 * GARMIN_HD_MAX_SPOKE_LEN];
 
   if (packet->scan_length * 2 > GARMIN_HD_MAX_SPOKE_LEN) {
     LOG_INFO(wxT("%s truncating data, %d longer than expected max length %d"), packet->scan_length * 8, GARMIN_HD_MAX_SPOKE_LEN);
     packet->scan_length = GARMIN_HD_MAX_SPOKE_LEN / 2;
   }
 
+  wxCriticalSectionLocker lock(m_ri->m_exclusive);
+  wxCriticalSectionLocker stats_lock(m_ri->m_statistics_lock);
+
   int angle_raw = packet->angle * 2;
   int spoke = angle_raw;
   m_ri->m_statistics.spokes++;
@@ -122,37 +123,23 @@ void GarminHDReceive::ProcessFrame(radar_line *packet) {
     wxLongLong startup_elapsed = wxGetUTCTimeMillis() - m_pi->GetBootMillis();
     LOG_INFO(wxT("%s first radar spoke received after %llu ms\n"), m_ri->m_name.c_str(), startup_elapsed);
   }
-  wxCriticalSectionLocker lock(m_ri->m_exclusive);
 
-  for (int j = 0; j < 4; j++) {
-    s = &packet->line_data[packet->scan_length / 4 * j];
-    for (p = line, i = 0; i < packet->scan_length / 4; i++, s++) {
-      *p++ = (*s & 0x01) > 0 ? 255 : 0;
-      *p++ = (*s & 0x02) > 0 ? 255 : 0;
-      *p++ = (*s & 0x04) > 0 ? 255 : 0;
-      *p++ = (*s & 0x08) > 0 ? 255 : 0;
-      *p++ = (*s & 0x10) > 0 ? 255 : 0;
-      *p++ = (*s & 0x20) > 0 ? 255 : 0;
-      *p++ = (*s & 0x40) > 0 ? 255 : 0;
-      *p++ = (*s & 0x80) > 0 ? 255 : 0;
-    }
+  // The packet holds four consecutive spokes of scan_length / 4 bytes each,
+  // so they are expanded in one go and share the same heading.
+  size_t spoke_bytes = packet->scan_length / 4;
+  size_t spoke_len = spoke_bytes * 8;
+  m_unpacker.unpack(packet->line_data, line, 4 * spoke_bytes);
 
-    m_next_spoke = (spoke + 1) % GARMIN_HD_SPOKES;
+  short int heading_raw = SCALE_DEGREES_TO_RAW(m_pi->GetHeadingTrue());  // include variation
 
-    short int heading_raw = 0;
-    int bearing_raw;
-
-    heading_raw = SCALE_DEGREES_TO_RAW(m_pi->GetHeadingTrue());  // include variation
-    bearing_raw = angle_raw + heading_raw;
-
-    SpokeBearing a = MOD_SPOKES(angle_raw);
-    SpokeBearing b = MOD_SPOKES(bearing_raw);
-
-    m_ri->ProcessRadarSpoke(a, b, line, p - line, packet->display_meters, time_rec);
+  for (int j = 0; j < 4; j++) {
+    SpokeBearing a = MOD_SPOKES(angle_raw + j);
+    SpokeBearing b = MOD_SPOKES(angle_raw + j + heading_raw);
 
-    angle_raw++;
-    spoke++;
+    m_ri->QueueRadarSpoke(a, b, line + j * spoke_len, spoke_len, packet->display_meters, time_rec);
   }
+  m_next_spoke = (spoke + 4) % GARMIN_HD_SPOKES;
+  m_ri->SpokesQueued();
 }
 
 // Check that this interface is valid for
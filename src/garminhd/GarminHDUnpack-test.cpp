@@ -0,0 +1,200 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Check that every Garmin HD spoke unpacker that can run on this CPU gives
+ * exactly the same result as the expansion GarminHDReceive used before.
+ *
+ * Usage: GarminHDUnpack-test [capture.pcap]
+ *
+ * Without a capture only synthetic data is used. With one, the line data of
+ * every Garmin HD spoke packet (0x2a3) in it is checked as well. Both pcap
+ * and pcapng captures are read; gunzip them first.
+ */
+
+#include <vector>
+
+#include "GarminHDUnpack.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_LEN (252 * 4 + 64)
+#define GARMIN_HD_LINE_DATA (52)  // offset of line_data in radar_line
+
+// The old expansion
+static void Expand(const uint8_t *s, uint8_t *p, size_t len) {
+  for (size_t i = 0; i < len; i++, s++) {
+    *p++ = (*s & 0x01) > 0 ? 255 : 0;
+    *p++ = (*s & 0x02) > 0 ? 255 : 0;
+    *p++ = (*s & 0x04) > 0 ? 255 : 0;
+    *p++ = (*s & 0x08) > 0 ? 255 : 0;
+    *p++ = (*s & 0x10) > 0 ? 255 : 0;
+    *p++ = (*s & 0x20) > 0 ? 255 : 0;
+    *p++ = (*s & 0x40) > 0 ? 255 : 0;
+    *p++ = (*s & 0x80) > 0 ? 255 : 0;
+  }
+}
+
+static uint32_t Get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t Get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+// The line data of a Garmin HD spoke packet in an Ethernet frame, if it is one
+static void AddPacket(const uint8_t *packet, size_t caplen, vector<vector<uint8_t> > &lines) {
+  if (caplen <= 14 + 20 + 8 || packet[12] != 0x08 || packet[13] != 0x00 || packet[14 + 9] != 17) {
+    return;
+  }
+  size_t header = 14 + (packet[14] & 0x0f) * 4 + 8;
+  if (caplen <= header + GARMIN_HD_LINE_DATA || Get32(packet + header) != 0x2a3) {
+    return;
+  }
+  size_t scan_length = Get16(packet + header + 10);
+  if (scan_length > caplen - header - GARMIN_HD_LINE_DATA) {
+    scan_length = caplen - header - GARMIN_HD_LINE_DATA;
+  }
+  const uint8_t *data = packet + header + GARMIN_HD_LINE_DATA;
+  lines.push_back(vector<uint8_t>(data, data + scan_length));
+}
+
+static void LoadCapture(const char *name, vector<vector<uint8_t> > &lines) {
+  vector<uint8_t> file;
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    cout << "ERROR: cannot open " << name << "\n";
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  file.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  if (file.size() < 24 || fread(file.data(), 1, file.size(), f) != file.size()) {
+    cout << "ERROR: cannot read " << name << "\n";
+    exit(1);
+  }
+  fclose(f);
+
+  size_t offset;
+  if (Get32(file.data()) == 0xa1b2c3d4) {  // pcap
+    for (offset = 24; offset + 16 <= file.size();) {
+      size_t caplen = Get32(file.data() + offset + 8);
+      if (offset + 16 + caplen > file.size()) {
+        break;
+      }
+      AddPacket(file.data() + offset + 16, caplen, lines);
+      offset += 16 + caplen;
+    }
+  } else if (Get32(file.data()) == 0x0a0d0d0a) {  // pcapng
+    for (offset = 0; offset + 12 <= file.size();) {
+      uint32_t length = Get32(file.data() + offset + 4);
+      if (length < 12 || offset + length > file.size()) {
+        break;
+      }
+      if (Get32(file.data() + offset) == 6 && length >= 32) {  // Enhanced packet block
+        size_t caplen = Get32(file.data() + offset + 20);
+        AddPacket(file.data() + offset + 28, caplen < length - 32 ? caplen : length - 32, lines);
+      }
+      offset += length;
+    }
+  } else {
+    cout << "ERROR: " << name << " is not a pcap or pcapng file\n";
+    exit(1);
+  }
+}
+
+static int Check(const GarminHDUnpacker &unpacker, const uint8_t *packed, size_t len, const char *what) {
+  static uint8_t expected[8 * TEST_LEN];
+  static uint8_t actual[8 * TEST_LEN + 32];
+
+  Expand(packed, expected, len);
+  memset(actual, 0xaa, sizeof(actual));
+  unpacker.unpack(packed, actual, len);
+  if (memcmp(expected, actual, 8 * len) != 0) {
+    cout << "ERROR: " << unpacker.name << " differs, " << what << " len " << len << "\n";
+    return 1;
+  }
+  if (actual[8 * len] != 0xaa) {
+    cout << "ERROR: " << unpacker.name << " writes past the end, len " << len << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  int ret = 0;
+  GarminHDUnpacker unpackers[GARMIN_HD_UNPACKERS];
+  size_t n = GetGarminHDUnpackers(unpackers);
+  uint8_t packed[TEST_LEN + 16];
+  vector<vector<uint8_t> > lines;
+  uint32_t seed = 1;
+
+  // Every byte value, followed by noise
+  for (size_t i = 0; i < sizeof(packed); i++) {
+    if (i < 256) {
+      packed[i] = (uint8_t)i;
+    } else {
+      seed = seed * 1103515245 + 12345;
+      packed[i] = (uint8_t)(seed >> 16);
+    }
+  }
+
+  if (argc > 1) {
+    LoadCapture(argv[1], lines);
+    cout << "INFO: " << lines.size() << " spokes in " << argv[1] << "\n";
+    if (lines.empty()) {
+      cout << "ERROR: no Garmin HD spokes in " << argv[1] << "\n";
+      ret = 1;
+    }
+  }
+
+  for (size_t u = 0; u < n; u++) {
+    cout << "INFO: testing " << unpackers[u].name << "\n";
+    // All lengths around the vector sizes, and unaligned input
+    for (size_t offset = 0; offset < 4; offset++) {
+      for (size_t len = 0; len <= TEST_LEN; len += (len < 80 ? 1 : 61)) {
+        ret |= Check(unpackers[u], packed + offset, len, "synthetic");
+      }
+    }
+    for (size_t l = 0; l < lines.size(); l++) {
+      if (lines[l].size() <= TEST_LEN) {
+        ret |= Check(unpackers[u], lines[l].data(), lines[l].size(), "capture");
+      }
+    }
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main(int argc, char **argv) { RadarPlugin::main(argc, argv); }
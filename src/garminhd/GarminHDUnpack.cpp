@@ -0,0 +1,189 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "GarminHDUnpack.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNPACK_X86
+#define UNPACK_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define UNPACK_X86
+#define UNPACK_TARGET(x)
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+// The eight returns for each byte value
+static uint8_t lookupBits[256][8];
+
+static void InitializeLookupBits() {
+  if (lookupBits[255][7] == 0) {
+    for (int j = 0; j <= UINT8_MAX; j++) {
+      for (int bit = 0; bit < 8; bit++) {
+        lookupBits[j][bit] = (j & (1 << bit)) ? 255 : 0;
+      }
+    }
+  }
+}
+
+// One 8 byte copy per byte, works everywhere.
+static void UnpackLookup(const uint8_t *packed, uint8_t *unpacked, size_t packed_len) {
+  for (size_t i = 0; i < packed_len; i++) {
+    memcpy(unpacked + 8 * i, lookupBits[packed[i]], 8);
+  }
+}
+
+#ifdef UNPACK_X86
+
+// Each byte is copied into eight lanes, the lanes are masked with one bit
+// each and compared to that bit, giving 0xff where the bit is set.
+// 4 bytes in, 32 out.
+UNPACK_TARGET("sse2")
+static void UnpackSSE2(const uint8_t *packed, uint8_t *unpacked, size_t packed_len) {
+  const __m128i bits = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, (char)0x80, 0x40, 0x20, 0x10,
+                                    0x08, 0x04, 0x02, 0x01);
+  size_t i = 0;
+
+  for (; i + 4 <= packed_len; i += 4) {
+    int32_t in;
+    memcpy(&in, packed + i, sizeof(in));
+    __m128i v = _mm_cvtsi32_si128(in);
+    v = _mm_unpacklo_epi8(v, v);  // b0 b0 b1 b1 b2 b2 b3 b3
+    v = _mm_unpacklo_epi16(v, v);  // b0 x4, b1 x4, b2 x4, b3 x4
+    __m128i lo = _mm_unpacklo_epi32(v, v);  // b0 x8, b1 x8
+    __m128i hi = _mm_unpackhi_epi32(v, v);  // b2 x8, b3 x8
+    _mm_storeu_si128((__m128i *)(unpacked + 8 * i), _mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits));
+    _mm_storeu_si128((__m128i *)(unpacked + 8 * i + 16), _mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits));
+  }
+  UnpackLookup(packed + i, unpacked + 8 * i, packed_len - i);
+}
+
+// As SSE2, but the byte shuffle spreads 4 bytes over all 32 lanes at once.
+UNPACK_TARGET("avx2")
+static void UnpackAVX2(const uint8_t *packed, uint8_t *unpacked, size_t packed_len) {
+  const __m256i bits = _mm256_set1_epi64x(0x8040201008040201LL);
+  const __m256i spread = _mm256_set_epi64x(0x0303030303030303LL, 0x0202020202020202LL, 0x0101010101010101LL, 0);
+  size_t i = 0;
+
+  for (; i + 4 <= packed_len; i += 4) {
+    int32_t in;
+    memcpy(&in, packed + i, sizeof(in));
+    __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(in), spread);
+    _mm256_storeu_si256((__m256i *)(unpacked + 8 * i), _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits));
+  }
+  UnpackLookup(packed + i, unpacked + 8 * i, packed_len - i);
+}
+
+#ifdef _MSC_VER
+static bool HasSSE2() {
+  int regs[4];
+  __cpuid(regs, 1);
+  return (regs[3] & (1 << 26)) != 0;
+}
+
+static bool HasAVX2() {
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return false;
+  }
+  __cpuid(regs, 1);
+  bool osxsave = (regs[2] & (1 << 27)) != 0;
+  bool avx = (regs[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {  // OS must save the YMM registers
+    return false;
+  }
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+}
+#else
+static bool HasSSE2() { return __builtin_cpu_supports("sse2"); }
+static bool HasAVX2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+#endif  // UNPACK_X86
+
+#ifdef UNPACK_NEON
+
+// vtst sets a lane to 0xff when any bit of the lane and the mask is set.
+// 2 bytes in, 16 out.
+static void UnpackNEON(const uint8_t *packed, uint8_t *unpacked, size_t packed_len) {
+  static const uint8_t bit_values[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t bits = vld1q_u8(bit_values);
+  size_t i = 0;
+
+  for (; i + 2 <= packed_len; i += 2) {
+    uint8x16_t v = vcombine_u8(vdup_n_u8(packed[i]), vdup_n_u8(packed[i + 1]));
+    vst1q_u8(unpacked + 8 * i, vtstq_u8(v, bits));
+  }
+  UnpackLookup(packed + i, unpacked + 8 * i, packed_len - i);
+}
+
+#endif  // UNPACK_NEON
+
+size_t GetGarminHDUnpackers(GarminHDUnpacker unpackers[GARMIN_HD_UNPACKERS]) {
+  size_t n = 0;
+
+  InitializeLookupBits();
+
+  unpackers[n].name = "lookup";
+  unpackers[n++].unpack = UnpackLookup;
+#ifdef UNPACK_X86
+  if (HasSSE2()) {
+    unpackers[n].name = "SSE2";
+    unpackers[n++].unpack = UnpackSSE2;
+  }
+  if (HasAVX2()) {
+    unpackers[n].name = "AVX2";
+    unpackers[n++].unpack = UnpackAVX2;
+  }
+#endif
+#ifdef UNPACK_NEON
+  unpackers[n].name = "NEON";
+  unpackers[n++].unpack = UnpackNEON;
+#endif
+  return n;
+}
+
+GarminHDUnpacker GetGarminHDUnpacker() {
+  GarminHDUnpacker unpackers[GARMIN_HD_UNPACKERS];
+  size_t n = GetGarminHDUnpackers(unpackers);
+
+  return unpackers[n - 1];
+}
+
+PLUGIN_END_NAMESPACE
@@ -82,6 +82,7 @@ void GarminxHDReceive::ProcessFrame(const uint8_t *data, size_t len) {
   radar_line *packet = (radar_line *)data;
 
   wxCriticalSectionLocker lock(m_ri->m_exclusive);
+  wxCriticalSectionLocker stats_lock(m_ri->m_statistics_lock);
 
   m_ri->m_radar_timeout = now + WATCHDOG_TIMEOUT;
   m_ri->m_data_timeout = now + DATA_TIMEOUT;
@@ -125,7 +126,8 @@ void GarminxHDReceive::ProcessFrame(const uint8_t *data, size_t len) {
   SpokeBearing b = MOD_SPOKES(bearing_raw);
 
   m_ri->m_range.Update(packet->range_meters);
-  m_ri->ProcessRadarSpoke(a, b, packet->line_data, len, packet->display_meters, time_rec);
+  m_ri->QueueRadarSpoke(a, b, packet->line_data, len, packet->display_meters, time_rec);
+  m_ri->SpokesQueued();
 }
 
 // Check that this interface is valid for
@@ -35,6 +35,10 @@
 #include "MessageBox.h"
 #include "NavicoControl.h"
 
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
 PLUGIN_BEGIN_NAMESPACE
 
 /*
@@ -189,85 +193,64 @@ struct radar_frame_pkt {
 };
 #pragma pack(pop)
 
-enum LookupSpokeEnum {
-  LOOKUP_SPOKE_LOW_NORMAL,
-  LOOKUP_SPOKE_LOW_BOTH,
-  LOOKUP_SPOKE_LOW_APPROACHING,
-  LOOKUP_SPOKE_HIGH_NORMAL,
-  LOOKUP_SPOKE_HIGH_BOTH,
-  LOOKUP_SPOKE_HIGH_APPROACHING
-};
-
-static uint8_t lookupData[6][256];
-
-// Make space for BLOB_HISTORY_COLORS
-static const uint8_t lookupNibbleToByte[16] = {
-    0,     // 0
-    0x32,  // 1
-    0x40,  // 2
-    0x4e,  // 3
-    0x5c,  // 4
-    0x6a,  // 5
-    0x78,  // 6
-    0x86,  // 7
-    0x94,  // 8
-    0xa2,  // 9
-    0xb0,  // a
-    0xbe,  // b
-    0xcc,  // c
-    0xda,  // d
-    0xe8,  // e
-    0xf4,  // f
-};
-
-void NavicoReceive::InitializeLookupData() {
-  if (lookupData[5][255] == 0) {
-    for (int j = 0; j <= UINT8_MAX; j++) {
-      uint8_t low = lookupNibbleToByte[(j & 0x0f)];
-      uint8_t high = lookupNibbleToByte[(j & 0xf0) >> 4];
-
-      lookupData[LOOKUP_SPOKE_LOW_NORMAL][j] = (uint8_t)low;
-      lookupData[LOOKUP_SPOKE_HIGH_NORMAL][j] = (uint8_t)high;
-
-      switch (low) {
-        case 0xf4:
-          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = 0xff;
-          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = 0xff;
-          break;
-
-        case 0xe8:
-          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = 0xfe;
-          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = (uint8_t)low;
-          break;
-
-        default:
-          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = (uint8_t)low;
-          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = (uint8_t)low;
-      }
+// ReceiveFrames
+// -------------
+// Drain the data socket into the frame arena. On Linux a single recvmmsg() call returns
+// up to NAVICO_FRAME_BATCH frames, elsewhere we read one frame per select() wakeup.
+// Returns the number of frames received, or <= 0 when the socket is in error.
+//
+int NavicoReceive::ReceiveFrames(SOCKET socket) {
+#ifdef __linux__
+  struct mmsghdr msgs[NAVICO_FRAME_BATCH];
+  struct iovec iov[NAVICO_FRAME_BATCH];
+
+  CLEAR_STRUCT(msgs);
+  for (int i = 0; i < NAVICO_FRAME_BATCH; i++) {
+    iov[i].iov_base = m_frame_arena + i * sizeof(radar_frame_pkt);
+    iov[i].iov_len = sizeof(radar_frame_pkt);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-      switch (high) {
-        case 0xf4:
-          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = 0xff;
-          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = 0xff;
-          break;
+  // select() said the socket is readable, so this returns at least one frame without blocking.
+  int r = recvmmsg(socket, msgs, NAVICO_FRAME_BATCH, MSG_DONTWAIT, 0);
+  for (int i = 0; i < r; i++) {
+    m_frame_len[i] = msgs[i].msg_len;
+  }
+  return r;
+#else
+  int r = recv(socket, (char *)m_frame_arena, sizeof(radar_frame_pkt), 0);
+  if (r > 0) {
+    m_frame_len[0] = (size_t)r;
+    return 1;
+  }
+  return r;
+#endif
+}
 
-        case 0xe8:
-          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = 0xfe;
-          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = (uint8_t)high;
-          break;
+// ProcessFrames
+// -------------
+// Process all frames that ReceiveFrames put in the arena, taking the locks only once.
+//
+void NavicoReceive::ProcessFrames(int frames) {
+  wxCriticalSectionLocker lock(m_ri->m_exclusive);
+  wxCriticalSectionLocker stats_lock(m_ri->m_statistics_lock);
 
-        default:
-          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = (uint8_t)high;
-          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = (uint8_t)high;
-      }
-    }
+  m_ri->m_statistics.receive_calls++;
+  if (frames > m_ri->m_statistics.max_batch) {
+    m_ri->m_statistics.max_batch = frames;
+  }
+  for (int i = 0; i < frames; i++) {
+    ProcessFrame(m_frame_arena + i * sizeof(radar_frame_pkt), m_frame_len[i]);
   }
+  m_ri->SpokesQueued();
 }
 
 // ProcessFrame
 // ------------
 // Process one radar frame packet, which can contain up to 32 'spokes' or lines extending outwards
 // from the radar up to the range indicated in the packet.
+// The caller must hold m_ri->m_exclusive and m_ri->m_statistics_lock.
 //
 void NavicoReceive::ProcessFrame(const uint8_t *data, size_t len) {
   time_t now = time(0);
@@ -277,8 +260,6 @@ void NavicoReceive::ProcessFrame(const uint8_t *data, size_t len) {
 
   radar_frame_pkt *packet = (radar_frame_pkt *)data;
 
-  wxCriticalSectionLocker lock(m_ri->m_exclusive);
-
   m_ri->m_radar_timeout = now + WATCHDOG_TIMEOUT;
   m_ri->m_data_timeout = now + DATA_TIMEOUT;
   m_ri->m_state.Update(RADAR_TRANSMIT);
@@ -420,13 +401,8 @@ void NavicoReceive::ProcessFrame(const uint8_t *data, size_t len) {
     if (doppler < 0 || doppler > 2) {
       doppler = 0;
     }
-    uint8_t *lookup_low = lookupData[LOOKUP_SPOKE_LOW_NORMAL + doppler];
-    uint8_t *lookup_high = lookupData[LOOKUP_SPOKE_HIGH_NORMAL + doppler];
-    for (int i = 0; i < NAVICO_SPOKE_LEN / 2; i++) {
-      data_highres[2 * i] = lookup_low[line->data[i]];
-      data_highres[2 * i + 1] = lookup_high[line->data[i]];
-    }
-    m_ri->ProcessRadarSpoke(a, b, data_highres, len, range_meters, time_rec);
+    m_unpacker.unpack(line->data, data_highres, NAVICO_SPOKE_LEN / 2, doppler);
+    m_ri->QueueRadarSpoke(a, b, data_highres, len, range_meters, time_rec);
   }
 }
 
@@ -674,9 +650,15 @@ void *NavicoReceive::Entry(void) {
   SOCKET infoSocket = INVALID_SOCKET;
 
   LOG_VERBOSE(wxT("%s thread starting"), m_ri->m_name.c_str());
-  reportSocket = GetNewReportSocket();  // Start using the same interface_addr as previous time
+  m_frame_arena = (uint8_t *)malloc(NAVICO_FRAME_BATCH * sizeof(radar_frame_pkt));
+  if (m_frame_arena) {
+    reportSocket = GetNewReportSocket();  // Start using the same interface_addr as previous time
+  } else {
+    // Skip the loop, the sockets are closed below
+    wxLogError(wxT("%s cannot allocate frame buffer"), m_ri->m_name.c_str());
+  }
 
-  while (m_receive_socket != INVALID_SOCKET) {
+  while (m_frame_arena && m_receive_socket != INVALID_SOCKET) {
     if (reportSocket == INVALID_SOCKET) {
       reportSocket = PickNextEthernetCard();
       if (reportSocket != INVALID_SOCKET) {
@@ -748,10 +730,9 @@ void *NavicoReceive::Entry(void) {
       }
 
       if (dataSocket != INVALID_SOCKET && FD_ISSET(dataSocket, &fdin)) {
-        rx_len = sizeof(rx_addr);
-        r = recvfrom(dataSocket, (char *)data, sizeof(data), 0, (struct sockaddr *)&rx_addr, &rx_len);
+        r = ReceiveFrames(dataSocket);
         if (r > 0) {
-          ProcessFrame(data, (size_t)r);
+          ProcessFrames(r);
           no_data_timeout = -15;
           no_spoke_timeout = -5;
         } else {
@@ -906,6 +887,8 @@ void *NavicoReceive::Entry(void) {
   if (m_interface_array) {
     freeifaddrs(m_interface_array);
   }
+  free(m_frame_arena);
+  m_frame_arena = 0;
 
 #ifdef TEST_THREAD_RACES
   LOG_VERBOSE(wxT("%s receive thread sleeping"), m_ri->m_name.c_str());
@@ -0,0 +1,114 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Check that every Navico spoke unpacker that can run on this CPU gives
+ * exactly the same result as the lookup table, for all doppler modes.
+ */
+
+#include "NavicoUnpack.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_LEN (NAVICO_SPOKE_LEN / 2 + 64)
+
+int main() {
+  int ret = 0;
+  NavicoUnpacker unpackers[NAVICO_UNPACKERS];
+  size_t n = GetNavicoUnpackers(unpackers);
+  uint8_t packed[TEST_LEN + 16];
+  uint8_t expected[2 * TEST_LEN];
+  uint8_t actual[2 * TEST_LEN + 32];
+  uint32_t seed = 1;
+
+  // Every byte value, followed by noise
+  for (size_t i = 0; i < sizeof(packed); i++) {
+    if (i < 256) {
+      packed[i] = (uint8_t)i;
+    } else {
+      seed = seed * 1103515245 + 12345;
+      packed[i] = (uint8_t)(seed >> 16);
+    }
+  }
+
+  // Spot check the lookup table itself
+  static const struct {
+    uint8_t in;
+    int doppler;
+    uint8_t low;
+    uint8_t high;
+  } known[] = {
+      {0x00, 0, 0x00, 0x00}, {0x21, 0, 0x32, 0x40}, {0xef, 0, 0xf4, 0xe8}, {0xef, 1, 0xff, 0xfe},
+      {0xef, 2, 0xff, 0xe8}, {0xfe, 1, 0xfe, 0xff}, {0xee, 2, 0xe8, 0xe8}, {0x1f, 2, 0xff, 0x32},
+  };
+  for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++) {
+    unpackers[0].unpack(&known[k].in, actual, 1, known[k].doppler);
+    if (actual[0] != known[k].low || actual[1] != known[k].high) {
+      cout << "ERROR: lookup of " << (int)known[k].in << " doppler " << known[k].doppler << " gives " << (int)actual[0] << ","
+           << (int)actual[1] << "\n";
+      ret = 1;
+    }
+  }
+
+  for (size_t u = 0; u < n; u++) {
+    cout << "INFO: testing " << unpackers[u].name << "\n";
+    for (int doppler = 0; doppler < NAVICO_DOPPLER_MODES; doppler++) {
+      // All lengths around the vector sizes, and unaligned input
+      for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t len = 0; len <= TEST_LEN; len += (len < 80 ? 1 : 61)) {
+          unpackers[0].unpack(packed + offset, expected, len, doppler);
+          memset(actual, 0xaa, sizeof(actual));
+          unpackers[u].unpack(packed + offset, actual, len, doppler);
+          if (memcmp(expected, actual, 2 * len) != 0) {
+            cout << "ERROR: " << unpackers[u].name << " differs, doppler " << doppler << " offset " << offset << " len " << len
+                 << "\n";
+            ret = 1;
+          }
+          if (actual[2 * len] != 0xaa) {
+            cout << "ERROR: " << unpackers[u].name << " writes past the end, len " << len << "\n";
+            ret = 1;
+          }
+        }
+      }
+    }
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { RadarPlugin::main(); }
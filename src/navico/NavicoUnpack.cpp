@@ -0,0 +1,292 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "NavicoUnpack.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UNPACK_X86
+#define UNPACK_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define UNPACK_X86
+#define UNPACK_TARGET(x)
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define UNPACK_NEON
+#include <arm_neon.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+enum LookupSpokeEnum {
+  LOOKUP_SPOKE_LOW_NORMAL,
+  LOOKUP_SPOKE_LOW_BOTH,
+  LOOKUP_SPOKE_LOW_APPROACHING,
+  LOOKUP_SPOKE_HIGH_NORMAL,
+  LOOKUP_SPOKE_HIGH_BOTH,
+  LOOKUP_SPOKE_HIGH_APPROACHING
+};
+
+static uint8_t lookupData[6][256];
+
+// The same mapping per nibble, for the vector implementations
+static uint8_t lookupNibble[NAVICO_DOPPLER_MODES][16];
+
+// Make space for BLOB_HISTORY_COLORS
+static const uint8_t lookupNibbleToByte[16] = {
+    0,     // 0
+    0x32,  // 1
+    0x40,  // 2
+    0x4e,  // 3
+    0x5c,  // 4
+    0x6a,  // 5
+    0x78,  // 6
+    0x86,  // 7
+    0x94,  // 8
+    0xa2,  // 9
+    0xb0,  // a
+    0xbe,  // b
+    0xcc,  // c
+    0xda,  // d
+    0xe8,  // e
+    0xf4,  // f
+};
+
+static void InitializeLookupData() {
+  if (lookupData[5][255] == 0) {
+    for (int j = 0; j <= UINT8_MAX; j++) {
+      uint8_t low = lookupNibbleToByte[(j & 0x0f)];
+      uint8_t high = lookupNibbleToByte[(j & 0xf0) >> 4];
+
+      lookupData[LOOKUP_SPOKE_LOW_NORMAL][j] = (uint8_t)low;
+      lookupData[LOOKUP_SPOKE_HIGH_NORMAL][j] = (uint8_t)high;
+
+      switch (low) {
+        case 0xf4:
+          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = 0xff;
+          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = 0xff;
+          break;
+
+        case 0xe8:
+          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = 0xfe;
+          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = (uint8_t)low;
+          break;
+
+        default:
+          lookupData[LOOKUP_SPOKE_LOW_BOTH][j] = (uint8_t)low;
+          lookupData[LOOKUP_SPOKE_LOW_APPROACHING][j] = (uint8_t)low;
+      }
+
+      switch (high) {
+        case 0xf4:
+          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = 0xff;
+          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = 0xff;
+          break;
+
+        case 0xe8:
+          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = 0xfe;
+          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = (uint8_t)high;
+          break;
+
+        default:
+          lookupData[LOOKUP_SPOKE_HIGH_BOTH][j] = (uint8_t)high;
+          lookupData[LOOKUP_SPOKE_HIGH_APPROACHING][j] = (uint8_t)high;
+      }
+    }
+    for (int mode = 0; mode < NAVICO_DOPPLER_MODES; mode++) {
+      for (int n = 0; n < 16; n++) {
+        lookupNibble[mode][n] = lookupData[LOOKUP_SPOKE_LOW_NORMAL + mode][n];
+      }
+    }
+  }
+}
+
+// Two table lookups per byte, works everywhere.
+static void UnpackLookup(const uint8_t *packed, uint8_t *unpacked, size_t packed_len, int doppler) {
+  uint8_t *lookup_low = lookupData[LOOKUP_SPOKE_LOW_NORMAL + doppler];
+  uint8_t *lookup_high = lookupData[LOOKUP_SPOKE_HIGH_NORMAL + doppler];
+
+  for (size_t i = 0; i < packed_len; i++) {
+    unpacked[2 * i] = lookup_low[packed[i]];
+    unpacked[2 * i + 1] = lookup_high[packed[i]];
+  }
+}
+
+// The bytes left over after the last full vector
+static inline void UnpackTail(const uint8_t *packed, uint8_t *unpacked, size_t i, size_t packed_len, const uint8_t *table) {
+  for (; i < packed_len; i++) {
+    unpacked[2 * i] = table[packed[i] & 0x0f];
+    unpacked[2 * i + 1] = table[packed[i] >> 4];
+  }
+}
+
+#ifdef UNPACK_X86
+
+// Both nibbles are used as index into the 16 byte table with a byte shuffle,
+// then the low and high results are interleaved. 16 bytes in, 32 out.
+UNPACK_TARGET("ssse3")
+static void UnpackSSSE3(const uint8_t *packed, uint8_t *unpacked, size_t packed_len, int doppler) {
+  const __m128i table = _mm_loadu_si128((const __m128i *)lookupNibble[doppler]);
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 16 <= packed_len; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(packed + i));
+    __m128i lo = _mm_shuffle_epi8(table, _mm_and_si128(in, mask));
+    __m128i hi = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+    _mm_storeu_si128((__m128i *)(unpacked + 2 * i), _mm_unpacklo_epi8(lo, hi));
+    _mm_storeu_si128((__m128i *)(unpacked + 2 * i + 16), _mm_unpackhi_epi8(lo, hi));
+  }
+  UnpackTail(packed, unpacked, i, packed_len, lookupNibble[doppler]);
+}
+
+// As SSSE3 but 32 bytes in, 64 out. The unpack instructions work per 128 bit
+// lane, so the halves have to be put back in order before storing.
+UNPACK_TARGET("avx2")
+static void UnpackAVX2(const uint8_t *packed, uint8_t *unpacked, size_t packed_len, int doppler) {
+  const __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)lookupNibble[doppler]));
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  size_t i = 0;
+
+  for (; i + 32 <= packed_len; i += 32) {
+    __m256i in = _mm256_loadu_si256((const __m256i *)(packed + i));
+    __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(in, mask));
+    __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+    __m256i a = _mm256_unpacklo_epi8(lo, hi);  // input bytes 0-7 and 16-23
+    __m256i b = _mm256_unpackhi_epi8(lo, hi);  // input bytes 8-15 and 24-31
+    _mm256_storeu_si256((__m256i *)(unpacked + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i *)(unpacked + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  UnpackTail(packed, unpacked, i, packed_len, lookupNibble[doppler]);
+}
+
+#ifdef _MSC_VER
+static bool HasSSSE3() {
+  int regs[4];
+  __cpuid(regs, 1);
+  return (regs[2] & (1 << 9)) != 0;
+}
+
+static bool HasAVX2() {
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return false;
+  }
+  __cpuid(regs, 1);
+  bool osxsave = (regs[2] & (1 << 27)) != 0;
+  bool avx = (regs[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {  // OS must save the YMM registers
+    return false;
+  }
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+}
+#else
+static bool HasSSSE3() { return __builtin_cpu_supports("ssse3"); }
+static bool HasAVX2() { return __builtin_cpu_supports("avx2"); }
+#endif
+
+#endif  // UNPACK_X86
+
+#ifdef UNPACK_NEON
+
+#ifdef __aarch64__
+// 16 bytes in, 32 out. vst2q does the interleaving while storing.
+static void UnpackNEON(const uint8_t *packed, uint8_t *unpacked, size_t packed_len, int doppler) {
+  const uint8x16_t table = vld1q_u8(lookupNibble[doppler]);
+  const uint8x16_t mask = vdupq_n_u8(0x0f);
+  size_t i = 0;
+
+  for (; i + 16 <= packed_len; i += 16) {
+    uint8x16_t in = vld1q_u8(packed + i);
+    uint8x16x2_t out;
+    out.val[0] = vqtbl1q_u8(table, vandq_u8(in, mask));
+    out.val[1] = vqtbl1q_u8(table, vshrq_n_u8(in, 4));
+    vst2q_u8(unpacked + 2 * i, out);
+  }
+  UnpackTail(packed, unpacked, i, packed_len, lookupNibble[doppler]);
+}
+#else
+// 32 bit ARM (Raspberry Pi OS) only has the 64 bit table lookup: 8 bytes in, 16 out.
+static void UnpackNEON(const uint8_t *packed, uint8_t *unpacked, size_t packed_len, int doppler) {
+  uint8x8x2_t table;
+  table.val[0] = vld1_u8(lookupNibble[doppler]);
+  table.val[1] = vld1_u8(lookupNibble[doppler] + 8);
+  const uint8x8_t mask = vdup_n_u8(0x0f);
+  size_t i = 0;
+
+  for (; i + 8 <= packed_len; i += 8) {
+    uint8x8_t in = vld1_u8(packed + i);
+    uint8x8x2_t out;
+    out.val[0] = vtbl2_u8(table, vand_u8(in, mask));
+    out.val[1] = vtbl2_u8(table, vshr_n_u8(in, 4));
+    vst2_u8(unpacked + 2 * i, out);
+  }
+  UnpackTail(packed, unpacked, i, packed_len, lookupNibble[doppler]);
+}
+#endif
+
+#endif  // UNPACK_NEON
+
+size_t GetNavicoUnpackers(NavicoUnpacker unpackers[NAVICO_UNPACKERS]) {
+  size_t n = 0;
+
+  InitializeLookupData();
+
+  unpackers[n].name = "lookup";
+  unpackers[n++].unpack = UnpackLookup;
+#ifdef UNPACK_X86
+  if (HasSSSE3()) {
+    unpackers[n].name = "SSSE3";
+    unpackers[n++].unpack = UnpackSSSE3;
+  }
+  if (HasAVX2()) {
+    unpackers[n].name = "AVX2";
+    unpackers[n++].unpack = UnpackAVX2;
+  }
+#endif
+#ifdef UNPACK_NEON
+  unpackers[n].name = "NEON";
+  unpackers[n++].unpack = UnpackNEON;
+#endif
+  return n;
+}
+
+NavicoUnpacker GetNavicoUnpacker() {
+  NavicoUnpacker unpackers[NAVICO_UNPACKERS];
+  size_t n = GetNavicoUnpackers(unpackers);
+
+  return unpackers[n - 1];
+}
+
+PLUGIN_END_NAMESPACE
@@ -40,6 +40,7 @@
 #include "MessageBox.h"
 #include "OptionsDialog.h"
 #include "RadarMarpa.h"
+#include "RadarSnapshot.h"
 #include "SelectDialog.h"
 #include "icons.h"
 #include "navico/NavicoLocate.h"
@@ -139,11 +140,13 @@ GeoPosition local_position(GeoPosition &pos, double distance, double bearing) {
 
 enum { TIMER_ID = 51 };
 enum { UPDATE_TIMER_ID = 52 };
+enum { ARPA_SECTOR_ID = 53 };
 
 #define UPDATE_INTERVAL 500
 BEGIN_EVENT_TABLE(radar_pi, wxEvtHandler)
 EVT_TIMER(TIMER_ID, radar_pi::OnTimerNotify)
 EVT_TIMER(UPDATE_TIMER_ID, radar_pi::TimedUpdate)
+EVT_THREAD(ARPA_SECTOR_ID, radar_pi::OnArpaSector)
 END_EVENT_TABLE()
 
 //---------------------------------------------------------------------------------------------------------
@@ -635,6 +638,49 @@ void radar_pi::NotifyRadarWindowViz() { m_notify_radar_window_viz = true; }
 //
 void radar_pi::NotifyControlDialog() { m_notify_control_dialog = true; }
 
+// Called by the spoke processing thread of a radar each time it has published
+// another sector of the history. The ARPA targets of that radar are then refreshed
+// on the main thread, so a target is refreshed as soon as the beam has passed it
+// instead of at the next TimedUpdate. While an event is waiting no others are queued,
+// so a busy main thread does not get a backlog.
+void radar_pi::NotifyArpaSector(RadarInfo *ri) {
+  if (!ri->m_arpa_sector_queued.exchange(true)) {
+    wxThreadEvent *event = new wxThreadEvent(wxEVT_THREAD, ARPA_SECTOR_ID);
+    event->SetInt((int)ri->m_radar);
+    wxQueueEvent(this, event);
+  }
+}
+
+void radar_pi::OnArpaSector(wxThreadEvent &event) {
+  size_t r = (size_t)event.GetInt();
+
+  if (!m_initialized || r >= m_settings.radar_count || !m_radar[r]) {
+    return;
+  }
+  m_radar[r]->m_arpa_sector_queued = false;
+  RefreshArpaTargets(r);
+}
+
+// Refresh the ARPA targets of radar r, when it has targets, may find new ones or has some to restore.
+void radar_pi::RefreshArpaTargets(size_t r) {
+  if (m_radar[r] && m_radar[r]->m_arpa) {
+    // No m_exclusive here, ARPA works on its own copy of the history so the
+    // spoke processor can carry on while the targets are refreshed.
+    bool guard_zone_arpa = false;
+    for (int i = 0; i < GUARD_ZONES; i++) {
+      if (m_radar[r]->m_guard_zone[i]->m_arpa_on) {
+        guard_zone_arpa = true;
+      }
+    }
+    bool autotrack_doppler = m_radar[r]->m_doppler.GetValue() > 0 && m_radar[r]->m_autotrack_doppler.GetValue() > 0;
+    bool restore_pending = m_radar[r]->m_snapshot && m_radar[r]->m_snapshot->TargetsPending();
+
+    if (ArpaRefreshWanted(guard_zone_arpa, m_radar[r]->m_arpa->GetTargetCount(), autotrack_doppler, restore_pending)) {
+      m_radar[r]->m_arpa->RefreshArpaTargets();
+    }
+  }
+}
+
 void radar_pi::SetRadarWindowViz(bool reparent) {
   for (size_t r = 0; r < m_settings.radar_count; r++) {
     bool showThisRadar = m_settings.show && m_settings.show_radar[r];
@@ -1102,12 +1148,19 @@ void radar_pi::TimedControlUpdate() {
     wxString t;
     for (size_t r = 0; r < M_SETTINGS.radar_count; r++) {
       if (m_radar[r]->m_state.GetValue() != RADAR_OFF) {
-        wxCriticalSectionLocker lock(m_radar[r]->m_exclusive);
+        wxCriticalSectionLocker lock(m_radar[r]->m_statistics_lock);
 
         t << wxString::Format(wxT("%s\npackets %d/%d\nspokes %d/%d/%d\n"), m_radar[r]->m_name.c_str(),
                               m_radar[r]->m_statistics.packets, m_radar[r]->m_statistics.broken_packets,
                               m_radar[r]->m_statistics.spokes, m_radar[r]->m_statistics.broken_spokes,
                               m_radar[r]->m_statistics.missing_spokes);
+        if (m_radar[r]->m_statistics.dropped_spokes > 0) {
+          t << wxString::Format(wxT("dropped spokes %d\n"), m_radar[r]->m_statistics.dropped_spokes);
+        }
+        if (m_radar[r]->m_statistics.receive_calls > 0) {
+          t << wxString::Format(wxT("receive calls %d (max batch %d)\n"), m_radar[r]->m_statistics.receive_calls,
+                                m_radar[r]->m_statistics.max_batch);
+        }
         if (m_radar[r]->m_radar_type == RM_E120) {
           t << wxString::Format(wxT("Magnetron current %d\n"), m_radar[r]->m_magnetron_current.GetValue());
           double mag_hours = (double)m_radar[r]->m_magnetron_time.GetValue() / 10.;
@@ -1137,13 +1190,16 @@ void radar_pi::TimedControlUpdate() {
 
   // Always reset the counters, so they don't show huge numbers after IsShown changes
   for (size_t r = 0; r < M_SETTINGS.radar_count; r++) {
-    wxCriticalSectionLocker lock(m_radar[r]->m_exclusive);
+    wxCriticalSectionLocker lock(m_radar[r]->m_statistics_lock);
 
     m_radar[r]->m_statistics.broken_packets = 0;
     m_radar[r]->m_statistics.broken_spokes = 0;
     m_radar[r]->m_statistics.missing_spokes = 0;
     m_radar[r]->m_statistics.packets = 0;
     m_radar[r]->m_statistics.spokes = 0;
+    m_radar[r]->m_statistics.dropped_spokes = 0;
+    m_radar[r]->m_statistics.receive_calls = 0;
+    m_radar[r]->m_statistics.max_batch = 0;
   }
 
   wxString info;
@@ -1228,28 +1284,11 @@ void radar_pi::TimedUpdate(wxTimerEvent &event) {
     }
   }
 
-  // refresh ARPA targets
+  // Refresh ARPA targets. This normally happens when a sector of spokes has been
+  // received, see NotifyArpaSector, but the targets must also be lost when no
+  // spokes come in anymore.
   for (size_t r = 0; r < M_SETTINGS.radar_count; r++) {
-    bool arpa_on = false;
-    if (m_radar[r]) {
-      wxCriticalSectionLocker lock(m_radar[r]->m_exclusive);
-      if (m_radar[r]->m_arpa) {
-        for (int i = 0; i < GUARD_ZONES; i++) {
-          if (m_radar[r]->m_guard_zone[i]->m_arpa_on) {
-            arpa_on = true;
-          }
-        }
-        if (m_radar[r]->m_arpa->GetTargetCount() > 0) {
-          arpa_on = true;
-        }
-      }
-      if (m_radar[r]->m_doppler.GetValue() > 0 && m_radar[r]->m_autotrack_doppler.GetValue() > 0) {
-        arpa_on = true;
-      }
-      if (arpa_on) {
-        m_radar[r]->m_arpa->RefreshArpaTargets();
-      }
-    }
+    RefreshArpaTargets(r);
   }
 
   UpdateHeadingPositionState();
@@ -1981,6 +2020,8 @@ void radar_pi::SetPluginMessage(wxString &message_id, wxString &message_body) {
 }
 
 bool radar_pi::FindAIS_at_arpaPos(const GeoPosition &pos, const double &arpa_dist) {
+  wxCriticalSectionLocker lock(m_exclusive);  // ARPA targets are refreshed on more than one thread
+
   m_arpa_max_range = MAX(arpa_dist + 200, m_arpa_max_range);  // For AIS search area
   if (m_ais_in_arpa_zone.size() < 1) return false;
   bool hit = false;
@@ -2127,19 +2168,28 @@ bool radar_pi::MouseEventHook(wxMouseEvent &event) {
 }
 
 void radar_pi::logBinaryData(const wxString &what, const uint8_t *data, int size) {
+  static const char hex[] = "0123456789ABCDEF";
   wxString explain;
+  char line[80];
   int i = 0;
-  explain.Alloc(size * 3 + 50);
-  explain += wxT("");
+
+  explain.Alloc(size * 4 + 50);
   explain += what;
   explain += wxString::Format(wxT(" %d bytes: "), size);
-  for (i = 0; i < size; i++) {
-    if (i % 16 == 0) {
-      explain += wxString::Format(wxT(" \n %3d    "), i);
-    } else if (i % 8 == 0) {
-      explain += wxString::Format(wxT("  "), i);
+  // Format a line of 16 bytes at a time, wxString::Format per byte is slow
+  while (i < size) {
+    char *p = line + snprintf(line, 16, " \n %3d    ", i);
+    for (int j = 0; j < 16 && i < size; j++, i++) {
+      if (j == 8) {
+        *p++ = ' ';
+        *p++ = ' ';
+      }
+      *p++ = ' ';
+      *p++ = hex[data[i] >> 4];
+      *p++ = hex[data[i] & 15];
     }
-    explain += wxString::Format(wxT(" %02X"), data[i]);
+    *p = 0;
+    explain += wxString::FromAscii(line);
   }
   LOG_INFO(explain);
 }
@@ -0,0 +1,247 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Microbenchmark for RaymarineDecodeRLE.
+ *
+ * Reads the Raymarine spokes from a pcapng capture, decodes each one with
+ * the byte by byte loop that RaymarineReceive used before and with the
+ * shared decoder, and checks that both produce the same returns.
+ *
+ * Usage: RaymarineRLE-bench capture.pcapng
+ *
+ * Both the E-120 (analogue and HD) and the Quantum scan data formats are
+ * recognised. The captures in example/Quantum2 are compressed, gunzip them
+ * first.
+ */
+
+#include <chrono>
+#include <vector>
+
+#include "RaymarineRLE.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_REPEAT (200)
+#define BENCH_MAX_RETURNS (1024)
+
+struct EncodedSpoke {
+  const uint8_t *data;
+  size_t len;
+  size_t returns;
+  bool nibbles;
+};
+
+// The old decoder, with the output made large enough for its overruns
+static size_t OldDecode(const uint8_t *sData, size_t data_len, uint8_t *dData, bool nibbles) {
+  size_t iS = 0;
+  size_t iD = 0;
+
+  while (iS + 3 <= data_len || (iS < data_len && sData[iS] != 0x5c)) {
+    if (!nibbles) {
+      if (iD >= 1024) {
+        break;
+      }
+      if (sData[iS] != 0x5c) {
+        dData[iD++] = sData[iS++];
+      } else {
+        uint8_t nFill = sData[iS + 1];
+        uint8_t cFill = sData[iS + 2];
+        for (unsigned int i = 0; i < nFill; i++) {
+          dData[iD++] = cFill;
+        }
+        iS += 3;
+      }
+    } else {
+      if (sData[iS] != 0x5c) {
+        dData[iD++] = ((sData[iS] & 0x0f) << 4) + 0x0f;
+        dData[iD++] = (sData[iS] & 0xf0) + 0x0f;
+        iS++;
+      } else {
+        uint8_t nFill = sData[iS + 1];
+        uint8_t cFill = sData[iS + 2];
+        for (unsigned int i = 0; i < nFill; i++) {
+          dData[iD++] = ((cFill & 0x0f) << 4) + 0x0f;
+          dData[iD++] = (cFill & 0xf0) + 0x0f;
+        }
+        iS += 3;
+      }
+    }
+  }
+  return iD;
+}
+
+static uint32_t Get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t Get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+// E-120 scan data: Header1, then per spoke Header3, an optional Header2 and SpokeData
+static void AddScanData(const uint8_t *data, size_t len, vector<EncodedSpoke> &spokes) {
+  size_t offset = 32;
+
+  while (offset + 40 + 12 <= len && Get32(data + offset) == 1 && Get32(data + offset + 4) == 0x28) {
+    bool hd = Get32(data + offset + 12) == 3;
+    offset += 40;
+    if (Get32(data + offset) == 2) {
+      offset += Get32(data + offset + 4);
+    }
+    if (offset + 12 > len || (Get32(data + offset) & 0x7fffffff) != 3) {
+      return;
+    }
+    size_t length = Get32(data + offset + 4);
+    size_t data_len = Get32(data + offset + 8);
+    if (offset + 12 + data_len > len) {
+      return;
+    }
+    EncodedSpoke s = {data + offset + 12, data_len, hd ? 1024u : 512u, !hd};
+    spokes.push_back(s);
+    offset += length;
+  }
+}
+
+// Quantum scan data: a 20 byte header and a single spoke
+static void AddQuantumScanData(const uint8_t *data, size_t len, vector<EncodedSpoke> &spokes) {
+  if (len <= 20) {
+    return;
+  }
+  size_t returns = Get16(data + 8);
+  size_t data_len = Get16(data + 18);
+  EncodedSpoke s = {data + 20, data_len < len - 20 ? data_len : len - 20, returns > 252 ? 252 : returns, false};
+  spokes.push_back(s);
+}
+
+// Just enough pcapng to find the UDP payloads in Ethernet/IPv4 packets
+static void LoadCapture(const char *name, vector<uint8_t> &file, vector<EncodedSpoke> &spokes) {
+  FILE *f = fopen(name, "rb");
+  if (!f) {
+    cout << "ERROR: cannot open " << name << "\n";
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  file.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  if (fread(file.data(), 1, file.size(), f) != file.size()) {
+    cout << "ERROR: cannot read " << name << "\n";
+    exit(1);
+  }
+  fclose(f);
+
+  size_t offset = 0;
+  while (offset + 12 <= file.size()) {
+    const uint8_t *block = file.data() + offset;
+    uint32_t type = Get32(block);
+    uint32_t length = Get32(block + 4);
+    if (length < 12 || offset + length > file.size()) {
+      break;
+    }
+    if (type == 6 && length >= 32) {  // Enhanced packet block
+      const uint8_t *packet = block + 28;
+      size_t caplen = Get32(block + 20);
+      if (caplen > length - 32) {
+        caplen = length - 32;
+      }
+      if (caplen > 14 + 20 + 8 && packet[12] == 0x08 && packet[13] == 0x00 && packet[14 + 9] == 17) {
+        size_t ihl = (packet[14] & 0x0f) * 4;
+        if (14 + ihl + 8 < caplen) {
+          const uint8_t *payload = packet + 14 + ihl + 8;
+          size_t len = caplen - (14 + ihl + 8);
+          if (len > 4 && Get32(payload) == 0x00010003) {
+            AddScanData(payload, len, spokes);
+          } else if (len > 4 && Get32(payload) == 0x00280003) {
+            AddQuantumScanData(payload, len, spokes);
+          }
+        }
+      }
+    }
+    offset += length;
+  }
+}
+
+int main(int argc, char **argv) {
+  int ret = 0;
+  vector<uint8_t> file;
+  vector<EncodedSpoke> spokes;
+  static uint8_t old_data[BENCH_MAX_RETURNS * 4], new_data[BENCH_MAX_RETURNS];
+
+  if (argc < 2) {
+    cout << "Usage: RaymarineRLE-bench capture.pcapng\n";
+    exit(1);
+  }
+  LoadCapture(argv[1], file, spokes);
+  cout << "INFO: " << spokes.size() << " spokes\n";
+  if (spokes.empty()) {
+    cout << "ERROR: no Raymarine scan data in " << argv[1] << "\n";
+    exit(1);
+  }
+
+  for (size_t i = 0; i < spokes.size(); i++) {
+    const EncodedSpoke &s = spokes[i];
+    size_t consumed;
+    size_t old_len = OldDecode(s.data, s.len, old_data, s.nibbles);
+    size_t new_len = RaymarineDecodeRLE(s.data, s.len, new_data, s.returns, s.nibbles, &consumed);
+    size_t expect = old_len < s.returns ? old_len : s.returns;
+    if (new_len != expect || memcmp(old_data, new_data, expect) != 0) {
+      cout << "ERROR: spoke " << i << " differs, " << old_len << " vs " << new_len << " returns\n";
+      ret = 1;
+    }
+  }
+
+  size_t total = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    for (size_t i = 0; i < spokes.size(); i++) {
+      total += OldDecode(spokes[i].data, spokes[i].len, old_data, spokes[i].nibbles);
+    }
+  }
+  std::chrono::duration<double, std::micro> old_time = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < BENCH_REPEAT; rep++) {
+    for (size_t i = 0; i < spokes.size(); i++) {
+      size_t consumed;
+      total += RaymarineDecodeRLE(spokes[i].data, spokes[i].len, new_data, spokes[i].returns, spokes[i].nibbles, &consumed);
+    }
+  }
+  std::chrono::duration<double, std::micro> new_time = std::chrono::steady_clock::now() - start;
+
+  cout << "INFO: byte loop " << old_time.count() / (BENCH_REPEAT * spokes.size()) << " us/spoke\n";
+  cout << "INFO: shared    " << new_time.count() / (BENCH_REPEAT * spokes.size()) << " us/spoke (" << total << ")\n";
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main(int argc, char **argv) { RadarPlugin::main(argc, argv); }
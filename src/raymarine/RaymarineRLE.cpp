@@ -0,0 +1,152 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "RaymarineRLE.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RLE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define RLE_NEON
+#include <arm_neon.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define NIBBLE_LOW(b) ((uint8_t)((((b)&0x0f) << 4) + 0x0f))
+#define NIBBLE_HIGH(b) ((uint8_t)(((b)&0xf0) + 0x0f))
+
+// Expand n packed bytes into 2 * n returns.
+// SSE2 and NEON are part of the baseline on the platforms where they are used,
+// so no runtime check is needed.
+static void ExpandNibbles(const uint8_t *src, uint8_t *dst, size_t n) {
+  size_t i = 0;
+
+#if defined(RLE_SSE2)
+  const __m128i low = _mm_set1_epi8(0x0f);
+  const __m128i high = _mm_set1_epi8((char)0xf0);
+  for (; i + 16 <= n; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i lo = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(in, 4), high), low);
+    __m128i hi = _mm_or_si128(_mm_and_si128(in, high), low);
+    _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_unpacklo_epi8(lo, hi));
+    _mm_storeu_si128((__m128i *)(dst + 2 * i + 16), _mm_unpackhi_epi8(lo, hi));
+  }
+#elif defined(RLE_NEON)
+  const uint8x16_t low = vdupq_n_u8(0x0f);
+  const uint8x16_t high = vdupq_n_u8(0xf0);
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t in = vld1q_u8(src + i);
+    uint8x16x2_t out;
+    out.val[0] = vorrq_u8(vshlq_n_u8(in, 4), low);
+    out.val[1] = vorrq_u8(vandq_u8(in, high), low);
+    vst2q_u8(dst + 2 * i, out);
+  }
+#endif
+
+  for (; i < n; i++) {
+    dst[2 * i] = NIBBLE_LOW(src[i]);
+    dst[2 * i + 1] = NIBBLE_HIGH(src[i]);
+  }
+}
+
+size_t RaymarineDecodeRLE(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, bool nibbles, size_t *consumed) {
+  const uint8_t *s = src;
+  const uint8_t *end = src + src_len;
+  size_t d = 0;
+
+  while (s < end && d < dst_len) {
+    // Copy the literals up to the next escape in one go. Runs are often
+    // short, so only call memchr when a short scan does not find it.
+    const uint8_t *escape = s;
+    const uint8_t *scan_end = (end - s > 16) ? s + 16 : end;
+    while (escape < scan_end && *escape != RAYMARINE_RLE_ESCAPE) {
+      escape++;
+    }
+    if (escape == scan_end) {
+      escape = (const uint8_t *)memchr(scan_end, RAYMARINE_RLE_ESCAPE, end - scan_end);
+    }
+    size_t run = (escape ? escape : end) - s;
+
+    if (run > 0) {
+      size_t room = nibbles ? (dst_len - d) / 2 : dst_len - d;
+      if (run > room) {
+        run = room;
+        escape = 0;
+      }
+      if (nibbles) {
+        ExpandNibbles(s, dst + d, run);
+        d += 2 * run;
+      } else {
+        memcpy(dst + d, s, run);
+        d += run;
+      }
+      s += run;
+      if (!escape) {
+        break;
+      }
+    }
+
+    // s points at an escape: 0x5c, count, value
+    if (end - s < 3 || d >= dst_len) {
+      break;
+    }
+    size_t fill = s[1];
+    uint8_t value = s[2];
+    if (nibbles) {
+      uint8_t lo = NIBBLE_LOW(value);
+      uint8_t hi = NIBBLE_HIGH(value);
+      fill *= 2;
+      if (fill > dst_len - d) {
+        fill = dst_len - d;
+      }
+      if (lo == hi) {
+        memset(dst + d, lo, fill);
+      } else {
+        for (size_t i = 0; i < fill; i++) {
+          dst[d + i] = (i & 1) ? hi : lo;
+        }
+      }
+    } else {
+      if (fill > dst_len - d) {
+        fill = dst_len - d;
+      }
+      memset(dst + d, value, fill);
+    }
+    d += fill;
+    s += 3;
+  }
+
+  *consumed = s - src;
+  return d;
+}
+
+PLUGIN_END_NAMESPACE
@@ -37,7 +37,9 @@
 #include "RaymarineReceive.h"
 
 #include "MessageBox.h"
+#include "PacketTrace.h"
 #include "RME120Control.h"
+#include "RaymarineRLE.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
@@ -901,7 +903,8 @@ void RaymarineReceive::ProcessScanData(const UINT8 *data, int len) {
     LOG_RECEIVE(wxT("Invalid range"));
     return;
   }
-  m_pi->logBinaryData(wxT("Scandata"), data, len);
+  TRACE_PACKET(m_ri, data, len);
+  LOG_BINARY_SPOKES(wxT("Scandata"), data, len);
   if (len > (int)(sizeof(Header1) + sizeof(Header3))) {
     Header1 *pHeader = (Header1 *)data;
     bool HDtype = false;
@@ -925,6 +928,8 @@ void RaymarineReceive::ProcessScanData(const UINT8 *data, int len) {
     int headerIdx = 0;
     int nextOffset = sizeof(Header1);
 
+    wxCriticalSectionLocker lock(m_ri->m_statistics_lock);
+
     while (nextOffset < len) {
       Header3 *sHeader = (Header3 *)(data + nextOffset);
       if (sHeader->field01 != 0x00000001 || sHeader->length != 0x00000028) {
@@ -960,70 +965,31 @@ void RaymarineReceive::ProcessScanData(const UINT8 *data, int len) {
                     pSData->length, pSData->data_len);
         break;
       }
-      UINT8 unpacked_data[10240], *dataPtr = 0;
+      if (nextOffset + sizeof(SpokeData) > (size_t)len) {
+        LOG_RECEIVE(wxT("ProcessScanData::Scan data #%d truncated.\n"), headerIdx);
+        break;
+      }
+      UINT8 unpacked_data[1024], *dataPtr = 0;
 
-      uint8_t *dData = (uint8_t *)unpacked_data;
       uint8_t *sData = (uint8_t *)data + nextOffset + sizeof(SpokeData);
+      size_t available = len - nextOffset - sizeof(SpokeData);
+      size_t padded_len = wxMin(available, (size_t)(pSData->length - 8));
 
-      unsigned int iS = 0;
-      unsigned int iD = 0;
       // LOG_BINARY_RECEIVE(wxT("spoke data sData"), sData, pSData->data_len);
-      while (iS < pSData->data_len) {
-        if (HDtype) {
-          if (iD >= 1024) {  // remove trailing zero's
-            break;
-          }
-          if (*sData != 0x5c) {
-            *dData++ = *sData;
-            sData++;
-            iS++;
-            iD++;
-          } else {
-            uint8_t nFill = sData[1];  // number to be filled
-            uint8_t cFill = sData[2];  // data to be filled
-            for (unsigned int i = 0; i < nFill; i++) {
-              *dData++ = cFill;
-            }
-            sData += 3;
-            iS += 3;
-            iD += nFill;
-          }
-        } else {  // not HDtype
-          if (*sData != 0x5c) {
-            *dData++ = (((*sData) & 0x0f) << 4) + 0x0f;
-            *dData++ = ((*sData) & 0xf0) + 0x0f;
-            sData++;
-            iS++;
-            iD += 2;
-          } else {
-            uint8_t nFill = sData[1];
-            uint8_t cFill = sData[2];
-
-            for (unsigned int i = 0; i < nFill; i++) {
-              *dData++ = ((cFill & 0x0f) << 4) + 0x0f;
-              *dData++ = (cFill & 0xf0) + 0x0f;
-            }
-            sData += 3;
-            iS += 3;
-            iD += nFill * 2;
-          }
-        }
-      }
+      size_t iS;
+      size_t iD =
+          RaymarineDecodeRLE(sData, wxMin(available, (size_t)pSData->data_len), unpacked_data, returns_per_line, !HDtype, &iS);
       if (iD != returns_per_line) {
-        while (iS < pSData->length - 8 && iD <= returns_per_line) {
+        // The encoded data is short, use the padding after it
+        while (iS < padded_len && iD < returns_per_line) {
           if (HDtype) {
-            *dData++ = *sData;
-            sData++;
-            iS++;
-            iD++;
+            unpacked_data[iD++] = sData[iS++];
           } else {
-            *dData++ = ((*sData) & 0x0f) << 4;
-            *dData++ = (*sData) & 0xf0;
-            sData++;
-            iS++;
-            iD += 2;
+            unpacked_data[iD++] = (sData[iS] & 0x0f) << 4;
+            unpacked_data[iD++] = sData[iS++] & 0xf0;
           }
         }
+        memset(unpacked_data + iD, 0, returns_per_line - iD);
       }
 
       // LOG_BINARY_RECEIVE(wxT("spoke data dData"), unpacked_data, pSData->data_len);
@@ -1069,12 +1035,13 @@ void RaymarineReceive::ProcessScanData(const UINT8 *data, int len) {
       }
       /*LOG_INFO(wxT("ProcessRadarSpoke a=%i, angle_raw=%i b=%i, bearing_raw=%i, returns_per_line=%i range=%i spokes=%i"), angle,
          angle_raw, bearing, bearing_raw, returns_per_line, m_range_meters, m_ri->m_spokes);*/
-      m_ri->ProcessRadarSpoke(angle, bearing, dataPtr, returns_per_line, m_range_meters, nowMillis);
+      m_ri->QueueRadarSpoke(angle, bearing, dataPtr, returns_per_line, m_range_meters, nowMillis);
       // When te HD radar is transmitting in a mode with 1024 spokes, insert additional spokes to fill the image
       if (spokes_1024 && angle + 1 < (int)m_ri->m_spokes && bearing + 1 < (int)m_ri->m_spokes) {
-        m_ri->ProcessRadarSpoke(angle + 1, bearing + 1, dataPtr, returns_per_line, m_range_meters, nowMillis);
+        m_ri->QueueRadarSpoke(angle + 1, bearing + 1, dataPtr, returns_per_line, m_range_meters, nowMillis);
       }
     }
+    m_ri->SpokesQueued();
   }
 }
 
@@ -1106,7 +1073,8 @@ void RaymarineReceive::ProcessQuantumScanData(const UINT8 *data, int len) {
     return;
   }
   SQuantumScanDataHeader *qheader = (SQuantumScanDataHeader *)data;
-  m_pi->logBinaryData(wxT("SQuantumScanDataHeader"), data, len);
+  TRACE_PACKET(m_ri, data, len);
+  LOG_BINARY_SPOKES(wxT("SQuantumScanDataHeader"), data, len);
   if (len > (int)(sizeof(SQuantumScanDataHeader))) {
     u_int returns_per_line;
 
@@ -1117,39 +1085,20 @@ void RaymarineReceive::ProcessQuantumScanData(const UINT8 *data, int len) {
 
     wxLongLong nowMillis = wxGetLocalTimeMillis();
     int nextOffset = sizeof(QuantumHeader);
+    wxCriticalSectionLocker lock(m_ri->m_statistics_lock);
     UINT8 unpacked_data[1024], *dataPtr = 0;
 
-    uint8_t *dData = (uint8_t *)unpacked_data;
-    uint8_t *sData = (uint8_t *)data + nextOffset;
-
-    unsigned int iS = 0;
-    unsigned int iD = 0;
-    while (iS < qheader->data_len) {
-      if (iD >= 1024) {  // remove trailing zero's
-        break;
-      }
-      if (*sData != 0x5c) {
-        *dData++ = *sData;
-        sData++;
-        iS++;
-        iD++;
-      } else {
-        uint8_t nFill = sData[1];  // number to be filled
-        uint8_t cFill = sData[2];  // data to be filled
-        for (unsigned int i = 0; i < nFill; i++) {
-          *dData++ = cFill;
-        }
-        sData += 3;
-        iS += 3;
-        iD += nFill;
-      }
-    }  // end of while, only one spoke per packet
-
     returns_per_line = qheader->scan_len;
     if (returns_per_line > 252) {
       LOG_VERBOSE(wxT("Error returns_per_line too large %i"), returns_per_line);
       returns_per_line = 252;
     }
+
+    // Only one spoke per packet
+    size_t consumed;
+    size_t iD = RaymarineDecodeRLE(data + nextOffset, wxMin((size_t)(len - nextOffset), (size_t)qheader->data_len),
+                                   unpacked_data, returns_per_line, false, &consumed);
+    memset(unpacked_data + iD, 0, returns_per_line - iD);
     dataPtr = unpacked_data;
     m_ri->m_statistics.spokes++;
     unsigned int spoke = qheader->azimuth;
@@ -1189,8 +1138,9 @@ void RaymarineReceive::ProcessQuantumScanData(const UINT8 *data, int len) {
       LOG_INFO(wxT("Error range invalid"));
       return;
     }
-    m_ri->ProcessRadarSpoke(angle, bearing, dataPtr, returns_per_line,
-                            m_range_meters * returns_per_line / qheader->returns_per_range / 2, nowMillis);
+    m_ri->QueueRadarSpoke(angle, bearing, dataPtr, returns_per_line,
+                          m_range_meters * returns_per_line / qheader->returns_per_range / 2, nowMillis);
+    m_ri->SpokesQueued();
   }
 }
 